@@ -13,8 +13,8 @@ correspond to channels. """
 class EatonClient(modbus.TCPModbusClient):
 
     # Initializes EatonClient and verifies channels are valid
-    def __init__(self, name, IP, PORT, channels):
-        super(EatonClient, self).__init__(IP, PORT)
+    def __init__(self, name, IP, PORT, channels, hedges=0):
+        super(EatonClient, self).__init__(IP, PORT, hedges)
         self.name = name
         self.channels = channels
 
@@ -7,8 +7,8 @@ import Devices.LabSenseModbus.common.modbus as modbus
 
 class VerisClient(modbus.TCPModbusClient):
 
-    def __init__(self, name, IP, PORT, channels):
-        super(VerisClient, self).__init__(IP, PORT)
+    def __init__(self, name, IP, PORT, channels, hedges=0):
+        super(VerisClient, self).__init__(IP, PORT, hedges)
         self.name = name
         self.channels = channels
 
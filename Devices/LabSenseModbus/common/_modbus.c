@@ -0,0 +1,130 @@
+/* Modbus framing for the Python device clients (see modbus.py), on top of
+ * the frame codec and CRC of the C client in
+ * deprecated/LabSenseModbus/modbusframe.c. Build it next to modbus.py with
+ *
+ *   python setup.py build_ext --inplace
+ *
+ * modbus.py falls back to struct and crc16.py when it is not built. */
+
+#include <Python.h>
+#include <stdint.h>
+#include <string.h>
+#include "modbusframe.h"
+#include "E30ModbusMsg.h"
+
+#if PY_MAJOR_VERSION >= 3
+#define BYTES_FROM_SIZE PyBytes_FromStringAndSize
+#else
+#define BYTES_FROM_SIZE PyString_FromStringAndSize
+#endif
+
+/* Read replies hold at most MODBUS_REG_READ_QTY_MAX registers */
+#define REPLY_FLOATS_MAX (MODBUS_REG_READ_QTY_MAX / 2)
+
+PyDoc_STRVAR(crc16_doc,
+"crc16(data) -> int\n\n"
+"Modbus CRC-16 of data, as crc16.calcCRC computes it.");
+
+static PyObject *modbus_crc16(PyObject *self, PyObject *args) {
+  Py_buffer data;
+  uint16_t crc;
+
+  if (!PyArg_ParseTuple(args, "s*:crc16", &data))
+    return NULL;
+  if (data.len > 0xffff) {
+    PyBuffer_Release(&data);
+    PyErr_SetString(PyExc_ValueError, "data too long for a Modbus frame");
+    return NULL;
+  }
+  crc = calc_crc16((uint8_t *) data.buf, (uint16_t) data.len);
+  PyBuffer_Release(&data);
+  return PyLong_FromLong(crc);
+}
+
+PyDoc_STRVAR(read_request_doc,
+"read_request(addr, func, reg_addr, reg_qty) -> bytes\n\n"
+"The request frame, CRC included, reading reg_qty registers from\n"
+"reg_addr with function code func (0x03 or 0x04).");
+
+static PyObject *modbus_read_request(PyObject *self, PyObject *args) {
+  unsigned char addr, func;
+  unsigned short reg_addr, reg_qty;
+  uint8_t frame[sizeof(modbus_req_read_reg) + CRC16_SIZE + 1];
+  int length;
+
+  if (!PyArg_ParseTuple(args, "bbHH:read_request", &addr, &func, &reg_addr,
+                        &reg_qty))
+    return NULL;
+
+  length = modbus_frame_read(frame, addr, reg_addr, reg_qty);
+  if (func != MODBUS_FUNC_READ_REG) {
+    frame[BYTEPOS_MODBUS_FUNC] = func;
+    length = modbus_frame_seal(frame, sizeof(modbus_req_read_reg));
+  }
+  return BYTES_FROM_SIZE((const char *) frame, length);
+}
+
+PyDoc_STRVAR(decode_reply_doc,
+"decode_reply(reply, reg_qty) -> tuple of floats\n\n"
+"Checks the length and CRC of a read reply for reg_qty registers and\n"
+"decodes its registers as big-endian floats, two registers each. Raises\n"
+"ValueError if the reply is short, corrupt or an exception.");
+
+static PyObject *modbus_decode_reply(PyObject *self, PyObject *args) {
+  Py_buffer reply;
+  unsigned short reg_qty;
+  uint32_t values[REPLY_FLOATS_MAX];
+  const uint8_t *frame;
+  PyObject *result;
+  int func, count, c;
+
+  if (!PyArg_ParseTuple(args, "s*H:decode_reply", &reply, &reg_qty))
+    return NULL;
+
+  frame = (const uint8_t *) reply.buf;
+  func = modbus_frame_check(frame, (int) reply.len);
+  if (func < 0 || func & 0x80 || frame[2] != 2 * reg_qty ||
+      reg_qty > MODBUS_REG_READ_QTY_MAX) {
+    PyBuffer_Release(&reply);
+    PyErr_SetString(PyExc_ValueError, func > 0 && func & 0x80 ?
+                    "exception reply" : "short or corrupt reply");
+    return NULL;
+  }
+
+  count = reg_qty / 2;
+  modbus_decode_floats(frame + sizeof(modbus_reply_read_reg), count, values);
+  PyBuffer_Release(&reply);
+
+  result = PyTuple_New(count);
+  if (!result)
+    return NULL;
+  for (c = 0; c < count; c++) {
+    float value;
+    memcpy(&value, &values[c], sizeof(value));
+    PyTuple_SET_ITEM(result, c, PyFloat_FromDouble(value));
+  }
+  return result;
+}
+
+static PyMethodDef modbus_methods[] = {
+  { "crc16",        modbus_crc16,        METH_VARARGS, crc16_doc },
+  { "read_request", modbus_read_request, METH_VARARGS, read_request_doc },
+  { "decode_reply", modbus_decode_reply, METH_VARARGS, decode_reply_doc },
+  { NULL, NULL, 0, NULL }
+};
+
+PyDoc_STRVAR(module_doc, "Modbus framing, CRC and float decode in C.");
+
+#if PY_MAJOR_VERSION >= 3
+static struct PyModuleDef modbus_module = {
+  PyModuleDef_HEAD_INIT, "_modbus", module_doc, -1, modbus_methods
+};
+
+PyMODINIT_FUNC PyInit__modbus(void) {
+  return PyModule_Create(&modbus_module);
+}
+#else
+PyMODINIT_FUNC init_modbus(void) {
+  Py_InitModule3("_modbus", modbus_methods, module_doc);
+}
+#endif
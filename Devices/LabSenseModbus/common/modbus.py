@@ -4,67 +4,186 @@ import struct           # For reading/writing binary data
 import crc16            # For calculating crc-16 for modbus msgs
 import logging          # For logging events
 import sys              # For printing out response bytes
+import errno            # For telling a drained socket from a closed one
 import time             # For timestamping data retrieval
+import random           # For jittering reconnect delays
+
+try:
+    import _modbus      # Framing, CRC and decode in C (see setup.py)
+except ImportError:
+    _modbus = None
+
+# Largest reply: 3 header bytes, 125 registers and the CRC
+MAX_RESPONSE_SIZE = 5 + 2*125
+
+# Reply timeouts in seconds (see gateway.h in deprecated/LabSenseModbus):
+# RTO_INITIAL until the first reply, then the smoothed round trip time plus
+# four times its mean deviation, as TCP does, within RTO_MIN and RTO_MAX
+RTO_INITIAL = 1.0
+RTO_MIN = 0.02
+RTO_MAX = 10.0
+# Time given a reply that has started coming in at its deadline
+FRAME_GRACE = 1.0
+# Reconnect delays, doubled per failure and jittered
+RECONNECT_MIN = 0.5
+RECONNECT_MAX = 60.0
 
 class TCPModbusClient(object):
 
-    def __init__(self, IP, PORT):
+    def __init__(self, IP, PORT, hedges=0):
+        """ hedges is how many times a request is sent again when it goes
+        unanswered for the timeout, for meters with long tails; a reply to
+        any of them is taken. """
         self.IP = IP
         self.PORT = PORT
         self.server_addr = (str(IP), int(PORT))
+        self.response = bytearray(MAX_RESPONSE_SIZE)
+        self.hedges = hedges
+        self.srtt = None
+        self.rttvar = 0.0
+        self.rto = RTO_INITIAL
+        self.owed = 0               # replies to hedges still to come
+        self.owed_until = 0.0
+        self.sock = None
         self.connect()
 
     def connect(self):
+        """ Connects, retrying with jittered exponential backoff until it
+        succeeds. The connect timeout follows the reply timeout. """
+        delay = RECONNECT_MIN
+        while True:
+            try:
+                self.sock = socket.create_connection(self.server_addr,
+                                                     max(RTO_INITIAL, min(RTO_MAX, 2 * self.rto)))
+                self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                self.owed = 0
+                return
+            except socket.error:
+                wait = delay / 2 + random.uniform(0, delay / 2)
+                print ("Could not establish modbus "
+                       "connection. Retrying in %.1f seconds..." % wait)
+                time.sleep(wait)
+                delay = min(2 * delay, RECONNECT_MAX)
+
+    def reconnect(self):
         try:
-            # Try connecting with a timeout of 5 seconds
-            self.sock = socket.create_connection(self.server_addr, 10)
-        except socket.error:
-            print ("Could not establish modbus"
-                   "connection. Retrying in 5 seconds...")
-            time.sleep(5)
-            self.connect()
+            self.sock.close()
+        except (AttributeError, socket.error):
+            pass
+        self.connect()
 
-    def modbusReadReg(self, addr, modbus_func, reg_addr, reg_qty):
+    def rttSample(self, rtt):
+        """ Folds a round trip time into the estimates (RFC 6298) """
+        if self.srtt is None:
+            self.srtt = rtt
+            self.rttvar = rtt / 2
+        else:
+            self.rttvar += (abs(rtt - self.srtt) - self.rttvar) / 4
+            self.srtt += (rtt - self.srtt) / 8
+        self.rto = min(RTO_MAX, max(RTO_MIN, self.srtt + 4 * self.rttvar))
+
+    def drain(self):
+        """ Waits for the replies still owed to hedges, then throws away
+        anything else left over, so neither is taken for the next reply """
+        while self.owed > 0:
+            try:
+                self.receiveResponse(None, self.owed_until)
+            except socket.timeout:
+                break
+            self.owed -= 1
+        self.owed = 0
+
+        self.sock.setblocking(0)
+        try:
+            while True:
+                if not self.sock.recv(MAX_RESPONSE_SIZE):
+                    raise socket.error("Connection closed by Modbus Server")
+        except socket.error as e:
+            if e.args and e.args[0] not in (errno.EAGAIN, errno.EWOULDBLOCK):
+                raise
+        finally:
+            self.sock.setblocking(1)
 
-        # Create request with network endianness
-        struct_format = ("!BBHH")
-        packed_data = struct.pack(struct_format, addr, modbus_func, reg_addr, reg_qty)
+    def modbusReadReg(self, addr, modbus_func, reg_addr, reg_qty):
 
-        packed_data_size = struct.calcsize(struct_format)
+        if _modbus:
+            packed_data = _modbus.read_request(addr, modbus_func, reg_addr, reg_qty)
+        else:
+            # Create request with network endianness
+            struct_format = ("!BBHH")
+            packed_data = struct.pack(struct_format, addr, modbus_func, reg_addr, reg_qty)
 
-        # Calculate the CRC16 and append to the end
-        crc = crc16.calcCRC(packed_data)
-        crc = socket.htons(crc)
-        struct_format = ("!BBHHH")
-        packed_data = struct.pack(struct_format, addr, modbus_func, reg_addr, reg_qty, crc)
+            # Calculate the CRC16 and append to the end
+            crc = crc16.calcCRC(packed_data)
+            crc = socket.htons(crc)
+            struct_format = ("!BBHHH")
+            packed_data = struct.pack(struct_format, addr, modbus_func, reg_addr, reg_qty, crc)
 
         #print "Packed data: " + repr(packed_data)
 
-        sent = False
-        while sent == False:
+        while True:
             try:
-                # Send data
-                self.sock.sendall(packed_data)
-                response = self.getResponse(reg_qty)
-                sent = True
+                self.drain()
+                size = self.sendRequest(packed_data, addr, reg_qty)
+                break
+            except socket.timeout:
+                print ("Modbus device %d did not answer in %.3f seconds. "
+                       "Skipping..." % (addr, self.rto))
+                # Back off until a reply comes in (Karn)
+                if self.srtt is not None:
+                    self.rto = min(RTO_MAX, 2 * self.rto)
+                return []
             except socket.error:
                 print ("Modbus Connection was closed by Modbus Server. "
-                       "Retrying in 5 seconds...")
-                time.sleep(5)
-                self.connect()
-    
-        return response
+                       "Reconnecting...")
+                self.reconnect()
+
+        return self.getResponse(size, reg_qty)
+
+    def sendRequest(self, packed_data, addr, reg_qty):
+        """ Sends the request, and again each time it goes unanswered for
+        the timeout, up to self.hedges times. Returns the length of the
+        first reply from addr, or raises socket.timeout. """
+        sent = 0
+        while True:
+            self.sock.sendall(packed_data)
+            sent_at = time.time()
+            sent += 1
+            try:
+                size = self.receiveResponse(reg_qty, sent_at + self.rto, addr)
+                break
+            except socket.timeout:
+                if sent > self.hedges:
+                    raise
+
+        # It isn't known which of several requests was answered, so only
+        # single ones are timed; the other replies are waited for before
+        # the next request
+        if sent == 1:
+            self.rttSample(time.time() - sent_at)
+        else:
+            self.owed = sent - 1
+            self.owed_until = time.time() + self.rto
+        return size
 
-    def getResponse(self, reg_qty):
+    def getResponse(self, response_size, reg_qty):
         # Response size is:
         #   Modbus Address 1 byte
         #   Function Code  1 byte
         #   Number of data bytes to follow 1 byte
         #   Register contents reg_qty * 2 b/c they are 16 bit values
         #   CRC 2 bytes
-        response_size = 5 + 2*reg_qty
-        response = self.sock.recv(response_size)
 
+        if _modbus:
+            try:
+                data = _modbus.decode_reply(memoryview(self.response)[:response_size], reg_qty)
+            except ValueError:
+                print "Received bad data. Skipping..."
+                return []
+            print "\n"
+            return data
+
+        response = str(self.response[:response_size])
         struct_format = "!BBB" + "f" * (reg_qty/2) + "H"
 
         try:
@@ -73,6 +192,12 @@ class TCPModbusClient(object):
             print "Received bad data. Skipping..."
             return []
 
+        # The CRC is sent low byte first, as modbusReadReg packs it
+        crc = socket.htons(crc16.calcCRC(response[:-2]))
+        if crc != data[-1]:
+            print "Received bad data. Skipping..."
+            return []
+
         # Remove first 3 bytes and last two bytes (See
         # above)
         start = 3
@@ -86,6 +211,43 @@ class TCPModbusClient(object):
         print "\n"
         return data
 
+    def receiveResponse(self, reg_qty, deadline, addr=None):
+        """ Reads a whole response into self.response, as the server may
+        send it in several segments. An exception response is 5 bytes long,
+        so the length is only known after the function code; without
+        reg_qty the byte count is used. Replies from other addresses than
+        addr are dropped. Raises socket.timeout at deadline, unless a reply
+        is coming in, which gets FRAME_GRACE more seconds since it can't be
+        left in the stream. Returns the length. """
+        view = memoryview(self.response)
+        late = False
+        while True:
+            response_size = 3
+            received = 0
+            while received < response_size:
+                left = deadline - time.time()
+                if left <= 0 and received > 0 and not late:
+                    deadline += FRAME_GRACE
+                    late = True
+                    continue
+                if left <= 0:
+                    raise socket.timeout("No reply in time")
+                self.sock.settimeout(left)
+                count = self.sock.recv_into(view[received:], response_size - received)
+                if count == 0:
+                    raise socket.error("Connection closed by Modbus Server")
+                received += count
+                if response_size == 3 and received == 3:
+                    if self.response[1] & 0x80:
+                        response_size = 5
+                    elif reg_qty is None:
+                        response_size = 5 + self.response[2]
+                    else:
+                        response_size = 5 + 2*reg_qty
+
+            if addr is None or self.response[0] == addr:
+                return response_size
+            print "Dropped a late reply from Modbus device %d" % self.response[0]
 
     """ Channel-level calls for getting
     data from meters """
@@ -127,10 +289,11 @@ if __name__ == "__main__":
     parser.add_argument("Modbus_start_reg", help="Modbus\
             starting register")
     parser.add_argument("Modbus_num_regs", help="Number of registers")
+    parser.add_argument("--hedges", type=int, default=0,
+                        help="Times to send a request again when unanswered")
     args = parser.parse_args()
 
-    client = TCPModbusClient(args.IP, args.PORT)
-    client.connect()
+    client = TCPModbusClient(args.IP, args.PORT, args.hedges)
     data = client.modbusReadReg(int(args.Modbus_address),
                          int(args.Modbus_funct_code),
                          int(args.Modbus_start_reg),
@@ -0,0 +1,15 @@
+# Builds _modbus, the C framing used by modbus.py when it is available:
+#
+#   python setup.py build_ext --inplace
+
+from distutils.core import setup, Extension
+
+CLIENT = "../../../deprecated/LabSenseModbus"
+
+setup(name="_modbus",
+      ext_modules=[Extension("_modbus",
+                             sources=["_modbus.c",
+                                      CLIENT + "/modbusframe.c",
+                                      CLIENT + "/crc16.c"],
+                             include_dirs=[CLIENT],
+                             extra_compile_args=["-O2"])])
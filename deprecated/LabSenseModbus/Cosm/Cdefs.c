@@ -0,0 +1,14 @@
+#include "Cdefs.h"
+
+int CosmError(char *str)
+{
+    fprintf(stderr, "%s\n", str);
+    fprintf(stderr, "%s\n", "Exiting...");
+    exit(1);
+}
+
+void freeCosmConfig(CosmConfig *config) {
+    free(config->Url);
+    free(config->Api_key);
+    free(config);
+}
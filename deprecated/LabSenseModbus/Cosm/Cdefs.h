@@ -8,12 +8,12 @@
 #define COSM_BUFFER_LENGTH 2048
 #define URL_LENGTH 128
 
-int CosmError(char *str)
-{
-    fprintf(stderr, "%s\n", str);
-    fprintf(stderr, "%s\n", "Exiting...");
-    exit(1);
-}
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Prints str and exits
+int CosmError(char *str);
 
 typedef struct CosmConfig {
     char *Url;
@@ -21,10 +21,10 @@ typedef struct CosmConfig {
     char *Api_key;
 } CosmConfig;
 
-void freeCosmConfig(CosmConfig *config) {
-    free(config->Url);
-    free(config->Api_key);
-    free(config);
+void freeCosmConfig(CosmConfig *config);
+
+#ifdef __cplusplus
 }
+#endif
 
 #endif
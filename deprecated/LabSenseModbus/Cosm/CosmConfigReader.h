@@ -1,61 +1,20 @@
-#include <jansson.h>
-#include <string.h>
+#ifndef COSM_CONFIG_READER_H
+#define COSM_CONFIG_READER_H
 
-// Read Cosm config file for Ip, port, and api ke
-CosmConfig *readCosmConfig()
-{
-    int url_length;
-    int api_key_length;
+#include "Cdefs.h"
 
-    char URL_CHAR[128];
-    char API_KEY_CHAR[128];
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-    // JSON nodes
-    json_t *root, *url, *json_feed, *api_key;
-    json_error_t error;
+#define COSM_CONFIG_FILE "Cosm/config.json"
 
-    // Read the JSON contents
-    root = json_load_file("Cosm/config.json", 0, &error);
-
-    if(!root) {
-        CosmError("\nError when parsing Cosm Config File");
-    }
-
-    // Get url, Feed, and API_KEY
-    url = json_object_get(root, "URL");
-    json_feed = json_object_get(root, "feed");
-    api_key = json_object_get(root, "API_KEY");
-
-    // Get values
-    strcpy(URL_CHAR, json_string_value(url));
-    strcpy(API_KEY_CHAR, json_string_value(api_key));
-
-    // Free json objects
-    free(root);
-    free(url);
-    free(api_key);
-
-    // Allocate memory for config
-    CosmConfig *config = malloc(sizeof(CosmConfig *));
-
-    url_length = strlen(URL_CHAR);
-    api_key_length = strlen(API_KEY_CHAR);
-
-
-    // url length + 1 for NULL
-    config->Url = (char *) malloc(url_length + 1);
-    // API key length + 1 for NULL
-    config->Api_key = (char *) malloc(api_key_length + 1);
-
-    if(!config->Url || !config->Api_key)
-    {
-        CosmError("Can't allocate memory for Cosm Configuration");
-    }
-
-    strcpy(config->Url, URL_CHAR);
-    strcpy(config->Api_key, API_KEY_CHAR);
-    config->Feed = json_integer_value(json_feed);
-
-    return config;
+// Reads the Cosm URL, feed and API key from COSM_CONFIG_FILE. Exits if it
+// cannot.
+CosmConfig *readCosmConfig(void);
 
+#ifdef __cplusplus
 }
+#endif
+
+#endif
@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "CosmUploader.h"
+
+int sendToCosm(uint32_t *reg_vals, int count, Type type)
+{
+    char **sa_buf; 
+
+    CosmConfig *config;
+    config = readCosmConfig();
+
+    // Format data for Cosm
+    // Failures are not fatal: the samples are still in the sample store
+    if(!cosmFormatter(&sa_buf, reg_vals, &count, type, config->Api_key))
+    {
+        fprintf(stderr, "Error when formatting data for Cosm!\n");
+        freeCosmConfig(config);
+        return 0;
+    }
+
+    // Send formatted data to Cosm
+    if(!uploadToCosm(&sa_buf, count, config))
+    {
+        fprintf(stderr, "Error when sending data to Cosm!\n");
+        free(sa_buf[0]);
+        free(sa_buf);
+        freeCosmConfig(config);
+        return 0;
+    }
+    else {
+        printf("\nSuccessfully Sent Data to Cosm!\n");
+    }
+
+    // Free memory
+    freeCosmConfig(config);
+    free(sa_buf);
+
+    return 1;
+
+}
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <sys/time.h>
 #include "SensorAct/SensorActUploader.h"
+#include "channelstore.h"
 
 #define SUCCESS     0
 #define FAIL        1
@@ -108,6 +109,32 @@ typedef struct modbus_reply_report_slaveid {
 
 #pragma pack(pop)
 
+/* When the values of a reply were sampled: the midpoint of the request
+ * and the reply, and half the time between them, in nanoseconds */
+typedef struct sample_time {
+  int64_t   ns;             /* since the epoch */
+  int64_t   uncertainty;    /* the sample was taken within +/- this */
+} sample_time;
+
+/* Sweeps published on SWEEP_PORT: one two part message per block read,
+ * a sweep_header followed by count floats, both in host byte order. The
+ * header starts with the type, so subscribers can filter on it. Version 1
+ * headers had a millisecond timestamp and no uncertainty. Not 5556-5558:
+ * the forwarder and the Socket.IO server read those as text samples. */
+#define SWEEP_PORT     5560
+#define SWEEP_VERSION  2
+
+typedef struct sweep_header {
+  uint8_t   type;           /* Type of the block: Eaton, VerisPower, ... */
+  uint8_t   version;
+  uint8_t   modbus_addr;    /* of the device */
+  uint8_t   reserved;
+  uint16_t  reg_addr;       /* first register of the block */
+  uint16_t  count;          /* floats in the second part */
+  int64_t   timestamp;      /* nanoseconds since the epoch */
+  int64_t   uncertainty;    /* of the timestamp, +/- nanoseconds */
+} sweep_header;
+
 /* Function declarations */
 
 /* Error handling function */
@@ -120,11 +147,18 @@ uint16_t calc_crc16(uint8_t* modbusframe, uint16_t length);
 uint16_t read_crc16(uint8_t* byteArr, uint16_t byteOffset);
 
 /* Print the contents of the buffer */
-void print_received_msg(uint8_t *buf, int buflen, Type type, time_t timestamp, SensorActConfig *Sconfig); 
-void print_modbus_reply_read_reg(uint8_t *buf, int buflen, Type type, time_t timestamp, SensorActConfig *Sconfig);
+void print_received_msg(uint8_t *buf, int buflen, Type type, const sample_time *when, SensorActConfig *Sconfig); 
+void print_modbus_reply_read_reg(uint8_t *buf, int buflen, Type type, const sample_time *when, SensorActConfig *Sconfig);
 void print_modbus_reply_write_reg(uint8_t *buf, int buflen);
 void print_modbus_reply_write_multireg(uint8_t *buf, int buflen);
 void print_modbus_reply_report_slaveid(uint8_t *buf, int buflen);
 
+/* Publishes the sweeps read from now on on a ZMQ_PUB socket, as read from
+ * the register block starting at reg_addr */
+void set_sweep_publisher(void *publisher, uint16_t reg_addr);
+
+/* The store of recent samples, created on first use. NULL if out of memory. */
+channel_store *sample_store(void);
+
 #endif
 
@@ -1,31 +1,161 @@
 #include <stdio.h>      /* for printf() and fprintf() */
-#include <sys/socket.h> /* for recv() and send() */
-#include <unistd.h>     /* for close() */
+#include <unistd.h>     /* for read(), write() and close() */
 #include <string.h>
 #include <stdint.h>
 #include <netinet/in.h>
+#include <math.h>
+#include <time.h>
 #include "E30ModbusMsg.h"
 
 #define RCVBUFSIZE 1024   /* Size of receive buffer */ 
 #define SLAVEID "Veris Model E30A Branch Circuit Monitor, S/N=0x12345678, Location=\"NOT_ASSIGNED\""
 
+static int char_us = 0;     /* time of a character on the simulated line */
 
-void HandleTCPClient(int clntSocket, uint8_t modbus_addr)
+/* Makes replies take as long as at baud on a serial line, 11 bits a
+ * character */
+void SimulateBaudRate(int baud)
+{
+    char_us = (baud > 0) ? 11 * 1000000 / baud : 0;
+}
+
+/* Sends a reply, taking the time it would on the wire */
+static void send_reply(int clntSocket, char *txBuf, int replyMsgSize)
+{
+    if (char_us > 0)
+        usleep(replyMsgSize * char_us);
+    if (write(clntSocket, txBuf, replyMsgSize) != replyMsgSize)
+        DieWithError("send() failed");
+}
+
+
+/* Fills reg_qty registers from reg_addr with float values, two registers
+ * each, high word first. Each value drifts slowly around a level set by
+ * its register address, like a branch circuit reading. */
+static void simulate_registers(uint16_t reg_addr, uint16_t reg_qty,
+                               uint16_t *regs)
+{
+  double now = (double) time(NULL);
+  uint16_t cnt;
+
+  for (cnt = 0; cnt + 1 < reg_qty; cnt += 2) {
+    uint16_t reg = reg_addr + cnt;
+    float level = 1.0f + (reg % 97) * 0.25f;
+    float value = level * (1.0f + 0.1f * (float) sin(now / 60.0 + reg));
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    regs[cnt] = htons((uint16_t) (bits >> 16));
+    regs[cnt + 1] = htons((uint16_t) (bits & 0xffff));
+  }
+  if (cnt < reg_qty)
+    regs[cnt] = htons(cnt);
+}
+
+/* Registers written by clients, which reads return from then on, so a
+ * configuration push can be read back */
+#define WRITTEN_MAX 4096
+
+static struct written_reg {
+  uint8_t   modbus_addr;
+  uint16_t  reg;
+  uint16_t  val;              /* network byte order */
+} written[WRITTEN_MAX];
+static int written_count = 0;
+
+/* Stores reg_qty register values for the slave. Returns 0, or -1 when the
+ * table is full. */
+static int write_registers(uint8_t modbus_addr, uint16_t reg_addr,
+                           uint16_t reg_qty, const uint16_t *vals)
+{
+  uint16_t cnt;
+  int w;
+
+  for (cnt = 0; cnt < reg_qty; cnt++) {
+    for (w = 0; w < written_count; w++) {
+      if (written[w].modbus_addr == modbus_addr &&
+          written[w].reg == (uint16_t) (reg_addr + cnt))
+        break;
+    }
+    if (w == WRITTEN_MAX)
+      return -1;
+    if (w == written_count)
+      written_count++;
+    written[w].modbus_addr = modbus_addr;
+    written[w].reg = reg_addr + cnt;
+    written[w].val = vals[cnt];
+  }
+  return 0;
+}
+
+/* Replaces simulated values with the ones written */
+static void written_registers(uint8_t modbus_addr, uint16_t reg_addr,
+                              uint16_t reg_qty, uint16_t *regs)
+{
+  int w;
+
+  for (w = 0; w < written_count; w++) {
+    uint16_t offset = written[w].reg - reg_addr;
+    if (written[w].modbus_addr == modbus_addr && offset < reg_qty)
+      regs[offset] = written[w].val;
+  }
+}
+
+/* Sends the reply of length bytes in txBuf after adding its CRC */
+static void send_sealed(int clntSocket, char *txBuf, int length)
+{
+    uint32_t crc_temp = calc_crc16((uint8_t*) txBuf, length) & 0x0ffff;
+
+    txBuf[length] = (uint8_t) (crc_temp & 0x0ff);
+    txBuf[length + 1] = (uint8_t) (crc_temp >> 8 & 0x0ff);
+    send_reply(clntSocket, txBuf, length + 2);
+}
+
+/* Length of the request at the start of the buffered bytes, so requests
+ * sent back to back without waiting for replies are answered one by one */
+static int request_length(const char *rxBuf, int buffered)
+{
+  int length;
+
+  switch ((uint8_t) rxBuf[BYTEPOS_MODBUS_FUNC]) {
+  case MODBUS_FUNC_READ_REG:
+  case MODBUS_FUNC_WRITE_REG:
+    length = sizeof(modbus_req_read_reg) + CRC16_SIZE;
+    break;
+  case MODBUS_FUNC_REPORT_SLAVEID:
+    length = sizeof(modbus_req_report_slaveid) + CRC16_SIZE;
+    break;
+  case MODBUS_FUNC_WRITE_MULTIREG:
+    length = (buffered > 6) ? (int) sizeof(modbus_req_write_multireg) +
+                              (uint8_t) rxBuf[6] + CRC16_SIZE : buffered;
+    break;
+  default:
+    length = buffered;
+  }
+  return (buffered < 2 || length > buffered) ? buffered : length;
+}
+
+/* Answers requests for the slaves first_addr to last_addr, as a gateway
+ * in front of several meters; requests for other slaves go unanswered */
+void HandleTCPClient(int clntSocket, uint8_t first_addr, uint8_t last_addr)
 {
     char rxBuf[RCVBUFSIZE];    /* Buffer for echo string */
     int recvMsgSize = 0;        /* Size of received message */
+    int buffered = 0;           /* Bytes received and not yet handled */
     char txBuf[RCVBUFSIZE];  /* Buffer for reply string */
     int replyMsgSize = 0;       /* Size of reply message */
 
     /* Receive message from client */
-    if ((recvMsgSize = recv(clntSocket, rxBuf, RCVBUFSIZE, 0)) < 0)
+    if ((buffered = read(clntSocket, rxBuf, RCVBUFSIZE)) < 0)
         DieWithError("recv() failed");
 
-    printf("Message of %d bytes received.\n", recvMsgSize);
+    printf("Message of %d bytes received.\n", buffered);
 
     /* Send received string and receive again until end of transmission */
-    while (recvMsgSize > 0)      /* zero indicates end of transmission */
+    while (buffered > 0)      /* zero indicates end of transmission */
     {
+        recvMsgSize = request_length(rxBuf, buffered);
+
         /* Display the received message as hex arrays */
         int c;
         for (c = 0; c < recvMsgSize; c++) {
@@ -34,7 +164,8 @@ void HandleTCPClient(int clntSocket, uint8_t modbus_addr)
         printf("\n");
 
         /* Check the modbus server addr */ 
-        if (rxBuf[BYTEPOS_MODBUS_ADDR] == modbus_addr) {
+        uint8_t modbus_addr = (uint8_t) rxBuf[BYTEPOS_MODBUS_ADDR];
+        if (modbus_addr >= first_addr && modbus_addr <= last_addr) {
           uint32_t crc_in_packet = 0;
           uint32_t crc_calculated = 0;
           
@@ -70,26 +201,27 @@ void HandleTCPClient(int clntSocket, uint8_t modbus_addr)
               txBuf[crc_offset + 2] = 0;
               replyMsgSize = crc_offset + 2;
 
-              if (send(clntSocket, txBuf, replyMsgSize, 0) != replyMsgSize)
-                DieWithError("send() failed");
+              send_reply(clntSocket, txBuf, replyMsgSize);
             }
             else if (rxBuf[BYTEPOS_MODBUS_FUNC] == MODBUS_FUNC_READ_REG) {
               uint32_t crc_temp;
               uint32_t crc_offset;
               uint16_t reg_qty;
-              uint16_t cnt;
 
               modbus_req_read_reg* reqMsg = (modbus_req_read_reg*) rxBuf; 
               modbus_reply_read_reg* replyMsg = (modbus_reply_read_reg*) txBuf;
 
               reg_qty = ntohs(reqMsg->modbus_reg_qty);
+              if (reg_qty > MODBUS_REG_READ_QTY_MAX)
+                reg_qty = MODBUS_REG_READ_QTY_MAX;
 
               replyMsg->modbus_addr = modbus_addr;
               replyMsg->modbus_func = MODBUS_FUNC_READ_REG;
               replyMsg->modbus_val_bytes = 2 * reg_qty;
-              for (cnt = 0; cnt < reg_qty; cnt++) {
-                replyMsg->modbus_reg_val[cnt] = htons(cnt); 
-              }
+              simulate_registers(ntohs(reqMsg->modbus_reg_addr), reg_qty,
+                                 replyMsg->modbus_reg_val);
+              written_registers(modbus_addr, ntohs(reqMsg->modbus_reg_addr),
+                                reg_qty, replyMsg->modbus_reg_val);
               
               crc_offset = sizeof(modbus_reply_read_reg) + 2 * reg_qty; 
               crc_temp = calc_crc16((uint8_t*) txBuf, crc_offset) & 0x0ffff; 
@@ -98,8 +230,32 @@ void HandleTCPClient(int clntSocket, uint8_t modbus_addr)
               txBuf[crc_offset + 2] = 0;
               replyMsgSize = crc_offset + 2;
 
-              if (send(clntSocket, txBuf, replyMsgSize, 0) != replyMsgSize)
-                DieWithError("send() failed");
+              send_reply(clntSocket, txBuf, replyMsgSize);
+            }
+            else if (rxBuf[BYTEPOS_MODBUS_FUNC] == MODBUS_FUNC_WRITE_REG) {
+              modbus_req_write_reg* reqMsg = (modbus_req_write_reg*) rxBuf;
+
+              /* The reply echoes the request */
+              if (write_registers(modbus_addr, ntohs(reqMsg->modbus_reg_addr),
+                                  1, &reqMsg->modbus_reg_val) == 0) {
+                memcpy(txBuf, rxBuf, sizeof(modbus_req_write_reg));
+                send_sealed(clntSocket, txBuf, sizeof(modbus_req_write_reg));
+              }
+            }
+            else if (rxBuf[BYTEPOS_MODBUS_FUNC] == MODBUS_FUNC_WRITE_MULTIREG) {
+              modbus_req_write_multireg* reqMsg =
+                (modbus_req_write_multireg*) rxBuf;
+              uint16_t reg_qty = ntohs(reqMsg->modbus_reg_qty);
+
+              /* The reply echoes the start address and quantity */
+              if (reqMsg->modbus_val_bytes == 2 * reg_qty &&
+                  recvMsgSize == sizeof(modbus_req_write_multireg) +
+                                 2 * reg_qty + CRC16_SIZE &&
+                  write_registers(modbus_addr, ntohs(reqMsg->modbus_reg_addr),
+                                  reg_qty, reqMsg->modbus_reg_val) == 0) {
+                memcpy(txBuf, rxBuf, sizeof(modbus_req_read_reg));
+                send_sealed(clntSocket, txBuf, sizeof(modbus_req_read_reg));
+              }
             }
             else {
               printf("Modbus function code %02x not supported!\n", 
@@ -114,12 +270,17 @@ void HandleTCPClient(int clntSocket, uint8_t modbus_addr)
         }
         else {
           printf("Modbus server address does not match!\n");
-          printf("address in the packet: %d\n", rxBuf[BYTEPOS_MODBUS_ADDR]);
-          printf("address of this server: %d\n", modbus_addr);
+          printf("address in the packet: %d\n", modbus_addr);
+          printf("addresses of this server: %d-%d\n", first_addr, last_addr);
         }
 
+        /* Answer the requests that came in behind this one first */
+        buffered -= recvMsgSize;
+        memmove(rxBuf, rxBuf + recvMsgSize, buffered);
+
         /* See if there is more data to receive */
-        if ((recvMsgSize = recv(clntSocket, rxBuf, RCVBUFSIZE, 0)) < 0)
+        if (buffered == 0 &&
+            (buffered = read(clntSocket, rxBuf, RCVBUFSIZE)) < 0)
             DieWithError("recv() failed");
     }
 
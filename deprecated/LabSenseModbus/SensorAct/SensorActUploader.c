@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "SensorActUploader.h"
+
+int sendToSensorAct(uint32_t *reg_vals, int count, Type type, time_t timestamp, int interval, SensorActConfig *config, const uint8_t *report)
+{
+    char **sa_buf; 
+    int i;
+
+    //SensorActConfig *config;
+    //config = readSensorActConfig();
+
+    // Format data for SensorAct
+    // Failures are not fatal: the samples are still in the sample store
+    if(!sensorActFormatter(&sa_buf, reg_vals, &count, type, timestamp, interval, config->Api_key, report))
+    {
+        fprintf(stderr, "Error when formatting data for SensorAct!\n");
+        free(sa_buf);
+        return 0;
+    }
+
+    // Send formatted data to SensorAct
+    if(!uploadToSensorAct(&sa_buf, count, config))
+    {
+        fprintf(stderr, "Error when sending data to SensorAct!\n");
+        for (i = 0; i < count; i++)
+            free(sa_buf[i]);
+        free(sa_buf);
+        return 0;
+    }
+    else {
+        printf("\nSuccessfully Sent Data to SensorAct!\n");
+    }
+
+    // Free memory; the config is the caller's
+    free(sa_buf);
+
+    return 1;
+
+}
@@ -1,48 +1,25 @@
 #ifndef SENSORACT_H
 #define SENSORACT_H
 
-#include <stdio.h>
-#include <stdlib.h>
 #include <stdint.h>
-#include <string.h>
-#include <sys/time.h>
+#include <time.h>
 
 #include "uploader.h"
 #include "formatter.h"
 #include "defs.h"
 #include "SensorActConfigReader.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-// Send Veris data to SensorAct
-int sendToSensorAct(uint32_t *reg_vals, int count, Type type, time_t timestamp, SensorActConfig *config)
-{
-    char **sa_buf; 
-    int i;
-
-    //SensorActConfig *config;
-    //config = readSensorActConfig();
-
-    // Format data for SensorAct
-    if(!sensorActFormatter(&sa_buf, reg_vals, &count, type, timestamp, config->Api_key))
-    {
-        SensorActError("Error when formatting data for SensorAct!");
-    }
-
-    // Send formatted data to SensorAct
-    if(!uploadToSensorAct(&sa_buf, count, config))
-    {
-        SensorActError("Error when sending data to SensorAct!");
-    }
-    else {
-        printf("\nSuccessfully Sent Data to SensorAct!\n");
-    }
-
-    // Free memory
-    freeSensorActConfig(config);
-    free(sa_buf);
-
-    return 1;
+// Send Veris data to SensorAct. interval is the seconds between readings.
+// report selects the channels to send (see deadband.h); NULL sends all of
+// them. Returns 1, or 0 if the data could not be formatted or sent.
+int sendToSensorAct(uint32_t *reg_vals, int count, Type type, time_t timestamp, int interval, SensorActConfig *config, const uint8_t *report);
 
+#ifdef __cplusplus
 }
+#endif
 
 #endif
@@ -0,0 +1,14 @@
+#include "defs.h"
+
+int SensorActError(char *str)
+{
+    fprintf(stderr, "%s\n", str);
+    fprintf(stderr, "%s\n", "Exiting...");
+    exit(1);
+}
+
+void freeSensorActConfig(SensorActConfig *config) {
+    free(config->Ip);
+    free(config->Api_key);
+    free(config);
+}
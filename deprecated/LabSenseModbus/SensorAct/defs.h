@@ -24,12 +24,12 @@ typedef enum Type {
 } Type;
 
 
-int SensorActError(char *str)
-{
-    fprintf(stderr, "%s\n", str);
-    fprintf(stderr, "%s\n", "Exiting...");
-    exit(1);
-}
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Prints str and exits
+int SensorActError(char *str);
 
 typedef struct SensorActConfig {
     char *Ip;
@@ -37,10 +37,10 @@ typedef struct SensorActConfig {
     char *Api_key;
 } SensorActConfig;
 
-void freeSensorActConfig(SensorActConfig *config) {
-    free(config->Ip);
-    free(config->Api_key);
-    free(config);
+void freeSensorActConfig(SensorActConfig *config);
+
+#ifdef __cplusplus
 }
+#endif
 
 #endif
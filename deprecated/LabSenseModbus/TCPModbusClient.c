@@ -4,11 +4,19 @@
 #include <stdlib.h>     /* for atoi() and exit() */
 #include <string.h>     /* for memset() */
 #include <unistd.h>     /* for close() */
+#include <fcntl.h>      /* for fcntl() */
+#include <poll.h>       /* for poll() */
+#include <errno.h>      /* for errno */
+#include <signal.h>     /* for sigaction() */
 
 #include "E30ModbusMsg.h"
+#include "modbusframe.h"
+#include "gateway.h"
+#include "configpush.h"
+#include "capture.h"
 
 // Zeromq helper file
-/*#include <zmq.h>*/
+#include <zmq.h>
 
 #define RCVBUFSIZE 1024   /* Size of receive buffer */ 
 
@@ -17,7 +25,15 @@
 #define ARGS_WRITE  7
 #define ARGS_WRITEM_REGVAL_POS 7
 
-#define SAMPLING_RATE 1
+#define ONESHOT_TIMEOUT 5000  /* ms to connect and for the reply */
+#define MAX_GATEWAYS 8
+
+/* The meters read by "read eaton" and "read veris": the Eaton every
+ * second, and the Veris blocks one after another, each every 3 seconds */
+static char *eaton_slaves[] = { "128.97.11.100", "4660", "1:eaton:1000" };
+static char *veris_slaves[] = {
+  "172.17.5.177", "4660", "1:power:3000", "1:powerfactor:3000", "1:current:3000"
+};
 
 
 void print_usage_top(char *str);
@@ -25,6 +41,19 @@ void print_usage_query(char *str);
 void print_usage_read(char *str);
 void print_usage_write(char *str);
 void print_usage_writem(char *str);
+void print_usage_config(char *str);
+void print_usage_capture(char *str);
+void print_usage_capture(char *str) {
+  fprintf(stderr,"E30 TCP Modbus Client\n");
+  fprintf(stderr,"Usage: %s capture <Gateway IP> <Gateway Port> <Modbus Addr>:<Block> <Rate Hz> <Seconds> <Output File> [<Depth>]\n", str);
+  fprintf(stderr,"  Block: eaton, power, powerfactor or current\n");
+  fprintf(stderr,"  Rate: at most %d Hz, for at most %d seconds\n", CAPTURE_RATE_MAX,
+          CAPTURE_SECONDS_MAX);
+  fprintf(stderr,"  Depth: requests in flight, 1 to %d (default %d)\n", CAPTURE_DEPTH_MAX,
+          CAPTURE_DEPTH);
+  exit(1);
+}
+
 int prepare_msg_query(int argc, char* argv[], char* buf, 
                       struct sockaddr_in *pServAddr);
 int prepare_msg_read(int argc, char* argv[], char* buf,
@@ -33,6 +62,13 @@ int prepare_msg_write(int argc, char* argv[], char* buf,
                       struct sockaddr_in *pServAddr);
 int prepare_msg_writem(int argc, char* argv[], char* buf,
                       struct sockaddr_in *pServAddr);
+void open_zmq_sockets(void **context, void **publisher, void **responder, int local);
+void set_eaton_sensoract_config(SensorActConfig *Sconfig);
+void poll_gateway(char *prog, int nargs, char *args[], SensorActConfig *Sconfig);
+extern int upload_samples;
+int connect_with_timeout(struct sockaddr_in *pServAddr, int timeout);
+void push_config(char *prog, char *path, int jobs);
+void run_capture(char *prog, int nargs, char *args[]);
 
 int main(int argc, char *argv[])
 {
@@ -43,15 +79,9 @@ int main(int argc, char *argv[])
     uint32_t txBufLen;            /* Length of string to echo */
     int bytesRcvd;                /* Bytes read in single recv() */ 
     int c;
-    int i;
-    Type read_type = Normal;      /* This type is used for zeromq_special_mode */
-    int first_iteration_finished = 0;
-    SensorActConfig *Sconfig = malloc(sizeof(SensorActConfig));
-
-    // Zeromq context and publisher
-    /*void *context = zmq_init(1);*/
-    /*void *publisher = zmq_socket (context, ZMQ_PUB);*/
-    /*zmq_bind(publisher, "tcp://*:5557");*/
+    int64_t sentNs;               /* when the request went out */
+    sample_time when;
+    SensorActConfig *Sconfig = calloc(1, sizeof(SensorActConfig));
 
     txBufLen = 0;
 
@@ -87,83 +117,17 @@ int main(int argc, char *argv[])
         print_usage_read(argv[0]);
       }
       else if (argc == 3 && strcmp(argv[2], "eaton") == 0) {
-
-eaton_loop:
-          read_type = Eaton;
-
           printf("Tracking Voltages, Currents, Power, VARS, VAS, Power Factor\n");
-
-          // Set the arguments according to the prepare_msg_read function
-          argc = 7;
-          argv[1] = "read";             // Read from the eaton
-          argv[2] = "128.97.11.100";    // IP address of eaton
-          argv[3] = "4660";             // Server Port
-          argv[4] ="1";                 // Modbus Address
-          argv[5] = "999";              // Modbus Register Address
-          argv[6] = "54";               // Reading 54 Registers
-
-          Sconfig->Ip = malloc(IP_LENGTH);
-          strcpy(Sconfig->Ip, "128.97.11.100");
-          Sconfig->Port = 4660;
-          Sconfig->Api_key = malloc(API_KEY_LENGTH);
-          strcpy(Sconfig->Api_key, "2bb5d6b943fc44f0bb6b467450e07ce7");
-
+          poll_gateway(argv[0], sizeof(eaton_slaves) / sizeof(eaton_slaves[0]),
+                       eaton_slaves, Sconfig);
+      }
+      else if (argc >= 6 && strcmp(argv[2], "gateway") == 0) {
+          poll_gateway(argv[0], argc - 3, argv + 3, Sconfig);
       }
       else if (argc == 3 && strcmp(argv[2], "veris") == 0) {
-    
-veris_loop:
-          // Special case to read all power and current readings 
-          // and send over zeromq
           printf("Tracking power, current, energy ,and power factor\n");
-
-          if(read_type == Normal) {
-              read_type = VerisPower;
-          }
-          else if(read_type == VerisPower) {
-            read_type = VerisPowerFactor;
-          }
-          else if(read_type == VerisPowerFactor) {
-              read_type = VerisCurrent;
-          }
-          else if(read_type == VerisCurrent) {
-              read_type = VerisPower;
-          }
-          else {
-              printf("Error in read type\n");
-          }
-
-          // Set the arguments according to the prepare_msg_read function
-          argc = 7;
-          argv[1] = "read";             // Read from the veris
-          argv[2] = "172.17.5.177";     // IP Address of Veris
-          /*argv[2] = "128.97.93.201";     // IP Address of Veris*/
-          argv[3] = "4660";             // Server Port
-          argv[4] ="1";                 // Modbus Address
-          argv[6] = "42";               // Reading 42 Registers
-
-          // Set the Register address
-          switch(read_type) {
-              case VerisPower:
-                  // Get Power Readings (KW)
-                  argv[5] = "2083";
-                  read_type = VerisPower;
-                  break;
-
-              case VerisPowerFactor:
-                  // Get Power Factor Readings (KW)
-                  argv[5] = "2267";
-                  read_type = VerisPowerFactor;
-                  break;
-                  
-              case VerisCurrent:
-                  // Get Current Readings (A)
-                  argv[5] = "2251";
-                  read_type = VerisCurrent;
-                  break;
-              default: 
-                  printf("Error in read type\n");
-                  break;
-          }
+          poll_gateway(argv[0], sizeof(veris_slaves) / sizeof(veris_slaves[0]),
+                       veris_slaves, Sconfig);
       }
       /* Test for correct number of arguments */
       else if (argc != ARGS_READ && argc != ARGS_READ + 1) {
@@ -201,20 +165,27 @@ veris_loop:
       /* Prepare tx buffer for writem command */
       txBufLen = prepare_msg_writem(argc, argv, txBuf, &servAddr); 
     }
+    /* Check arguments for config command */
+    else if (strcmp(argv[1], "config") == 0 || strcmp(argv[1], "c") == 0) {
+      if (argc < 3 || argc > 4 || strcmp(argv[2], "help") == 0 ||
+          strcmp(argv[2], "h") == 0) {
+        print_usage_config(argv[0]);
+      }
+      push_config(argv[0], argv[2], argc == 4 ? atoi(argv[3]) : PUSH_DEFAULT_JOBS);
+    }
+    /* Check arguments for capture command */
+    else if (strcmp(argv[1], "capture") == 0 || strcmp(argv[1], "x") == 0) {
+      if (argc != 8 && argc != 9)
+        print_usage_capture(argv[0]);
+      run_capture(argv[0], argc - 2, argv + 2);
+    }
     else {
       print_usage_top(argv[0]); 
     }
 
-
-    if(first_iteration_finished == 0) {
-        /* Create a reliable, stream socket using TCP */
-        if ((sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
-            DieWithError("socket() failed");
-
-        /* Establish the connection to the echo server */
-        if (connect(sock, (struct sockaddr *) &servAddr, sizeof(servAddr)) < 0)
-            DieWithError("connect() failed");
-    }
+    /* A single request: give up rather than hang on a meter that is down */
+    if ((sock = connect_with_timeout(&servAddr, ONESHOT_TIMEOUT)) < 0)
+        DieWithError("connect() failed");
 
     /* Print the size of message */
     fprintf(stderr, "Number of transmitting bytes: %d\n", txBufLen);
@@ -230,6 +201,7 @@ veris_loop:
     fprintf(stderr, "\n"); 
 
     /* Send the string to the server */
+    sentNs = gateway_clock_ns();
     if (send(sock, txBuf, txBufLen, 0) != txBufLen)
         DieWithError("send() sent a different number of bytes than expected");
 
@@ -243,32 +215,259 @@ veris_loop:
         rxBuf[bytesRcvd] = '\0';  /* Terminate the string! */ 
     }
 
-    time_t timestamp = time(NULL);
-    print_received_msg((uint8_t *)rxBuf, bytesRcvd, read_type, timestamp, Sconfig);
-
-    if(read_type != Normal) {
-        first_iteration_finished = 1;
-        sleep(SAMPLING_RATE);
-        if(read_type == Eaton)
-            goto eaton_loop;
-        else
-            goto veris_loop;
-    }
+    when.uncertainty = (gateway_clock_ns() - sentNs) / 2;
+    when.ns = sentNs + when.uncertainty;
+    print_received_msg((uint8_t *)rxBuf, bytesRcvd, Normal, &when, Sconfig);
 
-    /*zmq_close(publisher);*/
     close(sock);
     exit(0);
 
 }
 
+/* Connects to the server, waiting at most timeout ms, and sets the same
+ * timeout on receiving. Returns the socket, or -1 with errno set. */
+int connect_with_timeout(struct sockaddr_in *pServAddr, int timeout) {
+  struct pollfd pfd;
+  struct timeval tv = { timeout / 1000, (timeout % 1000) * 1000 };
+  int sock, flags, error = 0;
+  socklen_t length = sizeof(error);
+
+  if ((sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+    return -1;
+  flags = fcntl(sock, F_GETFL);
+  fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+  if (connect(sock, (struct sockaddr *) pServAddr, sizeof(*pServAddr)) < 0) {
+    if (errno != EINPROGRESS)
+      error = errno;
+    else {
+      pfd.fd = sock;
+      pfd.events = POLLOUT;
+      if (poll(&pfd, 1, timeout) <= 0)
+        error = ETIMEDOUT;
+      else if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length) < 0)
+        error = errno;
+    }
+  }
+  if (error) {
+    close(sock);
+    errno = error;
+    return -1;
+  }
+
+  fcntl(sock, F_SETFL, flags);
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  return sock;
+}
+
+/* Opens the sweep publisher and the sample store responder. Either is
+ * left NULL if its port can't be bound. If local, they are bound to the
+ * "sweeps" and "queries" ipc sockets in the working directory instead of
+ * their TCP ports, so a trial run reaches no subscriber on the host. */
+void open_zmq_sockets(void **context, void **publisher, void **responder, int local) {
+  char endpoint[32];
+
+  *context = zmq_init(1);
+
+  *publisher = zmq_socket(*context, ZMQ_PUB);
+  if (local)
+    snprintf(endpoint, sizeof(endpoint), "ipc://sweeps");
+  else
+    snprintf(endpoint, sizeof(endpoint), "tcp://*:%d", SWEEP_PORT);
+  if (zmq_bind(*publisher, endpoint) != 0) {
+    fprintf(stderr, "Can't publish sweeps on %s: %s\n",
+            endpoint, zmq_strerror(zmq_errno()));
+    zmq_close(*publisher);
+    *publisher = NULL;
+  }
+
+  *responder = zmq_socket(*context, ZMQ_REP);
+  if (local)
+    snprintf(endpoint, sizeof(endpoint), "ipc://queries");
+  else
+    snprintf(endpoint, sizeof(endpoint), "tcp://*:%d", STORE_QUERY_PORT);
+  if (zmq_bind(*responder, endpoint) != 0) {
+    fprintf(stderr, "Can't serve sample queries on %s: %s\n",
+            endpoint, zmq_strerror(zmq_errno()));
+    zmq_close(*responder);
+    *responder = NULL;
+  }
+}
+
+/* Where the Eaton readings are uploaded */
+void set_eaton_sensoract_config(SensorActConfig *Sconfig) {
+  if (Sconfig->Ip == NULL) {
+    Sconfig->Ip = malloc(IP_LENGTH + 1);
+    strcpy(Sconfig->Ip, "128.97.11.100");
+    Sconfig->Port = 4660;
+    Sconfig->Api_key = malloc(API_KEY_LENGTH + 1);
+    strcpy(Sconfig->Api_key, "2bb5d6b943fc44f0bb6b467450e07ce7");
+  }
+}
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop_polling(int signo) {
+  stopping = 1;
+}
+
+/* Polls the slaves behind one or more gateways, each over its own
+ * connection (see gateway.h), answering sample store queries in between.
+ * args are an optional -n (a trial run: nothing is uploaded and the zeromq
+ * sockets are local, see open_zmq_sockets), a gateway address and
+ * port, its slaves, then the next gateway and so on; slaves are told apart
+ * by their colons. A gateway that is down is reconnected in the background
+ * while the others go on. Exits on SIGINT or SIGTERM once the read or wait
+ * in progress is over, so a run can be stopped cleanly (pgo.sh relies on
+ * it to get its profile). */
+void poll_gateway(char *prog, int nargs, char *args[], SensorActConfig *Sconfig) {
+  static gateway gw[MAX_GATEWAYS];
+  void *context, *publisher, *responder;
+  uint8_t reply[GATEWAY_FRAME_MAX];
+  sample_time when;
+  struct sigaction stop;
+  int gateways = 0, first = 0;
+  int a, g;
+
+  if (nargs > 0 && strcmp(args[0], "-n") == 0) {
+    upload_samples = 0;
+    args++;
+    nargs--;
+  }
+
+  for (a = 0; a < nargs; a++) {
+    if (strchr(args[a], ':') == NULL) {
+      if (gateways == MAX_GATEWAYS) {
+        fprintf(stderr, "At most %d gateways\n", MAX_GATEWAYS);
+        print_usage_read(prog);
+      }
+      if (a + 1 == nargs || (gateways > 0 && gw[gateways - 1].slaves == 0) ||
+          gateway_init_device(&gw[gateways], args[a], args[a + 1]) < 0)
+        print_usage_read(prog);
+      gateways++;
+      a++;
+      continue;
+    }
+    if (gateways == 0 || gateway_add_slave(&gw[gateways - 1], args[a]) < 0)
+      print_usage_read(prog);
+    if (gw[gateways - 1].slave[gw[gateways - 1].slaves - 1].type == Eaton)
+      set_eaton_sensoract_config(Sconfig);
+  }
+  if (gateways == 0 || gw[gateways - 1].slaves == 0)
+    print_usage_read(prog);
+
+  open_zmq_sockets(&context, &publisher, &responder, !upload_samples);
+
+  memset(&stop, 0, sizeof(stop));
+  stop.sa_handler = stop_polling;
+  sigaction(SIGINT, &stop, NULL);
+  sigaction(SIGTERM, &stop, NULL);
+
+  while (!stopping) {
+    int64_t now = gateway_now();
+    int64_t wait = GATEWAY_MAX_BACKOFF, next;
+    gateway_slave *slave = NULL;
+    int length;
+
+    /* The gateway asked first takes turns, so a busy one can't starve
+     * the rest */
+    for (g = 0; g < gateways && slave == NULL; g++) {
+      slave = gateway_next(&gw[(first + g) % gateways], now, &next);
+      if (slave == NULL && next < wait)
+        wait = next;
+    }
+    if (slave == NULL) {
+      /* Answer sample store queries until the next read is due */
+      if (responder == NULL || sample_store() == NULL ||
+          store_serve(sample_store(), responder, (long) wait) < 0)
+        usleep(wait * 1000);
+      continue;
+    }
+    g = (first + g - 1) % gateways;
+    first = (g + 1) % gateways;
+
+    /* A lost connection leaves the slave due; it is read once
+     * gateway_next has connected again */
+    length = gateway_read(&gw[g], slave, reply);
+    if (length < 0)
+      continue;
+
+    when.ns = gateway_sample_ns(slave, &when.uncertainty);
+    if (publisher != NULL)
+      set_sweep_publisher(publisher, slave->reg_addr);
+    print_received_msg(reply, length, slave->type, &when, Sconfig);
+  }
+  exit(0);
+}
+
+
+/* Pushes the register settings in the plan file to the meters, jobs
+ * gateways at a time, and exits 1 if any meter failed. */
+void push_config(char *prog, char *path, int jobs) {
+  push_plan plan;
+  int failed, d;
+
+  if (jobs < 1)
+    print_usage_config(prog);
+  if (push_load(&plan, path) < 0)
+    exit(1);
+
+  failed = push_run(&plan, jobs, PUSH_DEFAULT_TIMEOUT);
+  printf("%d of %d meters configured\n", plan.devices - failed, plan.devices);
+  for (d = 0; failed && d < plan.devices; d++) {
+    if (plan.device[d].error[0])
+      printf("  failed: %s %s %d\n", plan.device[d].host, plan.device[d].port,
+             plan.device[d].modbus_addr);
+  }
+  push_free(&plan);
+  exit(failed ? 1 : 0);
+}
+
+/* Captures a block at a high rate for a while into memory, then writes
+ * it out (see capture.h). args are the gateway address and port, the
+ * slave, the rate in Hz, the seconds, the output file and optionally the
+ * pipeline depth. Exits 1 if nothing could be captured or written. */
+void run_capture(char *prog, int nargs, char *args[]) {
+  static gateway gw;
+  capture cap;
+  int rate = atoi(args[3]), seconds = atoi(args[4]);
+  int depth = (nargs > 6) ? atoi(args[6]) : CAPTURE_DEPTH;
+
+  if (rate < 1 || rate > CAPTURE_RATE_MAX || seconds < 1 ||
+      seconds > CAPTURE_SECONDS_MAX || depth < 1 || depth > CAPTURE_DEPTH_MAX ||
+      gateway_init_device(&gw, args[0], args[1]) < 0 ||
+      gateway_add_slave(&gw, args[2]) < 0)
+    print_usage_capture(prog);
+
+  if (capture_init(&cap, gw.slave[0].reg_qty / 2, rate * seconds) < 0) {
+    fprintf(stderr, "Can't allocate memory for the capture\n");
+    exit(1);
+  }
+
+  fprintf(stderr, "Capturing slave %d at %d Hz for %d seconds\n",
+          gw.slave[0].modbus_addr, rate, seconds);
+  capture_run(&cap, &gw, &gw.slave[0], rate, depth);
+  gateway_close(&gw);
+  fprintf(stderr, "%d samples of %d, %u lost, %u missed\n", cap.count,
+          rate * seconds, cap.lost, cap.missed);
+
+  if (cap.count == 0 || capture_write(&cap, &gw.slave[0], args[5]) < 0) {
+    capture_free(&cap);
+    exit(1);
+  }
+  capture_free(&cap);
+  exit(0);
+}
 
 void print_usage_top(char *str) {
 fprintf(stderr,"E30 TCP Modbus Client\n");
-fprintf(stderr,"Usage: %s {(q)uery | (r)ead | (w)rite | write(m) | (h)elp} ...\n",str);
+fprintf(stderr,"Usage: %s {(q)uery | (r)ead | (w)rite | write(m) | (c)onfig | capture (x) | (h)elp} ...\n",str);
 fprintf(stderr,"  query  - queries the slave ID\n");
 fprintf(stderr,"  read   - read one or multiple registers\n");
 fprintf(stderr,"  write  - write to a register\n");
 fprintf(stderr,"  writem - write to one or multiple registers\n");
+fprintf(stderr,"  config - push register settings to many meters\n");
+fprintf(stderr,"  capture - read a block at 10-50 Hz for a while into a file\n");
 fprintf(stderr,"  help   - print this message\n"); 
 exit(1);
 }
@@ -283,6 +482,12 @@ void print_usage_query(char *str) {
 void print_usage_read(char *str) {
   fprintf(stderr,"E30 TCP Modbus Client\n");
   fprintf(stderr,"Usage: %s read <Server IP> <Server Port> <Modbus Addr> <Register Addr> [<Qty Registers>]\n", str);
+  fprintf(stderr,"       %s read gateway [-n] <Gateway IP> <Gateway Port> <Slave> ...\n", str);
+  fprintf(stderr,"       %s read gateway [-n] <Serial Device> <Baud>[N|E|O] <Slave> ...\n", str);
+  fprintf(stderr,"       (more gateways, each followed by its slaves, may follow)\n");
+  fprintf(stderr,"  -n: keep the samples local, upload nothing\n");
+  fprintf(stderr,"  Slave: <Modbus Addr>:<Block>[:<Interval ms>[:<Timeout ms>[:<Hedges>]]]\n");
+  fprintf(stderr,"  Block: eaton, power, powerfactor or current\n");
   exit(1); 
 }
 
@@ -298,16 +503,20 @@ void print_usage_writem(char *str) {
   exit(1); 
 }
 
+void print_usage_config(char *str) {
+  fprintf(stderr,"E30 TCP Modbus Client\n");
+  fprintf(stderr,"Usage: %s config <Plan File> [<Gateways at once>]\n", str);
+  fprintf(stderr,"  Plan file lines: <Gateway IP> <Gateway Port> <Modbus Addr> <Reg>=<Val>[,<Val>...] ...\n");
+  fprintf(stderr,"  Only registers that differ are written, and are read back\n");
+  exit(1);
+}
+
 int prepare_msg_query(int argc, char* argv[], char* buf, 
                       struct sockaddr_in *pServAddr) {
   uint16_t servPort;            /* Server port */
   char *servIP;                 /* Server IP address (dotted quad) */
   int bufLen;                   /* Length of string to echo */
   uint8_t modbus_addr;          /* 8-bit modbus addr */
-  uint32_t crc_temp;
-  uint32_t crc_offset;
-  
-  modbus_req_report_slaveid* req_msg = NULL;
 
   servIP = argv[2];             /* First arg: server IP address */ 
   servPort = atoi(argv[3]);     /* Use given port, if any */ 
@@ -317,18 +526,7 @@ int prepare_msg_query(int argc, char* argv[], char* buf,
   pServAddr->sin_addr.s_addr = inet_addr(servIP); /* Server IP address */
   pServAddr->sin_port        = htons(servPort);   /* Server port */
 
-  req_msg = (modbus_req_report_slaveid*) buf;
-  req_msg->modbus_addr = modbus_addr;
-  req_msg->modbus_func = MODBUS_FUNC_REPORT_SLAVEID;
-
-  /* Calculate CRC16 for the request msg */
-  crc_offset = sizeof(modbus_req_report_slaveid); 
-  crc_temp = calc_crc16((uint8_t*) buf, crc_offset); 
-  buf[crc_offset]   = (uint8_t) crc_temp & 0x0ff; /* lower 8bit */
-  buf[crc_offset+1] = (uint8_t) (crc_temp >> 8) & 0x0ff;  /* upper 8bit */
-  buf[crc_offset+2] = 0; /* end of string */
-
-  bufLen = crc_offset + CRC16_SIZE;
+  bufLen = modbus_frame_query((uint8_t*) buf, modbus_addr);
 
   return bufLen; 
 }
@@ -339,13 +537,9 @@ int prepare_msg_read(int argc, char* argv[], char* buf,
   char *servIP;                 /* Server IP address (dotted quad) */
   int bufLen;                   /* Length of string to echo */
   uint8_t modbus_addr;          /* 8-bit modbus addr */
-  uint32_t crc_temp;
-  uint32_t crc_offset;
   uint16_t reg_addr;            /* 16-bit register addr */
   uint16_t reg_qty;             /* quantity of registers to read (1-125) */
 
-  modbus_req_read_reg* req_msg = NULL;
-
   servIP = argv[2];         /* First arg: server IP address (dotted quad) */
   servPort = atoi(argv[3]); /* Use given port, if any */
   modbus_addr = (uint8_t) atoi(argv[4]);   /* modbus address */
@@ -367,21 +561,7 @@ int prepare_msg_read(int argc, char* argv[], char* buf,
     reg_qty = MODBUS_REG_READ_QTY_DEFAULT;
   }
 
-  /* Fill in each field of buf */
-  req_msg = (modbus_req_read_reg*) buf;
-  req_msg->modbus_addr = modbus_addr;
-  req_msg->modbus_func = MODBUS_FUNC_READ_REG;
-  req_msg->modbus_reg_addr = htons(reg_addr);
-  req_msg->modbus_reg_qty  = htons(reg_qty);
-
-  /* Calculate CRC16 for the request msg */
-  crc_offset = sizeof(modbus_req_read_reg);
-  crc_temp = calc_crc16((uint8_t*) buf, crc_offset);
-  buf[crc_offset]   = (uint8_t) crc_temp & 0x0ff; /* lower 8bit */
-  buf[crc_offset+1] = (uint8_t) (crc_temp >> 8) & 0x0ff;  /* upper 8bit */
-  buf[crc_offset+2] = '\0'; /* end of string */
-
-  bufLen = crc_offset + CRC16_SIZE; 
+  bufLen = modbus_frame_read((uint8_t*) buf, modbus_addr, reg_addr, reg_qty);
 
   return bufLen; 
 }
@@ -392,13 +572,9 @@ int prepare_msg_write(int argc, char* argv[], char* buf,
   char *servIP;                 /* Server IP address (dotted quad) */
   int bufLen;                   /* Length of string to echo */
   uint8_t modbus_addr;          /* 8-bit modbus addr */
-  uint32_t crc_temp;
-  uint32_t crc_offset;
   uint16_t reg_addr;            /* 16-bit register addr */
   uint16_t reg_val;             /* 16-bit register value to write with */
 
-  modbus_req_write_reg* req_msg      = NULL;
-
   servIP = argv[2];         /* First arg: server IP address (dotted quad) */
   servPort = atoi(argv[3]); /* Use given port, if any */
   modbus_addr = (uint8_t) atoi(argv[4]);   /* modbus address */
@@ -409,22 +585,7 @@ int prepare_msg_write(int argc, char* argv[], char* buf,
   pServAddr->sin_addr.s_addr = inet_addr(servIP); /* Server IP address */
   pServAddr->sin_port        = htons(servPort);   /* Server port */
 
-  /* Fill in each field of buf */
-  req_msg = (modbus_req_write_reg*) buf;
-  req_msg->modbus_addr = modbus_addr;
-  req_msg->modbus_func = MODBUS_FUNC_WRITE_REG;
-  req_msg->modbus_reg_addr = htons(reg_addr);
-  req_msg->modbus_reg_val  = htons(reg_val);
-
-  /* CRC: first lower 8-bit, then upper 8-bit */
-  /* Exception to Big-endianess */
-  crc_offset = sizeof(modbus_req_write_reg);
-  crc_temp = calc_crc16((uint8_t*) buf, crc_offset);
-  buf[crc_offset]   = (uint8_t) crc_temp & 0x0ff; /* lower 8bit */
-  buf[crc_offset+1] = (uint8_t) (crc_temp >> 8) & 0x0ff;  /* upper 8bit */
-  buf[crc_offset+2] = '\0'; /* end of string */
-
-  bufLen = crc_offset + CRC16_SIZE;
+  bufLen = modbus_frame_write((uint8_t*) buf, modbus_addr, reg_addr, reg_val);
 
   return bufLen; 
 }
@@ -435,15 +596,11 @@ int prepare_msg_writem(int argc, char* argv[], char* buf,
   char *servIP;                 /* Server IP address (dotted quad) */
   int bufLen;                   /* Length of string to echo */
   uint8_t modbus_addr;          /* 8-bit modbus addr */
-  uint32_t crc_temp;
-  uint32_t crc_offset;
   uint16_t reg_addr;            /* 16-bit register addr */
   uint16_t reg_qty;             /* quantity of registers to write */
-  uint16_t reg_val;             /* 16-bit register value to write with */
+  uint16_t reg_vals[MODBUS_REG_READ_QTY_MAX]; /* values to write with */
   int c;
 
-  modbus_req_write_multireg* req_msg = NULL;
-
   servIP   = argv[2];       /* First arg: server IP address (dotted quad) */
   servPort = atoi(argv[3]); /* Use given port, if any */
   modbus_addr = (uint8_t) atoi(argv[4]);  /* modbus address */
@@ -460,28 +617,17 @@ int prepare_msg_writem(int argc, char* argv[], char* buf,
     fprintf(stderr, "<Register Qty> and number of registers <Val 1>, <Val 2>, ... should match. \n");
     exit(1);
   }
+  if (reg_qty > MODBUS_REG_READ_QTY_MAX) {
+    fprintf(stderr, "At most %d registers can be written at once.\n",
+            MODBUS_REG_READ_QTY_MAX);
+    exit(1);
+  }
 
-  /* Fill in each field of buf */
-  req_msg = (modbus_req_write_multireg*) buf;
-  req_msg->modbus_addr = modbus_addr;
-  req_msg->modbus_func = MODBUS_FUNC_WRITE_MULTIREG;
-  req_msg->modbus_reg_addr = htons(reg_addr);
-  req_msg->modbus_reg_qty  = htons(reg_qty);
-  req_msg->modbus_val_bytes = (uint8_t) 2 * reg_qty;
   for (c = 0; c < reg_qty; c++) {
-    reg_val = (uint16_t) atoi(argv[ARGS_WRITEM_REGVAL_POS + c]);
-    req_msg->modbus_reg_val[c] = htons(reg_val);
+    reg_vals[c] = (uint16_t) atoi(argv[ARGS_WRITEM_REGVAL_POS + c]);
   }
-
-  /* CRC: first lower 8-bit, then upper 8-bit */
-  /* Exception to Big-endianess */
-  crc_offset = sizeof(modbus_req_write_multireg) + 2 * reg_qty;
-  crc_temp = calc_crc16((uint8_t*) buf, crc_offset);
-  buf[crc_offset]   = (uint8_t) crc_temp & 0x0ff; /* lower 8bit */
-  buf[crc_offset+1] = (uint8_t) (crc_temp >> 8) & 0x0ff;  /* upper 8bit */
-  buf[crc_offset+2] = '\0'; /* end of string */
-
-  bufLen = crc_offset + CRC16_SIZE;
+  bufLen = modbus_frame_writem((uint8_t*) buf, modbus_addr, reg_addr,
+                               reg_vals, reg_qty);
 
   return bufLen; 
 }
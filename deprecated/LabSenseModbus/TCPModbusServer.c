@@ -0,0 +1,122 @@
+#define _GNU_SOURCE
+#include <stdio.h>      /* for printf() and fprintf() */
+#include <sys/socket.h> /* for socket(), bind(), and connect() */
+#include <arpa/inet.h>  /* for sockaddr_in and inet_ntoa() */
+#include <stdlib.h>     /* for atoi() and exit() */
+#include <string.h>     /* for memset() */
+#include <unistd.h>     /* for close() */
+#include <stdint.h>
+#include <fcntl.h>      /* for O_RDWR and O_NOCTTY */
+#include <termios.h>    /* for cfmakeraw() */
+
+#include "E30ModbusMsg.h"
+
+#define MAXPENDING 5    /* Maximum outstanding connection requests */
+
+void HandleTCPClient(int clntSocket, uint8_t first_addr, uint8_t last_addr);
+void SimulateBaudRate(int baud);
+void ServeSerial(int baud, uint8_t first_addr, uint8_t last_addr);
+
+/* Simulates a Veris E30 (or anything else answering register reads) behind
+ * the TCP gateway, for testing the client and as the profiling workload of
+ * the release build. Read replies carry slowly varying float values. With
+ * a range of Modbus addresses, it plays a gateway to several meters. With
+ * -s, it plays meters on a serial line instead: the far end of a pseudo
+ * terminal, whose name it prints, replying at the given baud rate. */
+int main(int argc, char *argv[])
+{
+    int servSock;                    /* Socket descriptor for server */
+    int clntSock;                    /* Socket descriptor for client */
+    struct sockaddr_in servAddr;     /* Local address */
+    struct sockaddr_in clntAddr;     /* Client address */
+    unsigned short servPort;         /* Server port */
+    unsigned int clntLen;            /* Length of client address data structure */
+    int first_addr, last_addr;       /* Modbus addresses of the simulated devices */
+    int connections;                 /* Connections to serve, 0 for no limit */
+    int served = 0;
+    int reuse = 1;
+
+    if (argc != 3 && argc != 4)
+    {
+        fprintf(stderr, "E30 TCP Modbus Server (simulator)\n");
+        fprintf(stderr, "Usage: %s <Server Port> <Modbus Addr>[-<Last Addr>] [<Connections>]\n", argv[0]);
+        fprintf(stderr, "       %s -s <Baud> <Modbus Addr>[-<Last Addr>]\n", argv[0]);
+        exit(1);
+    }
+
+    if (strcmp(argv[1], "-s") == 0 && argc == 4)
+    {
+        if (sscanf(argv[3], "%d-%d", &first_addr, &last_addr) != 2)
+            last_addr = first_addr = atoi(argv[3]);
+        ServeSerial(atoi(argv[2]), (uint8_t) first_addr, (uint8_t) last_addr);
+    }
+
+    servPort = atoi(argv[1]);
+    if (sscanf(argv[2], "%d-%d", &first_addr, &last_addr) != 2)
+        last_addr = first_addr = atoi(argv[2]);
+    connections = (argc == 4) ? atoi(argv[3]) : 0;
+
+    /* Create socket for incoming connections */
+    if ((servSock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+        DieWithError("socket() failed");
+
+    /* Restarting the simulator should not wait out the old connections */
+    setsockopt(servSock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    /* Construct local address structure */
+    memset(&servAddr, 0, sizeof(servAddr));
+    servAddr.sin_family = AF_INET;
+    servAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    servAddr.sin_port = htons(servPort);
+
+    /* Bind to the local address */
+    if (bind(servSock, (struct sockaddr *) &servAddr, sizeof(servAddr)) < 0)
+        DieWithError("bind() failed");
+
+    /* Mark the socket so it will listen for incoming connections */
+    if (listen(servSock, MAXPENDING) < 0)
+        DieWithError("listen() failed");
+
+    while (connections == 0 || served < connections)
+    {
+        clntLen = sizeof(clntAddr);
+
+        /* Wait for a client to connect */
+        if ((clntSock = accept(servSock, (struct sockaddr *) &clntAddr,
+                               &clntLen)) < 0)
+            DieWithError("accept() failed");
+
+        printf("Handling client %s\n", inet_ntoa(clntAddr.sin_addr));
+        HandleTCPClient(clntSock, (uint8_t) first_addr, (uint8_t) last_addr);
+        served++;
+    }
+
+    close(servSock);
+    return 0;
+}
+
+/* Serves requests arriving on a new pseudo terminal until killed */
+void ServeSerial(int baud, uint8_t first_addr, uint8_t last_addr)
+{
+    int master, slave;
+    struct termios tio;
+
+    if ((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 ||
+        grantpt(master) < 0 || unlockpt(master) < 0)
+        DieWithError("posix_openpt() failed");
+
+    /* Holding the slave end open keeps the line up between clients */
+    if ((slave = open(ptsname(master), O_RDWR | O_NOCTTY)) < 0)
+        DieWithError("open() of the pseudo terminal failed");
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    printf("Serial line: %s\n", ptsname(master));
+    fflush(stdout);
+
+    SimulateBaudRate(baud);
+    HandleTCPClient(master, first_addr, last_addr);
+    close(slave);
+    exit(0);
+}
@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <math.h>
+#include "aggregate.h"
+
+int aggregate_init(aggregate *agg, int channels, double window, double slide) {
+  size_t cells;
+
+  agg->count = NULL;
+  agg->min = agg->max = agg->sum = agg->sum_squares = NULL;
+  agg->stats.count = NULL;
+  agg->stats.min = agg->stats.max = agg->stats.mean = agg->stats.rms = NULL;
+
+  if (channels <= 0 || window <= 0 || slide <= 0)
+    return 0;
+
+  agg->channels = channels;
+  agg->slide = slide;
+  agg->panes = (int) (window / slide + 0.5);
+  if (agg->panes < 1)
+    agg->panes = 1;
+  agg->pane = -1;
+
+  cells = (size_t) agg->panes * channels;
+  agg->count = (uint32_t *) malloc(cells * sizeof(uint32_t));
+  agg->min = (float *) malloc(cells * sizeof(float));
+  agg->max = (float *) malloc(cells * sizeof(float));
+  agg->sum = (float *) malloc(cells * sizeof(float));
+  agg->sum_squares = (float *) malloc(cells * sizeof(float));
+  agg->stats.count = (uint32_t *) malloc(channels * sizeof(uint32_t));
+  agg->stats.min = (float *) malloc(channels * sizeof(float));
+  agg->stats.max = (float *) malloc(channels * sizeof(float));
+  agg->stats.mean = (float *) malloc(channels * sizeof(float));
+  agg->stats.rms = (float *) malloc(channels * sizeof(float));
+
+  if (!agg->count || !agg->min || !agg->max || !agg->sum ||
+      !agg->sum_squares || !agg->stats.count || !agg->stats.min ||
+      !agg->stats.max || !agg->stats.mean || !agg->stats.rms) {
+    aggregate_free(agg);
+    return 0;
+  }
+  return 1;
+}
+
+void aggregate_free(aggregate *agg) {
+  free(agg->count);
+  free(agg->min);
+  free(agg->max);
+  free(agg->sum);
+  free(agg->sum_squares);
+  free(agg->stats.count);
+  free(agg->stats.min);
+  free(agg->stats.max);
+  free(agg->stats.mean);
+  free(agg->stats.rms);
+  agg->count = NULL;
+  agg->min = agg->max = agg->sum = agg->sum_squares = NULL;
+  agg->stats.count = NULL;
+  agg->stats.min = agg->stats.max = agg->stats.mean = agg->stats.rms = NULL;
+}
+
+static void aggregate_clear_pane(aggregate *agg, int64_t pane) {
+  size_t row = (size_t) (pane % agg->panes) * agg->channels;
+  int c;
+
+  for (c = 0; c < agg->channels; c++) {
+    agg->count[row + c] = 0;
+    agg->min[row + c] = INFINITY;
+    agg->max[row + c] = -INFINITY;
+    agg->sum[row + c] = 0;
+    agg->sum_squares[row + c] = 0;
+  }
+}
+
+/* The loops over the channels. They take restrict pointers so the compiler
+ * can vectorize them without runtime alias checks; the NaN selects also
+ * need -fno-trapping-math (see the Makefile). */
+
+/* Adds one sample vector to a pane. NaN compares false, so it leaves min
+ * and max alone. */
+static void aggregate_pane_add(int channels, const float *restrict values,
+                               uint32_t *restrict count, float *restrict min,
+                               float *restrict max, float *restrict sum,
+                               float *restrict sum_squares) {
+  int c;
+
+  for (c = 0; c < channels; c++) {
+    float value = values[c];
+    float v = (value == value) ? value : 0;
+
+    count[c] += (value == value);
+    min[c] = (value < min[c]) ? value : min[c];
+    max[c] = (value > max[c]) ? value : max[c];
+    sum[c] += v;
+    sum_squares[c] += v * v;
+  }
+}
+
+/* Merges one pane into the window totals */
+static void aggregate_pane_merge(int channels, const uint32_t *restrict count,
+                                 const float *restrict min,
+                                 const float *restrict max,
+                                 const float *restrict sum,
+                                 const float *restrict sum_squares,
+                                 uint32_t *restrict total,
+                                 float *restrict lowest,
+                                 float *restrict highest,
+                                 float *restrict total_sum,
+                                 float *restrict total_squares) {
+  int c;
+
+  for (c = 0; c < channels; c++) {
+    total[c] += count[c];
+    lowest[c] = (min[c] < lowest[c]) ? min[c] : lowest[c];
+    highest[c] = (max[c] > highest[c]) ? max[c] : highest[c];
+    total_sum[c] += sum[c];
+    total_squares[c] += sum_squares[c];
+  }
+}
+
+/* Combines the panes of the window ending with the current pane */
+static void aggregate_close_window(aggregate *agg) {
+  aggregate_stats *stats = &agg->stats;
+  uint32_t *total = stats->count;
+  float *lowest = stats->min;
+  float *highest = stats->max;
+  float *mean = stats->mean;      /* sums until the end */
+  float *rms = stats->rms;
+  int channels = agg->channels;
+  int p, c;
+
+  for (c = 0; c < channels; c++) {
+    total[c] = 0;
+    lowest[c] = INFINITY;
+    highest[c] = -INFINITY;
+    mean[c] = 0;
+    rms[c] = 0;
+  }
+
+  for (p = 0; p < agg->panes; p++) {
+    size_t row = (size_t) p * channels;
+    aggregate_pane_merge(channels, agg->count + row, agg->min + row,
+                         agg->max + row, agg->sum + row,
+                         agg->sum_squares + row,
+                         total, lowest, highest, mean, rms);
+  }
+
+  for (c = 0; c < channels; c++) {
+    if (total[c] > 0) {
+      mean[c] /= total[c];
+      rms[c] = sqrtf(rms[c] / total[c]);
+    }
+    else {
+      lowest[c] = highest[c] = mean[c] = rms[c] = NAN;
+    }
+  }
+
+  stats->end = (agg->pane + 1) * agg->slide;
+  stats->start = stats->end - agg->panes * agg->slide;
+}
+
+const aggregate_stats *aggregate_add(aggregate *agg, const float *values,
+                                     double now) {
+  const aggregate_stats *closed = NULL;
+  int64_t pane = (int64_t) floor(now / agg->slide);
+  size_t row;
+
+  if (agg->pane < 0) {
+    /* First sample: start with empty panes */
+    int64_t p;
+    for (p = 0; p < agg->panes; p++)
+      aggregate_clear_pane(agg, p);
+    agg->pane = pane;
+  }
+  else if (pane > agg->pane) {
+    int64_t p;
+
+    aggregate_close_window(agg);
+    closed = &agg->stats;
+
+    /* Empty the panes that the window slides over, at most all of them */
+    p = (pane - agg->pane > agg->panes) ? pane - agg->panes + 1 : agg->pane + 1;
+    for (; p <= pane; p++)
+      aggregate_clear_pane(agg, p);
+    agg->pane = pane;
+  }
+  /* A sample from before the current pane (clock stepped back) is counted
+   * in the current pane */
+
+  row = (size_t) (agg->pane % agg->panes) * agg->channels;
+  aggregate_pane_add(agg->channels, values, agg->count + row, agg->min + row,
+                     agg->max + row, agg->sum + row, agg->sum_squares + row);
+
+  return closed;
+}
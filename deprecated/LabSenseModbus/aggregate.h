@@ -0,0 +1,62 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+/* Windowed aggregates of a set of channels sampled together: min, max,
+ * mean, RMS and sample count per channel over the last `window` seconds,
+ * produced every `slide` seconds. slide == window gives tumbling windows,
+ * a smaller slide gives sliding ones. Windows are aligned to multiples of
+ * slide since the epoch, so 60 second windows close on the minute.
+ *
+ * A window is kept as window / slide panes of slide seconds. Each pane
+ * holds per channel partial results, one array per statistic, so adding a
+ * sample and closing a window are loops over whole channel vectors. */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct aggregate_stats {
+  double    start;          /* window start and end, seconds */
+  double    end;
+  uint32_t *count;          /* samples per channel */
+  float    *min;            /* statistics per channel; NaN without samples */
+  float    *max;
+  float    *mean;
+  float    *rms;
+} aggregate_stats;
+
+typedef struct aggregate {
+  int       channels;
+  int       panes;          /* window / slide */
+  double    slide;
+  int64_t   pane;           /* number of the current pane; -1 before the first sample */
+
+  /* Partial results, panes rows of channels each */
+  uint32_t *count;
+  float    *min;
+  float    *max;
+  float    *sum;
+  float    *sum_squares;
+
+  aggregate_stats stats;    /* the last window closed */
+} aggregate;
+
+/* Allocates the state for windows of window seconds every slide seconds
+ * (window is rounded to a multiple of slide). Returns 1 on success, 0 if
+ * out of memory or the lengths are not positive. */
+int aggregate_init(aggregate *agg, int channels, double window, double slide);
+void aggregate_free(aggregate *agg);
+
+/* Adds one sample of every channel taken at time now (seconds). NaN values
+ * are left out. Returns the statistics of the window that ended before
+ * this sample if one did, NULL otherwise. */
+const aggregate_stats *aggregate_add(aggregate *agg, const float *values,
+                                     double now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,551 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "archive.h"
+
+#define ARCHIVE_MAGIC 0x31524f47  /* "GOR1" */
+
+/* Chunk header in the data file; the first sample's value opens the bit
+ * stream that follows */
+typedef struct archive_chunk_header {
+  uint32_t  magic;
+  uint32_t  count;
+  int64_t   start;
+  int64_t   end;
+  uint32_t  bits;
+  uint32_t  reserved;
+} archive_chunk_header;
+
+/* Bit streams, most significant bit first */
+static void put_bits(uint8_t *buf, size_t *bits, uint64_t value, int n) {
+  while (n > 0) {
+    size_t at = *bits;
+    int room = 8 - (int) (at & 7);
+    int take = (n < room) ? n : room;
+    uint8_t part = (uint8_t) ((value >> (n - take)) & ((1u << take) - 1));
+
+    buf[at >> 3] |= (uint8_t) (part << (room - take));
+    *bits += take;
+    n -= take;
+  }
+}
+
+typedef struct bit_reader {
+  const uint8_t *buf;
+  size_t  bits;
+  size_t  at;
+} bit_reader;
+
+static int get_bits(bit_reader *in, int n, uint64_t *value) {
+  uint64_t result = 0;
+
+  if (in->at + n > in->bits)
+    return 0;
+
+  while (n > 0) {
+    int room = 8 - (int) (in->at & 7);
+    int take = (n < room) ? n : room;
+    uint8_t byte = in->buf[in->at >> 3];
+
+    result = (result << take) |
+             ((byte >> (room - take)) & ((1u << take) - 1));
+    in->at += take;
+    n -= take;
+  }
+  *value = result;
+  return 1;
+}
+
+static int get_bit(bit_reader *in, int *bit) {
+  uint64_t value;
+
+  if (!get_bits(in, 1, &value))
+    return 0;
+  *bit = (int) value;
+  return 1;
+}
+
+static uint32_t float_bits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static float bits_float(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/* Sign-extends the low n bits */
+static int64_t sign_extend(uint64_t value, int n) {
+  uint64_t sign = (uint64_t) 1 << (n - 1);
+  return (int64_t) ((value ^ sign) - sign);
+}
+
+/* Delta-of-delta buckets: control prefix, its length and the payload bits.
+ * Sized for jitter in milliseconds around a steady sampling period. */
+static const struct {
+  uint32_t  prefix;
+  int       prefix_bits;
+  int       value_bits;
+} dod_buckets[] = {
+  { 0x2, 2, 7 },
+  { 0x6, 3, 9 },
+  { 0xe, 4, 12 },
+  { 0xf, 4, 32 },
+};
+#define DOD_BUCKETS (sizeof(dod_buckets) / sizeof(dod_buckets[0]))
+
+static void encode_time(archive_writer *writer, int64_t time) {
+  int64_t delta = time - writer->last_time;
+  int64_t dod = delta - writer->last_delta;
+  size_t b;
+
+  writer->last_time = time;
+  writer->last_delta = delta;
+
+  if (dod == 0) {
+    put_bits(writer->buf, &writer->bits, 0, 1);
+    return;
+  }
+
+  for (b = 0; b < DOD_BUCKETS; b++) {
+    int n = dod_buckets[b].value_bits;
+    int64_t limit = (int64_t) 1 << (n - 1);
+
+    if (dod >= -limit && dod < limit) {
+      put_bits(writer->buf, &writer->bits, dod_buckets[b].prefix,
+               dod_buckets[b].prefix_bits);
+      put_bits(writer->buf, &writer->bits, (uint64_t) dod, n);
+      return;
+    }
+  }
+}
+
+static void encode_value(archive_writer *writer, uint32_t value) {
+  uint32_t xor = value ^ writer->last_value;
+  int leading, trailing, meaningful;
+
+  writer->last_value = value;
+
+  if (xor == 0) {
+    put_bits(writer->buf, &writer->bits, 0, 1);
+    return;
+  }
+
+  leading = __builtin_clz(xor);
+  trailing = __builtin_ctz(xor);
+
+  put_bits(writer->buf, &writer->bits, 1, 1);
+
+  /* Reuse the previous window when the meaningful bits fit in it */
+  if (writer->last_leading >= 0 && leading >= writer->last_leading &&
+      trailing >= writer->last_trailing) {
+    meaningful = 32 - writer->last_leading - writer->last_trailing;
+    put_bits(writer->buf, &writer->bits, 0, 1);
+    put_bits(writer->buf, &writer->bits, xor >> writer->last_trailing,
+             meaningful);
+    return;
+  }
+
+  meaningful = 32 - leading - trailing;
+  put_bits(writer->buf, &writer->bits, 1, 1);
+  put_bits(writer->buf, &writer->bits, leading, 5);
+  put_bits(writer->buf, &writer->bits, meaningful - 1, 5);
+  put_bits(writer->buf, &writer->bits, xor >> trailing, meaningful);
+
+  writer->last_leading = leading;
+  writer->last_trailing = trailing;
+}
+
+static void archive_path(char *path, const char *dir, const char *name,
+                         const char *suffix) {
+  snprintf(path, ARCHIVE_PATH_LENGTH, "%s/%s.%s", dir, name, suffix);
+}
+
+static void start_chunk(archive_writer *writer) {
+  writer->count = 0;
+  writer->bits = 0;
+  writer->last_delta = 0;
+  writer->last_leading = -1;
+  writer->last_trailing = 0;
+  memset(writer->buf, 0, sizeof(writer->buf));
+}
+
+/* Drops data written after the last indexed chunk, left by a crash between
+ * writing a chunk and its index entry */
+static int recover(archive_writer *writer, const char *name) {
+  struct stat index_stat, data_stat;
+  archive_index_entry last;
+  uint64_t end = 0;
+  off_t entries;
+
+  if (fstat(writer->index_fd, &index_stat) < 0 ||
+      fstat(writer->data_fd, &data_stat) < 0)
+    return 0;
+
+  /* A torn index entry goes too */
+  entries = index_stat.st_size / sizeof(archive_index_entry);
+  if (entries * (off_t) sizeof(archive_index_entry) != index_stat.st_size &&
+      ftruncate(writer->index_fd, entries * sizeof(archive_index_entry)) < 0)
+    return 0;
+
+  if (entries > 0) {
+    if (pread(writer->index_fd, &last, sizeof(last),
+              (entries - 1) * sizeof(archive_index_entry)) != sizeof(last))
+      return 0;
+    end = last.offset + last.length;
+  }
+
+  if ((uint64_t) data_stat.st_size > end) {
+    fprintf(stderr, "archive %s: dropping %lu unindexed bytes\n", name,
+            (unsigned long) (data_stat.st_size - end));
+    if (ftruncate(writer->data_fd, end) < 0)
+      return 0;
+  }
+  else if ((uint64_t) data_stat.st_size < end) {
+    fprintf(stderr, "archive %s: data file is shorter than its index\n",
+            name);
+    return 0;
+  }
+
+  writer->data_size = end;
+  return 1;
+}
+
+archive_writer *archive_open(const char *dir, const char *name) {
+  char path[ARCHIVE_PATH_LENGTH];
+  archive_writer *writer;
+
+  if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+    fprintf(stderr, "archive: cannot create %s: %s\n", dir, strerror(errno));
+    return NULL;
+  }
+
+  writer = (archive_writer *) malloc(sizeof(archive_writer));
+  if (!writer)
+    return NULL;
+
+  archive_path(path, dir, name, "dat");
+  writer->data_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  archive_path(path, dir, name, "idx");
+  writer->index_fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+
+  if (writer->data_fd < 0 || writer->index_fd < 0 || !recover(writer, name)) {
+    fprintf(stderr, "archive %s: cannot open: %s\n", name, strerror(errno));
+    if (writer->data_fd >= 0)
+      close(writer->data_fd);
+    if (writer->index_fd >= 0)
+      close(writer->index_fd);
+    free(writer);
+    return NULL;
+  }
+
+  start_chunk(writer);
+  return writer;
+}
+
+int archive_flush(archive_writer *writer) {
+  archive_chunk_header header;
+  archive_index_entry entry;
+  struct iovec chunk[2];
+  size_t bytes = (writer->bits + 7) / 8;
+
+  if (writer->count == 0)
+    return 0;
+
+  header.magic = ARCHIVE_MAGIC;
+  header.count = writer->count;
+  header.start = writer->start;
+  header.end = writer->last_time;
+  header.bits = (uint32_t) writer->bits;
+  header.reserved = 0;
+
+  entry.start = header.start;
+  entry.end = header.end;
+  entry.offset = writer->data_size;
+  entry.length = (uint32_t) (sizeof(header) + bytes);
+  entry.count = header.count;
+
+  chunk[0].iov_base = &header;
+  chunk[0].iov_len = sizeof(header);
+  chunk[1].iov_base = writer->buf;
+  chunk[1].iov_len = bytes;
+
+  /* Data first: readers never see a chunk before its index entry */
+  if (writev(writer->data_fd, chunk, 2) != (ssize_t) entry.length) {
+    fprintf(stderr, "archive: cannot write chunk: %s\n", strerror(errno));
+    if (ftruncate(writer->data_fd, writer->data_size) < 0)
+      fprintf(stderr, "archive: cannot drop partial chunk\n");
+    return -1;
+  }
+  if (write(writer->index_fd, &entry, sizeof(entry)) != sizeof(entry)) {
+    fprintf(stderr, "archive: cannot index chunk: %s\n", strerror(errno));
+    if (ftruncate(writer->data_fd, writer->data_size) < 0)
+      fprintf(stderr, "archive: cannot drop unindexed chunk\n");
+    return -1;
+  }
+
+  writer->data_size += entry.length;
+  start_chunk(writer);
+  return 0;
+}
+
+int archive_append(archive_writer *writer, int64_t time, float value) {
+  uint32_t bits = float_bits(value);
+  int result = 0;
+
+  if (writer->count > 0) {
+    int64_t dod = (time - writer->last_time) - writer->last_delta;
+
+    if (time < writer->last_time)
+      return 0;
+
+    /* Close the chunk when full, or when the gap is too big to encode */
+    if (writer->count >= ARCHIVE_CHUNK_SAMPLES ||
+        time - writer->start >= ARCHIVE_CHUNK_SPAN_MS ||
+        dod < INT32_MIN || dod > INT32_MAX) {
+      result = archive_flush(writer);
+      /* The chunk is lost rather than overrunning the buffer */
+      if (result < 0)
+        start_chunk(writer);
+    }
+  }
+
+  if (writer->count == 0) {
+    writer->start = time;
+    writer->last_time = time;
+    writer->last_value = bits;
+    put_bits(writer->buf, &writer->bits, bits, 32);
+  }
+  else {
+    encode_time(writer, time);
+    encode_value(writer, bits);
+  }
+  writer->count++;
+  return result;
+}
+
+void archive_close(archive_writer *writer) {
+  if (!writer)
+    return;
+  archive_flush(writer);
+  close(writer->data_fd);
+  close(writer->index_fd);
+  free(writer);
+}
+
+archive_reader *archive_reader_open(const char *dir, const char *name) {
+  archive_reader *reader;
+
+  reader = (archive_reader *) calloc(1, sizeof(archive_reader));
+  if (!reader)
+    return NULL;
+
+  archive_path(reader->data_path, dir, name, "dat");
+  archive_path(reader->index_path, dir, name, "idx");
+  reader->data_fd = open(reader->data_path, O_RDONLY);
+  reader->index_fd = open(reader->index_path, O_RDONLY);
+
+  if (reader->data_fd < 0 || reader->index_fd < 0) {
+    archive_reader_close(reader);
+    return NULL;
+  }
+  return reader;
+}
+
+static void unmap_index(archive_reader *reader) {
+  if (reader->index)
+    munmap((void *) reader->index, reader->index_size);
+  reader->index = NULL;
+  reader->index_size = 0;
+}
+
+void archive_reader_close(archive_reader *reader) {
+  if (!reader)
+    return;
+  unmap_index(reader);
+  if (reader->data_fd >= 0)
+    close(reader->data_fd);
+  if (reader->index_fd >= 0)
+    close(reader->index_fd);
+  free(reader);
+}
+
+/* Maps the index again when the writer has added chunks since */
+static int map_index(archive_reader *reader, size_t *entries) {
+  struct stat st;
+  size_t size;
+  void *map;
+
+  if (fstat(reader->index_fd, &st) < 0)
+    return 0;
+  size = (st.st_size / sizeof(archive_index_entry)) *
+         sizeof(archive_index_entry);
+
+  if (size != reader->index_size) {
+    unmap_index(reader);
+    if (size > 0) {
+      map = mmap(NULL, size, PROT_READ, MAP_SHARED, reader->index_fd, 0);
+      if (map == MAP_FAILED)
+        return 0;
+      reader->index = (const archive_index_entry *) map;
+      reader->index_size = size;
+    }
+  }
+
+  *entries = size / sizeof(archive_index_entry);
+  return 1;
+}
+
+/* Decodes one chunk, keeping the samples in [start, end) */
+static int decode_chunk(const archive_chunk_header *header, int64_t start,
+                        int64_t end, int64_t *times, float *values, int max) {
+  bit_reader in;
+  uint64_t raw;
+  int64_t time = header->start;
+  int64_t delta = 0;
+  uint32_t value;
+  int leading = 0, trailing = 0;
+  int copied = 0;
+  uint32_t i;
+
+  in.buf = (const uint8_t *) (header + 1);
+  in.bits = header->bits;
+  in.at = 0;
+
+  if (!get_bits(&in, 32, &raw))
+    return -1;
+  value = (uint32_t) raw;
+
+  for (i = 0; i < header->count && copied < max; i++) {
+    int bit;
+
+    if (i > 0) {
+      /* Timestamp */
+      int64_t dod = 0;
+      size_t b;
+
+      if (!get_bit(&in, &bit))
+        return -1;
+      if (bit) {
+        uint32_t prefix = 1;
+        int prefix_bits = 1;
+
+        for (b = 0; b < DOD_BUCKETS; b++) {
+          while (prefix_bits < dod_buckets[b].prefix_bits) {
+            if (!get_bit(&in, &bit))
+              return -1;
+            prefix = (prefix << 1) | bit;
+            prefix_bits++;
+          }
+          if (prefix == dod_buckets[b].prefix)
+            break;
+        }
+        if (b == DOD_BUCKETS ||
+            !get_bits(&in, dod_buckets[b].value_bits, &raw))
+          return -1;
+        dod = sign_extend(raw, dod_buckets[b].value_bits);
+      }
+      delta += dod;
+      time += delta;
+
+      /* Value */
+      if (!get_bit(&in, &bit))
+        return -1;
+      if (bit) {
+        int meaningful;
+
+        if (!get_bit(&in, &bit))
+          return -1;
+        if (bit) {
+          if (!get_bits(&in, 5, &raw))
+            return -1;
+          leading = (int) raw;
+          if (!get_bits(&in, 5, &raw))
+            return -1;
+          meaningful = (int) raw + 1;
+          trailing = 32 - leading - meaningful;
+          if (trailing < 0)
+            return -1;
+        }
+        else
+          meaningful = 32 - leading - trailing;
+        if (!get_bits(&in, meaningful, &raw))
+          return -1;
+        value ^= (uint32_t) raw << trailing;
+      }
+    }
+
+    if (time >= end)
+      break;
+    if (time >= start) {
+      times[copied] = time;
+      values[copied] = bits_float(value);
+      copied++;
+    }
+  }
+  return copied;
+}
+
+int archive_read(archive_reader *reader, int64_t start, int64_t end,
+                 int64_t *times, float *values, int max) {
+  long page = sysconf(_SC_PAGESIZE);
+  size_t entries, low, high;
+  int copied = 0;
+
+  if (!map_index(reader, &entries))
+    return -1;
+
+  /* First chunk ending at or after start */
+  low = 0;
+  high = entries;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (reader->index[mid].end < start)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  for (; low < entries && copied < max; low++) {
+    const archive_index_entry *entry = &reader->index[low];
+    off_t base = (off_t) (entry->offset & ~(uint64_t) (page - 1));
+    size_t skew = (size_t) (entry->offset - base);
+    const archive_chunk_header *header;
+    void *map;
+    int n;
+
+    if (entry->start >= end)
+      break;
+
+    map = mmap(NULL, skew + entry->length, PROT_READ, MAP_SHARED,
+               reader->data_fd, base);
+    if (map == MAP_FAILED)
+      return -1;
+
+    header = (const archive_chunk_header *) ((const uint8_t *) map + skew);
+    if (header->magic != ARCHIVE_MAGIC ||
+        sizeof(*header) + (header->bits + 7) / 8 > entry->length) {
+      fprintf(stderr, "archive: bad chunk at %lu in %s\n",
+              (unsigned long) entry->offset, reader->data_path);
+      n = -1;
+    }
+    else
+      n = decode_chunk(header, start, end, times + copied, values + copied,
+                       max - copied);
+    munmap(map, skew + entry->length);
+
+    if (n < 0)
+      return -1;
+    copied += n;
+  }
+  return copied;
+}
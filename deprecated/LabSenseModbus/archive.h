@@ -0,0 +1,92 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+/* Compressed on-disk history of the meter channels. Each channel is an
+ * append-only data file of chunks (<dir>/<name>.dat) and an index with one
+ * entry per chunk (<dir>/<name>.idx). A chunk holds up to
+ * ARCHIVE_CHUNK_SAMPLES samples or ARCHIVE_CHUNK_SPAN_MS of time, encoded
+ * as in Facebook's Gorilla: timestamps as delta-of-deltas, values XOR'ed
+ * with the previous one so unchanged and slowly changing readings take a
+ * bit or a few. A steady 1 Hz meter channel takes around 2 bytes a sample.
+ *
+ * The writer keeps the open chunk in memory and writes it out whole, data
+ * first, then its index entry; readers only trust chunks in the index, so
+ * a crash loses at most the open chunk. Readers map the index and, for a
+ * query, only the chunks that overlap it, and decode them on demand. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARCHIVE_CHUNK_SAMPLES 4096
+#define ARCHIVE_CHUNK_SPAN_MS (10 * 60 * 1000)
+/* Worst case: 36 bits of timestamp and 44 bits of value per sample */
+#define ARCHIVE_CHUNK_BYTES (ARCHIVE_CHUNK_SAMPLES * 10 + 8)
+#define ARCHIVE_PATH_LENGTH 256
+
+/* Index entry, one per chunk */
+typedef struct archive_index_entry {
+  int64_t   start;          /* first and last timestamp, milliseconds */
+  int64_t   end;
+  uint64_t  offset;         /* of the chunk header in the data file */
+  uint32_t  length;         /* bytes, header included */
+  uint32_t  count;          /* samples */
+} archive_index_entry;
+
+typedef struct archive_writer {
+  int       data_fd;
+  int       index_fd;
+  uint64_t  data_size;
+
+  /* The open chunk */
+  uint32_t  count;
+  int64_t   start;
+  int64_t   last_time;
+  int64_t   last_delta;
+  uint32_t  last_value;
+  int       last_leading;   /* zero bits around the last XOR; -1 for none */
+  int       last_trailing;
+  size_t    bits;
+  uint8_t   buf[ARCHIVE_CHUNK_BYTES];
+} archive_writer;
+
+typedef struct archive_reader {
+  char      data_path[ARCHIVE_PATH_LENGTH];
+  char      index_path[ARCHIVE_PATH_LENGTH];
+  int       data_fd;
+  int       index_fd;
+  const archive_index_entry *index;   /* mapped index */
+  size_t    index_size;               /* bytes mapped */
+} archive_reader;
+
+/* Opens (creating if needed) the archive of a channel for appending.
+ * Returns NULL and prints why if it cannot. */
+archive_writer *archive_open(const char *dir, const char *name);
+
+/* Appends a sample. Timestamps must not go backwards. Returns 0, or -1 if
+ * a full chunk could not be written out. */
+int archive_append(archive_writer *writer, int64_t time, float value);
+
+/* Writes out the open chunk, if any. Returns 0 or -1. */
+int archive_flush(archive_writer *writer);
+
+/* Flushes and closes */
+void archive_close(archive_writer *writer);
+
+/* Opens a channel's archive for reading. Returns NULL if there is none. */
+archive_reader *archive_reader_open(const char *dir, const char *name);
+void archive_reader_close(archive_reader *reader);
+
+/* Copies the samples with start <= time < end, oldest first, at most max
+ * of them. Returns the number copied, or -1 on an I/O error. */
+int archive_read(archive_reader *reader, int64_t start, int64_t end,
+                 int64_t *times, float *values, int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
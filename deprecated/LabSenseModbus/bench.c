@@ -0,0 +1,476 @@
+/* Microbenchmarks of the kernels on the ingest path, on fixed data: the
+ * CRC and frame codec, the SensorAct and Cosm formatters, the Zwave
+ * publish encode, and the sample filters, store and on-disk spool.
+ *
+ * Usage: labsensebench [-o results] [-b baseline] [-t percent] [kernel ...]
+ *
+ * Runs the named kernels (all of them by default) and writes one line per
+ * kernel, "name ns_per_op ops", to results (stdout by default); lines
+ * starting with # are comments. With -b, compares each kernel with its
+ * line in a baseline written earlier the same way, and exits with 1 if
+ * any is more than percent (10 by default) slower. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "labsense.h"
+#include "E30ModbusMsg.h"
+#include "SensorAct/formatter.h"
+#include "Cosm/Cformatter.h"
+
+#define BENCH_ROUNDS      5
+#define BENCH_MIN_NS      20000000  /* calibrated length of a round */
+#define BENCH_MAX_KERNELS 32
+
+#define VERIS_REGS        42        /* as the client reads a Veris block */
+#define VERIS_FLOATS      (VERIS_REGS / 2)
+#define EATON_FLOATS      18
+
+/* Fixed data, filled by make_datasets() */
+static uint8_t  veris_reply[3 + 2 * VERIS_REGS + CRC16_SIZE + 1];
+static int      veris_reply_length;
+static uint32_t veris_values[VERIS_FLOATS];
+static uint32_t eaton_values[EATON_FLOATS];
+static float    sweep[NUMBER_CHANNELS];
+
+static deadband_filter deadband;
+static aggregate       agg;
+static channel_store  *store;
+static archive_writer *archive;
+static rollup         *rollups;
+static char            spool_dir[] = "/tmp/labsensebench.XXXXXX";
+
+/* Sample clock of the filter, store and spool kernels, in milliseconds,
+ * so their samples stay in time order across rounds */
+static int64_t now_ms = 1400000000000LL;
+
+static volatile uint32_t sink;
+
+typedef void (*bench_fn)(long ops);
+
+typedef struct bench_kernel {
+  const char *name;
+  bench_fn    run;
+} bench_kernel;
+
+typedef struct bench_result {
+  char    name[32];
+  double  ns_per_op;
+  long    ops;
+} bench_result;
+
+static uint32_t lcg(void) {
+  static uint32_t state = 12345;
+  state = state * 1103515245 + 12345;
+  return state >> 8;
+}
+
+/* Meter-like levels: a few hundred watts with a little noise */
+static float level(int c) {
+  return 1.0f + (c % 97) * 0.25f + (lcg() % 1000) / 4000.0f;
+}
+
+static void make_datasets(void) {
+  uint8_t *regs = veris_reply + 3;
+  int c;
+
+  veris_reply[0] = 1;
+  veris_reply[1] = MODBUS_FUNC_READ_REG;
+  veris_reply[2] = 2 * VERIS_REGS;
+  for (c = 0; c < VERIS_FLOATS; c++) {
+    float value = level(c);
+    uint32_t raw;
+    memcpy(&raw, &value, sizeof(raw));
+    raw = htonl(raw);
+    memcpy(regs + 4 * c, &raw, sizeof(raw));
+  }
+  veris_reply_length = modbus_frame_seal(veris_reply, 3 + 2 * VERIS_REGS);
+  modbus_decode_floats(regs, VERIS_FLOATS, veris_values);
+
+  for (c = 0; c < EATON_FLOATS; c++) {
+    float value = level(c);
+    memcpy(&eaton_values[c], &value, sizeof(value));
+  }
+  for (c = 0; c < NUMBER_CHANNELS; c++)
+    sweep[c] = level(c);
+}
+
+/* The next sweep: the fixed one with every tenth channel moved */
+static const float *next_sweep(long op) {
+  static float values[NUMBER_CHANNELS];
+  int c;
+
+  for (c = 0; c < NUMBER_CHANNELS; c++)
+    values[c] = sweep[c] + ((c + op) % 10 == 0 ? 0.5f : 0.0f);
+  return values;
+}
+
+static void bench_crc16(long ops) {
+  long i;
+
+  for (i = 0; i < ops; i++)
+    sink += calc_crc16(veris_reply, veris_reply_length - CRC16_SIZE);
+}
+
+/* The frame prepare_msg_read builds once it has parsed its arguments */
+static void bench_frame_read(long ops) {
+  uint8_t frame[sizeof(modbus_req_read_reg) + CRC16_SIZE + 1];
+  long i;
+
+  for (i = 0; i < ops; i++)
+    sink += modbus_frame_read(frame, 1, 2083 + (i & 3), VERIS_REGS);
+}
+
+/* What print_received_msg and the Veris path do with a reply */
+static void bench_reply_decode(long ops) {
+  uint32_t values[VERIS_FLOATS];
+  long i;
+
+  for (i = 0; i < ops; i++) {
+    if (modbus_frame_check(veris_reply, veris_reply_length) ==
+        MODBUS_FUNC_READ_REG)
+      modbus_decode_floats(veris_reply + 3, veris_reply[2] / 4, values);
+    sink += values[i % VERIS_FLOATS];
+  }
+}
+
+static void free_messages(char **messages, int count) {
+  int c;
+
+  for (c = 0; c < count; c++)
+    free(messages[c]);
+  free(messages);
+}
+
+static void bench_sensoract_format(long ops) {
+  char **messages;
+  long i;
+
+  for (i = 0; i < ops; i++) {
+    int count = VERIS_FLOATS;
+    if (sensorActFormatter(&messages, veris_values, &count, VerisPower,
+                           (time_t) (now_ms / 1000), 1, "0123456789abcdef",
+                           NULL)) {
+      sink += messages[0][0];
+      free_messages(messages, count);
+    }
+  }
+}
+
+static void bench_cosm_format(long ops) {
+  char **messages;
+  long i;
+
+  for (i = 0; i < ops; i++) {
+    int count = EATON_FLOATS;
+    if (cosmFormatter(&messages, eaton_values, &count, Eaton,
+                      "0123456789abcdef")) {
+      sink += messages[0][0];
+      free_messages(messages, count);
+    }
+  }
+}
+
+/* The text message publishValue() in LabSenseZwave/Main.cpp builds for
+ * each value: formatted straight into the next slot of a round robin pool
+ * the zeromq message then points into, so nothing is allocated. The sizes
+ * are Main.cpp's PUBLISH_POOL_SIZE and PUBLISH_BUFFER_SIZE. */
+#define ZWAVE_POOL_SIZE    2000
+#define ZWAVE_BUFFER_SIZE  40
+
+static char zwave_pool[ZWAVE_POOL_SIZE][ZWAVE_BUFFER_SIZE];
+
+static void bench_zwave_encode(long ops) {
+  static int next = 0;
+  long i;
+
+  for (i = 0; i < ops; i++) {
+    char *buffer = zwave_pool[next];
+    next = (next + 1) % ZWAVE_POOL_SIZE;
+    int length = snprintf(buffer, ZWAVE_BUFFER_SIZE, "%s_%s_%d %f", "HSM100",
+                          "Temperature", (int) (i & 7) + 1,
+                          sweep[i % NUMBER_CHANNELS]);
+    if (length >= ZWAVE_BUFFER_SIZE)
+      length = ZWAVE_BUFFER_SIZE - 1;
+    sink += buffer[length - 1];
+  }
+}
+
+/* One op is one sweep of NUMBER_CHANNELS channels */
+static void bench_deadband(long ops) {
+  uint8_t report[NUMBER_CHANNELS];
+  long i;
+
+  for (i = 0; i < ops; i++) {
+    now_ms += 1000;
+    sink += deadband_apply(&deadband, next_sweep(i), now_ms / 1000.0, report);
+  }
+}
+
+static void bench_aggregate(long ops) {
+  long i;
+
+  for (i = 0; i < ops; i++) {
+    now_ms += 1000;
+    sink += aggregate_add(&agg, next_sweep(i), now_ms / 1000.0) != NULL;
+  }
+}
+
+static void bench_store_append(long ops) {
+  long i;
+
+  for (i = 0; i < ops; i++) {
+    now_ms += 1000;
+    store_append_vector(store, 0, next_sweep(i), NUMBER_CHANNELS,
+                        now_ms / 1000.0);
+  }
+}
+
+/* One op is one sample; the chunk writes are amortized over them */
+static void bench_archive_append(long ops) {
+  long i;
+
+  for (i = 0; i < ops; i++) {
+    now_ms += 1000 + (i & 3);
+    archive_append(archive, now_ms, sweep[i % NUMBER_CHANNELS]);
+  }
+}
+
+static void bench_rollup_add(long ops) {
+  long i;
+
+  for (i = 0; i < ops; i++) {
+    now_ms += 1000;
+    rollup_add(rollups, now_ms, sweep[i % NUMBER_CHANNELS]);
+  }
+}
+
+static const bench_kernel kernels[] = {
+  { "crc16",            bench_crc16 },
+  { "frame_read",       bench_frame_read },
+  { "reply_decode",     bench_reply_decode },
+  { "sensoract_format", bench_sensoract_format },
+  { "cosm_format",      bench_cosm_format },
+  { "zwave_encode",     bench_zwave_encode },
+  { "deadband",         bench_deadband },
+  { "aggregate",        bench_aggregate },
+  { "store_append",     bench_store_append },
+  { "archive_append",   bench_archive_append },
+  { "rollup_add",       bench_rollup_add },
+};
+
+#define NUMBER_KERNELS ((int) (sizeof(kernels) / sizeof(kernels[0])))
+
+static int64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Doubles the ops until a round takes BENCH_MIN_NS, then keeps the
+ * fastest of BENCH_ROUNDS rounds */
+static void run_kernel(const bench_kernel *kernel, bench_result *result) {
+  long ops = 1;
+  int64_t elapsed;
+  double best = 0;
+  int round;
+
+  for (;;) {
+    int64_t start = now_ns();
+    kernel->run(ops);
+    elapsed = now_ns() - start;
+    if (elapsed >= BENCH_MIN_NS || ops >= (1L << 30))
+      break;
+    ops *= 2;
+  }
+
+  for (round = 0; round < BENCH_ROUNDS; round++) {
+    int64_t start = now_ns();
+    kernel->run(ops);
+    double ns = (double) (now_ns() - start) / ops;
+    if (round == 0 || ns < best)
+      best = ns;
+  }
+
+  snprintf(result->name, sizeof(result->name), "%s", kernel->name);
+  result->ns_per_op = best;
+  result->ops = ops;
+}
+
+static int setup(void) {
+  deadband_config config = { 0.1f, 0.01f, 0, 300, 900 };
+
+  if (!mkdtemp(spool_dir)) {
+    perror("mkdtemp");
+    return -1;
+  }
+  if (!deadband_init(&deadband, NUMBER_CHANNELS, &config) ||
+      !aggregate_init(&agg, NUMBER_CHANNELS, 60, 10) ||
+      !(store = store_create(NUMBER_CHANNELS, 86400)) ||
+      !(archive = archive_open(spool_dir, "bench")) ||
+      !(rollups = rollup_open(spool_dir, "bench"))) {
+    fprintf(stderr, "Cannot set up the benchmarks\n");
+    return -1;
+  }
+
+  int c;
+  for (c = 0; c < NUMBER_CHANNELS; c++) {
+    char name[STORE_NAME_LENGTH];
+    snprintf(name, sizeof(name), "Bench_%d", c + 1);
+    store_channel(store, name);
+  }
+  return 0;
+}
+
+static void teardown(void) {
+  static const char *files[] = { "bench.dat", "bench.idx", "bench.1m",
+                                 "bench.1h" };
+  char path[sizeof(spool_dir) + 16];
+  int f;
+
+  if (archive)
+    archive_close(archive);
+  if (rollups)
+    rollup_close(rollups);
+  if (store)
+    store_destroy(store);
+  aggregate_free(&agg);
+  deadband_free(&deadband);
+
+  for (f = 0; f < (int) (sizeof(files) / sizeof(files[0])); f++) {
+    snprintf(path, sizeof(path), "%s/%s", spool_dir, files[f]);
+    unlink(path);
+  }
+  rmdir(spool_dir);
+}
+
+/* Reads a results file. Returns the number of results, or -1. */
+static int read_results(const char *path, bench_result *results, int max) {
+  char line[128];
+  int n = 0;
+  FILE *file = fopen(path, "r");
+
+  if (!file) {
+    perror(path);
+    return -1;
+  }
+  while (n < max && fgets(line, sizeof(line), file)) {
+    if (line[0] == '#')
+      continue;
+    if (sscanf(line, "%31s %lf %ld", results[n].name, &results[n].ns_per_op,
+               &results[n].ops) == 3)
+      n++;
+  }
+  fclose(file);
+  return n;
+}
+
+/* Prints how each result compares with the baseline. Returns the number
+ * of regressions beyond tolerance percent. */
+static int compare_results(const bench_result *results, int count,
+                           const bench_result *baseline, int baseline_count,
+                           double tolerance) {
+  int regressions = 0;
+  int r, b;
+
+  for (r = 0; r < count; r++) {
+    for (b = 0; b < baseline_count; b++)
+      if (strcmp(results[r].name, baseline[b].name) == 0)
+        break;
+    if (b == baseline_count) {
+      fprintf(stderr, "%-18s %10.1f ns  (not in baseline)\n", results[r].name,
+              results[r].ns_per_op);
+      continue;
+    }
+
+    double change = 100.0 * (results[r].ns_per_op - baseline[b].ns_per_op) /
+                    baseline[b].ns_per_op;
+    int regressed = change > tolerance;
+    fprintf(stderr, "%-18s %10.1f ns  %10.1f ns  %+7.1f%%%s\n",
+            results[r].name, baseline[b].ns_per_op, results[r].ns_per_op,
+            change, regressed ? "  REGRESSION" : "");
+    regressions += regressed;
+  }
+  return regressions;
+}
+
+static void print_usage(char *str) {
+  int k;
+
+  fprintf(stderr, "Usage: %s [-o results] [-b baseline] [-t percent] [kernel ...]\n", str);
+  fprintf(stderr, "Kernels:");
+  for (k = 0; k < NUMBER_KERNELS; k++)
+    fprintf(stderr, " %s", kernels[k].name);
+  fprintf(stderr, "\n");
+  exit(2);
+}
+
+int main(int argc, char *argv[]) {
+  bench_result results[BENCH_MAX_KERNELS];
+  bench_result baseline[BENCH_MAX_KERNELS];
+  const char *output = NULL;
+  const char *baseline_path = NULL;
+  double tolerance = 10;
+  int count = 0;
+  int opt, k, a;
+
+  while ((opt = getopt(argc, argv, "o:b:t:h")) != -1) {
+    switch (opt) {
+      case 'o': output = optarg; break;
+      case 'b': baseline_path = optarg; break;
+      case 't': tolerance = atof(optarg); break;
+      default: print_usage(argv[0]);
+    }
+  }
+  for (a = optind; a < argc; a++) {
+    for (k = 0; k < NUMBER_KERNELS; k++)
+      if (strcmp(argv[a], kernels[k].name) == 0)
+        break;
+    if (k == NUMBER_KERNELS) {
+      fprintf(stderr, "Unknown kernel: %s\n", argv[a]);
+      print_usage(argv[0]);
+    }
+  }
+
+  make_datasets();
+  if (setup() < 0) {
+    teardown();
+    return 2;
+  }
+
+  for (k = 0; k < NUMBER_KERNELS; k++) {
+    int selected = optind == argc;
+    for (a = optind; a < argc; a++)
+      selected |= strcmp(argv[a], kernels[k].name) == 0;
+    if (selected)
+      run_kernel(&kernels[k], &results[count++]);
+  }
+  teardown();
+
+  FILE *file = output ? fopen(output, "w") : stdout;
+  if (!file) {
+    perror(output);
+    return 2;
+  }
+  fprintf(file, "# labsensebench %d: kernel ns_per_op ops\n",
+          LABSENSE_API_VERSION);
+  for (k = 0; k < count; k++)
+    fprintf(file, "%s %.2f %ld\n", results[k].name, results[k].ns_per_op,
+            results[k].ops);
+  if (output)
+    fclose(file);
+
+  if (baseline_path) {
+    int baseline_count = read_results(baseline_path, baseline,
+                                      BENCH_MAX_KERNELS);
+    if (baseline_count < 0)
+      return 2;
+    if (compare_results(results, count, baseline, baseline_count, tolerance))
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,210 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include "E30ModbusMsg.h"
+#include "modbusframe.h"
+#include "capture.h"
+
+/* A request in flight */
+typedef struct capture_request {
+  int64_t   sent_ns;        /* wall clock, for the sample time */
+  int64_t   expires;        /* capture_clock() */
+} capture_request;
+
+/* Monotonic clock in nanoseconds, the same clock as gateway_now */
+static int64_t capture_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Sleeps until at on capture_clock(), or until the gateway has something
+ * to read if fd is not -1. Returns 1 if it has. */
+static int capture_wait(int fd, int64_t at) {
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  struct timespec ts;
+  int64_t left;
+  int rc;
+
+  if (fd < 0) {
+    ts.tv_sec = at / 1000000000;
+    ts.tv_nsec = at % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+    return 0;
+  }
+
+  left = at - capture_clock();
+  if (left < 0)
+    left = 0;
+  ts.tv_sec = left / 1000000000;
+  ts.tv_nsec = left % 1000000000;
+  rc = ppoll(&pfd, 1, &ts, NULL);
+  return rc > 0;
+}
+
+int capture_init(capture *cap, int channels, int capacity) {
+  memset(cap, 0, sizeof(*cap));
+  cap->channels = channels;
+  cap->capacity = capacity;
+  cap->time_ns = malloc(capacity * sizeof(int64_t));
+  cap->uncertainty_ns = malloc(capacity * sizeof(int64_t));
+  cap->values = malloc((size_t) capacity * channels * sizeof(float));
+  if (!cap->time_ns || !cap->uncertainty_ns || !cap->values) {
+    capture_free(cap);
+    return -1;
+  }
+  return 0;
+}
+
+void capture_free(capture *cap) {
+  free(cap->time_ns);
+  free(cap->uncertainty_ns);
+  free(cap->values);
+  memset(cap, 0, sizeof(*cap));
+}
+
+/* Keeps the sample in a read reply answering req. Returns 0, or -1 if the
+ * reply isn't one. */
+static int capture_sample(capture *cap, gateway *gw, const uint8_t *reply,
+                          const capture_request *req) {
+  int64_t half;
+
+  if (reply[BYTEPOS_MODBUS_FUNC] != MODBUS_FUNC_READ_REG ||
+      reply[2] != 4 * cap->channels || cap->count == cap->capacity)
+    return -1;
+
+  half = (gw->received_ns - req->sent_ns) / 2;
+  if (half < 0)
+    half = 0;     /* the wall clock stepped back */
+  cap->time_ns[cap->count] = req->sent_ns + half;
+  cap->uncertainty_ns[cap->count] = half;
+  modbus_decode_floats(reply + 3, cap->channels,
+                       (uint32_t *) &cap->values[(size_t) cap->count *
+                                                 cap->channels]);
+  cap->count++;
+  return 0;
+}
+
+int capture_run(capture *cap, gateway *gw, const gateway_slave *slave,
+                int rate, int depth) {
+  uint8_t request[sizeof(modbus_req_read_reg) + CRC16_SIZE + 1];
+  uint8_t reply[GATEWAY_FRAME_MAX];
+  capture_request pipe[CAPTURE_DEPTH_MAX];
+  int head = 0, pending = 0, length, rc, k = 0;
+  int64_t period = 1000000000 / rate, timeout = CAPTURE_TIMEOUT;
+  int64_t start, now, next;
+
+  if (gw->serial) {
+    depth = 1;      /* the master waits for each reply on the bus */
+    timeout += rtu_frame_ms(&gw->rtu, 3 + 2 * slave->reg_qty + CRC16_SIZE);
+  }
+  if (depth < 1)
+    depth = 1;
+  if (depth > CAPTURE_DEPTH_MAX)
+    depth = CAPTURE_DEPTH_MAX;
+  timeout *= 1000000;
+
+  length = modbus_frame_read(request, slave->modbus_addr, slave->reg_addr,
+                             slave->reg_qty);
+
+  /* Connect, and see the slave answers, before the clock starts */
+  rc = gateway_transact(gw, request, length, reply,
+                        (int) (timeout / 1000000) * 4);
+  if (rc < 0 || reply[BYTEPOS_MODBUS_FUNC] != MODBUS_FUNC_READ_REG) {
+    fprintf(stderr, "Slave %d doesn't answer, not capturing\n",
+            slave->modbus_addr);
+    return 0;
+  }
+
+  start = capture_clock();
+  while (k < cap->capacity || pending > 0) {
+    now = capture_clock();
+    next = (k < cap->capacity) ? start + k * period : INT64_MAX;
+
+    if (now >= next) {
+      /* Deadlines already gone by are skipped, not sent in a burst */
+      int64_t behind = (now - next) / period;
+      if (behind > cap->capacity - k - 1)
+        behind = cap->capacity - k - 1;
+      cap->missed += (uint32_t) behind;
+      k += (int) behind + 1;
+      if (pending == depth || gateway_submit(gw, request, length) < 0) {
+        cap->missed++;
+        continue;
+      }
+      cap->sent++;
+      pipe[(head + pending) % depth].sent_ns = gw->sent_ns;
+      pipe[(head + pending) % depth].expires = capture_clock() + timeout;
+      pending++;
+      continue;
+    }
+
+    if (pending > 0 && now >= pipe[head].expires) {
+      /* Replies behind a lost one can't be told from it, so they go too,
+       * up to when the last of them would have been given up */
+      int64_t until = pipe[(head + pending - 1) % depth].expires;
+      cap->lost += pending;
+      pending = 0;
+      gateway_flush(gw, until / 1000000);
+      continue;
+    }
+
+    if (pending > 0 && next > pipe[head].expires)
+      next = pipe[head].expires;
+    if (!capture_wait(pending > 0 ? gw->sock : -1, next))
+      continue;
+
+    rc = gateway_reply(gw, request, reply, pipe[head].expires / 1000000);
+    if (rc == GATEWAY_DISCONNECTED || rc == GATEWAY_TIMEOUT) {
+      cap->lost += pending;
+      pending = 0;
+      if (rc == GATEWAY_TIMEOUT)
+        gateway_flush(gw, gateway_now() + timeout / 1000000);
+      continue;
+    }
+    if (rc < 0 || capture_sample(cap, gw, reply, &pipe[head]) < 0)
+      cap->lost++;
+    head = (head + 1) % depth;
+    pending--;
+  }
+  return cap->count;
+}
+
+int capture_write(const capture *cap, const gateway_slave *slave,
+                  const char *path) {
+  FILE *file = fopen(path, "w");
+  const float *row;
+  int s, c;
+
+  if (!file) {
+    perror(path);
+    return -1;
+  }
+
+  fprintf(file, "# slave %d, %u requests, %d samples, %u lost, %u missed\n",
+          slave->modbus_addr, cap->sent, cap->count, cap->lost, cap->missed);
+  fprintf(file, "time_ns,uncertainty_ns");
+  for (c = 0; c < cap->channels; c++)
+    fprintf(file, ",reg%u", slave->reg_addr + 2 * c);
+  fprintf(file, "\n");
+
+  for (s = 0; s < cap->count; s++) {
+    row = &cap->values[(size_t) s * cap->channels];
+    fprintf(file, "%lld,%lld", (long long) cap->time_ns[s],
+            (long long) cap->uncertainty_ns[s]);
+    for (c = 0; c < cap->channels; c++)
+      fprintf(file, ",%.7g", row[c]);
+    fprintf(file, "\n");
+  }
+
+  if (fclose(file) != 0) {
+    perror(path);
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,72 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/* High rate captures of one register block, for load event studies: a
+ * slave read at 10-50 Hz for a bounded time into a buffer allocated up
+ * front, written out once the capture is over.
+ *
+ * Requests go out on absolute deadlines, start + k * period on the
+ * monotonic clock, so lateness in one round doesn't push back the rest.
+ * Over TCP up to `depth` requests are in flight at once, so the gateway
+ * already holds the next request when a reply leaves and the network
+ * round trip doesn't limit the rate; on a serial line the bus allows only
+ * one. A deadline that comes with the pipeline still full is skipped
+ * rather than made up, and counted as missed, as are deadlines gone by
+ * while the capture was held up. A request unanswered for the timeout is
+ * counted lost, along with the ones behind it, and the connection is
+ * flushed before going on, so replies stay matched to requests.
+ *
+ * Each sample is stamped like a polled one (see gateway.h): halfway
+ * between its request going out and its reply arriving, with half that
+ * time as the uncertainty. A capture uses a gateway connection of its own
+ * and leaves the regular poller alone. */
+
+#include <stdint.h>
+#include "gateway.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAPTURE_RATE_MAX      100     /* Hz */
+#define CAPTURE_SECONDS_MAX   3600
+#define CAPTURE_DEPTH         2       /* requests in flight, by default */
+#define CAPTURE_DEPTH_MAX     8
+#define CAPTURE_TIMEOUT       250     /* ms */
+
+typedef struct capture {
+  int       channels;       /* floats per sample */
+  int       capacity;       /* samples */
+  int       count;
+  int64_t  *time_ns;        /* sample times, ns since the epoch */
+  int64_t  *uncertainty_ns;
+  float    *values;         /* count rows of channels */
+  uint32_t  sent;           /* requests */
+  uint32_t  lost;           /* unanswered or corrupt */
+  uint32_t  missed;         /* deadlines skipped, nothing sent */
+} capture;
+
+/* Allocates room for capacity samples of channels floats. Returns 0, or
+ * -1 if out of memory. */
+int capture_init(capture *cap, int channels, int capacity);
+
+/* Reads the slave's block rate times a second until capacity deadlines
+ * have passed, with up to depth requests in flight. A first read connects
+ * and checks the slave answers before the deadlines start. Returns the
+ * number of samples taken. */
+int capture_run(capture *cap, gateway *gw, const gateway_slave *slave,
+                int rate, int depth);
+
+/* Writes the samples as CSV: the time and uncertainty in nanoseconds, then
+ * a column per float named by its first register. Returns 0, or -1 and
+ * prints why. */
+int capture_write(const capture *cap, const gateway_slave *slave,
+                  const char *path);
+
+void capture_free(capture *cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,588 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <zmq.h>
+#include "channelstore.h"
+
+#define REQUEST_LENGTH 256
+
+channel_store *store_create(int max_channels, uint32_t capacity) {
+  channel_store *store = (channel_store *) calloc(1, sizeof(channel_store));
+  int names_size = max_channels * (STORE_NAME_LENGTH + 4);
+  int points_size = capacity * 96;  /* a downsample point is the longest */
+
+  if (!store)
+    return NULL;
+
+  store->max_channels = max_channels;
+  store->capacity = capacity;
+  store->rings = (channel_ring *) calloc(max_channels, sizeof(channel_ring));
+  store->reply_size = ((names_size > points_size) ? names_size : points_size) + 256;
+  store->reply = (char *) malloc(store->reply_size);
+
+  if (!store->rings || !store->reply) {
+    store_destroy(store);
+    return NULL;
+  }
+  return store;
+}
+
+void store_destroy(channel_store *store) {
+  int c;
+
+  if (!store)
+    return;
+  for (c = 0; store->rings && c < store->channels; c++) {
+    free(store->rings[c].time);
+    free(store->rings[c].value);
+    archive_close(store->rings[c].archive);
+    archive_reader_close(store->rings[c].history);
+    rollup_close(store->rings[c].rollup);
+  }
+  free(store->rings);
+  free(store->reply);
+  free(store->archive_dir);
+  free(store->history_times);
+  free(store->history_values);
+  free(store->history_rollups);
+  free(store);
+}
+
+int store_archive(channel_store *store, const char *dir) {
+  int c;
+
+  store->archive_dir = strdup(dir);
+  store->history_times = (int64_t *) malloc(store->capacity * sizeof(int64_t));
+  store->history_values = (float *) malloc(store->capacity * sizeof(float));
+  store->history_rollups = (rollup_record *)
+      malloc(store->capacity * sizeof(rollup_record));
+  if (!store->archive_dir || !store->history_times || !store->history_values ||
+      !store->history_rollups) {
+    free(store->archive_dir);
+    free(store->history_times);
+    free(store->history_values);
+    free(store->history_rollups);
+    store->archive_dir = NULL;
+    store->history_times = NULL;
+    store->history_values = NULL;
+    store->history_rollups = NULL;
+    return -1;
+  }
+
+  for (c = 0; c < store->channels; c++) {
+    if (!store->rings[c].archive)
+      store->rings[c].archive = archive_open(dir, store->rings[c].name);
+    if (!store->rings[c].rollup)
+      store->rings[c].rollup = rollup_open(dir, store->rings[c].name);
+  }
+  return 0;
+}
+
+void store_flush(channel_store *store) {
+  int c;
+
+  for (c = 0; c < store->channels; c++) {
+    if (store->rings[c].archive)
+      archive_flush(store->rings[c].archive);
+    if (store->rings[c].rollup)
+      rollup_flush(store->rings[c].rollup);
+  }
+}
+
+static int store_find(const channel_store *store, const char *name) {
+  int c;
+
+  for (c = 0; c < store->channels; c++) {
+    if (strcmp(store->rings[c].name, name) == 0)
+      return c;
+  }
+  return -1;
+}
+
+int store_channel(channel_store *store, const char *name) {
+  channel_ring *ring;
+  int c = store_find(store, name);
+
+  if (c >= 0)
+    return c;
+  if (store->channels == store->max_channels)
+    return -1;
+
+  ring = &store->rings[store->channels];
+  ring->time = (double *) malloc(store->capacity * sizeof(double));
+  ring->value = (float *) malloc(store->capacity * sizeof(float));
+  if (!ring->time || !ring->value) {
+    free(ring->time);
+    free(ring->value);
+    ring->time = NULL;
+    ring->value = NULL;
+    return -1;
+  }
+  snprintf(ring->name, sizeof(ring->name), "%s", name);
+  ring->start = 0;
+  ring->size = 0;
+  ring->archive = NULL;
+  ring->history = NULL;
+  ring->rollup = NULL;
+  if (store->archive_dir) {
+    ring->archive = archive_open(store->archive_dir, name);
+    ring->rollup = rollup_open(store->archive_dir, name);
+  }
+
+  return store->channels++;
+}
+
+void store_append(channel_store *store, int channel, double time,
+                  float value) {
+  channel_ring *ring;
+  uint32_t slot;
+
+  if (channel < 0 || channel >= store->channels)
+    return;
+
+  ring = &store->rings[channel];
+  slot = (ring->start + ring->size) % store->capacity;
+  ring->time[slot] = time;
+  ring->value[slot] = value;
+  if (ring->size < store->capacity)
+    ring->size++;
+  else
+    ring->start = (ring->start + 1) % store->capacity;
+
+  if (ring->archive)
+    archive_append(ring->archive, llround(time * 1000), value);
+  if (ring->rollup)
+    rollup_add(ring->rollup, llround(time * 1000), value);
+}
+
+void store_append_vector(channel_store *store, int first, const float *values,
+                         int count, double time) {
+  int c;
+
+  for (c = 0; c < count; c++)
+    store_append(store, first + c, time, values[c]);
+}
+
+/* Index (from the oldest sample) of the first sample at or after t */
+static uint32_t ring_lower_bound(const channel_ring *ring, uint32_t capacity,
+                                 double t) {
+  uint32_t low = 0;
+  uint32_t high = ring->size;
+
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (ring->time[(ring->start + middle) % capacity] < t)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+int store_range(const channel_store *store, int channel, double t0, double t1,
+                double *times, float *values, int max) {
+  const channel_ring *ring;
+  uint32_t i, end;
+  int n = 0;
+
+  if (channel < 0 || channel >= store->channels)
+    return 0;
+
+  ring = &store->rings[channel];
+  i = ring_lower_bound(ring, store->capacity, t0);
+  end = ring_lower_bound(ring, store->capacity, t1);
+
+  for (; i < end && n < max; i++, n++) {
+    uint32_t slot = (ring->start + i) % store->capacity;
+    times[n] = ring->time[slot];
+    values[n] = ring->value[slot];
+  }
+  return n;
+}
+
+/* Appends printf output to the reply, truncating at the end of the buffer;
+ * reply_end turns a truncated reply into an error */
+static int reply_printf(channel_store *store, int length, const char *format,
+                        ...) __attribute__ ((format (printf, 3, 4)));
+static int reply_printf(channel_store *store, int length, const char *format,
+                        ...) {
+  va_list args;
+  int written;
+
+  if (length >= store->reply_size - 1)
+    return length;
+
+  va_start(args, format);
+  written = vsnprintf(store->reply + length, store->reply_size - length,
+                      format, args);
+  va_end(args);
+
+  if (written < 0)
+    return length;
+  return (length + written < store->reply_size) ? length + written
+                                                : store->reply_size - 1;
+}
+
+static int reply_error(channel_store *store, const char *message) {
+  return reply_printf(store, 0, "{\"error\": \"%s\"}", message);
+}
+
+/* Closes the reply's list and object, or replaces a reply that didn't fit
+ * with an error, since a cut off one isn't JSON */
+static int reply_end(channel_store *store, int length) {
+  length = reply_printf(store, length, "]}");
+  if (length >= store->reply_size - 1)
+    return reply_error(store, "reply too long");
+  return length;
+}
+
+/* JSON has no NaN; a missing reading is written as null */
+static int reply_value(channel_store *store, int length, float value) {
+  if (value != value)
+    return reply_printf(store, length, ", null");
+  return reply_printf(store, length, ", %g", value);
+}
+
+/* Writes the samples [i, end) of a ring as [t, v] points */
+static int reply_points(channel_store *store, int length,
+                        const channel_ring *ring, uint32_t i, uint32_t end) {
+  const char *separator = "";
+
+  for (; i < end; i++) {
+    uint32_t slot = (ring->start + i) % store->capacity;
+    length = reply_printf(store, length, "%s[%.3f", separator,
+                          ring->time[slot]);
+    length = reply_value(store, length, ring->value[slot]);
+    length = reply_printf(store, length, "]");
+    separator = ", ";
+  }
+  return length;
+}
+
+/* Output buckets of a downsample query, filled from rollup records or
+ * samples in time order */
+typedef struct downsample {
+  double      t0;
+  double      width;
+  int         buckets;
+  int         bucket;       /* open bucket; count is 0 if none */
+  uint32_t    count;
+  double      sum;
+  float       min;
+  float       max;
+  float       last;
+  const char *separator;
+} downsample;
+
+static int downsample_close(channel_store *store, int length,
+                            downsample *out) {
+  if (out->count == 0)
+    return length;
+
+  length = reply_printf(store, length, "%s[%.3f", out->separator,
+                        out->t0 + out->bucket * out->width);
+  length = reply_value(store, length, out->sum / out->count);
+  length = reply_value(store, length, out->min);
+  length = reply_value(store, length, out->max);
+  length = reply_value(store, length, out->last);
+  length = reply_printf(store, length, ", %u]", out->count);
+  out->separator = ", ";
+  out->count = 0;
+  return length;
+}
+
+static int downsample_add(channel_store *store, int length, downsample *out,
+                          double time, uint32_t count, float mean, float min,
+                          float max, float last) {
+  int bucket = (int) ((time - out->t0) / out->width);
+
+  if (count == 0 || mean != mean || bucket < 0 || bucket >= out->buckets)
+    return length;
+
+  if (out->count > 0 && bucket != out->bucket)
+    length = downsample_close(store, length, out);
+  if (out->count == 0) {
+    out->bucket = bucket;
+    out->sum = 0;
+    out->min = min;
+    out->max = max;
+  }
+  out->min = (min < out->min) ? min : out->min;
+  out->max = (max > out->max) ? max : out->max;
+  out->sum += (double) mean * count;
+  out->last = last;
+  out->count += count;
+  return length;
+}
+
+/* Adds the records of a rollup tier in [t0, t1), a page at a time */
+static int downsample_rollups(channel_store *store, int length,
+                              downsample *out, const channel_ring *ring,
+                              int tier, double t0, double t1) {
+  rollup_record *records = store->history_rollups;
+  int64_t start = llround(t0 * 1000);
+  int64_t end = llround(t1 * 1000);
+  int n, i;
+
+  do {
+    n = rollup_read(store->archive_dir, ring->name, tier, start, end,
+                    records, store->capacity);
+    for (i = 0; i < n; i++)
+      length = downsample_add(store, length, out, records[i].start / 1000.0,
+                              records[i].count, records[i].mean,
+                              records[i].min, records[i].max,
+                              records[i].last);
+    if (n > 0)
+      start = records[n - 1].start + 1;
+  } while (n == (int) store->capacity);
+
+  return length;
+}
+
+/* Adds the archived samples of [t0, t1), a page at a time */
+static int downsample_archive(channel_store *store, int length,
+                              downsample *out, channel_ring *ring, double t0,
+                              double t1) {
+  int64_t start = llround(t0 * 1000);
+  int64_t end = llround(t1 * 1000);
+  int n, i;
+
+  if (!ring->history)
+    ring->history = archive_reader_open(store->archive_dir, ring->name);
+  if (!ring->history)
+    return length;
+
+  do {
+    n = archive_read(ring->history, start, end, store->history_times,
+                     store->history_values, store->capacity);
+    for (i = 0; i < n; i++) {
+      float value = store->history_values[i];
+      length = downsample_add(store, length, out,
+                              store->history_times[i] / 1000.0, 1, value,
+                              value, value, value);
+    }
+    if (n > 0)
+      start = store->history_times[n - 1] + 1;
+  } while (n == (int) store->capacity);
+
+  return length;
+}
+
+/* Adds the samples in memory of [t0, t1) */
+static int downsample_ring(channel_store *store, int length, downsample *out,
+                           const channel_ring *ring, double t0, double t1) {
+  uint32_t i = ring_lower_bound(ring, store->capacity, t0);
+  uint32_t end = ring_lower_bound(ring, store->capacity, t1);
+
+  for (; i < end; i++) {
+    uint32_t slot = (ring->start + i) % store->capacity;
+    float value = ring->value[slot];
+    length = downsample_add(store, length, out, ring->time[slot], 1, value,
+                            value, value, value);
+  }
+  return length;
+}
+
+/* Writes the mean, min, max, last and count of each non empty bucket of
+ * [t0, t1), from the coarsest source that is no coarser than a bucket */
+static int reply_downsample(channel_store *store, int length,
+                            channel_ring *ring, double t0, double t1,
+                            int buckets) {
+  downsample out;
+  int tier = -1;
+  int t;
+
+  out.t0 = t0;
+  out.width = (t1 - t0) / buckets;
+  out.buckets = buckets;
+  out.count = 0;
+  out.separator = "";
+
+  if (store->archive_dir) {
+    for (t = ROLLUP_TIERS - 1; t >= 0 && tier < 0; t--) {
+      if (out.width * 1000 >= rollup_resolution(t))
+        tier = t;
+    }
+  }
+
+  length = reply_printf(store, length, "\"resolution\": %d, \"points\": [",
+                        (tier < 0) ? 0 : (int) (rollup_resolution(tier) / 1000));
+
+  if (tier >= 0) {
+    length = downsample_rollups(store, length, &out, ring, tier, t0, t1);
+
+    /* The newest records are still open in memory */
+    for (t = tier; ring->rollup && t >= 0; t--) {
+      const rollup_tier *open = &ring->rollup->tiers[t];
+      if (open->count > 0 && open->start >= llround(t0 * 1000) &&
+          open->start < llround(t1 * 1000))
+        length = downsample_add(store, length, &out, open->start / 1000.0,
+                                open->count, (float) (open->sum / open->count),
+                                open->min, open->max, open->last);
+    }
+  }
+  else {
+    /* Older samples from the archive, which lacks its open chunk, the rest
+     * from memory */
+    double oldest = (ring->size > 0) ? ring->time[ring->start] : t1;
+
+    if (store->archive_dir && oldest > t0)
+      length = downsample_archive(store, length, &out, ring, t0,
+                                  (oldest < t1) ? oldest : t1);
+    length = downsample_ring(store, length, &out, ring, t0, t1);
+  }
+
+  return downsample_close(store, length, &out);
+}
+
+/* Writes the archived samples of [t0, t1), up to capacity of them. Returns
+ * -1 if the channel has no archive. */
+static int reply_history(channel_store *store, int length, channel_ring *ring,
+                         double t0, double t1) {
+  const char *separator = "";
+  int n, i;
+
+  if (!store->archive_dir)
+    return -1;
+  if (!ring->history)
+    ring->history = archive_reader_open(store->archive_dir, ring->name);
+  if (!ring->history)
+    return -1;
+
+  n = archive_read(ring->history, llround(t0 * 1000), llround(t1 * 1000),
+                   store->history_times, store->history_values,
+                   store->capacity);
+  for (i = 0; i < n; i++) {
+    length = reply_printf(store, length, "%s[%.3f", separator,
+                          store->history_times[i] / 1000.0);
+    length = reply_value(store, length, store->history_values[i]);
+    length = reply_printf(store, length, "]");
+    separator = ", ";
+  }
+  return length;
+}
+
+int store_query(channel_store *store, const char *request) {
+  char command[16];
+  char name[STORE_NAME_LENGTH];
+  double t0, t1;
+  int buckets;
+  int fields;
+  int length;
+  int c;
+  channel_ring *ring;
+
+  fields = sscanf(request, "%15s %47s %lf %lf %d", command, name, &t0, &t1,
+                  &buckets);
+  if (fields < 1)
+    return reply_error(store, "empty request");
+
+  if (strcmp(command, "channels") == 0) {
+    length = reply_printf(store, 0, "{\"channels\": [");
+    for (c = 0; c < store->channels; c++) {
+      length = reply_printf(store, length, "%s\"%s\"", c ? ", " : "",
+                            store->rings[c].name);
+    }
+    return reply_end(store, length);
+  }
+
+  if (fields < 2)
+    return reply_error(store, "no channel given");
+  c = store_find(store, name);
+  if (c < 0)
+    return reply_error(store, "unknown channel");
+  ring = &store->rings[c];
+
+  length = reply_printf(store, 0, "{\"channel\": \"%s\", ", name);
+  if (strcmp(command, "downsample") != 0)
+    length = reply_printf(store, length, "\"points\": [");
+
+  if (strcmp(command, "latest") == 0) {
+    if (ring->size > 0)
+      length = reply_points(store, length, ring, ring->size - 1, ring->size);
+  }
+  else if (strcmp(command, "range") == 0 && fields >= 4) {
+    length = reply_points(store, length, ring,
+                          ring_lower_bound(ring, store->capacity, t0),
+                          ring_lower_bound(ring, store->capacity, t1));
+  }
+  else if (strcmp(command, "history") == 0 && fields >= 4) {
+    length = reply_history(store, length, ring, t0, t1);
+    if (length < 0)
+      return reply_error(store, "no archive");
+  }
+  else if (strcmp(command, "downsample") == 0 && fields == 5 &&
+           buckets > 0 && t1 > t0) {
+    if ((uint32_t) buckets > store->capacity)
+      return reply_error(store, "too many buckets");
+    length = reply_downsample(store, length, ring, t0, t1, buckets);
+  }
+  else {
+    return reply_error(store, "bad request");
+  }
+
+  return reply_end(store, length);
+}
+
+static long elapsed_ms(const struct timespec *since) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - since->tv_sec) * 1000 +
+         (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+int store_serve(channel_store *store, void *socket, long timeout_ms) {
+  struct timespec start;
+  zmq_pollitem_t item;
+  long remaining;
+
+  item.socket = socket;
+  item.fd = 0;
+  item.events = ZMQ_POLLIN;
+  item.revents = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  while ((remaining = timeout_ms - elapsed_ms(&start)) > 0) {
+    char request[REQUEST_LENGTH];
+    zmq_msg_t message;
+    size_t size;
+    int length;
+
+    /* zeromq 2.1 takes the poll timeout in microseconds */
+    if (zmq_poll(&item, 1, remaining * 1000) < 0) {
+      if (zmq_errno() == EINTR)
+        continue;
+      fprintf(stderr, "zmq_poll() failed: %s\n", zmq_strerror(zmq_errno()));
+      return -1;
+    }
+    if (!(item.revents & ZMQ_POLLIN))
+      continue;
+
+    zmq_msg_init(&message);
+    if (zmq_recv(socket, &message, ZMQ_NOBLOCK) != 0) {
+      zmq_msg_close(&message);
+      continue;
+    }
+    size = zmq_msg_size(&message);
+    if (size >= sizeof(request))
+      size = sizeof(request) - 1;
+    memcpy(request, zmq_msg_data(&message), size);
+    request[size] = '\0';
+    zmq_msg_close(&message);
+
+    /* A REP socket must answer each request before taking the next */
+    length = store_query(store, request);
+    zmq_msg_init_size(&message, length);
+    memcpy(zmq_msg_data(&message), store->reply, length);
+    if (zmq_send(socket, &message, 0) != 0)
+      fprintf(stderr, "zmq_send() failed: %s\n", zmq_strerror(zmq_errno()));
+    zmq_msg_close(&message);
+  }
+  return 0;
+}
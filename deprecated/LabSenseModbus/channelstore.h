@@ -0,0 +1,105 @@
+#ifndef CHANNELSTORE_H
+#define CHANNELSTORE_H
+
+/* In-memory store of the recent samples of every channel, for dashboards
+ * and local consumers. Each channel is a fixed size ring kept as separate
+ * time and value arrays, so nothing is written to disk per sample and a
+ * range query is a binary search plus a copy.
+ *
+ * The store answers queries on a zeromq REP socket (see store_serve). A
+ * request is one text message, the reply one JSON object:
+ *
+ *   channels                            {"channels": ["Veris_Power_1", ...]}
+ *   latest <channel>                    {"channel": .., "points": [[t, v]]}
+ *   range <channel> <t0> <t1>           {"channel": .., "points": [[t, v], ...]}
+ *   downsample <channel> <t0> <t1> <n>  {"channel": .., "resolution": r,
+ *                                        "points": [[t, mean, min, max, last, count], ...]}
+ *   history <channel> <t0> <t1>         {"channel": .., "points": [[t, v], ...]}
+ *
+ * Times are seconds since the epoch; downsample splits [t0, t1) into n
+ * buckets, n at most capacity, and leaves out the empty ones and NaN
+ * samples. It reads the coarsest source no coarser than a bucket: the hour
+ * or minute rollups (see rollup.h), else the samples in memory or in the
+ * archive, and says which in resolution (seconds, 0 for samples). history
+ * reads the on-disk archive (see store_archive) and returns at most capacity points from t0 on; ask
+ * again from just after the last one for more. Errors are {"error": ".."},
+ * as is a reply too long for the reply buffer. */
+
+#include <stdint.h>
+#include "archive.h"
+#include "rollup.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STORE_NAME_LENGTH 48
+#define STORE_QUERY_PORT 5559
+
+typedef struct channel_ring {
+  char      name[STORE_NAME_LENGTH];
+  uint32_t  start;          /* index of the oldest sample */
+  uint32_t  size;           /* samples held, up to the store capacity */
+  double   *time;
+  float    *value;
+  archive_writer *archive;  /* when archiving */
+  archive_reader *history;  /* opened by the first history query */
+  rollup   *rollup;         /* when archiving */
+} channel_ring;
+
+typedef struct channel_store {
+  int           channels;       /* channels in use */
+  int           max_channels;
+  uint32_t      capacity;       /* samples per channel */
+  channel_ring *rings;
+  char         *reply;          /* reply buffer for store_query */
+  int           reply_size;
+  char         *archive_dir;    /* NULL unless archiving */
+  int64_t      *history_times;  /* buffers for history queries */
+  float        *history_values;
+  rollup_record *history_rollups;
+} channel_store;
+
+/* Allocates a store for up to max_channels channels of capacity samples
+ * each. Returns NULL if out of memory. */
+channel_store *store_create(int max_channels, uint32_t capacity);
+void store_destroy(channel_store *store);
+
+/* Also appends every sample to an archive of each channel in dir, keeps
+ * its rollups there and enables history queries. Returns 0, or -1 if out of memory. */
+int store_archive(channel_store *store, const char *dir);
+
+/* Writes out the archive chunks and rollup records still in memory */
+void store_flush(channel_store *store);
+
+/* Returns the index of the named channel, adding it if it is new. Returns
+ * -1 if the store is full. */
+int store_channel(channel_store *store, const char *name);
+
+/* Appends one sample, dropping the oldest one when the ring is full, and
+ * archives and rolls it up. Samples are expected in time order. */
+void store_append(channel_store *store, int channel, double time,
+                  float value);
+
+/* Appends one sample of count consecutive channels starting at first */
+void store_append_vector(channel_store *store, int first, const float *values,
+                         int count, double time);
+
+/* Copies the samples of [t0, t1) into times and values, at most max of
+ * them from the start of the range. Returns the number copied. */
+int store_range(const channel_store *store, int channel, double t0, double t1,
+                double *times, float *values, int max);
+
+/* Answers one text request (see above) into store->reply. Returns the
+ * length of the reply. */
+int store_query(channel_store *store, const char *request);
+
+/* Answers the requests arriving on the REP socket for timeout_ms
+ * milliseconds, then returns. Returns -1 if polling the socket failed. */
+int store_serve(channel_store *store, void *socket, long timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
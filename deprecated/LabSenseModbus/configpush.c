@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include "E30ModbusMsg.h"
+#include "modbusframe.h"
+#include "gateway.h"
+#include "configpush.h"
+
+/* The device's entry in the plan, added if it is new. NULL if out of
+ * memory. */
+static push_device *push_device_for(push_plan *plan, const char *host,
+                                    const char *port, uint8_t modbus_addr) {
+  push_device *dev;
+  int d;
+
+  for (d = 0; d < plan->devices; d++) {
+    dev = &plan->device[d];
+    if (dev->modbus_addr == modbus_addr && strcmp(dev->host, host) == 0 &&
+        strcmp(dev->port, port) == 0)
+      return dev;
+  }
+
+  if (plan->devices == plan->capacity) {
+    int capacity = plan->capacity ? 2 * plan->capacity : 16;
+    push_device *device = realloc(plan->device, capacity * sizeof(*device));
+    if (!device)
+      return NULL;
+    plan->device = device;
+    plan->capacity = capacity;
+  }
+
+  dev = &plan->device[plan->devices++];
+  memset(dev, 0, sizeof(*dev));
+  snprintf(dev->host, sizeof(dev->host), "%s", host);
+  snprintf(dev->port, sizeof(dev->port), "%s", port);
+  dev->modbus_addr = modbus_addr;
+  return dev;
+}
+
+/* Sets a register's desired value; a later setting wins. Returns 0, or -1
+ * if out of memory. */
+static int push_set(push_device *dev, uint16_t reg, uint16_t want) {
+  int r;
+
+  for (r = 0; r < dev->count; r++) {
+    if (dev->regs[r].reg == reg) {
+      dev->regs[r].want = want;
+      return 0;
+    }
+  }
+
+  if (dev->count == dev->capacity) {
+    int capacity = dev->capacity ? 2 * dev->capacity : 32;
+    push_register *regs = realloc(dev->regs, capacity * sizeof(*regs));
+    if (!regs)
+      return -1;
+    dev->regs = regs;
+    dev->capacity = capacity;
+  }
+  dev->regs[dev->count].reg = reg;
+  dev->regs[dev->count].want = want;
+  dev->regs[dev->count].have = 0;
+  dev->count++;
+  return 0;
+}
+
+static int push_register_order(const void *a, const void *b) {
+  return (int) ((const push_register *) a)->reg -
+         (int) ((const push_register *) b)->reg;
+}
+
+/* Parses "<reg>=<value>[,<value>...]" into dev. Returns 0, or -1. */
+static int push_parse_setting(push_device *dev, char *setting) {
+  char *end, *value;
+  unsigned long reg;
+  long val;
+
+  reg = strtoul(setting, &end, 0);
+  if (end == setting || *end != '=')
+    return -1;
+
+  for (value = end + 1; ; value = end + 1) {
+    val = strtol(value, &end, 0);
+    if (end == value || (*end != ',' && *end != '\0') ||
+        reg > 0xffff || val < -32768 || val > 0xffff)
+      return -1;
+    if (push_set(dev, (uint16_t) reg++, (uint16_t) val) < 0)
+      return -1;
+    if (*end == '\0')
+      return 0;
+  }
+}
+
+int push_load(push_plan *plan, const char *path) {
+  char line[4096];
+  int number = 0;
+  int d;
+  FILE *file = fopen(path, "r");
+
+  memset(plan, 0, sizeof(*plan));
+  if (!file) {
+    perror(path);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), file)) {
+    char *host, *port, *addr, *setting, *save, *end;
+    long modbus_addr;
+    push_device *dev;
+
+    number++;
+    if ((end = strchr(line, '#')) != NULL)
+      *end = '\0';
+    if ((host = strtok_r(line, " \t\r\n", &save)) == NULL)
+      continue;
+    port = strtok_r(NULL, " \t\r\n", &save);
+    addr = strtok_r(NULL, " \t\r\n", &save);
+    modbus_addr = addr ? strtol(addr, &end, 0) : 0;
+    if (!port || !addr || *end != '\0' || modbus_addr < 1 ||
+        modbus_addr > 247) {
+      fprintf(stderr, "%s:%d: expected <address> <port> <modbus addr> <reg>=<value> ...\n",
+              path, number);
+      goto fail;
+    }
+
+    dev = push_device_for(plan, host, port, (uint8_t) modbus_addr);
+    if (!dev) {
+      fprintf(stderr, "Can't allocate memory for the configuration\n");
+      goto fail;
+    }
+    while ((setting = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+      if (push_parse_setting(dev, setting) < 0) {
+        fprintf(stderr, "%s:%d: bad register setting %s\n", path, number,
+                setting);
+        goto fail;
+      }
+    }
+  }
+  fclose(file);
+
+  for (d = 0; d < plan->devices; d++) {
+    qsort(plan->device[d].regs, plan->device[d].count,
+          sizeof(push_register), push_register_order);
+  }
+  return 0;
+
+fail:
+  fclose(file);
+  push_free(plan);
+  return -1;
+}
+
+void push_free(push_plan *plan) {
+  int d;
+
+  for (d = 0; d < plan->devices; d++)
+    free(plan->device[d].regs);
+  free(plan->device);
+  memset(plan, 0, sizeof(*plan));
+}
+
+/* Sends a request to the device, trying again if it goes unanswered.
+ * Returns the reply length, or a GATEWAY_ result. */
+static int push_transact(gateway *gw, const uint8_t *request, int length,
+                         uint8_t *reply, int timeout) {
+  int attempt, rc = GATEWAY_TIMEOUT;
+
+  for (attempt = 0; attempt <= PUSH_RETRIES; attempt++) {
+    rc = gateway_transact(gw, request, length, reply, timeout);
+    if (rc > 0)
+      break;
+    if (rc == GATEWAY_DISCONNECTED && attempt < PUSH_RETRIES) {
+      /* Sit out the reconnect backoff */
+      int64_t wait = gw->retry_at - gateway_now();
+      if (wait > 0)
+        poll(NULL, 0, (int) wait);
+    }
+  }
+  return rc;
+}
+
+static const char *push_failure(int rc) {
+  switch (rc) {
+  case GATEWAY_TIMEOUT:      return "no reply";
+  case GATEWAY_BAD_REPLY:    return "corrupt reply";
+  case GATEWAY_DISCONNECTED: return "can't connect";
+  default:                   return "unexpected reply";
+  }
+}
+
+/* Reads the device's registers into their have values, joining registers
+ * at most PUSH_READ_GAP apart into one read. Returns 0, or -1 with the
+ * error set. */
+static int push_read(gateway *gw, push_device *dev, int timeout) {
+  uint8_t request[sizeof(modbus_req_read_reg) + CRC16_SIZE + 1];
+  uint8_t reply[GATEWAY_FRAME_MAX];
+  int first, last, r, rc;
+
+  for (first = 0; first < dev->count; first = last + 1) {
+    uint16_t start = dev->regs[first].reg;
+    uint16_t qty;
+
+    for (last = first; last + 1 < dev->count; last++) {
+      if (dev->regs[last + 1].reg - start >= MODBUS_REG_READ_QTY_MAX ||
+          dev->regs[last + 1].reg - dev->regs[last].reg > PUSH_READ_GAP)
+        break;
+    }
+    qty = dev->regs[last].reg - start + 1;
+
+    rc = push_transact(gw, request,
+                       modbus_frame_read(request, dev->modbus_addr, start, qty),
+                       reply, timeout);
+    if (rc > 0 && (reply[BYTEPOS_MODBUS_FUNC] & 0x80)) {
+      snprintf(dev->error, sizeof(dev->error),
+               "exception %d reading registers %u-%u", reply[2], start,
+               start + qty - 1);
+      return -1;
+    }
+    if (rc < 0 || reply[BYTEPOS_MODBUS_FUNC] != MODBUS_FUNC_READ_REG ||
+        reply[2] != 2 * qty) {
+      snprintf(dev->error, sizeof(dev->error), "%s reading registers %u-%u",
+               push_failure(rc), start, start + qty - 1);
+      return -1;
+    }
+
+    for (r = first; r <= last; r++) {
+      const uint8_t *val = reply + 3 + 2 * (dev->regs[r].reg - start);
+      dev->regs[r].have = (uint16_t) (val[0] << 8 | val[1]);
+    }
+  }
+  return 0;
+}
+
+/* Writes the registers that differ, a run of consecutive ones at a time.
+ * Returns 0, or -1 with the error set. */
+static int push_write(gateway *gw, push_device *dev, int timeout) {
+  uint8_t request[sizeof(modbus_req_write_multireg) +
+                  2 * PUSH_WRITE_QTY_MAX + CRC16_SIZE + 1];
+  uint8_t reply[GATEWAY_FRAME_MAX];
+  uint16_t vals[PUSH_WRITE_QTY_MAX];
+  int first, last, r, rc;
+
+  for (first = 0; first < dev->count; first = last + 1) {
+    last = first;
+    if (dev->regs[first].have == dev->regs[first].want)
+      continue;
+    while (last + 1 < dev->count && last + 1 - first < PUSH_WRITE_QTY_MAX &&
+           dev->regs[last + 1].reg == dev->regs[last].reg + 1 &&
+           dev->regs[last + 1].have != dev->regs[last + 1].want)
+      last++;
+
+    for (r = first; r <= last; r++)
+      vals[r - first] = dev->regs[r].want;
+    rc = push_transact(gw, request,
+                       modbus_frame_writem(request, dev->modbus_addr,
+                                           dev->regs[first].reg, vals,
+                                           (uint16_t) (last - first + 1)),
+                       reply, timeout);
+    if (rc > 0 && (reply[BYTEPOS_MODBUS_FUNC] & 0x80)) {
+      snprintf(dev->error, sizeof(dev->error),
+               "exception %d writing registers %u-%u", reply[2],
+               dev->regs[first].reg, dev->regs[last].reg);
+      return -1;
+    }
+    /* The reply echoes the start address and quantity */
+    if (rc < 0 || reply[BYTEPOS_MODBUS_FUNC] != MODBUS_FUNC_WRITE_MULTIREG ||
+        memcmp(reply + 2, request + 2, 4) != 0) {
+      snprintf(dev->error, sizeof(dev->error), "%s writing registers %u-%u",
+               push_failure(rc), dev->regs[first].reg, dev->regs[last].reg);
+      return -1;
+    }
+    dev->written += last - first + 1;
+    dev->writes++;
+  }
+  return 0;
+}
+
+/* Reads, writes what differs and verifies one device. Returns 0 or -1. */
+static int push_device_run(gateway *gw, push_device *dev, int timeout) {
+  int r;
+
+  if (push_read(gw, dev, timeout) < 0 || push_write(gw, dev, timeout) < 0)
+    return -1;
+  if (dev->writes == 0)
+    return 0;
+
+  if (push_read(gw, dev, timeout) < 0)
+    return -1;
+  for (r = 0; r < dev->count; r++) {
+    if (dev->regs[r].have != dev->regs[r].want) {
+      snprintf(dev->error, sizeof(dev->error),
+               "register %u reads %u after writing %u", dev->regs[r].reg,
+               dev->regs[r].have, dev->regs[r].want);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Shared by the workers: the devices ordered by gateway, where each
+ * gateway's devices start, and the next gateway to take */
+typedef struct push_work {
+  push_plan *plan;
+  int       *order;
+  int       *start;         /* endpoints + 1 entries */
+  int        endpoints;
+  int        next;
+  int        timeout;
+  int        failed;
+} push_work;
+
+static push_plan *sort_plan;
+
+static int push_gateway_order(const void *a, const void *b) {
+  const push_device *x = &sort_plan->device[*(const int *) a];
+  const push_device *y = &sort_plan->device[*(const int *) b];
+  int c = strcmp(x->host, y->host);
+
+  if (c == 0)
+    c = strcmp(x->port, y->port);
+  return c ? c : (int) x->modbus_addr - (int) y->modbus_addr;
+}
+
+static void *push_worker(void *arg) {
+  push_work *work = (push_work *) arg;
+  int e, i;
+
+  while ((e = __sync_fetch_and_add(&work->next, 1)) < work->endpoints) {
+    push_device *first = &work->plan->device[work->order[work->start[e]]];
+    gateway gw;
+    int ok = gateway_init_device(&gw, first->host, first->port) == 0;
+
+    for (i = work->start[e]; i < work->start[e + 1]; i++) {
+      push_device *dev = &work->plan->device[work->order[i]];
+
+      if (!ok)
+        snprintf(dev->error, sizeof(dev->error), "not a gateway address");
+      if (!ok || push_device_run(&gw, dev, work->timeout) < 0) {
+        __sync_fetch_and_add(&work->failed, 1);
+        printf("FAILED %s %s %d: %s\n", dev->host, dev->port,
+               dev->modbus_addr, dev->error);
+      }
+      else {
+        printf("OK %s %s %d: %d registers, %d written in %d requests\n",
+               dev->host, dev->port, dev->modbus_addr, dev->count,
+               dev->written, dev->writes);
+      }
+      fflush(stdout);
+    }
+    gateway_close(&gw);
+  }
+  return NULL;
+}
+
+int push_run(push_plan *plan, int jobs, int timeout) {
+  push_work work;
+  pthread_t *threads;
+  int d, e, t;
+
+  memset(&work, 0, sizeof(work));
+  work.plan = plan;
+  work.timeout = timeout;
+  work.order = malloc(plan->devices * sizeof(int));
+  work.start = malloc((plan->devices + 1) * sizeof(int));
+  threads = malloc((jobs > 0 ? jobs : 1) * sizeof(pthread_t));
+  if (!work.order || !work.start || !threads) {
+    fprintf(stderr, "Can't allocate memory for the configuration push\n");
+    free(work.order);
+    free(work.start);
+    free(threads);
+    return plan->devices;
+  }
+
+  for (d = 0; d < plan->devices; d++)
+    work.order[d] = d;
+  sort_plan = plan;
+  qsort(work.order, plan->devices, sizeof(int), push_gateway_order);
+  for (d = 0, e = 0; d < plan->devices; d++) {
+    const push_device *dev = &plan->device[work.order[d]];
+    const push_device *prev = d ? &plan->device[work.order[d - 1]] : NULL;
+    if (!prev || strcmp(dev->host, prev->host) != 0 ||
+        strcmp(dev->port, prev->port) != 0)
+      work.start[e++] = d;
+  }
+  work.start[e] = plan->devices;
+  work.endpoints = e;
+
+  if (jobs > work.endpoints)
+    jobs = work.endpoints;
+  for (t = 0; t < jobs; t++) {
+    if (pthread_create(&threads[t], NULL, push_worker, &work) != 0)
+      break;
+  }
+  if (t == 0)
+    push_worker(&work);   /* no threads to be had: do it all here */
+  while (t-- > 0)
+    pthread_join(threads[t], NULL);
+
+  free(work.order);
+  free(work.start);
+  free(threads);
+  return work.failed;
+}
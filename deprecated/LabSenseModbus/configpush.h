@@ -0,0 +1,73 @@
+#ifndef CONFIGPUSH_H
+#define CONFIGPUSH_H
+
+/* Pushing a desired register state to a fleet of meters. The plan file
+ * has a line per device:
+ *
+ *   <gateway address> <port> <modbus addr> <reg>=<value>[,<value>...] ...
+ *
+ * where a list of values goes to consecutive registers, values are
+ * decimal or 0x hexadecimal (negative ones as 16 bit two's complement),
+ * and # starts a comment. Lines for the same device add up. A serial
+ * device and its settings can stand for the address and port (see
+ * gateway_init_device).
+ *
+ * Each device's registers are read first, in reads that cover registers
+ * at most PUSH_READ_GAP apart. Only the registers that differ are written,
+ * each run of consecutive ones with one write multiple registers request
+ * (0x10), and the device is read again to verify them. A gateway carries
+ * one request at a time, so the devices behind one are done in turn over
+ * a single connection, while up to `jobs` gateways are worked on at once.
+ * A request that goes unanswered is tried PUSH_RETRIES more times. */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PUSH_READ_GAP       8       /* registers read over to join reads */
+#define PUSH_WRITE_QTY_MAX  123     /* registers per write request */
+#define PUSH_RETRIES        2
+#define PUSH_DEFAULT_JOBS   16
+#define PUSH_DEFAULT_TIMEOUT 1000   /* ms */
+
+typedef struct push_register {
+  uint16_t  reg;
+  uint16_t  want;
+  uint16_t  have;           /* as read, before and after writing */
+} push_register;
+
+typedef struct push_device {
+  char      host[64];       /* gateway address, or serial device */
+  char      port[16];       /* port, or serial settings */
+  uint8_t   modbus_addr;
+  int       count;          /* registers, sorted by address */
+  int       capacity;
+  push_register *regs;
+  int       written;        /* registers written */
+  int       writes;         /* write requests */
+  char      error[96];      /* why the push failed; empty if it didn't */
+} push_device;
+
+typedef struct push_plan {
+  int       devices;
+  int       capacity;
+  push_device *device;
+} push_plan;
+
+/* Reads a plan file. Returns 0, or -1 and prints why. */
+int push_load(push_plan *plan, const char *path);
+
+/* Pushes the plan to up to jobs gateways at a time, waiting timeout ms
+ * for each reply, and prints a line per device as it is done. Returns
+ * the number of devices that failed; their error says why. */
+int push_run(push_plan *plan, int jobs, int timeout);
+
+void push_free(push_plan *plan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
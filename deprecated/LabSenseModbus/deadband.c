@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <math.h>
+#include "deadband.h"
+
+int deadband_init(deadband_filter *filter, int count,
+                  const deadband_config *config) {
+  filter->config = *config;
+  filter->count = count;
+  filter->reported = (float *) malloc(count * sizeof(float));
+  filter->reported_at = (double *) malloc(count * sizeof(double));
+  filter->pending = (float *) malloc(count * sizeof(float));
+  filter->held = (uint8_t *) malloc(count);
+
+  if (!filter->reported || !filter->reported_at || !filter->pending ||
+      !filter->held) {
+    deadband_free(filter);
+    return 0;
+  }
+
+  deadband_reset(filter);
+  return 1;
+}
+
+void deadband_free(deadband_filter *filter) {
+  free(filter->reported);
+  free(filter->reported_at);
+  free(filter->pending);
+  free(filter->held);
+  filter->reported = NULL;
+  filter->reported_at = NULL;
+  filter->pending = NULL;
+  filter->held = NULL;
+  filter->count = 0;
+}
+
+void deadband_reset(deadband_filter *filter) {
+  int c;
+
+  for (c = 0; c < filter->count; c++) {
+    filter->reported[c] = 0;
+    filter->reported_at[c] = -1;
+    filter->held[c] = 0;
+  }
+  filter->heartbeat_at = -1;
+}
+
+/* Whether a value is out of the deadband around the reported one. A NaN
+ * sample never is. */
+static inline int deadband_outside(const deadband_config *config,
+                                   float value, float reported) {
+  float delta = fabsf(value - reported);
+  float limit = config->abs_deadband;
+  float relative = config->rel_deadband * fabsf(reported);
+
+  limit = (relative > limit) ? relative : limit;
+  return delta > limit;
+}
+
+/* Whether one channel reports. Branch free, so the loop in deadband_apply
+ * vectorizes. A NaN sample is only reported when forced. */
+static inline int deadband_test(const deadband_config *config, float value,
+                                float reported, double reported_at,
+                                double now) {
+  double age = now - reported_at;
+
+  int changed = deadband_outside(config, value, reported) &
+                (age >= config->min_interval);
+  int forced = (config->max_interval > 0) & (age >= config->max_interval);
+  int never = (reported_at < 0);
+
+  return changed | forced | never;
+}
+
+/* Records the reports chosen in report[] */
+static int deadband_commit(deadband_filter *filter, const float *values,
+                           double now, uint8_t *report) {
+  int c;
+  int reports = 0;
+
+  for (c = 0; c < filter->count; c++) {
+    if (report[c]) {
+      filter->reported[c] = values[c];
+      filter->reported_at[c] = now;
+      filter->held[c] = 0;
+      reports++;
+    }
+  }
+  return reports;
+}
+
+static int deadband_heartbeat_due(deadband_filter *filter, double now) {
+  if (filter->config.heartbeat <= 0)
+    return 0;
+  if (filter->heartbeat_at >= 0 &&
+      now - filter->heartbeat_at < filter->config.heartbeat)
+    return 0;
+
+  filter->heartbeat_at = now;
+  return 1;
+}
+
+int deadband_apply(deadband_filter *filter, const float *values, double now,
+                   uint8_t *report) {
+  const deadband_config *config = &filter->config;
+  const float *reported = filter->reported;
+  const double *reported_at = filter->reported_at;
+  int count = filter->count;
+  int c;
+
+  if (deadband_heartbeat_due(filter, now)) {
+    for (c = 0; c < count; c++)
+      report[c] = 1;
+  }
+  else {
+    for (c = 0; c < count; c++)
+      report[c] = (uint8_t) deadband_test(config, values[c], reported[c],
+                                          reported_at[c], now);
+  }
+
+  return deadband_commit(filter, values, now, report);
+}
+
+int deadband_apply_one(deadband_filter *filter, int channel, float value,
+                       double now) {
+  if (channel < 0 || channel >= filter->count)
+    return 1;
+
+  if (!deadband_test(&filter->config, value, filter->reported[channel],
+                     filter->reported_at[channel], now)) {
+    /* Either within the deadband, or a change too soon after the last
+     * report; only the latter waits for deadband_due */
+    filter->pending[channel] = value;
+    filter->held[channel] = (uint8_t) deadband_outside(&filter->config, value,
+                                                       filter->reported[channel]);
+    return 0;
+  }
+
+  filter->reported[channel] = value;
+  filter->reported_at[channel] = now;
+  filter->held[channel] = 0;
+  return 1;
+}
+
+int deadband_due(deadband_filter *filter, double now, uint8_t *report) {
+  const deadband_config *config = &filter->config;
+  int heartbeat = deadband_heartbeat_due(filter, now);
+  int c;
+
+  for (c = 0; c < filter->count; c++) {
+    double reported_at = filter->reported_at[c];
+    int forced = (config->max_interval > 0) &
+                 (now - reported_at >= config->max_interval);
+    int held = filter->held[c] & (now - reported_at >= config->min_interval);
+    report[c] = (uint8_t) ((reported_at >= 0) & (heartbeat | forced | held));
+    if (report[c] && filter->held[c])
+      filter->reported[c] = filter->pending[c];
+  }
+
+  return deadband_commit(filter, filter->reported, now, report);
+}
@@ -0,0 +1,77 @@
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+/* Deadband filter shared by the pollers (the Veris channels here, the door
+ * and motion states in LabSenseZwave). It decides which values of a set of
+ * channels are worth reporting upstream: a channel reports when it has
+ * moved out of its deadband since it last reported, but never more often
+ * than min_interval and at least every max_interval seconds. Every
+ * heartbeat seconds all channels report together, so consumers can rebuild
+ * a full snapshot.
+ *
+ * A change that comes within min_interval of the last report is held
+ * rather than dropped. A polled source's next sample carries it anyway;
+ * for sources that only send on change, deadband_due reports it once
+ * min_interval has passed, so the last state before a quiet spell still
+ * goes out.
+ *
+ * The state is kept as one array per field, and deadband_apply() works on
+ * a whole vector of samples at once. */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct deadband_config {
+  float   abs_deadband;   /* report when |value - reported| > abs_deadband */
+  float   rel_deadband;   /* ... or > rel_deadband * |reported| */
+  double  min_interval;   /* seconds; 0 reports every change */
+  double  max_interval;   /* seconds; 0 never forces a report */
+  double  heartbeat;      /* seconds; 0 disables the full report */
+} deadband_config;
+
+typedef struct deadband_filter {
+  deadband_config config;
+  int       count;          /* number of channels */
+  float    *reported;       /* value last reported, per channel */
+  double   *reported_at;    /* time of that report; < 0 if never reported */
+  float    *pending;        /* latest value, per channel */
+  uint8_t  *held;           /* 1 if pending is a change not reported yet */
+  double    heartbeat_at;   /* time of the last full report */
+} deadband_filter;
+
+/* Allocates the state for count channels. Returns 1 on success, 0 if out
+ * of memory. */
+int deadband_init(deadband_filter *filter, int count,
+                  const deadband_config *config);
+void deadband_free(deadband_filter *filter);
+
+/* Makes every channel report on its next sample */
+void deadband_reset(deadband_filter *filter);
+
+/* Filters one sample of every channel taken at time now (seconds). Sets
+ * report[c] to 1 for the channels to report, 0 for the others, and
+ * returns the number of channels to report. */
+int deadband_apply(deadband_filter *filter, const float *values, double now,
+                   uint8_t *report);
+
+/* Filters one sample of a single channel, for sources that report one
+ * value at a time. Returns 1 if it should be reported; a change held back
+ * by min_interval is kept for deadband_due. */
+int deadband_apply_one(deadband_filter *filter, int channel, float value,
+                       double now);
+
+/* For sources that only send on change: sets report[c] for the channels
+ * that have reported before but are due a forced report (max_interval or
+ * heartbeat) at time now, or hold a change and are past min_interval, and
+ * marks them reported with their latest value, which is then in
+ * reported[c]. Returns the number of channels due. */
+int deadband_due(deadband_filter *filter, double now, uint8_t *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
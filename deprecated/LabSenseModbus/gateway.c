@@ -0,0 +1,669 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include "E30ModbusMsg.h"
+#include "modbusframe.h"
+#include "gateway.h"
+
+#define GATEWAY_DEFAULT_INTERVAL  (1000)  /* ms */
+#define GATEWAY_DEFAULT_TIMEOUT   (1000)  /* ms */
+
+/* The blocks the client knows how to handle (see print_received_msg) */
+typedef struct gateway_block {
+  const char *name;
+  Type        type;
+  uint16_t    reg_addr;
+  uint16_t    reg_qty;
+} gateway_block;
+
+static const gateway_block blocks[] = {
+  { "eaton",       Eaton,            999,  54 },
+  { "power",       VerisPower,       2083, 42 },
+  { "powerfactor", VerisPowerFactor, 2267, 42 },
+  { "current",     VerisCurrent,     2251, 42 },
+};
+
+int64_t gateway_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int64_t gateway_clock_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int64_t gateway_sample_ns(const gateway_slave *slave, int64_t *uncertainty) {
+  int64_t half = (slave->received_ns - slave->sent_ns) / 2;
+
+  if (half < 0)
+    half = 0;     /* the wall clock stepped back */
+  *uncertainty = half;
+  return slave->sent_ns + half;
+}
+
+int gateway_init(gateway *gw, const char *ip, int port) {
+  char digits[16];
+
+  if (ip[0] == '/') {
+    fprintf(stderr, "Not a gateway address: %s\n", ip);
+    return -1;
+  }
+  snprintf(digits, sizeof(digits), "%d", port);
+  return gateway_init_device(gw, ip, digits);
+}
+
+int gateway_init_device(gateway *gw, const char *host, const char *port) {
+  memset(gw, 0, sizeof(*gw));
+  gw->sock = -1;
+  gw->rtu.fd = -1;
+  gw->state = GATEWAY_IDLE;
+  gw->seed = (unsigned) time(NULL) ^ ((unsigned) getpid() << 16) ^
+             (unsigned) (uintptr_t) gw;
+
+  if (host[0] == '/') {
+    gw->serial = 1;
+    snprintf(gw->device, sizeof(gw->device), "%s", host);
+    snprintf(gw->settings, sizeof(gw->settings), "%s", port);
+    return 0;
+  }
+
+  gw->address.sin_family = AF_INET;
+  gw->address.sin_port = htons(atoi(port));
+  if (inet_pton(AF_INET, host, &gw->address.sin_addr) != 1) {
+    fprintf(stderr, "Not a gateway address: %s\n", host);
+    return -1;
+  }
+  snprintf(gw->device, sizeof(gw->device), "%s:%s", host, port);
+  return 0;
+}
+
+int gateway_add_slave(gateway *gw, const char *spec) {
+  gateway_slave *slave;
+  char name[16];
+  int addr, interval = GATEWAY_DEFAULT_INTERVAL;
+  int timeout = GATEWAY_DEFAULT_TIMEOUT, hedges = 0;
+  unsigned b;
+
+  if (gw->slaves == GATEWAY_MAX_SLAVES) {
+    fprintf(stderr, "At most %d slaves per gateway\n", GATEWAY_MAX_SLAVES);
+    return -1;
+  }
+  if (sscanf(spec, "%d:%15[a-z]:%d:%d:%d", &addr, name, &interval,
+             &timeout, &hedges) < 2 ||
+      addr < 1 || addr > 247 || interval <= 0 || timeout <= 0 ||
+      hedges < 0 || hedges > GATEWAY_MAX_HEDGES) {
+    fprintf(stderr, "Bad slave %s, expected addr:block[:interval_ms[:timeout_ms[:hedges]]]\n",
+            spec);
+    return -1;
+  }
+  for (b = 0; b < sizeof(blocks) / sizeof(blocks[0]); b++) {
+    if (strcmp(name, blocks[b].name) == 0)
+      break;
+  }
+  if (b == sizeof(blocks) / sizeof(blocks[0])) {
+    fprintf(stderr, "Unknown block %s (eaton, power, powerfactor, current)\n",
+            name);
+    return -1;
+  }
+
+  slave = &gw->slave[gw->slaves++];
+  memset(slave, 0, sizeof(*slave));
+  slave->modbus_addr = (uint8_t) addr;
+  slave->type = blocks[b].type;
+  slave->reg_addr = blocks[b].reg_addr;
+  slave->reg_qty = blocks[b].reg_qty;
+  slave->interval = interval;
+  slave->timeout = timeout;
+  slave->hedges = hedges;
+  slave->due = 0;           /* read right away */
+  gw->last = gw->slaves - 1;  /* the first round goes in order */
+  return 0;
+}
+
+void gateway_close(gateway *gw) {
+  if (gw->serial)
+    rtu_close(&gw->rtu);
+  else if (gw->sock >= 0)
+    close(gw->sock);
+  gw->sock = -1;
+  gw->state = GATEWAY_IDLE;
+}
+
+/* Closes the connection that failed or was lost and schedules the next
+ * try: GATEWAY_RECONNECT_MIN << reconnects ms, jittered */
+static void gateway_retry(gateway *gw, int64_t now, const char *why) {
+  int64_t backoff = (int64_t) GATEWAY_RECONNECT_MIN <<
+                    (gw->reconnects < 16 ? gw->reconnects : 16);
+
+  gateway_close(gw);
+  gw->reconnects++;
+  if (backoff > GATEWAY_MAX_BACKOFF)
+    backoff = GATEWAY_MAX_BACKOFF;
+  backoff = backoff / 2 + rand_r(&gw->seed) % (backoff / 2 + 1);
+  gw->retry_at = now + backoff;
+  fprintf(stderr, "%s %s, connecting again in %d ms\n", why, gw->device,
+          (int) backoff);
+}
+
+/* The connection is up. The backoff is only reset once it has carried a
+ * reply (gateway_answered), so a gateway that accepts connections and
+ * drops them straight away is still backed off. */
+static void gateway_connected(gateway *gw) {
+  gw->state = GATEWAY_CONNECTED;
+  if (gw->reconnects)
+    fprintf(stderr, "Connected to %s\n", gw->device);
+}
+
+/* A sound reply came over the connection */
+static void gateway_answered(gateway *gw) {
+  gw->reconnects = 0;
+}
+
+/* Starts connecting, without waiting for a TCP connect to complete */
+static void gateway_connect(gateway *gw, int64_t now) {
+  int nodelay = 1, stamps = 1;
+
+  if (gw->serial) {
+    if (rtu_open(&gw->rtu, gw->device, gw->settings) < 0) {
+      gateway_retry(gw, now, "Can't open");
+      return;
+    }
+    gw->sock = gw->rtu.fd;
+    gateway_connected(gw);
+    return;
+  }
+
+  gw->sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (gw->sock < 0) {
+    perror("socket() failed");
+    gateway_retry(gw, now, "Can't connect to");
+    return;
+  }
+  fcntl(gw->sock, F_SETFL, fcntl(gw->sock, F_GETFL) | O_NONBLOCK);
+  /* Requests are small and each waits for its reply, so Nagle would hold
+   * a hedge back until the last request is acknowledged */
+  setsockopt(gw->sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+#ifdef SO_TIMESTAMPNS
+  setsockopt(gw->sock, SOL_SOCKET, SO_TIMESTAMPNS, &stamps, sizeof(stamps));
+#else
+  (void) stamps;
+#endif
+
+  if (connect(gw->sock, (struct sockaddr *) &gw->address,
+              sizeof(gw->address)) == 0) {
+    gateway_connected(gw);
+  }
+  else if (errno == EINPROGRESS) {
+    gw->state = GATEWAY_CONNECTING;
+    gw->connect_by = now + GATEWAY_CONNECT_TIMEOUT;
+  }
+  else {
+    perror("connect() to the gateway failed");
+    gateway_retry(gw, now, "Can't connect to");
+  }
+}
+
+/* Moves the connection along. Returns 1 once connected, or 0 with *wait
+ * set to when to look again. */
+static int gateway_progress(gateway *gw, int64_t now, int64_t *wait) {
+  struct pollfd pfd;
+  int error = 0;
+  socklen_t length = sizeof(error);
+
+  if (gw->state == GATEWAY_IDLE) {
+    if (now < gw->retry_at) {
+      *wait = gw->retry_at - now;
+      return 0;
+    }
+    gateway_connect(gw, now);
+  }
+  else if (gw->state == GATEWAY_CONNECTING) {
+    pfd.fd = gw->sock;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) > 0) {
+      if (getsockopt(gw->sock, SOL_SOCKET, SO_ERROR, &error, &length) < 0)
+        error = errno;
+      if (error == 0) {
+        gateway_connected(gw);
+      }
+      else {
+        fprintf(stderr, "connect() to the gateway failed: %s\n",
+                strerror(error));
+        gateway_retry(gw, now, "Can't connect to");
+      }
+    }
+    else if (now >= gw->connect_by) {
+      gateway_retry(gw, now, "Timed out connecting to");
+    }
+  }
+
+  if (gw->state == GATEWAY_CONNECTED)
+    return 1;
+  if (gw->state == GATEWAY_CONNECTING)
+    *wait = (gw->connect_by - now < GATEWAY_CONNECT_POLL) ?
+            gw->connect_by - now : GATEWAY_CONNECT_POLL;
+  else
+    *wait = gw->retry_at - now;
+  return 0;
+}
+
+gateway_slave *gateway_next(gateway *gw, int64_t now, int64_t *wait) {
+  gateway_slave *best = NULL;
+  int s;
+
+  if (gw->slaves == 0) {
+    *wait = GATEWAY_DEFAULT_INTERVAL;
+    return NULL;
+  }
+
+  /* Starting after the last slave read, so ties go round robin */
+  for (s = 1; s <= gw->slaves; s++) {
+    gateway_slave *slave = &gw->slave[(gw->last + s) % gw->slaves];
+    if (!best || slave->due < best->due)
+      best = slave;
+  }
+
+  if (best->due > now) {
+    *wait = best->due - now;
+    return NULL;
+  }
+  /* Only connect once a read is due */
+  if (gw->state != GATEWAY_CONNECTED && !gateway_progress(gw, now, wait))
+    return NULL;
+  gw->last = best - gw->slave;
+  return best;
+}
+
+/* Receives over TCP, setting *stamp to when the kernel got the data,
+ * or to now if it doesn't say */
+static ssize_t gateway_recv_stamped(gateway *gw, uint8_t *buf, int length,
+                                    int64_t *stamp) {
+  union {
+    char           buf[CMSG_SPACE(sizeof(struct timespec))];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = { buf, (size_t) length };
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  ssize_t n;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  n = recvmsg(gw->sock, &msg, MSG_DONTWAIT);
+  if (n <= 0)
+    return n;
+
+  *stamp = gateway_clock_ns();
+#ifdef SO_TIMESTAMPNS
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      struct timespec ts;
+      memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+      *stamp = (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+  }
+#else
+  (void) cmsg;
+#endif
+  return n;
+}
+
+/* Reads up to length bytes of what has arrived, without blocking, and
+ * sets *stamp (if given) to when they started arriving. Returns the
+ * count, 0 if nothing has, or -1 if the connection is gone. */
+static int gateway_recv(gateway *gw, uint8_t *buf, int length,
+                        int64_t *stamp) {
+  int64_t ignored;
+  ssize_t n;
+
+  if (!stamp)
+    stamp = &ignored;
+  if (gw->serial) {
+    n = read(gw->sock, buf, length);
+    /* The characters read came in one after another until now */
+    *stamp = gateway_clock_ns() - (int64_t) n * gw->rtu.char_us * 1000;
+  }
+  else
+    n = gateway_recv_stamped(gw, buf, length, stamp);
+
+  if (n > 0) {
+    if (gw->serial)
+      rtu_activity(&gw->rtu);
+    return (int) n;
+  }
+  if (n == 0)
+    return gw->serial ? 0 : -1;     /* end of file only on a socket */
+  if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+    return 0;
+  return -1;
+}
+
+/* Throws away what is left of earlier replies, such as the late reply of
+ * a slave that timed out, so it is not taken for the next one */
+static int gateway_drain(gateway *gw) {
+  uint8_t junk[GATEWAY_FRAME_MAX];
+  int n;
+
+  while ((n = gateway_recv(gw, junk, sizeof(junk), NULL)) > 0)
+    fprintf(stderr, "Dropped %d stale bytes from the gateway\n", n);
+  return n;
+}
+
+static int gateway_receive(gateway *gw, int modbus_addr, uint8_t *reply,
+                           int64_t deadline);
+
+/* Waits until owed_until for the replies still owed to the hedges of the
+ * last read, which would otherwise be taken for the next reply of that
+ * slave. Returns 0, or GATEWAY_DISCONNECTED. */
+static int gateway_collect(gateway *gw) {
+  uint8_t junk[GATEWAY_FRAME_MAX];
+  int rc;
+
+  while (gw->owed > 0) {
+    rc = gateway_receive(gw, -1, junk, gw->owed_until);
+    if (rc == GATEWAY_DISCONNECTED)
+      return rc;
+    if (rc == GATEWAY_TIMEOUT)
+      break;
+    gw->owed--;
+  }
+  gw->owed = 0;
+  return 0;
+}
+
+/* Length of the reply whose first 3 bytes are in frame */
+static int reply_length(const uint8_t *frame) {
+  if (frame[BYTEPOS_MODBUS_FUNC] & 0x80)
+    return 3 + CRC16_SIZE;
+  switch (frame[BYTEPOS_MODBUS_FUNC]) {
+  case MODBUS_FUNC_READ_REG:
+  case MODBUS_FUNC_REPORT_SLAVEID:
+    return 3 + frame[2] + CRC16_SIZE;
+  default:
+    return sizeof(modbus_reply_write_reg) + CRC16_SIZE;
+  }
+}
+
+/* Receives the reply of slave modbus_addr until deadline. Replies from
+ * other slaves are dropped; with modbus_addr -1, any reply is taken.
+ * Returns the length,
+ * GATEWAY_TIMEOUT or GATEWAY_DISCONNECTED. On a serial line, a frame that
+ * stops short is returned as it is, to fail its CRC check; over TCP, one
+ * that is coming in at the deadline gets GATEWAY_FRAME_GRACE ms more. */
+static int gateway_receive(gateway *gw, int modbus_addr, uint8_t *reply,
+                           int64_t deadline) {
+  int length = 0;
+  int expected = 3;
+  int late = 0;
+
+  for (;;) {
+    while (length < expected) {
+      struct pollfd pfd = { gw->sock, POLLIN, 0 };
+      int64_t left = deadline - gateway_now();
+      int silence = (gw->serial && length > 0) ? GATEWAY_RTU_SILENCE : -1;
+      int64_t stamp;
+      int n, rc;
+
+      if (left <= 0 && length > 0 && !gw->serial && !late) {
+        /* TCP has no gaps to resync on, so a reply that has started
+         * coming in is let finish rather than left in the stream */
+        deadline += GATEWAY_FRAME_GRACE;
+        late = 1;
+        continue;
+      }
+      if (left <= 0)
+        return (silence > 0) ? length : GATEWAY_TIMEOUT;
+      rc = poll(&pfd, 1, (silence > 0 && silence < left) ? silence : (int) left);
+      if (rc < 0 && errno == EINTR)
+        continue;
+      if (rc == 0)
+        return (silence > 0) ? length : GATEWAY_TIMEOUT;
+      if (rc < 0 ||
+          (n = gateway_recv(gw, reply + length, expected - length,
+                            &stamp)) < 0) {
+        perror("recv() from the gateway failed or connection closed");
+        return GATEWAY_DISCONNECTED;
+      }
+      if (length == 0 && n > 0)
+        gw->received_ns = stamp;
+      length += n;
+      if (expected == 3 && length == 3)
+        expected = reply_length(reply);
+    }
+
+    if (modbus_addr < 0 || reply[BYTEPOS_MODBUS_ADDR] == modbus_addr)
+      return length;
+    fprintf(stderr, "Dropped a late reply from slave %d\n",
+            reply[BYTEPOS_MODBUS_ADDR]);
+    length = 0;
+    expected = 3;
+  }
+}
+
+/* Schedules the next read: on time after a reply, backed off after a
+ * failure */
+static void gateway_reschedule(gateway_slave *slave, int64_t now, int ok) {
+  int64_t backoff;
+
+  if (ok) {
+    slave->failures = 0;
+    slave->due += slave->interval;
+    if (slave->due < now)
+      slave->due = now;     /* missed reads are not made up */
+    return;
+  }
+
+  slave->failures++;
+  backoff = (int64_t) slave->interval <<
+            (slave->failures < 16 ? slave->failures : 16);
+  if (backoff > GATEWAY_MAX_BACKOFF)
+    backoff = GATEWAY_MAX_BACKOFF > slave->interval ?
+              GATEWAY_MAX_BACKOFF : slave->interval;
+  slave->due = now + backoff;
+}
+
+/* Folds a round trip time into the slave's estimates and derives its
+ * timeout from them, as TCP does (RFC 6298): srtt + 4 rttvar, but at
+ * least GATEWAY_RTO_MIN */
+static void gateway_rtt_sample(gateway_slave *slave, int64_t rtt) {
+  int64_t delta;
+
+  if (slave->srtt == 0) {
+    slave->srtt = rtt > 0 ? rtt : 1;
+    slave->rttvar = rtt / 2;
+  }
+  else {
+    delta = rtt - slave->srtt;
+    slave->rttvar += ((delta < 0 ? -delta : delta) - slave->rttvar) / 4;
+    slave->srtt += delta / 8;
+    if (slave->srtt <= 0)
+      slave->srtt = 1;
+  }
+  slave->rto = (int) ((slave->srtt + 4 * slave->rttvar + 999) / 1000);
+  if (slave->rto < GATEWAY_RTO_MIN)
+    slave->rto = GATEWAY_RTO_MIN;
+}
+
+/* Sends the read request and notes when in sent_ns. Returns 0, or
+ * GATEWAY_DISCONNECTED. */
+static int gateway_send(gateway *gw, const uint8_t *request, int length) {
+  if (gw->serial) {
+    if (rtu_send(&gw->rtu, request, length) < 0) {
+      gateway_retry(gw, gateway_now(), "Lost");
+      return GATEWAY_DISCONNECTED;
+    }
+    gw->sent_ns = gateway_clock_ns();   /* the request is out */
+    return 0;
+  }
+
+  gw->sent_ns = gateway_clock_ns();
+  if (send(gw->sock, request, length, MSG_NOSIGNAL) != length) {
+    perror("send() to the gateway failed");
+    gateway_retry(gw, gateway_now(), "Lost the connection to");
+    return GATEWAY_DISCONNECTED;
+  }
+  return 0;
+}
+
+int gateway_read(gateway *gw, gateway_slave *slave, uint8_t *reply) {
+  uint8_t request[sizeof(modbus_req_read_reg) + CRC16_SIZE + 1];
+  int length, limit, wait, sent = 0, rc;
+  int64_t sent_at, first_ns = 0;
+
+  if (gw->state != GATEWAY_CONNECTED)
+    return GATEWAY_DISCONNECTED;
+  if (gateway_collect(gw) < 0 || gateway_drain(gw) < 0) {
+    gateway_retry(gw, gateway_now(), "Lost the connection to");
+    return GATEWAY_DISCONNECTED;
+  }
+
+  length = modbus_frame_read(request, slave->modbus_addr, slave->reg_addr,
+                             slave->reg_qty);
+
+  /* The configured timeout is the most a request waits, counted from when
+   * the reply could start coming in on a serial line. Once round trips
+   * have been measured (from the end of the request, so including the
+   * reply's time on the wire) the estimate is used instead. */
+  limit = slave->timeout;
+  if (gw->serial)
+    limit += rtu_frame_ms(&gw->rtu, 3 + 2 * slave->reg_qty + CRC16_SIZE);
+  wait = (slave->srtt && slave->rto < limit) ? slave->rto : limit;
+
+  /* Each hedge is the same request again, sent when the last one has gone
+   * unanswered for the timeout; a reply to any of them will do */
+  do {
+    if (gateway_send(gw, request, length) < 0)
+      return GATEWAY_DISCONNECTED;
+    sent_at = rtu_now();
+    if (sent++ == 0)
+      first_ns = gw->sent_ns;
+    rc = gateway_receive(gw, slave->modbus_addr, reply, gateway_now() + wait);
+    if (rc == GATEWAY_DISCONNECTED) {
+      gateway_retry(gw, gateway_now(), "Lost the connection to");
+      return rc;
+    }
+    if (rc == GATEWAY_TIMEOUT && sent <= slave->hedges)
+      slave->hedged++;
+  } while (rc == GATEWAY_TIMEOUT && sent <= slave->hedges);
+
+  if (rc == GATEWAY_TIMEOUT) {
+    slave->timeouts++;
+    fprintf(stderr, "Slave %d timed out after %d ms (%u of %u reads)\n",
+            slave->modbus_addr, wait, slave->timeouts, slave->reads + 1);
+    /* Back off the estimate until a reply comes in (Karn) */
+    if (slave->srtt)
+      slave->rto = (2 * slave->rto < limit) ? 2 * slave->rto : limit;
+    /* The hedges that went unanswered are owed no wait */
+  }
+  else {
+    /* The reply may answer the first request, so the sample is only
+     * known to have been taken after that */
+    slave->sent_ns = first_ns;
+    slave->received_ns = gw->received_ns;
+
+    /* With hedges out, it is not known which request this answers, so
+     * the round trip is not measured (Karn). The other replies may still
+     * come, for as long as it took this one. */
+    if (sent == 1)
+      gateway_rtt_sample(slave, rtu_now() - sent_at);
+    else {
+      gw->owed = sent - 1;
+      gw->owed_until = gateway_now() + wait;
+    }
+
+    /* A reply that is sound but holds another quantity than asked for
+     * would overrun the buffers it is decoded into */
+    if (modbus_frame_check(reply, rc) < 0 ||
+        (reply[BYTEPOS_MODBUS_FUNC] == MODBUS_FUNC_READ_REG &&
+         reply[2] != 2 * slave->reg_qty)) {
+      slave->errors++;
+      rc = GATEWAY_BAD_REPLY;
+    }
+    else {
+      gateway_answered(gw);
+      if (reply[BYTEPOS_MODBUS_FUNC] & 0x80)
+        slave->errors++;
+    }
+  }
+
+  slave->reads++;
+  gateway_reschedule(slave, gateway_now(),
+                     rc > 0 && !(reply[BYTEPOS_MODBUS_FUNC] & 0x80));
+  return rc;
+}
+
+int gateway_submit(gateway *gw, const uint8_t *request, int length) {
+  int64_t wait;
+
+  /* Wait for a connect in progress, but not out a reconnect backoff */
+  while (!gateway_progress(gw, gateway_now(), &wait)) {
+    if (gw->state != GATEWAY_CONNECTING)
+      return GATEWAY_DISCONNECTED;
+    poll(NULL, 0, (int) wait);
+  }
+  return gateway_send(gw, request, length);
+}
+
+int gateway_reply(gateway *gw, const uint8_t *request, uint8_t *reply,
+                  int64_t deadline) {
+  const modbus_req_read_reg *read = (const modbus_req_read_reg *) request;
+  int rc = gateway_receive(gw, request[BYTEPOS_MODBUS_ADDR], reply, deadline);
+
+  if (rc == GATEWAY_DISCONNECTED)
+    gateway_retry(gw, gateway_now(), "Lost the connection to");
+  else if (rc > 0 &&
+           (modbus_frame_check(reply, rc) < 0 ||
+            (reply[BYTEPOS_MODBUS_FUNC] == MODBUS_FUNC_READ_REG &&
+             reply[2] != 2 * ntohs(read->modbus_reg_qty))))
+    rc = GATEWAY_BAD_REPLY;
+  else if (rc > 0)
+    gateway_answered(gw);
+  return rc;
+}
+
+int gateway_flush(gateway *gw, int64_t until) {
+  uint8_t junk[GATEWAY_FRAME_MAX];
+  int rc;
+
+  if (gw->state != GATEWAY_CONNECTED)
+    return 0;
+  while ((rc = gateway_receive(gw, -1, junk, until)) > 0)
+    ;
+  if (rc == GATEWAY_DISCONNECTED || gateway_drain(gw) < 0) {
+    gateway_retry(gw, gateway_now(), "Lost the connection to");
+    return GATEWAY_DISCONNECTED;
+  }
+  return 0;
+}
+
+int gateway_transact(gateway *gw, const uint8_t *request, int length,
+                     uint8_t *reply, int timeout) {
+  int rc;
+
+  if (gw->state == GATEWAY_CONNECTED &&
+      (gateway_collect(gw) < 0 || gateway_drain(gw) < 0)) {
+    gateway_retry(gw, gateway_now(), "Lost the connection to");
+    return GATEWAY_DISCONNECTED;
+  }
+  if ((rc = gateway_submit(gw, request, length)) < 0)
+    return rc;
+
+  if (gw->serial)
+    timeout += rtu_frame_ms(&gw->rtu, GATEWAY_FRAME_MAX);
+  return gateway_reply(gw, request, reply, gateway_now() + timeout);
+}
@@ -0,0 +1,191 @@
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+/* Polling several Modbus slaves behind one RS-485 gateway over a single
+ * TCP connection. The bus carries one request at a time, so the slaves
+ * take turns: each read is due every `interval` ms, and of the reads that
+ * are due the one due longest goes first (ties go round robin). A slave
+ * that falls behind is not owed the reads it missed, so an overloaded bus
+ * degrades to plain round robin instead of bursts.
+ *
+ * A slave only holds the bus for its own timeout. That starts at the
+ * configured timeout and then follows the slave's measured round trips the
+ * way TCP's retransmission timeout does: smoothed round trip time plus
+ * four times its mean deviation, at least GATEWAY_RTO_MIN ms and at most
+ * the configured timeout, doubled after each timeout until a reply comes
+ * in. A lost frame then costs a few round trips rather than the whole
+ * timeout. A slave with long tails can be given hedges: the request is
+ * sent again each time the last one goes unanswered for that long, and
+ * whichever reply comes first is taken. Round trips of hedged reads are
+ * not measured, since it isn't known which request was answered, and the
+ * next read first waits up to a timeout for the duplicate replies.
+ *
+ * A slave that times out or answers garbage is retried after
+ * interval << failures ms, up to
+ * GATEWAY_MAX_BACKOFF, so a dead meter costs one timeout per backoff
+ * period rather than one per round. A late reply to a timed out request
+ * is told apart by its address and dropped.
+ *
+ * The gateway can also be a serial line wired straight to the meters (see
+ * rtu.h). Replies are then complete as soon as their length is in, and a
+ * frame that goes silent for GATEWAY_RTU_SILENCE ms midway is given up.
+ *
+ * Connecting never blocks the caller: gateway_next starts a non-blocking
+ * connect and checks on it every GATEWAY_CONNECT_POLL ms until it is up
+ * or GATEWAY_CONNECT_TIMEOUT has passed, so several gateways can be polled
+ * from one loop while one of them is unreachable. A failed connect or a
+ * lost connection is retried after GATEWAY_RECONNECT_MIN << failures ms
+ * (up to GATEWAY_MAX_BACKOFF), jittered between half and all of that so
+ * clients that lost the same gateway don't all come back at once. The
+ * slaves keep their schedule meanwhile and are read as soon as the
+ * connection is back.
+ *
+ * Each reply is timestamped in wall clock nanoseconds: the request when
+ * it is handed to the kernel (or, on a serial line, once it is out on the
+ * wire), and the reply with the kernel's receive timestamp of its first
+ * segment (SO_TIMESTAMPNS), so time spent in this process doesn't count.
+ * The meter sampled somewhere in between. */
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include "SensorAct/defs.h"
+#include "rtu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GATEWAY_MAX_SLAVES    32
+#define GATEWAY_FRAME_MAX     260     /* longest reply frame */
+#define GATEWAY_MAX_BACKOFF   60000   /* ms */
+#define GATEWAY_RTU_SILENCE   20      /* ms; adapters deliver in chunks */
+#define GATEWAY_CONNECT_TIMEOUT 3000  /* ms */
+#define GATEWAY_CONNECT_POLL  100     /* ms between checks on a connect */
+#define GATEWAY_RECONNECT_MIN 500     /* ms */
+#define GATEWAY_RTO_MIN       20      /* ms */
+#define GATEWAY_FRAME_GRACE   1000    /* ms to finish a TCP reply in progress */
+#define GATEWAY_MAX_HEDGES    3
+
+/* Connection states */
+#define GATEWAY_IDLE          0       /* not connected, next try at retry_at */
+#define GATEWAY_CONNECTING    1       /* connect in progress */
+#define GATEWAY_CONNECTED     2
+
+/* gateway_read results besides a reply length */
+#define GATEWAY_TIMEOUT       -1      /* no (valid) reply in time */
+#define GATEWAY_DISCONNECTED  -2      /* not connected or connection lost */
+#define GATEWAY_BAD_REPLY     -3      /* reply with a bad CRC */
+
+typedef struct gateway_slave {
+  uint8_t   modbus_addr;
+  Type      type;           /* how its replies are handled */
+  uint16_t  reg_addr;       /* block read */
+  uint16_t  reg_qty;
+  int       interval;       /* ms between reads */
+  int       timeout;        /* most ms to wait for a reply */
+  int       hedges;         /* extra requests for a read that goes unanswered */
+  int64_t   srtt;           /* smoothed round trip time, us; 0 before any */
+  int64_t   rttvar;         /* its mean deviation, us */
+  int       rto;            /* ms to wait for a reply, from the two above */
+  int64_t   due;            /* next read, gateway_now() ms */
+  int       failures;       /* consecutive timeouts or bad replies */
+  uint32_t  reads;          /* counters since start */
+  uint32_t  timeouts;
+  uint32_t  errors;
+  uint32_t  hedged;         /* hedges sent */
+  int64_t   sent_ns;        /* last reply: its request went out, and */
+  int64_t   received_ns;    /* it started arriving (gateway_clock_ns) */
+} gateway_slave;
+
+typedef struct gateway {
+  struct sockaddr_in address;
+  int       sock;           /* -1 while not connected */
+  int       state;          /* GATEWAY_IDLE, _CONNECTING or _CONNECTED */
+  int64_t   retry_at;       /* next connect, gateway_now() ms */
+  int64_t   connect_by;     /* deadline of the connect in progress */
+  int       reconnects;     /* consecutive failed or lost connections */
+  unsigned  seed;           /* for the backoff jitter */
+  int       serial;         /* a serial line rather than TCP */
+  char      device[64];     /* serial device, or host:port for messages */
+  char      settings[16];   /* serial settings */
+  rtu_line  rtu;
+  int       slaves;
+  gateway_slave slave[GATEWAY_MAX_SLAVES];
+  int       last;           /* slave read last, for round robin ties */
+  int       owed;           /* replies still to come for hedges */
+  int64_t   owed_until;     /* how long to wait for them */
+  int64_t   sent_ns;        /* last request sent, gateway_clock_ns */
+  int64_t   received_ns;    /* last reply started arriving */
+} gateway;
+
+/* Monotonic clock in milliseconds */
+int64_t gateway_now(void);
+
+/* Wall clock in nanoseconds since the epoch, for timestamping samples */
+int64_t gateway_clock_ns(void);
+
+/* When the slave's last reply was sampled: halfway between sending the
+ * request (the first one, with hedges) and the reply starting to arrive,
+ * with half that time as the uncertainty, both in nanoseconds. */
+int64_t gateway_sample_ns(const gateway_slave *slave, int64_t *uncertainty);
+
+/* Sets up a gateway at ip:port with no slaves; does not connect yet.
+ * Returns 0, or -1 if ip is not an address. */
+int gateway_init(gateway *gw, const char *ip, int port);
+
+/* Like gateway_init, with the port as a string, or a serial device for
+ * host (starting with /) and its settings for port (see rtu_open). */
+int gateway_init_device(gateway *gw, const char *host, const char *port);
+
+/* Adds a slave from "addr:block[:interval_ms[:timeout_ms[:hedges]]]",
+ * block being eaton, power, powerfactor or current (see
+ * TCPModbusClient.c), and hedges at most GATEWAY_MAX_HEDGES. Returns 0, or
+ * -1 and prints why. */
+int gateway_add_slave(gateway *gw, const char *spec);
+
+/* The slave to read now, or NULL with *wait set to the ms until the next
+ * one is due or the connection should be looked at again. Connects and
+ * reconnects as needed, without blocking. */
+gateway_slave *gateway_next(gateway *gw, int64_t now, int64_t *wait);
+
+/* Reads the slave's block and reschedules it. Returns the reply length
+ * (exception replies included), or GATEWAY_TIMEOUT, GATEWAY_BAD_REPLY or
+ * GATEWAY_DISCONNECTED, in which case the slave stays due and the
+ * connection is retried after a backoff. reply must hold
+ * GATEWAY_FRAME_MAX bytes. */
+int gateway_read(gateway *gw, gateway_slave *slave, uint8_t *reply);
+
+/* Sends a request frame outside the schedule without waiting for the
+ * reply, so several can be in flight over TCP; replies then come back in
+ * order. Waits for a connect in progress, but returns GATEWAY_DISCONNECTED
+ * straight away while a reconnect is backed off. Returns 0 or
+ * GATEWAY_DISCONNECTED. */
+int gateway_submit(gateway *gw, const uint8_t *request, int length);
+
+/* Receives the next reply to request from its slave until deadline
+ * (gateway_now ms) and checks its CRC and, for a register read, that it
+ * holds the quantity asked for. Returns the length, GATEWAY_TIMEOUT,
+ * GATEWAY_BAD_REPLY or GATEWAY_DISCONNECTED. */
+int gateway_reply(gateway *gw, const uint8_t *request, uint8_t *reply,
+                  int64_t deadline);
+
+/* Throws away whatever replies arrive until `until` (gateway_now ms), to
+ * get back in step after a request went unanswered. Returns 0 or
+ * GATEWAY_DISCONNECTED. */
+int gateway_flush(gateway *gw, int64_t until);
+
+/* Sends any request frame outside the schedule and receives the reply of
+ * the slave it is addressed to, within timeout ms. Waits for a connect in
+ * progress, but returns GATEWAY_DISCONNECTED straight away while a
+ * reconnect is backed off. Returns the reply length (exception replies
+ * included), GATEWAY_TIMEOUT, GATEWAY_BAD_REPLY or GATEWAY_DISCONNECTED. */
+int gateway_transact(gateway *gw, const uint8_t *request, int length,
+                     uint8_t *reply, int timeout);
+
+void gateway_close(gateway *gw);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef LABSENSE_H
+#define LABSENSE_H
+
+/* Public interface of liblabsense, the ingest code shared by the Modbus
+ * client, the simulator and the benchmarks. The headers are usable from
+ * C and C++; functions are only added to them, not changed, and
+ * LABSENSE_API_VERSION goes up when they are. */
+
+#define LABSENSE_API_VERSION 5
+
+#include "modbusframe.h"
+#include "rtu.h"
+#include "gateway.h"
+#include "configpush.h"
+#include "capture.h"
+#include "deadband.h"
+#include "aggregate.h"
+#include "channelstore.h"
+#include "archive.h"
+#include "rollup.h"
+#include "SensorAct/SensorActUploader.h"
+#include "Cosm/CosmUploader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Modbus CRC (see crc16.c) */
+uint16_t calc_crc16(uint8_t* modbusframe, uint16_t length);
+uint16_t read_crc16(uint8_t* byteArr, uint16_t byteOffset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+#include <string.h>
+#include <netinet/in.h>
+#include "E30ModbusMsg.h"
+#include "modbusframe.h"
+
+int modbus_frame_seal(uint8_t *frame, int length) {
+  uint16_t crc = calc_crc16(frame, length);
+
+  frame[length]     = (uint8_t) (crc & 0x0ff);         /* lower 8bit */
+  frame[length + 1] = (uint8_t) ((crc >> 8) & 0x0ff);  /* upper 8bit */
+  frame[length + 2] = 0;                               /* end of string */
+  return length + CRC16_SIZE;
+}
+
+int modbus_frame_query(uint8_t *frame, uint8_t modbus_addr) {
+  modbus_req_report_slaveid *req_msg = (modbus_req_report_slaveid *) frame;
+
+  req_msg->modbus_addr = modbus_addr;
+  req_msg->modbus_func = MODBUS_FUNC_REPORT_SLAVEID;
+  return modbus_frame_seal(frame, sizeof(modbus_req_report_slaveid));
+}
+
+int modbus_frame_read(uint8_t *frame, uint8_t modbus_addr, uint16_t reg_addr,
+                      uint16_t reg_qty) {
+  modbus_req_read_reg *req_msg = (modbus_req_read_reg *) frame;
+
+  req_msg->modbus_addr = modbus_addr;
+  req_msg->modbus_func = MODBUS_FUNC_READ_REG;
+  req_msg->modbus_reg_addr = htons(reg_addr);
+  req_msg->modbus_reg_qty = htons(reg_qty);
+  return modbus_frame_seal(frame, sizeof(modbus_req_read_reg));
+}
+
+int modbus_frame_write(uint8_t *frame, uint8_t modbus_addr, uint16_t reg_addr,
+                       uint16_t reg_val) {
+  modbus_req_write_reg *req_msg = (modbus_req_write_reg *) frame;
+
+  req_msg->modbus_addr = modbus_addr;
+  req_msg->modbus_func = MODBUS_FUNC_WRITE_REG;
+  req_msg->modbus_reg_addr = htons(reg_addr);
+  req_msg->modbus_reg_val = htons(reg_val);
+  return modbus_frame_seal(frame, sizeof(modbus_req_write_reg));
+}
+
+int modbus_frame_writem(uint8_t *frame, uint8_t modbus_addr,
+                        uint16_t reg_addr, const uint16_t *reg_vals,
+                        uint16_t reg_qty) {
+  modbus_req_write_multireg *req_msg = (modbus_req_write_multireg *) frame;
+  int c;
+
+  req_msg->modbus_addr = modbus_addr;
+  req_msg->modbus_func = MODBUS_FUNC_WRITE_MULTIREG;
+  req_msg->modbus_reg_addr = htons(reg_addr);
+  req_msg->modbus_reg_qty = htons(reg_qty);
+  req_msg->modbus_val_bytes = (uint8_t) (2 * reg_qty);
+  for (c = 0; c < reg_qty; c++)
+    req_msg->modbus_reg_val[c] = htons(reg_vals[c]);
+  return modbus_frame_seal(frame,
+                           sizeof(modbus_req_write_multireg) + 2 * reg_qty);
+}
+
+int modbus_frame_check(const uint8_t *frame, int length) {
+  int expected;
+
+  if (length < BYTEPOS_MODBUS_FUNC + 1 + CRC16_SIZE)
+    return -1;
+
+  /* A read reply says how long it is; don't trust trailing bytes */
+  if (frame[BYTEPOS_MODBUS_FUNC] == MODBUS_FUNC_READ_REG) {
+    expected = sizeof(modbus_reply_read_reg) + frame[2] + CRC16_SIZE;
+    if (length < expected)
+      return -1;
+    length = expected;
+  }
+
+  if (calc_crc16((uint8_t *) frame, length - CRC16_SIZE) !=
+      read_crc16((uint8_t *) frame, length - CRC16_SIZE))
+    return -1;
+  return frame[BYTEPOS_MODBUS_FUNC];
+}
+
+void modbus_decode_floats(const uint8_t *regs, int count, uint32_t *values) {
+  int c;
+
+  for (c = 0; c < count; c++) {
+    uint32_t raw;
+    memcpy(&raw, regs + 4 * c, sizeof(raw));
+    values[c] = ntohl(raw);
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef MODBUSFRAME_H
+#define MODBUSFRAME_H
+
+/* Modbus RTU frames as exchanged through the gateway: builders for the
+ * requests the client sends, which append the CRC (low byte first), a
+ * check for replies, and the decode of the meters' float registers (an
+ * IEEE 754 value in two big-endian registers, high word first).
+ *
+ * The builders write one byte past the CRC, a terminating zero, so frame
+ * must have room for the frame plus one. */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Appends the CRC of the first length bytes; returns the frame length */
+int modbus_frame_seal(uint8_t *frame, int length);
+
+/* Request builders; return the frame length */
+int modbus_frame_query(uint8_t *frame, uint8_t modbus_addr);
+int modbus_frame_read(uint8_t *frame, uint8_t modbus_addr, uint16_t reg_addr,
+                      uint16_t reg_qty);
+int modbus_frame_write(uint8_t *frame, uint8_t modbus_addr, uint16_t reg_addr,
+                       uint16_t reg_val);
+int modbus_frame_writem(uint8_t *frame, uint8_t modbus_addr,
+                        uint16_t reg_addr, const uint16_t *reg_vals,
+                        uint16_t reg_qty);
+
+/* Checks the length and CRC of a reply. Returns its function code, with
+ * 0x80 set for an exception, or -1 if the frame is short or corrupt. */
+int modbus_frame_check(const uint8_t *frame, int length);
+
+/* Decodes count float registers pairs into host order bit patterns */
+void modbus_decode_floats(const uint8_t *regs, int count, uint32_t *values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+#!/bin/bash
+# Profiling workload for "make pgo": the gateway poller reading the Eaton
+# block and the Veris power, power factor and current blocks from the
+# simulator for a fixed time, so the profile covers the steady state
+# ingest (framing, decoding, the deadband and the sweep publisher), then
+# the microbenchmarks of the ingest kernels.
+#
+# Runs in a scratch directory, removed afterwards, so the simulated samples
+# are archived there rather than in ./archive, and the poller's sockets are
+# the local ones of a trial run (-n) rather than the sweep and query ports.
+
+PORT=${1:-15020}
+SECONDS_RUN=${2:-20}
+BIN=$(pwd)
+
+SCRATCH=$(mktemp -d) || exit 1
+trap 'rm -rf "$SCRATCH"' EXIT
+cd "$SCRATCH" || exit 1
+
+# One connection, so the simulator exits (and writes its profile) when the
+# client disconnects
+"$BIN"/TCPModbusServer $PORT 1-2 1 > /dev/null &
+SERVER=$!
+sleep 1
+
+# -n: nothing is uploaded or published outside the scratch directory.
+# SIGINT stops the poller cleanly, so its profile is written too.
+timeout -s INT $SECONDS_RUN "$BIN"/TCPModbusClient r gateway -n 127.0.0.1 $PORT \
+  1:eaton:20 2:power:20 2:powerfactor:20 2:current:20 > /dev/null 2>&1
+
+wait $SERVER
+"$BIN"/labsensebench > /dev/null
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rollup.h"
+#include "archive.h"
+
+static const struct {
+  int64_t     resolution;
+  const char *suffix;
+} rollup_tiers[ROLLUP_TIERS] = {
+  { 60 * 1000, "1m" },
+  { 60 * 60 * 1000, "1h" },
+};
+
+int64_t rollup_resolution(int tier) {
+  return rollup_tiers[tier].resolution;
+}
+
+static void rollup_path(char *path, const char *dir, const char *name,
+                        int tier) {
+  snprintf(path, ARCHIVE_PATH_LENGTH, "%s/%s.%s", dir, name,
+           rollup_tiers[tier].suffix);
+}
+
+/* Start of the bucket of a tier holding time */
+static int64_t bucket_start(int tier, int64_t time) {
+  int64_t resolution = rollup_tiers[tier].resolution;
+  int64_t start = time - time % resolution;
+  return (time < 0 && start != time) ? start - resolution : start;
+}
+
+static void tier_merge(rollup_tier *tier, const rollup_record *record) {
+  if (tier->count == 0) {
+    tier->min = record->min;
+    tier->max = record->max;
+    tier->sum = 0;
+  }
+  tier->min = (record->min < tier->min) ? record->min : tier->min;
+  tier->max = (record->max > tier->max) ? record->max : tier->max;
+  tier->sum += (double) record->mean * record->count;
+  tier->last = record->last;
+  tier->count += record->count;
+}
+
+static void tier_add(rollup *rollup, int t, const rollup_record *record);
+
+/* Writes out the open record of a tier and passes it up */
+static void tier_close(rollup *rollup, int t) {
+  rollup_tier *tier = &rollup->tiers[t];
+  rollup_record record;
+
+  if (tier->count == 0)
+    return;
+
+  memset(&record, 0, sizeof(record));
+  record.start = tier->start;
+  record.count = tier->count;
+  record.mean = (float) (tier->sum / tier->count);
+  record.min = tier->min;
+  record.max = tier->max;
+  record.last = tier->last;
+  tier->count = 0;
+
+  if (write(tier->fd, &record, sizeof(record)) != sizeof(record))
+    fprintf(stderr, "rollup: cannot write %s record: %s\n",
+            rollup_tiers[t].suffix, strerror(errno));
+
+  if (t + 1 < ROLLUP_TIERS)
+    tier_add(rollup, t + 1, &record);
+}
+
+static void tier_add(rollup *rollup, int t, const rollup_record *record) {
+  rollup_tier *tier = &rollup->tiers[t];
+  int64_t start = bucket_start(t, record->start);
+
+  /* A late sample goes into the open record rather than a past one */
+  if (tier->count > 0 && start > tier->start)
+    tier_close(rollup, t);
+  if (tier->count == 0)
+    tier->start = start;
+  tier_merge(tier, record);
+}
+
+rollup *rollup_open(const char *dir, const char *name) {
+  char path[ARCHIVE_PATH_LENGTH];
+  rollup *result;
+  struct stat st;
+  int t;
+
+  result = (rollup *) calloc(1, sizeof(rollup));
+  if (!result)
+    return NULL;
+
+  for (t = 0; t < ROLLUP_TIERS; t++) {
+    rollup_tier *tier = &result->tiers[t];
+
+    rollup_path(path, dir, name, t);
+    tier->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+
+    /* Drop a record torn by a crash */
+    if (tier->fd < 0 || fstat(tier->fd, &st) < 0 ||
+        ftruncate(tier->fd, st.st_size - st.st_size % sizeof(rollup_record))) {
+      fprintf(stderr, "rollup %s: cannot open: %s\n", path, strerror(errno));
+      while (t >= 0) {
+        if (result->tiers[t].fd >= 0)
+          close(result->tiers[t].fd);
+        t--;
+      }
+      free(result);
+      return NULL;
+    }
+  }
+  return result;
+}
+
+void rollup_add(rollup *rollup, int64_t time, float value) {
+  rollup_record sample;
+
+  if (value != value)
+    return;
+
+  sample.start = time;
+  sample.count = 1;
+  sample.mean = value;
+  sample.min = value;
+  sample.max = value;
+  sample.last = value;
+  tier_add(rollup, 0, &sample);
+}
+
+void rollup_flush(rollup *rollup) {
+  int t;
+
+  /* Lower tiers first, so their partial records reach the tiers above */
+  for (t = 0; t < ROLLUP_TIERS; t++)
+    tier_close(rollup, t);
+}
+
+void rollup_close(rollup *rollup) {
+  int t;
+
+  if (!rollup)
+    return;
+  rollup_flush(rollup);
+  for (t = 0; t < ROLLUP_TIERS; t++)
+    close(rollup->tiers[t].fd);
+  free(rollup);
+}
+
+int rollup_read(const char *dir, const char *name, int tier, int64_t start,
+                int64_t end, rollup_record *records, int max) {
+  char path[ARCHIVE_PATH_LENGTH];
+  const rollup_record *mapped;
+  struct stat st;
+  size_t entries, low, high;
+  size_t size;
+  void *map;
+  int copied = 0;
+  int fd;
+
+  rollup_path(path, dir, name, tier);
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return (errno == ENOENT) ? 0 : -1;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  entries = st.st_size / sizeof(rollup_record);
+  size = entries * sizeof(rollup_record);
+  if (entries == 0) {
+    close(fd);
+    return 0;
+  }
+
+  map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return -1;
+  mapped = (const rollup_record *) map;
+
+  /* First record starting at or after start */
+  low = 0;
+  high = entries;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (mapped[mid].start < start)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  for (; low < entries && copied < max && mapped[low].start < end; low++)
+    records[copied++] = mapped[low];
+
+  munmap(map, size);
+  return copied;
+}
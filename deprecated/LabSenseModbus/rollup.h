@@ -0,0 +1,74 @@
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+/* Rollup tiers of a channel, kept next to its archive (see archive.h) so
+ * long range queries read one record per minute or hour instead of every
+ * sample. Tier 0 rolls up samples into one minute records, tier 1 rolls up
+ * those into one hour records. The open record of each tier is kept in
+ * memory and appended to <dir>/<name>.<suffix> when a sample falls past
+ * its end; the files are arrays of fixed size records in time order, so a
+ * read is a binary search plus a copy.
+ *
+ * NaN samples are left out. A record is only written for a bucket with at
+ * least one sample. A flush writes out partial records, so a bucket may
+ * have more than one record; readers merge records that share a start. */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ROLLUP_TIERS 2
+
+typedef struct rollup_record {
+  int64_t   start;          /* of the bucket, milliseconds */
+  uint32_t  count;          /* samples */
+  float     mean;
+  float     min;
+  float     max;
+  float     last;
+  uint32_t  reserved;
+} rollup_record;
+
+typedef struct rollup_tier {
+  int       fd;
+  int64_t   start;          /* open record; count is 0 if none */
+  uint32_t  count;
+  double    sum;
+  float     min;
+  float     max;
+  float     last;
+} rollup_tier;
+
+typedef struct rollup {
+  rollup_tier tiers[ROLLUP_TIERS];
+} rollup;
+
+/* Resolution of a tier in milliseconds */
+int64_t rollup_resolution(int tier);
+
+/* Opens (creating if needed) the tier files of a channel. Returns NULL and
+ * prints why if it cannot. */
+rollup *rollup_open(const char *dir, const char *name);
+
+/* Adds a sample, writing out the records it closes */
+void rollup_add(rollup *rollup, int64_t time, float value);
+
+/* Writes out the open records and starts new ones */
+void rollup_flush(rollup *rollup);
+
+/* Flushes and closes */
+void rollup_close(rollup *rollup);
+
+/* Copies the records of a tier with start <= record start < end, oldest
+ * first, at most max of them. Returns the number copied, 0 if the channel
+ * has no rollups yet, or -1 on an I/O error. */
+int rollup_read(const char *dir, const char *name, int tier, int64_t start,
+                int64_t end, rollup_record *records, int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
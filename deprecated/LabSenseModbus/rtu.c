@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "rtu.h"
+
+#define RTU_CHAR_BITS   11      /* start, 8 data, parity or stop, stop */
+
+int64_t rtu_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static speed_t rtu_speed(int baud) {
+  switch (baud) {
+  case 1200:   return B1200;
+  case 2400:   return B2400;
+  case 4800:   return B4800;
+  case 9600:   return B9600;
+  case 19200:  return B19200;
+  case 38400:  return B38400;
+  case 57600:  return B57600;
+  case 115200: return B115200;
+  default:     return B0;
+  }
+}
+
+int rtu_open(rtu_line *line, const char *device, const char *settings) {
+  struct termios tio;
+  char parity = 'N';
+  speed_t speed;
+
+  line->fd = -1;
+  if (sscanf(settings, "%d%c", &line->baud, &parity) < 1 ||
+      (speed = rtu_speed(line->baud)) == B0 ||
+      (parity != 'N' && parity != 'E' && parity != 'O')) {
+    fprintf(stderr, "Bad serial settings %s, expected <baud>[N|E|O]\n",
+            settings);
+    return -1;
+  }
+
+  line->char_us = RTU_CHAR_BITS * 1000000 / line->baud;
+  line->gap_us = (line->baud > 19200) ? 1750 : (7 * line->char_us + 1) / 2;
+  line->quiet_at = 0;
+
+  line->fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (line->fd < 0) {
+    perror(device);
+    return -1;
+  }
+  if (tcgetattr(line->fd, &tio) < 0) {
+    perror("tcgetattr() failed");
+    rtu_close(line);
+    return -1;
+  }
+
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSTOPB | PARENB | PARODD);
+  if (parity != 'N')
+    tio.c_cflag |= PARENB | (parity == 'O' ? PARODD : 0);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  if (tcsetattr(line->fd, TCSANOW, &tio) < 0) {
+    perror("tcsetattr() failed");
+    rtu_close(line);
+    return -1;
+  }
+  tcflush(line->fd, TCIOFLUSH);
+  return 0;
+}
+
+void rtu_close(rtu_line *line) {
+  if (line->fd >= 0)
+    close(line->fd);
+  line->fd = -1;
+}
+
+int rtu_frame_ms(const rtu_line *line, int length) {
+  return (int) (((int64_t) length * line->char_us + 999) / 1000);
+}
+
+void rtu_activity(rtu_line *line) {
+  line->quiet_at = rtu_now() + line->gap_us;
+}
+
+int rtu_send(rtu_line *line, const uint8_t *frame, int length) {
+  int64_t wait = line->quiet_at - rtu_now();
+  int sent = 0;
+
+  if (wait > 0) {
+    struct timespec ts = { wait / 1000000, (wait % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+      ;
+  }
+
+  while (sent < length) {
+    ssize_t n = write(line->fd, frame + sent, length - sent);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+      struct pollfd pfd = { line->fd, POLLOUT, 0 };
+      poll(&pfd, 1, rtu_frame_ms(line, length - sent) + 1);
+      continue;
+    }
+    if (n < 0) {
+      perror("write() to the serial line failed");
+      return -1;
+    }
+    sent += n;
+  }
+
+  /* The reply can only start once the request is out */
+  tcdrain(line->fd);
+  rtu_activity(line);
+  return 0;
+}
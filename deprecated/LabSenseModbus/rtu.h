@@ -0,0 +1,49 @@
+#ifndef RTU_H
+#define RTU_H
+
+/* Modbus RTU on a serial line (an RS-485 adapter, or one end of a
+ * pseudo-terminal for testing), set up raw with termios.
+ *
+ * RTU frames are delimited by silence: the line must stay quiet for 3.5
+ * character times before a request (fixed at 1.75 ms above 19200 baud,
+ * as the Modbus serial line spec says). A character is 11 bits on the
+ * wire. rtu_send waits out that gap since the last byte seen on the
+ * line, so requests can follow replies back to back at the bus's rate. */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct rtu_line {
+  int       fd;
+  int       baud;
+  int       char_us;        /* time of one character on the wire */
+  int       gap_us;         /* inter-frame gap, 3.5 characters */
+  int64_t   quiet_at;       /* when the line has been quiet long enough, us */
+} rtu_line;
+
+/* Monotonic clock in microseconds */
+int64_t rtu_now(void);
+
+/* Opens device as "<baud>[N|E|O]" (8 data bits, 1 stop bit, no parity by
+ * default), non-blocking. Returns 0, or -1 and prints why. */
+int rtu_open(rtu_line *line, const char *device, const char *settings);
+void rtu_close(rtu_line *line);
+
+/* Time on the wire of a frame of length bytes, in milliseconds, rounded up */
+int rtu_frame_ms(const rtu_line *line, int length);
+
+/* Waits for the inter-frame gap, writes the frame and waits until it has
+ * gone out. Returns 0, or -1 on an error. */
+int rtu_send(rtu_line *line, const uint8_t *frame, int length);
+
+/* Notes bytes seen on the line, which restarts the gap */
+void rtu_activity(rtu_line *line);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
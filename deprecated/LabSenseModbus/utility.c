@@ -4,61 +4,344 @@
 #include <stdint.h>
 #include <netinet/in.h>
 #include <string.h> 
+#include <sys/resource.h>
+#include <zmq.h>
+#include <jansson.h>
 #include "E30ModbusMsg.h"
+#include "modbusframe.h"
 #include "Cosm/CosmUploader.h"
+#include "deadband.h"
+#include "aggregate.h"
+#include "channelstore.h"
 
 #define RCVBUFSIZE 1024
 
 char rxBuf[RCVBUFSIZE];       /* buffer for the reply message */
 int rxBufLen = 0;             /* length of reply message */
 
+/* Deadbands of the Veris channels, indexed by Type. A channel is uploaded
+ * when it moves by more than its deadband, at least once a minute, and all
+ * channels together every 15 minutes. */
+static const deadband_config veris_deadband[] = {
+  [VerisPower]       = { 0.01, 0.01, 0, 60, 900 },  /* 10 W or 1% */
+  [VerisPowerFactor] = { 1.0,  0,    0, 60, 900 },  /* 1 % */
+  [VerisCurrent]     = { 0.1,  0.02, 0, 60, 900 },  /* 0.1 A or 2% */
+};
+
+/* What is kept per device, a block of one meter: its Type and Modbus
+ * address, since one gateway can front several meters of a kind */
+#define MAX_DEVICES 64
+
+typedef struct device_state {
+  Type            type;
+  uint8_t         modbus_addr;
+  int             first;            /* store index of its first channel; -1 before */
+  deadband_filter filter;           /* Veris */
+  aggregate       sensoract_window;
+  aggregate       cosm_window;      /* Eaton */
+} device_state;
+
+static device_state devices[MAX_DEVICES];
+static int device_count = 0;
+
+/* The state of a device, added on first use. NULL if there are too many. */
+static device_state *device(Type type, uint8_t modbus_addr) {
+  device_state *dev;
+  int d;
+
+  for (d = 0; d < device_count; d++) {
+    if (devices[d].type == type && devices[d].modbus_addr == modbus_addr)
+      return &devices[d];
+  }
+  if (device_count == MAX_DEVICES) {
+    fprintf(stderr, "More than %d devices, ignoring Modbus address %d\n",
+            MAX_DEVICES, modbus_addr);
+    return NULL;
+  }
+
+  dev = &devices[device_count++];
+  dev->type = type;
+  dev->modbus_addr = modbus_addr;
+  dev->first = -1;
+  return dev;
+}
+
+/* Picks the Veris channels worth uploading, see deadband.h. Returns the
+ * number set in report. */
+static int filter_veris_channels(device_state *dev, uint32_t *values, int count,
+                                 double timestamp, uint8_t *report) {
+  deadband_filter *filter = &dev->filter;
+
+  if (filter->count != count) {
+    deadband_free(filter);
+    if (!deadband_init(filter, count, &veris_deadband[dev->type])) {
+      /* Upload everything rather than nothing */
+      memset(report, 1, count);
+      return count;
+    }
+  }
+
+  return deadband_apply(filter, (float *) values, timestamp, report);
+}
+
+/* What each sink receives: every sample (raw), or the mean of each window
+ * of `window` seconds, every `slide` seconds (slide == window for tumbling
+ * windows). Raw Veris samples also go through the deadband above. Set by
+ * the "Output" object of the sink's config file, e.g.
+ * "Output": { "Aggregate": true, "Window": 300, "Slide": 60 }; anything
+ * not given keeps the default below. */
+typedef struct sink_output {
+  int     aggregate;
+  double  window;
+  double  slide;
+} sink_output;
+
+static sink_output sensoract_output = { 0, 60, 60 };  /* raw */
+static sink_output cosm_output      = { 1, 60, 60 };  /* 1 minute means */
+
+/* Reads a sink's "Output" object from its config file, if it has one.
+ * Settings that are missing or invalid are left as they were. */
+static void read_sink_output(const char *path, const char *sink,
+                             sink_output *output) {
+  json_t *root, *settings, *value;
+  json_error_t error;
+  sink_output next = *output;
+
+  root = json_load_file(path, 0, &error);
+  if (!root)
+    return;
+
+  settings = json_object_get(root, "Output");
+  if (json_is_object(settings)) {
+    value = json_object_get(settings, "Aggregate");
+    if (json_is_boolean(value))
+      next.aggregate = json_is_true(value);
+    value = json_object_get(settings, "Window");
+    if (json_is_number(value))
+      next.window = json_number_value(value);
+    value = json_object_get(settings, "Slide");
+    if (json_is_number(value))
+      next.slide = json_number_value(value);
+    else if (json_is_number(json_object_get(settings, "Window")))
+      next.slide = next.window;   /* tumbling */
+
+    if (next.window <= 0 || next.slide <= 0 || next.slide > next.window)
+      fprintf(stderr, "Ignoring the %s output in %s: Window and Slide must "
+              "be positive, with Slide at most Window\n", sink, path);
+    else
+      *output = next;
+  }
+  json_decref(root);
+}
+
+/* Reads the output of both sinks the first time a reply is handled */
+static void read_sink_outputs(void) {
+  static int done = 0;
+
+  if (!done) {
+    read_sink_output(SENSORACT_CONFIG_FILE, "SensorAct", &sensoract_output);
+    read_sink_output(COSM_CONFIG_FILE, "Cosm", &cosm_output);
+    done = 1;
+  }
+}
+
+/* 0 keeps the samples local: stored, published and filtered as usual, but
+ * never uploaded ("read gateway -n") */
+int upload_samples = 1;
+
+/* Adds a sample to a sink's window, allocating the window on first use.
+ * Returns the statistics of the window that just closed, or NULL. */
+static const aggregate_stats *window_sample(aggregate *agg,
+                                            const sink_output *output,
+                                            uint32_t *values, int count,
+                                            double timestamp) {
+  const aggregate_stats *stats;
+  int c;
+
+  if (agg->channels != count || !agg->count) {
+    aggregate_free(agg);
+    if (!aggregate_init(agg, count, output->window, output->slide)) {
+      fprintf(stderr, "Can't allocate memory for the aggregates\n");
+      return NULL;
+    }
+  }
+
+  stats = aggregate_add(agg, (float *) values, timestamp);
+  if (stats) {
+    fprintf(stderr, "\nWindow %.0f-%.0f (count min max mean rms):",
+            stats->start, stats->end);
+    for (c = 0; c < count; c++) {
+      fprintf(stderr, " [%u %f %f %f %f]", stats->count[c], stats->min[c],
+              stats->max[c], stats->mean[c], stats->rms[c]);
+    }
+    fprintf(stderr, "\n");
+  }
+  return stats;
+}
+
+
+/* Sweep publishing (see sweep_header). The values of a sweep are read
+ * straight into a slot of a small pool, and zeromq sends the header and
+ * values from the slot and hands it back through sweep_release once they
+ * are gone, so nothing is copied. A sweep finding no free slot, with
+ * subscribers that far behind, is not published. */
+#define SWEEP_SLOTS 8
+
+typedef struct sweep_slot {
+  int           refs;       /* message parts still held by zeromq */
+  sweep_header  header;
+  uint32_t      values[NUMBER_CHANNELS];
+} sweep_slot;
+
+static sweep_slot sweep_slots[SWEEP_SLOTS];
+static void *sweep_publisher = NULL;
+static uint16_t sweep_reg_addr = 0;
+
+void set_sweep_publisher(void *publisher, uint16_t reg_addr) {
+  sweep_publisher = publisher;
+  sweep_reg_addr = reg_addr;
+}
+
+/* Called by zeromq, possibly from its I/O thread */
+static void sweep_release(void *data, void *hint) {
+  sweep_slot *slot = (sweep_slot *) hint;
+  __sync_fetch_and_sub(&slot->refs, 1);
+}
+
+/* A free slot, or NULL if not publishing or none is free */
+static sweep_slot *sweep_acquire(void) {
+  int s;
+
+  if (!sweep_publisher)
+    return NULL;
+  for (s = 0; s < SWEEP_SLOTS; s++) {
+    if (__sync_bool_compare_and_swap(&sweep_slots[s].refs, 0, 2))
+      return &sweep_slots[s];
+  }
+  fprintf(stderr, "No free sweep buffer, not publishing this sweep\n");
+  return NULL;
+}
+
+/* Sends one zero copy part, giving up one reference to the slot */
+static int sweep_send_part(sweep_slot *slot, void *data, size_t size,
+                           int flags) {
+  zmq_msg_t part;
+  int rc;
+
+  if (zmq_msg_init_data(&part, data, size, sweep_release, slot) != 0) {
+    __sync_fetch_and_sub(&slot->refs, 1);
+    return -1;
+  }
+  rc = zmq_send(sweep_publisher, &part, flags);
+  zmq_msg_close(&part);
+  return rc;
+}
+
+/* Publishes the count values read into slot */
+static void publish_sweep(sweep_slot *slot, Type type, uint8_t modbus_addr,
+                          int count, const sample_time *when) {
+  slot->header.type = (uint8_t) type;
+  slot->header.version = SWEEP_VERSION;
+  slot->header.modbus_addr = modbus_addr;
+  slot->header.reserved = 0;
+  slot->header.reg_addr = sweep_reg_addr;
+  slot->header.count = (uint16_t) count;
+  slot->header.timestamp = when->ns;
+  slot->header.uncertainty = when->uncertainty;
+
+  if (sweep_send_part(slot, &slot->header, sizeof(slot->header),
+                      ZMQ_SNDMORE) != 0) {
+    /* The values part is never sent */
+    __sync_fetch_and_sub(&slot->refs, 1);
+    fprintf(stderr, "Can't publish sweep: %s\n", zmq_strerror(zmq_errno()));
+    return;
+  }
+  if (sweep_send_part(slot, slot->values, count * sizeof(uint32_t), 0) != 0)
+    fprintf(stderr, "Can't publish sweep: %s\n", zmq_strerror(zmq_errno()));
+}
 
-// Sends an array to the python process (sendToSensorSafe.py) given the type,
-// (Power/Current/etc), values, and the publisher to send to zeromq 
-// returns success (= 1) or fail (= 0)
-int sendBatchedMessage(void *publisher, char *type, uint32_t *values) {
-    // For efficiency reasons, specify the allocated memory for 21 uint32_t
-    // since that is what sendBatchedMessage is called with.
-    size_t count = 21;                          // 21 uint32_ts
-    char *message = (char *) malloc(count*9);   // each float is about 9 characters
-    char complete_msg[count*9+12];
-
-    if(message != NULL) {
-        int i;
-        char *last_written = message;
-        /*char *resized;*/
-        for (i = 0; i < count; i++) {
-            char str_value[30];
-            sprintf(str_value, "%f ", *(float *)&values[i]);
-            // Copy the string and return the last written byte to be used as
-            // the start of the next string
-            last_written = (char *)mempcpy((void *)last_written, (void *)str_value, (size_t) strlen(str_value));
-        }
-        // Terminate the string
-        *last_written++ = '\0';
-        printf("Message: %s\n", message);
-
-        // Resize memory to the optimal size
-        /*resized = realloc(message, last_written - message);*/
-        /*if(resized != NULL)*/
-            /*message = resized;*/
-        /*else*/
-            /*return 0;*/
-
-        sprintf(complete_msg, "%s %s", type, message);
-        printf("Complete msg: %s", complete_msg);
-
-        /*s_send(publisher, complete_msg);*/
-
-        // Success
-        return 1;
+/* Recent samples of every channel for local queries (see channelstore.h):
+ * an hour of 1 second samples per channel. Everything is also archived,
+ * with minute and hour rollups, under ARCHIVE_DIR (see archive.h). Room
+ * for a few meters behind a gateway; each archived channel keeps four
+ * files open. */
+#define STORE_MAX_CHANNELS 512
+#define STORE_CAPACITY 3600
+#define ARCHIVE_DIR "archive"
+
+static channel_store *store = NULL;
+
+/* Keeps the archive chunks still in memory when exiting on an error */
+static void flush_sample_store(void) {
+  if (store)
+    store_flush(store);
+}
+
+channel_store *sample_store(void) {
+  struct rlimit files;
+
+  if (!store) {
+    store = store_create(STORE_MAX_CHANNELS, STORE_CAPACITY);
+    if (!store) {
+      fprintf(stderr, "Can't allocate memory for the sample store\n");
+      return NULL;
     }
-    printf("FAILED");
-    // Fail
-    return 0;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+      files.rlim_cur = files.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &files);
+    }
+    if (store_archive(store, ARCHIVE_DIR) < 0)
+      fprintf(stderr, "Can't allocate memory for the sample archive\n");
+    atexit(flush_sample_store);
+  }
+  return store;
 }
 
-void print_received_msg(uint8_t *buf, int buflen, Type type, time_t timestamp, SensorActConfig *Sconfig) {
+/* Adds a sample vector to the store under names like Veris_Power_1 and
+ * Eaton_Voltage_A, or Veris_3_Power_1 for devices at other Modbus
+ * addresses than 1. The channels of a device are added together on first
+ * use, so they are consecutive in the store. */
+static void store_samples(device_state *dev, uint32_t *values, int count,
+                          double timestamp) {
+  static const char *eaton_names[] = {
+    "Voltage", "Current", "Power", "VARs", "VAs", "PowerFactor"
+  };
+  static const char *veris_names[] = {
+    [VerisPower] = "Power", [VerisPowerFactor] = "PowerFactor",
+    [VerisCurrent] = "Current"
+  };
+  char name[STORE_NAME_LENGTH];
+  char prefix[16];
+  int c;
+
+  if (!sample_store())
+    return;
+
+  if (dev->first < 0) {
+    snprintf(prefix, sizeof(prefix), dev->modbus_addr == 1 ? "%s" : "%s_%d",
+             dev->type == Eaton ? "Eaton" : "Veris", dev->modbus_addr);
+    for (c = 0; c < count; c++) {
+      if (dev->type == Eaton)
+        snprintf(name, sizeof(name), "%s_%s_%c", prefix,
+                 eaton_names[(c / 3) % 6], 'A' + c % 3);
+      else
+        snprintf(name, sizeof(name), "%s_%s_%d", prefix,
+                 veris_names[dev->type], c + 1);
+
+      int channel = store_channel(store, name);
+      if (channel < 0) {
+        fprintf(stderr, "Sample store is full\n");
+        return;
+      }
+      if (c == 0)
+        dev->first = channel;
+    }
+  }
+
+  store_append_vector(store, dev->first, (float *) values, count, timestamp);
+}
+
+void print_received_msg(uint8_t *buf, int buflen, Type type, const sample_time *when, SensorActConfig *Sconfig) {
   int c;
 
   /* Print the size of message */
@@ -73,9 +356,15 @@ void print_received_msg(uint8_t *buf, int buflen, Type type, time_t timestamp, S
   }
   fprintf(stderr, "\n");
 
+  /* Keep corrupt frames away from the sinks */
+  if (modbus_frame_check(buf, buflen) < 0) {
+    fprintf(stderr, "Short reply or CRC does not match!\n");
+    return;
+  }
+
   switch (buf[BYTEPOS_MODBUS_FUNC]) {
   case MODBUS_FUNC_READ_REG:
-    print_modbus_reply_read_reg(buf, buflen, type, timestamp, Sconfig);
+    print_modbus_reply_read_reg(buf, buflen, type, when, Sconfig);
     break;
 
   case MODBUS_FUNC_WRITE_REG:
@@ -95,19 +384,32 @@ void print_received_msg(uint8_t *buf, int buflen, Type type, time_t timestamp, S
   } 
 }
 
-void print_modbus_reply_read_reg(uint8_t *buf, int buflen, Type type, time_t timestamp, SensorActConfig *config) {
+void print_modbus_reply_read_reg(uint8_t *buf, int buflen, Type type, const sample_time *when, SensorActConfig *config) {
   uint8_t byte_cnt;
   int c;
   int count = 0;
   uint32_t crc_temp;
   modbus_reply_read_reg* reply_msg = (modbus_reply_read_reg*) buf;
 
-  uint32_t register_values[NUMBER_CHANNELS];
+  device_state *dev = (type == Normal) ? NULL :
+                      device(type, reply_msg->modbus_addr);
+  sweep_slot *slot = dev ? sweep_acquire() : NULL;
+  uint32_t unpublished_values[NUMBER_CHANNELS];
+  uint32_t *register_values = slot ? slot->values : unpublished_values;
+  uint8_t report[NUMBER_CHANNELS];
+  int reports;
+  const aggregate_stats *stats;
+  double timestamp = when->ns / 1e9;  /* seconds, for the store and windows */
+
+  if (dev)
+    read_sink_outputs();
 
   fprintf(stderr, "Response received:\n");
   fprintf(stderr, "  Modbus addr: %d\n", reply_msg->modbus_addr);
   fprintf(stderr, "  Modbus function: %d\n", reply_msg->modbus_func);
   fprintf(stderr, "  Modbus value bytes: %d\n", reply_msg->modbus_val_bytes);
+  fprintf(stderr, "  Sampled at: %.6f +/- %.3f ms\n", timestamp,
+          when->uncertainty / 1e6);
 
   byte_cnt = reply_msg->modbus_val_bytes;
 
@@ -139,12 +441,12 @@ void print_modbus_reply_read_reg(uint8_t *buf, int buflen, Type type, time_t tim
       fprintf(stderr, "\n");
 
   }
-  else {
+  else if (dev) {
 
       if(type == Eaton)
       {
           /* Eaton: all values are read at a time */
-          for(c =0; c < byte_cnt / 4; c++) {
+          for(c =0; c < byte_cnt / 4 && count < NUMBER_CHANNELS; c++) {
               /*if(c == 0) {*/
                   /*printf("VoltageAN, VoltageBN, VoltageCN, VoltageAB, VoltageBC, VoltageCA\n");*/
               /*}*/
@@ -178,34 +480,61 @@ void print_modbus_reply_read_reg(uint8_t *buf, int buflen, Type type, time_t tim
               }
           }
 
-          sendToSensorAct(register_values, count, type, timestamp, config);
-          sendToCosm(register_values, count, type);
+          store_samples(dev, register_values, count, timestamp);
+          if (slot)
+              publish_sweep(slot, type, reply_msg->modbus_addr, count, when);
+
+          if (!sensoract_output.aggregate) {
+              if (upload_samples)
+                  sendToSensorAct(register_values, count, type, (time_t) timestamp, 1, config, NULL);
+          }
+          else if ((stats = window_sample(&dev->sensoract_window, &sensoract_output,
+                                          register_values, count, timestamp)) &&
+                   upload_samples) {
+              sendToSensorAct((uint32_t *) stats->mean, count, type, (time_t) stats->start,
+                              (int) sensoract_output.slide, config, NULL);
+          }
+
+          if (!cosm_output.aggregate) {
+              if (upload_samples)
+                  sendToCosm(register_values, count, type);
+          }
+          else if ((stats = window_sample(&dev->cosm_window, &cosm_output,
+                                          register_values, count, timestamp)) &&
+                   upload_samples) {
+              sendToCosm((uint32_t *) stats->mean, count, type);
+          }
       }
 
       else {
           /* Veris: Values are read in separate runs */
-          for(c =0; c < byte_cnt / 4; c++) {
-              uint32_t tmp = ntohl(reply_msg->modbus_reg_val32[c]);
-              register_values[count] = tmp;
-              fprintf(stderr, "%f ",  *(float*)(&tmp));
-              count++;
+          count = (byte_cnt / 4 < NUMBER_CHANNELS) ? byte_cnt / 4 : NUMBER_CHANNELS;
+          modbus_decode_floats((uint8_t *) reply_msg->modbus_reg_val32, count,
+                               register_values);
+          for(c = 0; c < count; c++) {
+              fprintf(stderr, "%f ",  *(float*)(&register_values[c]));
           }
 
-          sendToSensorAct(register_values, byte_cnt/4, type, timestamp, config);
-
-          /*printf("Count: %d\n", count);*/
-          /*if(type == Power) {*/
-              /*printf("Sending Power to Zeromq\n");*/
-              /*sendBatchedMessage(publisher, "Veris_Power_1", register_values);*/
-          /*}*/
-          /*else if(type == PowerFactor) {*/
-              /*printf("Sending Power Factor to Zeromq\n");*/
-              /*sendBatchedMessage(publisher, "Veris_PowerFactor_1", register_values);*/
-          /*}*/
-          /*else if(type == Current) {*/
-              /*printf("Sending Current to Zeromq\n");*/
-              /*sendBatchedMessage(publisher, "Veris_Current_1", register_values);*/
-          /*}*/
+          store_samples(dev, register_values, count, timestamp);
+          if (slot)
+              publish_sweep(slot, type, reply_msg->modbus_addr, count, when);
+
+          if (sensoract_output.aggregate) {
+              if ((stats = window_sample(&dev->sensoract_window, &sensoract_output,
+                                         register_values, count, timestamp)) &&
+                  upload_samples) {
+                  sendToSensorAct((uint32_t *) stats->mean, count, type, (time_t) stats->start,
+                                  (int) sensoract_output.slide, config, NULL);
+              }
+          }
+          else {
+              /* Only upload the channels that changed (or are due a refresh) */
+              reports = filter_veris_channels(dev, register_values, count,
+                                              timestamp, report);
+              fprintf(stderr, "\n%d of %d channels changed", reports, count);
+              if (reports > 0 && upload_samples)
+                  sendToSensorAct(register_values, count, type, (time_t) timestamp, 1, config, report);
+          }
       }
 
       printf("\n");
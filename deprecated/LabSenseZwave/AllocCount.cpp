@@ -0,0 +1,50 @@
+//-----------------------------------------------------------------------------
+//
+//	AllocCount.cpp
+//
+//	Preloaded (LD_PRELOAD) by "make alloctest". Counts the malloc, calloc and
+//	realloc calls of each thread, including the ones made inside libzmq and
+//	libc that the debug build's operator new cannot see, and hands the count
+//	to LabSenseZwave through alloc_count().
+//
+//	glibc only: the calls are passed on to its __libc_* entry points, which
+//	avoids looking up the real functions with dlsym (which itself allocates).
+//
+//-----------------------------------------------------------------------------
+
+#include <stddef.h>
+
+extern "C"
+{
+
+void* __libc_malloc( size_t _size );
+void* __libc_calloc( size_t _count, size_t _size );
+void* __libc_realloc( void* _ptr, size_t _size );
+
+// initial-exec, so the first access from a thread doesn't allocate its TLS
+static __thread unsigned long t_count __attribute__(( tls_model( "initial-exec" ) )) = 0;
+
+unsigned long alloc_count()
+{
+	return t_count;
+}
+
+void* malloc( size_t _size )
+{
+	++t_count;
+	return __libc_malloc( _size );
+}
+
+void* calloc( size_t _count, size_t _size )
+{
+	++t_count;
+	return __libc_calloc( _count, _size );
+}
+
+void* realloc( void* _ptr, size_t _size )
+{
+	++t_count;
+	return __libc_realloc( _ptr, _size );
+}
+
+}
@@ -0,0 +1,105 @@
+//-----------------------------------------------------------------------------
+//
+//	LatencyHistogram.cpp
+//
+//	HDR-style latency histogram, see LatencyHistogram.h
+//
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+	Reset();
+}
+
+//-----------------------------------------------------------------------------
+// <LatencyHistogram::BucketIndex>
+// Values below 16us get one bucket each. Above that, the bucket is chosen by
+// the position of the highest set bit and the 4 bits below it.
+//-----------------------------------------------------------------------------
+int LatencyHistogram::BucketIndex( uint64_t _us )
+{
+	if( _us < SubBucketCount )
+	{
+		return (int) _us;
+	}
+
+	int msb = 63 - __builtin_clzll( _us );
+	int shift = msb - SubBucketBits;
+	int index = ( shift + 1 ) * SubBucketCount + (int) ( ( _us >> shift ) & ( SubBucketCount - 1 ) );
+	return ( index < BucketCount ) ? index : BucketCount - 1;
+}
+
+//-----------------------------------------------------------------------------
+// <LatencyHistogram::BucketUpperBound>
+// Largest value that falls into the given bucket
+//-----------------------------------------------------------------------------
+uint64_t LatencyHistogram::BucketUpperBound( int _index )
+{
+	if( _index < SubBucketCount )
+	{
+		return (uint64_t) _index;
+	}
+
+	int shift = _index / SubBucketCount - 1;
+	uint64_t sub = (uint64_t) ( _index % SubBucketCount + SubBucketCount );
+	return ( ( sub + 1 ) << shift ) - 1;
+}
+
+void LatencyHistogram::Record( uint64_t _us )
+{
+	m_buckets[BucketIndex( _us )]++;
+	m_count++;
+	m_sum += _us;
+	if( _us > m_max )
+	{
+		m_max = _us;
+	}
+}
+
+uint64_t LatencyHistogram::Percentile( double _fraction ) const
+{
+	if( m_count == 0 )
+	{
+		return 0;
+	}
+
+	uint64_t target = (uint64_t) ( _fraction * m_count + 0.5 );
+	if( target == 0 )
+	{
+		target = 1;
+	}
+
+	uint64_t seen = 0;
+	for( int i = 0; i < BucketCount; i++ )
+	{
+		seen += m_buckets[i];
+		if( seen >= target )
+		{
+			uint64_t bound = BucketUpperBound( i );
+			return ( bound < m_max ) ? bound : m_max;
+		}
+	}
+	return m_max;
+}
+
+void LatencyHistogram::Reset()
+{
+	memset( m_buckets, 0, sizeof( m_buckets ) );
+	m_count = 0;
+	m_sum = 0;
+	m_max = 0;
+}
+
+int LatencyHistogram::Format( char* _buffer, int _size ) const
+{
+	return snprintf( _buffer, _size, "n=%u mean=%llu p50=%llu p90=%llu p99=%llu max=%llu",
+			m_count, (unsigned long long) Mean(),
+			(unsigned long long) Percentile( 0.50 ),
+			(unsigned long long) Percentile( 0.90 ),
+			(unsigned long long) Percentile( 0.99 ),
+			(unsigned long long) m_max );
+}
@@ -0,0 +1,61 @@
+//-----------------------------------------------------------------------------
+//
+//	LatencyHistogram.h
+//
+//	Fixed-size, HDR-style latency histogram used to instrument the Z-Wave
+//	notification path. Values are recorded in microseconds into log-linear
+//	buckets: every power of two is split into 16 linear sub-buckets, so any
+//	recorded value is reported within 1/16 (~6%) of its true value from
+//	1 microsecond up to 2^35 microseconds (~9.5 hours), using 2 KB per
+//	histogram.
+//
+//	Recording is a couple of shifts and an increment and never allocates.
+//	The class is not thread-safe: callers serialise access (LabSenseZwave
+//	only records and snapshots while holding g_criticalSection).
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _LatencyHistogram_H
+#define _LatencyHistogram_H
+
+#include <stdint.h>
+
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	// Record one latency sample in microseconds
+	void Record( uint64_t _us );
+
+	// Value (in microseconds) below which the given fraction (0..1) of the
+	// samples fall, rounded up to the bucket's upper bound
+	uint64_t Percentile( double _fraction ) const;
+
+	uint32_t Count() const { return m_count; }
+	uint64_t Max() const { return m_max; }
+	uint64_t Mean() const { return m_count ? m_sum / m_count : 0; }
+
+	void Reset();
+
+	// Formats "n=.. mean=.. p50=.. p90=.. p99=.. max=.." (microseconds)
+	int Format( char* _buffer, int _size ) const;
+
+private:
+	enum
+	{
+		SubBucketBits  = 4,
+		SubBucketCount = 1 << SubBucketBits,
+		BucketCount    = 32 * SubBucketCount
+	};
+
+	static int BucketIndex( uint64_t _us );
+	static uint64_t BucketUpperBound( int _index );
+
+	uint32_t m_buckets[BucketCount];
+	uint32_t m_count;
+	uint64_t m_sum;
+	uint64_t m_max;
+};
+
+#endif
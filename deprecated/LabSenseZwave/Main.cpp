@@ -32,7 +32,15 @@
 
 #include <unistd.h>
 #include <stdlib.h>
+#include <getopt.h>
 #include <pthread.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <new>
 #include "Options.h"
 #include "Manager.h"
 #include "Driver.h"
@@ -44,9 +52,18 @@
 #include "ValueBool.h"
 #include "Log.h"
 
+#include "LatencyHistogram.h"
+#include "NotificationLog.h"
+#include "PollScheduler.h"
+#include "NodeCache.h"
+#include "deadband.h"
+
 // Includes for Zeromq transport layer to make zwave notifications decoupled from updating SensorSafe over http request
 #include <zmq.hpp>
 
+// Jansson is used to read the node id mapping from the config file
+#include <jansson.h>
+
 // Defines for different sensors, commented out command classes are classes 
 // that are sent by the sensors, but are not needed/implemented OR are classes 
 // that are defined by previous sensors
@@ -99,10 +116,37 @@ enum SensorType {
     Z_STICK,
     AL_DW_SENSOR,
     HSM_100_SENSOR,
-    SMART_SWITCH_SENSOR
+    SMART_SWITCH_SENSOR,
+    UNKNOWN_SENSOR,     // Product/manufacturer not known (yet)
+    NUM_SENSOR_TYPES
 };
 bool   g_initFailed = false;
 
+// Startup state of a node. Each node moves on by itself, so a node is
+// published and configured without waiting for the rest of the mesh.
+enum NodeState {
+    NodeState_Added,        // Known, type not identified yet
+    NodeState_Identified,   // Type known, its values are published
+    NodeState_Pending,      // Queries complete, waiting for the main thread to configure it
+    NodeState_Ready         // Configured (polling, parameters, wake-up interval)
+};
+
+// Sensor names used in the published messages and in the config file,
+// indexed by SensorType
+static const char *g_sensorNames[NUM_SENSOR_TYPES] = {
+    "ZStick", "DoorSensor", "HSM100", "SmartSwitch", "Unknown"
+};
+
+// Maps the raw Z-Wave node id to the logical node id that is published,
+// indexed by SensorType and then by raw node id. Filled in once from the
+// config file by loadNodeIdMap().
+static uint8 g_nodeIdMap[NUM_SENSOR_TYPES][256];
+
+// Seconds between two driver statistics messages (config "DriverStatsInterval")
+#define DEFAULT_DRIVER_STATS_INTERVAL 60
+#define STATE_CHECK_INTERVAL 1      // seconds between deadband_due checks
+static int g_driverStatsInterval = DEFAULT_DRIVER_STATS_INTERVAL;
+
 typedef struct
 {
 	uint32			m_homeId;
@@ -110,85 +154,694 @@ typedef struct
 	bool			m_polled;
 	list<ValueID>	m_values;
     SensorType      m_sensorType;
+    // Node identity, copied once so the notification path never has to
+    // fetch (and allocate) the product and manufacturer strings again
+    char            m_productName[64];
+    char            m_manufacturerName[64];
+    NodeState       m_state;
+    bool            m_fromCache;    // Identified from g_nodeCache, not yet confirmed live
 }NodeInfo;
 
 static list<NodeInfo*> g_nodes;
 static pthread_mutex_t g_criticalSection;
-static pthread_cond_t  initCond  = PTHREAD_COND_INITIALIZER;
-static pthread_mutex_t initMutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Wakes the main thread's event loop when the notification thread has
+// startup work for it (nodes to configure, the config file to write, a
+// failed driver). An eventfd; -1 in replay mode.
+static int g_wakeFd = -1;
+static bool g_writeConfigPending = false;   // Awake or all nodes queried
+static double g_startTime = 0;              // monotonicSeconds() at startup
+
+// Instrumentation of the notification path, all in microseconds. Only
+// recorded and read while holding g_criticalSection.
+static LatencyHistogram g_callbackLatency;  // OnNotification entry to exit
+static LatencyHistogram g_lockWait;         // waiting for g_criticalSection
+static LatencyHistogram g_lockHold;         // holding g_criticalSection
+static LatencyHistogram g_publishLatency;   // OnNotification entry to zeromq send
+static uint32 g_nodeNotificationCount[256]; // notifications per raw node id
+static uint64 g_notificationStart = 0;      // entry time of the current OnNotification
+static double g_statsPeriodStart = 0;       // start of the current stats period
+
+// Adaptive polling (see PollScheduler.h). A rule from the config file's
+// "Polling" section selects the values of one sensor type to poll; an
+// instance or index of -1 matches any.
+#define MAX_POLL_RULES 16
+#define DEFAULT_POLL_AIRTIME_BUDGET 0.1     // fraction of the channel
+#define DEFAULT_POLL_AIRTIME 0.02           // seconds per poll (get + report)
+
+typedef struct
+{
+    SensorType  m_sensorType;
+    uint8       m_commandClassId;
+    int         m_instance;
+    int         m_index;
+    double      m_priority;
+    double      m_minInterval;
+    double      m_maxInterval;
+    double      m_scale;
+}PollRule;
+
+static PollRule g_pollRules[MAX_POLL_RULES];
+static int g_numPollRules = 0;
+static PollScheduler g_pollScheduler;       // only used under g_criticalSection
+
+// Node information from the zwcfg file of the previous run, loaded at
+// DriverReady. Lets known nodes be identified (and their values decoded) as
+// soon as they are added.
+static NodeCache g_nodeCache;
+
+// Change suppression for the door and motion states, indexed by raw node id
+// (see deadband.h). Repeated states are dropped, a change held back by
+// "MinInterval" is published once it has passed and each state is
+// republished every "MaxInterval" seconds from the event loop.
+static deadband_filter g_doorFilter;
+static deadband_filter g_motionFilter;
+
+// Record and replay (see NotificationLog.h)
+static NotificationLog* g_recordLog = NULL; // set when recording with -r
+static bool g_replaying = false;            // set when replaying with -p
+
+
+#ifdef DEBUG
+// Counts operator new calls made by the current thread, so the debug build
+// can check that steady-state notifications are handled without touching the
+// heap (see OnNotification and replayLog).
+static __thread unsigned long t_allocCount = 0;
+
+// Every malloc of the current thread, libzmq's and libc's included, when
+// AllocCount.so is preloaded (see "make alloctest")
+extern "C" unsigned long alloc_count() __attribute__(( weak ));
+
+static unsigned long allocCount()
+{
+    return alloc_count ? alloc_count() : t_allocCount;
+}
+
+void* operator new( size_t size )
+{
+    ++t_allocCount;
+    void *p = malloc( size ? size : 1 );
+    if( !p )
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete( void *p ) throw()
+{
+    free( p );
+}
+
+void operator delete( void *p, size_t ) throw()
+{
+    free( p );
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// <nowMicros>
+// Returns the monotonic clock in microseconds
+//-----------------------------------------------------------------------------
+static inline uint64 nowMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//-----------------------------------------------------------------------------
+// <lockCriticalSection>
+// Locks g_criticalSection, records how long it took and returns the time the
+// lock was acquired, to be passed to unlockCriticalSection.
+//-----------------------------------------------------------------------------
+uint64 lockCriticalSection() {
+    uint64 start = nowMicros();
+    pthread_mutex_lock( &g_criticalSection );
+    uint64 acquired = nowMicros();
+    g_lockWait.Record(acquired - start);
+    return acquired;
+}
+
+//-----------------------------------------------------------------------------
+// <unlockCriticalSection>
+// Records how long g_criticalSection was held and unlocks it
+//-----------------------------------------------------------------------------
+void unlockCriticalSection(uint64 acquired) {
+    g_lockHold.Record(nowMicros() - acquired);
+    pthread_mutex_unlock( &g_criticalSection );
+}
+
+//-----------------------------------------------------------------------------
+// <wakeEventLoop>
+// Makes the main thread's event loop run its startup work
+//-----------------------------------------------------------------------------
+void wakeEventLoop() {
+    uint64_t one = 1;
+    if(g_wakeFd >= 0 && write(g_wakeFd, &one, sizeof(one)) < 0)
+        perror("Unable to wake the event loop");
+}
 
-// Zeromq initialization for context and publisher
+// Zeromq initialization for context and publisher. The statistics go out on
+// their own socket: the forwarder and the Socket.IO server take everything
+// on the value socket for "<sensor> <value>" samples.
 zmq::context_t context(1);
 zmq::socket_t publisher(context, ZMQ_PUB);
+zmq::socket_t statsPublisher(context, ZMQ_PUB);
+
+// Messages queued for a subscriber before the publisher drops them, and the
+// buffers publishValue formats into, used round robin (see publishValue)
+#define PUBLISH_HWM 1000
+#define PUBLISH_POOL_SIZE (2 * PUBLISH_HWM)
+#define PUBLISH_BUFFER_SIZE 40
+static char g_publishPool[PUBLISH_POOL_SIZE][PUBLISH_BUFFER_SIZE];
+static int g_publishNext = 0;               // only used under g_criticalSection
+
+//-----------------------------------------------------------------------------
+// <loadNodeIdMap>
+// Reads the "NodeIdMap" section of the config file into g_nodeIdMap.
+// Each sensor name maps raw node ids (as strings) to logical node ids, and
+// may give a "default" logical id for raw ids that are not listed. Raw ids
+// that are not listed and have no default keep their raw id.
+//-----------------------------------------------------------------------------
+void loadNodeIdMap(json_t *root) {
+    json_t *nodeIdMap, *sensorMap, *defaultId, *logicalId;
+    const char *key;
+    int type;
+    int id;
+
+    // Identity mapping unless the config says otherwise
+    for(type = 0; type < NUM_SENSOR_TYPES; type++) {
+        for(id = 0; id < 256; id++) {
+            g_nodeIdMap[type][id] = (uint8) id;
+        }
+    }
+
+    nodeIdMap = json_object_get(root, "NodeIdMap");
+    for(type = 0; nodeIdMap && type < NUM_SENSOR_TYPES; type++) {
+        sensorMap = json_object_get(nodeIdMap, g_sensorNames[type]);
+        if(!json_is_object(sensorMap))
+            continue;
+
+        // Apply the default first so that listed node ids override it
+        defaultId = json_object_get(sensorMap, "default");
+        if(json_is_integer(defaultId)) {
+            for(id = 0; id < 256; id++) {
+                g_nodeIdMap[type][id] = (uint8) json_integer_value(defaultId);
+            }
+        }
+
+        json_object_foreach(sensorMap, key, logicalId) {
+            if(strcmp(key, "default") == 0)
+                continue;
+            id = atoi(key);
+            if(id <= 0 || id > 255 || !json_is_integer(logicalId)) {
+                fprintf(stderr, "Ignoring bad NodeIdMap entry \"%s\" for %s\n", key, g_sensorNames[type]);
+                continue;
+            }
+            g_nodeIdMap[type][id] = (uint8) json_integer_value(logicalId);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// <loadPollRules>
+// Reads the "Polling" section of the config file: the airtime budget and
+// the rules selecting which values are polled and how.
+//-----------------------------------------------------------------------------
+void loadPollRules(json_t *root) {
+    json_t *polling, *values, *rule, *field;
+    double airtimeBudget = DEFAULT_POLL_AIRTIME_BUDGET;
+    double pollAirtime = DEFAULT_POLL_AIRTIME;
+    size_t i;
+    int type;
+
+    polling = json_object_get(root, "Polling");
+    if(!json_is_object(polling)) {
+        g_pollScheduler.SetBudget(airtimeBudget, pollAirtime);
+        return;
+    }
+
+    field = json_object_get(polling, "AirtimeBudget");
+    if(json_is_number(field))
+        airtimeBudget = json_number_value(field);
+    field = json_object_get(polling, "PollAirtime");
+    if(json_is_number(field))
+        pollAirtime = json_number_value(field);
+    g_pollScheduler.SetBudget(airtimeBudget, pollAirtime);
+
+    values = json_object_get(polling, "Values");
+    json_array_foreach(values, i, rule) {
+        const char *sensor = json_string_value(json_object_get(rule, "Sensor"));
+        json_t *commandClass = json_object_get(rule, "CommandClass");
+
+        for(type = 0; sensor && type < NUM_SENSOR_TYPES; type++) {
+            if(strcmp(sensor, g_sensorNames[type]) == 0)
+                break;
+        }
+        if(!sensor || type == NUM_SENSOR_TYPES || !json_is_integer(commandClass)) {
+            fprintf(stderr, "Ignoring Polling rule %d: needs a known \"Sensor\" and a \"CommandClass\"\n", (int) i);
+            continue;
+        }
+        field = json_object_get(rule, "MinInterval");
+        double minInterval = json_is_number(field) ? json_number_value(field) : 1;
+        field = json_object_get(rule, "MaxInterval");
+        double maxInterval = json_is_number(field) ? json_number_value(field) : 600;
+        if(minInterval <= 0 || maxInterval < minInterval) {
+            fprintf(stderr, "Ignoring Polling rule %d: needs 0 < \"MinInterval\" <= \"MaxInterval\"\n", (int) i);
+            continue;
+        }
+        if(g_numPollRules == MAX_POLL_RULES) {
+            fprintf(stderr, "Ignoring Polling rules after the first %d\n", MAX_POLL_RULES);
+            break;
+        }
+
+        PollRule *pollRule = &g_pollRules[g_numPollRules++];
+        pollRule->m_sensorType = (SensorType) type;
+        pollRule->m_commandClassId = (uint8) json_integer_value(commandClass);
+        field = json_object_get(rule, "Instance");
+        pollRule->m_instance = json_is_integer(field) ? (int) json_integer_value(field) : -1;
+        field = json_object_get(rule, "Index");
+        pollRule->m_index = json_is_integer(field) ? (int) json_integer_value(field) : -1;
+        field = json_object_get(rule, "Priority");
+        pollRule->m_priority = json_is_number(field) ? json_number_value(field) : 1;
+        pollRule->m_minInterval = minInterval;
+        pollRule->m_maxInterval = maxInterval;
+        field = json_object_get(rule, "Scale");
+        pollRule->m_scale = json_is_number(field) ? json_number_value(field) : 1;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// <loadDeadband>
+// Reads one entry of the "Deadband" section of the config file into a
+// filter over all raw node ids. Exits if out of memory.
+//-----------------------------------------------------------------------------
+void loadDeadband(json_t *root, const char *measurement, deadband_filter *filter) {
+    // By default only report changes, and repeat each state every 15 minutes
+    deadband_config config = { 0, 0, 0, 900, 0 };
+    json_t *entry, *field;
+
+    entry = json_object_get(json_object_get(root, "Deadband"), measurement);
+    field = json_object_get(entry, "AbsDeadband");
+    if(json_is_number(field))
+        config.abs_deadband = json_number_value(field);
+    field = json_object_get(entry, "RelDeadband");
+    if(json_is_number(field))
+        config.rel_deadband = json_number_value(field);
+    field = json_object_get(entry, "MinInterval");
+    if(json_is_number(field))
+        config.min_interval = json_number_value(field);
+    field = json_object_get(entry, "MaxInterval");
+    if(json_is_number(field))
+        config.max_interval = json_number_value(field);
+    field = json_object_get(entry, "Heartbeat");
+    if(json_is_number(field))
+        config.heartbeat = json_number_value(field);
+
+    if(!deadband_init(filter, 256, &config)) {
+        fprintf(stderr, "Out of memory for the %s deadband\n", measurement);
+        exit(1);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// <loadConfig>
+// Reads the config file once at startup. Exits if it cannot be parsed.
+//-----------------------------------------------------------------------------
+void loadConfig(const char *configFile) {
+    json_t *root, *interval;
+    json_error_t error;
+
+    root = json_load_file(configFile, 0, &error);
+    if(!root) {
+        fprintf(stderr, "Error when parsing Zwave Config File %s: %s (line %d)\n",
+                configFile, error.text, error.line);
+        exit(1);
+    }
+
+    loadNodeIdMap(root);
+    loadPollRules(root);
+    loadDeadband(root, "Door", &g_doorFilter);
+    loadDeadband(root, "Motion", &g_motionFilter);
+
+    interval = json_object_get(root, "DriverStatsInterval");
+    if(json_is_integer(interval) && json_integer_value(interval) > 0) {
+        g_driverStatsInterval = (int) json_integer_value(interval);
+    }
+
+    json_decref(root);
+}
 
 // Zeromq Functions
 
+//-----------------------------------------------------------------------------
+// <publishValue>
+// Formats and publishes one measurement. Must be called with
+// g_criticalSection held.
+//
+// The message points into g_publishPool rather than being allocated by
+// zeromq: with no free function zmq_msg_init_data() makes a constant
+// message (libzmq 4.2 and later) and allocates nothing, where a free
+// function, even one that does nothing, costs a malloc per message. The
+// buffer must outlive the message in every subscriber's queue, so the pool
+// is used round robin and holds more messages than PUBLISH_HWM lets queue.
+// Older libzmq (the 2.x the Modbus client is built against) still allocates
+// for a message without a free function, so there the slot is copied into
+// an ordinary message instead.
+//-----------------------------------------------------------------------------
+void publishValue(SensorType sensorType, const char *measurement, float f_val, uint8 nodeId) {
+    char *buffer = g_publishPool[g_publishNext];
+    g_publishNext = (g_publishNext + 1) % PUBLISH_POOL_SIZE;
+
+    // Choose the logical nodeId (1 to number of nodes) from the config mapping
+    nodeId = g_nodeIdMap[sensorType][nodeId];
+
+    int length = snprintf(buffer, PUBLISH_BUFFER_SIZE, "%s_%s_%d %f", g_sensorNames[sensorType], measurement, nodeId, f_val);
+    if(length >= PUBLISH_BUFFER_SIZE)
+        length = PUBLISH_BUFFER_SIZE - 1;
+
+#if ZMQ_VERSION >= ZMQ_MAKE_VERSION(4, 2, 0)
+    zmq::message_t message(buffer, length, NULL);
+#else
+    zmq::message_t message(length);
+    memcpy((char *) message.data(), buffer, length);
+#endif
+
+    publisher.send(message);
+}
+
 //-----------------------------------------------------------------------------
 // <sendMessage>
 // This function sends the data to the python process using zeromq. 
 //-----------------------------------------------------------------------------
-void sendMessage(const char *sensor, const char *measurement, float f_val, uint8 nodeId) {
-    char buffer[40];
+void sendMessage(SensorType sensorType, const char *measurement, float f_val, uint8 nodeId) {
+    publishValue(sensorType, measurement, f_val, nodeId);
 
-    // Note the following mapping is implementation specific!
-    // Choose nodeId (1 to number of nodes) based on given nodeIds
-    if(strcmp(sensor, "HSM100") == 0) {
-        switch(nodeId) {
-            case 35: 
-                nodeId = 1;
-                break;
-            case 37:
-                nodeId = 3;
-            case 27:
-                nodeId = 4;
-                break;
-            case 38:
-                nodeId = 5;
-                break;
-            case 39:
-                nodeId = 6;
-                break;
-            default:
-                nodeId = 2;
+    // sendMessage is only called from within OnNotification
+    g_publishLatency.Record(nowMicros() - g_notificationStart);
+}
+
+//-----------------------------------------------------------------------------
+// <sendStateMessage>
+// Sends a door or motion state unless the filter suppresses it as a repeat.
+// time is the notification's wall clock time in seconds.
+//-----------------------------------------------------------------------------
+void sendStateMessage(deadband_filter *filter, SensorType sensorType, const char *measurement,
+                      float f_val, uint8 nodeId, double time) {
+    if(deadband_apply_one(filter, nodeId, f_val, time))
+        sendMessage(sensorType, measurement, f_val, nodeId);
+}
+
+//-----------------------------------------------------------------------------
+// <monotonicSeconds>
+// Returns the monotonic clock in seconds, for scheduling periodic work
+//-----------------------------------------------------------------------------
+double monotonicSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//-----------------------------------------------------------------------------
+// <publishText>
+// Publishes a statistics message on the statistics socket. Only the main
+// thread uses that socket, so no lock is needed.
+//-----------------------------------------------------------------------------
+void publishText(const char *buffer, int length) {
+    zmq::message_t message(length);
+    memcpy((char *) message.data(), buffer, length);
+    statsPublisher.send(message);
+}
+
+//-----------------------------------------------------------------------------
+// <publishDriverStatistics>
+// Publishes the Z-Wave driver counters on the "ZwaveDriverStats" topic of the
+// statistics socket, so anyone subscribed can watch for radio saturation.
+// The counters are cumulative since the driver started.
+//-----------------------------------------------------------------------------
+void publishDriverStatistics() {
+    Driver::DriverData data;
+    char buffer[256];
+
+    // GetDriverStatistics leaves data alone until the driver is ready
+    memset(&data, 0, sizeof(data));
+
+    uint64 locked = lockCriticalSection();
+
+    if(g_homeId == 0) {
+        unlockCriticalSection(locked);
+        return;
+    }
+    Manager::Get()->GetDriverStatistics( g_homeId, &data );
+
+    int length = snprintf(buffer, sizeof(buffer),
+            "ZwaveDriverStats SOF=%u ACKWaiting=%u ReadAborts=%u BadChecksums=%u "
+            "Reads=%u Writes=%u CAN=%u NAK=%u ACK=%u OOF=%u Dropped=%u Retries=%u",
+            data.s_SOFCnt, data.s_ACKWaiting, data.s_readAborts, data.s_badChecksum,
+            data.s_readCnt, data.s_writeCnt, data.s_CANCnt, data.s_NAKCnt, data.s_ACKCnt,
+            data.s_OOFCnt, data.s_dropped, data.s_retries);
+    if(length >= (int) sizeof(buffer))
+        length = sizeof(buffer) - 1;
+
+    unlockCriticalSection(locked);
+
+    publishText(buffer, length);
+}
+
+//-----------------------------------------------------------------------------
+// <publishLatencyStatistics>
+// Publishes the notification path histograms on the "ZwaveLatencyStats"
+// topic, one message per histogram, and the per-node notification rates
+// (per second, by raw node id) on "ZwaveNodeRates". Everything is reset
+// afterwards, so each message covers one stats period.
+//-----------------------------------------------------------------------------
+void publishLatencyStatistics() {
+    LatencyHistogram histograms[4];
+    static const char *names[4] = { "Callback", "LockWait", "LockHold", "Publish" };
+    uint32 nodeCounts[256];
+    char buffer[1024];
+    int length;
+    int i;
+
+    // Take a snapshot, then format outside of the lock
+    uint64 locked = lockCriticalSection();
+    histograms[0] = g_callbackLatency;
+    histograms[1] = g_lockWait;
+    histograms[2] = g_lockHold;
+    histograms[3] = g_publishLatency;
+    g_callbackLatency.Reset();
+    g_lockWait.Reset();
+    g_lockHold.Reset();
+    g_publishLatency.Reset();
+    memcpy(nodeCounts, g_nodeNotificationCount, sizeof(nodeCounts));
+    memset(g_nodeNotificationCount, 0, sizeof(g_nodeNotificationCount));
+    double now = monotonicSeconds();
+    double elapsed = now - g_statsPeriodStart;
+    g_statsPeriodStart = now;
+    unlockCriticalSection(locked);
+
+    for(i = 0; i < 4; i++) {
+        length = snprintf(buffer, sizeof(buffer), "ZwaveLatencyStats %s ", names[i]);
+        length += histograms[i].Format(buffer + length, sizeof(buffer) - length);
+        publishText(buffer, length);
+    }
+
+    length = snprintf(buffer, sizeof(buffer), "ZwaveNodeRates");
+    for(i = 0; i < 256 && length < (int) sizeof(buffer) - 16; i++) {
+        if(nodeCounts[i] > 0 && elapsed > 0) {
+            length += snprintf(buffer + length, sizeof(buffer) - length, " %d=%.3f", i, nodeCounts[i] / elapsed);
         }
     }
-    else if(strcmp(sensor, "DoorSensor") == 0) {
-        switch(nodeId) {
-            case 43:
-                nodeId = 1;
-                break;
-            case 42:
-                nodeId = 2;
+    publishText(buffer, length);
+}
+
+//-----------------------------------------------------------------------------
+// <pollDueValues>
+// Refreshes the values g_pollScheduler says are due. The reports come back
+// as ValueChanged notifications.
+//-----------------------------------------------------------------------------
+void pollDueValues() {
+    uint64 valueIds[16];
+
+    uint64 locked = lockCriticalSection();
+    int count = g_pollScheduler.Due(monotonicSeconds(), valueIds, 16);
+    for(int i = 0; i < count; i++) {
+        Manager::Get()->RefreshValue(ValueID(g_homeId, valueIds[i]));
+    }
+    unlockCriticalSection(locked);
+}
+
+//-----------------------------------------------------------------------------
+// <publishStateHeartbeats>
+// Publishes the door and motion changes held back by their filter's
+// "MinInterval" once it has passed, and republishes the states that have
+// not been sent for "MaxInterval", so a quiet sensor still shows up
+// upstream.
+//-----------------------------------------------------------------------------
+void publishStateHeartbeats() {
+    uint8_t due[256];
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    double now = ts.tv_sec + ts.tv_nsec / 1e9;
+
+    uint64 locked = lockCriticalSection();
+    if(deadband_due(&g_doorFilter, now, due) > 0) {
+        for(int i = 0; i < 256; i++) {
+            if(due[i])
+                publishValue(AL_DW_SENSOR, "Door", g_doorFilter.reported[i], (uint8) i);
+        }
+    }
+    if(deadband_due(&g_motionFilter, now, due) > 0) {
+        for(int i = 0; i < 256; i++) {
+            if(due[i])
+                publishValue(HSM_100_SENSOR, "Motion", g_motionFilter.reported[i], (uint8) i);
+        }
+    }
+    unlockCriticalSection(locked);
+}
+
+//-----------------------------------------------------------------------------
+// <publishPollStatistics>
+// Publishes the adaptive polling state on the "ZwavePollStats" topic: the
+// number of polled values, polls and poll rate in the last stats period,
+// the budget rate and the range of the current intervals (seconds).
+//-----------------------------------------------------------------------------
+void publishPollStatistics() {
+    static double periodStart = 0;
+    char buffer[256];
+
+    uint64 locked = lockCriticalSection();
+    double now = monotonicSeconds();
+    double elapsed = (periodStart > 0)? now - periodStart : g_driverStatsInterval;
+    periodStart = now;
+    int length = snprintf(buffer, sizeof(buffer), "ZwavePollStats ");
+    length += g_pollScheduler.Format(buffer + length, sizeof(buffer) - length, elapsed);
+    unlockCriticalSection(locked);
+
+    publishText(buffer, length);
+}
+
+void configureNode(NodeInfo *nodeInfo);
+
+//-----------------------------------------------------------------------------
+// <runStartupWork>
+// Does the startup work handed over by the notification thread: writes the
+// config file and configures the nodes whose queries are complete, one node
+// per lock so notifications keep flowing in between. Returns false if the
+// driver failed.
+//-----------------------------------------------------------------------------
+bool runStartupWork() {
+    uint64 locked = lockCriticalSection();
+    bool failed = g_initFailed;
+    bool writeConfig = g_writeConfigPending;
+    g_writeConfigPending = false;
+    unlockCriticalSection(locked);
+
+    if(failed)
+        return false;
+    if(writeConfig)
+        Manager::Get()->WriteConfig( g_homeId );
+
+    while(true) {
+        NodeInfo *pending = NULL;
+
+        locked = lockCriticalSection();
+        for( list<NodeInfo*>::iterator it = g_nodes.begin(); it != g_nodes.end(); ++it ) {
+            if( (*it)->m_state == NodeState_Pending ) {
+                pending = *it;
                 break;
+            }
         }
+        if(pending)
+            configureNode(pending);
+        unlockCriticalSection(locked);
 
+        if(!pending)
+            return true;
     }
-    else {
-        // One SmartSensor
-        nodeId = 1;
-    }
+}
 
-    sprintf((char *) buffer, "%s_%s_%d %f", sensor, measurement, nodeId, f_val);
+//-----------------------------------------------------------------------------
+// <runEventLoop>
+// Waits for SIGINT/SIGTERM, does the startup work as nodes become ready,
+// polls the values that g_pollScheduler says are due, checks the door and
+// motion filters every STATE_CHECK_INTERVAL seconds and publishes the
+// statistics every g_driverStatsInterval seconds in between. Returns when a
+// shutdown signal has been received or the driver failed. The signals must
+// already be blocked in every thread.
+//-----------------------------------------------------------------------------
+void runEventLoop(int signalFd) {
+    double nextStats = monotonicSeconds() + g_driverStatsInterval;
+    double nextStates = monotonicSeconds() + STATE_CHECK_INTERVAL;
+    g_statsPeriodStart = monotonicSeconds();
+
+    while(true) {
+        struct pollfd fds[2];
+        fds[0].fd = signalFd;
+        fds[0].events = POLLIN;
+        fds[1].fd = g_wakeFd;
+        fds[1].events = POLLIN;
+
+        uint64 locked = lockCriticalSection();
+        double nextPoll = g_pollScheduler.NextDue();
+        unlockCriticalSection(locked);
+
+        double now = monotonicSeconds();
+        double next = (nextPoll < nextStats)? nextPoll : nextStats;
+        next = (nextStates < next)? nextStates : next;
+        int timeoutMs = (next > now)? (int) ((next - now) * 1000) + 1 : 0;
+
+        int ready = poll(fds, 2, timeoutMs);
+        if(ready < 0) {
+            if(errno == EINTR)
+                continue;
+            perror("poll() failed");
+            return;
+        }
 
-    zmq::message_t message(strlen(buffer));
+        if(ready > 0 && (fds[0].revents & POLLIN)) {
+            struct signalfd_siginfo info;
+            if(read(signalFd, &info, sizeof(info)) == sizeof(info)) {
+                printf("Received signal %u, shutting down\n", info.ssi_signo);
+                return;
+            }
+        }
 
-    memcpy((char *) message.data(), buffer, strlen(buffer));
-    
-    publisher.send(message);
+        if(ready > 0 && (fds[1].revents & POLLIN)) {
+            uint64_t count;
+            if(read(g_wakeFd, &count, sizeof(count)) == sizeof(count) && !runStartupWork()) {
+                printf("Driver failed, shutting down\n");
+                return;
+            }
+        }
+
+        if(monotonicSeconds() >= nextPoll) {
+            pollDueValues();
+        }
+
+        if(monotonicSeconds() >= nextStats) {
+            publishDriverStatistics();
+            publishLatencyStatistics();
+            publishPollStatistics();
+            nextStats += g_driverStatsInterval;
+        }
+
+        if(monotonicSeconds() >= nextStates) {
+            publishStateHeartbeats();
+            nextStates = monotonicSeconds() + STATE_CHECK_INTERVAL;
+        }
+    }
 }
 
 //-----------------------------------------------------------------------------
 // <GetNodeInfo>
-// Return the NodeInfo object associated with this notification
+// Return the NodeInfo object associated with this home and node id
 //-----------------------------------------------------------------------------
 NodeInfo* GetNodeInfo
 (
-	Notification const* _notification
+	uint32 const homeId,
+	uint8 const nodeId
 )
 {
-	uint32 const homeId = _notification->GetHomeId();
-	uint8 const nodeId = _notification->GetNodeId();
 	for( list<NodeInfo*>::iterator it = g_nodes.begin(); it != g_nodes.end(); ++it )
 	{
 		NodeInfo* nodeInfo = *it;
@@ -207,7 +860,7 @@ NodeInfo* GetNodeInfo
 //-----------------------------------------------------------------------------
 void configureSmartSwitchParameters(uint8 nodeId) 
 {
-    pthread_mutex_lock( &g_criticalSection );
+    uint64 locked = lockCriticalSection();
 
     // Send a multisensor report for Group 1.
     Manager::Get()->SetConfigParam(g_homeId, nodeId, 101, 2);
@@ -220,135 +873,372 @@ void configureSmartSwitchParameters(uint8 nodeId)
     Manager::Get()->RequestConfigParam(g_homeId, nodeId, 101);
     Manager::Get()->RequestConfigParam(g_homeId, nodeId, 102);
 
-    pthread_mutex_unlock( &g_criticalSection );
+    unlockCriticalSection(locked);
+}
+
+//-----------------------------------------------------------------------------
+// <schedulePolling>
+// Adds the values of a node that match a polling rule to g_pollScheduler.
+// Sleeping nodes cannot be polled and are skipped. Must be called with
+// g_criticalSection held, once the node's type is known.
+//-----------------------------------------------------------------------------
+void schedulePolling(NodeInfo *nodeInfo) {
+    if(g_numPollRules == 0 || !Manager::Get()->IsNodeListeningDevice(nodeInfo->m_homeId, nodeInfo->m_nodeId))
+        return;
+
+    double now = monotonicSeconds();
+    for(list<ValueID>::iterator it = nodeInfo->m_values.begin(); it != nodeInfo->m_values.end(); ++it) {
+        ValueID const& v = *it;
+        for(int i = 0; i < g_numPollRules; i++) {
+            PollRule const& rule = g_pollRules[i];
+            if(rule.m_sensorType != nodeInfo->m_sensorType || rule.m_commandClassId != v.GetCommandClassId())
+                continue;
+            if((rule.m_instance >= 0 && rule.m_instance != v.GetInstance()) || (rule.m_index >= 0 && rule.m_index != v.GetIndex()))
+                continue;
+            if(g_pollScheduler.Add(v.GetId(), rule.m_priority, rule.m_minInterval, rule.m_maxInterval, rule.m_scale, now))
+                printf("Polling value 0x%llx of node %u\n", (unsigned long long) v.GetId(), nodeInfo->m_nodeId);
+            break;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// <observePolledValue>
+// Tells g_pollScheduler about a new reading, so that changing values are
+// polled more often. Unscheduled values are ignored.
+//-----------------------------------------------------------------------------
+void observePolledValue(NotificationRecord const& record) {
+    float value;
+    switch(record.m_valueKind) {
+        case NotificationValue_Bool:
+        case NotificationValue_Byte:
+            value = (float) record.m_value.m_raw;
+            break;
+        case NotificationValue_Float:
+            value = record.m_value.m_float;
+            break;
+        case NotificationValue_Int:
+        case NotificationValue_List:
+            value = (float) record.m_value.m_int;
+            break;
+        default:
+            return;
+    }
+    g_pollScheduler.Observe(record.m_valueId, value, monotonicSeconds());
 }
 
 //-----------------------------------------------------------------------------
-// <configureSensorParameters>
-// Configures several parameters for all the sensors.
+// <configureNode>
+// Configures one node once its queries are complete: schedules its polled
+// values, sets its configuration parameters and, for the HSM100, its
+// wake-up interval. Commands for sleeping nodes are queued by the driver
+// until the node wakes up, so this never waits for the node. Must be called
+// with g_criticalSection held.
 //-----------------------------------------------------------------------------
-void configureSensorParameters() 
+void configureNode(NodeInfo *nodeInfo)
 {
-    uint8 nodeId = 0;
-	for( list<NodeInfo*>::iterator it = g_nodes.begin(); it != g_nodes.end(); ++it )
-	{
-		NodeInfo* nodeInfo = *it;
-        nodeId = nodeInfo->m_nodeId;
+    uint8 nodeId = nodeInfo->m_nodeId;
 
-        // Initialize Configuration Parameters
-        switch(nodeInfo->m_sensorType) {
-            case SMART_SWITCH_SENSOR:
-                configureSmartSwitchParameters(nodeId);
-                break;
-            case HSM_100_SENSOR:
-                pthread_mutex_lock( &g_criticalSection );
-                // Request and Set the "On Time" Config Param to 20 with index 2 (See zwcfg*.xml)
-                Manager::Get()->SetConfigParam(g_homeId, nodeId, 2, 1); 
-                Manager::Get()->RequestConfigParam(g_homeId, nodeId, 2); 
-
-                /*
-                // Request and Set the "On Value" Config Param to 255 with index 6 (See zwcfg*.xml)
-                // Manager::Get()->SetConfigParam(g_homeId, Hsm100SensorId, 6, 255); 
-                Manager::Get()->RequestConfigParam(g_homeId, Hsm100SensorId, 6); 
-
-                // Request "Stay Awake" Config Param
-                Manager::Get()->RequestConfigParam(g_homeId, Hsm100SensorId, 5);
-
-                // Request Sensitivity
-                //Manager::Get()->RequestConfigParam(g_homeId, Hsm100SensorId, 1);
-                */
-                pthread_mutex_unlock( &g_criticalSection );
-                break;
-            case AL_DW_SENSOR:
-            case Z_STICK:
-            default:
-                break;
+    schedulePolling(nodeInfo);
+
+    // Initialize Configuration Parameters
+    switch(nodeInfo->m_sensorType) {
+        case SMART_SWITCH_SENSOR:
+            configureSmartSwitchParameters(nodeId);
+            break;
+        case HSM_100_SENSOR:
+        {
+            // Request and Set the "On Time" Config Param to 20 with index 2 (See zwcfg*.xml)
+            Manager::Get()->SetConfigParam(g_homeId, nodeId, 2, 1); 
+            Manager::Get()->RequestConfigParam(g_homeId, nodeId, 2); 
+
+            /*
+            // Request and Set the "On Value" Config Param to 255 with index 6 (See zwcfg*.xml)
+            // Manager::Get()->SetConfigParam(g_homeId, Hsm100SensorId, 6, 255); 
+            Manager::Get()->RequestConfigParam(g_homeId, Hsm100SensorId, 6); 
+
+            // Request "Stay Awake" Config Param
+            Manager::Get()->RequestConfigParam(g_homeId, Hsm100SensorId, 5);
+
+            // Request Sensitivity
+            //Manager::Get()->RequestConfigParam(g_homeId, Hsm100SensorId, 1);
+            */
+
+            for( list<ValueID>::iterator it = nodeInfo->m_values.begin(); it != nodeInfo->m_values.end(); ++it )
+            {
+                if( it->GetCommandClassId() == COMMAND_CLASS_WAKE_UP ) {
+                    // Set the Wake-up interval
+                    bool success = Manager::Get()->SetValue(*it, 360);
+                    printf("Set Wake-up Interval Successfully: %s\n", (success)?"Yes":"No");
+                }
+            }
+            break;
         }
+        case AL_DW_SENSOR:
+        case Z_STICK:
+        default:
+            break;
+    }
+
+    nodeInfo->m_state = NodeState_Ready;
+    printf("Node %u configured after %.1f s\n", nodeId, monotonicSeconds() - g_startTime);
+}
+
+//-----------------------------------------------------------------------------
+// <printConfigVariable>
+// Prints the Configuration Variable
+//-----------------------------------------------------------------------------
+void printConfigVariable(uint8 index, uint8 byte_value) {
+    static const char *parameter_names[] = {"Sensitivity", "On Time", "LED ON/OFF", 
+        "Light Threshold", "Stay Awake", "On Value"};
+    printf("\"%s\" was set to %u\n", parameter_names[index-1], byte_value);
+}
+
+//-----------------------------------------------------------------------------
+// <printSmartSwitchMeterValue>
+// Prints the Smart Switch Meter Value
+//-----------------------------------------------------------------------------
+// Measurement names for the SmartSwitch meter, by value index
+struct IndexName {
+    uint8 index;
+    const char *name;
+};
+
+static constexpr IndexName SmartSwitchMeasurements[] = {
+    { 0,  "Energy" },
+    { 1,  "Previous_Energy_Reading" },
+    { 2,  "Energy_Interval" },
+    { 8,  "Power" },
+    { 9,  "Previous_Power_Reading" },
+    { 10, "Power_Interval" },
+    { 32, "Exporting" },
+    { 33, "Reset" }
+};
+
+// Labels of the SmartSwitch "Switch All" list value, by list value
+static constexpr IndexName SwitchAllLabels[] = {
+    { 0,   "Disabled" },
+    { 1,   "Off Enabled" },
+    { 2,   "On Enabled" },
+    { 255, "On and Off Enabled" }
+};
 
+template <size_t N>
+const char *lookupName(const IndexName (&table)[N], uint8 index) {
+    for(size_t i = 0; i < N; i++) {
+        if(table[i].index == index)
+            return table[i].name;
+    }
+    return "Unknown";
+}
+
+void printSmartSwitchMeterValue(ValueID value_id) {
+    float float_value = 0;
+    int32 int_value = 0;
+    bool bool_value = false;
+
+    const char *measurement = lookupName(SmartSwitchMeasurements, value_id.GetIndex());
+    switch((int) value_id.GetType()) {
+        case 0:
+            Manager::Get()->GetValueAsBool(value_id, &bool_value);
+            printf("\"%s\" is set to %s\n", measurement, (bool_value)?"True":"False");
+            break;
+        case 2:
+            Manager::Get()->GetValueAsFloat(value_id, &float_value);
+            printf("\"%s\" is set to %f\n", measurement, float_value);
+            break;
+        case 3:
+            Manager::Get()->GetValueAsInt(value_id, &int_value);
+            printf("\"%s\" is set to %d\n", measurement, int_value);
+            break;
+        default:
+            printf("\"%s\" has no printable value\n", measurement);
+            break;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// <getSensorType>
+// Get the Sensor Type Given the product and manufacturer names of a node
+//-----------------------------------------------------------------------------
+SensorType getSensorType(uint8 nodeId, const char *name, const char *manufacturer_name) {
+    SensorType sensorType = UNKNOWN_SENSOR;
+
+    if(strcmp(name, "Door/Window Sensor") == 0 && strcmp(manufacturer_name, "Aeon Labs") == 0) {
+        sensorType = AL_DW_SENSOR;
+    }
+    else if(strcmp(name, "HSM100 Wireless Multi-Sensor") == 0 && strcmp(manufacturer_name, "Homeseer") == 0) {
+        sensorType = HSM_100_SENSOR;
+    }
+    else if(strcmp(name, "Z-Stick S2") == 0 && strcmp(manufacturer_name, "Aeon Labs") == 0) {
+        sensorType = Z_STICK;
+    }
+    else if(strcmp(name, "Smart Energy Switch") == 0 && strcmp(manufacturer_name, "Aeon Labs") == 0) {
+        sensorType = SMART_SWITCH_SENSOR;
+    }
+    else if(name[0] != '\0' && manufacturer_name[0] != '\0') {
+        // Print unknown nodes
+        printf("Unknown Node %u called %s, manufactured by %s\n", nodeId, name, manufacturer_name);
+    }
+    return sensorType;
+}
+
+//-----------------------------------------------------------------------------
+// <identifyNode>
+// Caches the product and manufacturer names of a node and resolves its
+// SensorType. Only called from node-level notifications (NodeAdded,
+// NodeProtocolInfo, NodeNaming, NodeQueriesComplete) while the type is still
+// unknown, never for value notifications.
+//-----------------------------------------------------------------------------
+void identifyNode(NodeInfo *nodeInfo) {
+    string name = Manager::Get()->GetNodeProductName(nodeInfo->m_homeId, nodeInfo->m_nodeId);
+    string manufacturer_name = Manager::Get()->GetNodeManufacturerName(nodeInfo->m_homeId, nodeInfo->m_nodeId);
+
+    snprintf(nodeInfo->m_productName, sizeof(nodeInfo->m_productName), "%s", name.c_str());
+    snprintf(nodeInfo->m_manufacturerName, sizeof(nodeInfo->m_manufacturerName), "%s", manufacturer_name.c_str());
+
+    nodeInfo->m_sensorType = getSensorType(nodeInfo->m_nodeId, nodeInfo->m_productName, nodeInfo->m_manufacturerName);
+}
+
+//-----------------------------------------------------------------------------
+// <identifyNodeFromCache>
+// Identifies a node from the zwcfg file of the previous run while its live
+// names are not known yet. Returns true if the cached names resolve to a
+// known SensorType.
+//-----------------------------------------------------------------------------
+bool identifyNodeFromCache(NodeInfo *nodeInfo) {
+    CachedNode const* cached = g_nodeCache.Get(nodeInfo->m_nodeId);
+    if(!cached)
+        return false;
+
+    SensorType sensorType = getSensorType(nodeInfo->m_nodeId, cached->m_productName, cached->m_manufacturerName);
+    if(sensorType == UNKNOWN_SENSOR)
+        return false;
+
+    snprintf(nodeInfo->m_productName, sizeof(nodeInfo->m_productName), "%s", cached->m_productName);
+    snprintf(nodeInfo->m_manufacturerName, sizeof(nodeInfo->m_manufacturerName), "%s", cached->m_manufacturerName);
+    nodeInfo->m_sensorType = sensorType;
+    nodeInfo->m_fromCache = true;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// <verifyCachedNode>
+// Checks a node identified from the cache against its live names once the
+// Manager has them. A node that was replaced since the file was written is
+// re-identified; it goes back to NodeState_Added if it is now unknown.
+//-----------------------------------------------------------------------------
+void verifyCachedNode(NodeInfo *nodeInfo) {
+    if(Manager::Get()->GetNodeProductName(nodeInfo->m_homeId, nodeInfo->m_nodeId).empty())
+        return;     // Not known live yet
+
+    SensorType cachedType = nodeInfo->m_sensorType;
+    identifyNode(nodeInfo);
+    nodeInfo->m_fromCache = false;
+
+    if(nodeInfo->m_sensorType != cachedType) {
+        printf("Node %u: cached as %s but is %s, cache is stale\n", nodeInfo->m_nodeId,
+               g_sensorNames[cachedType], g_sensorNames[nodeInfo->m_sensorType]);
+        if(nodeInfo->m_sensorType == UNKNOWN_SENSOR)
+            nodeInfo->m_state = NodeState_Added;
+    }
+}
+//-----------------------------------------------------------------------------
+// <readValue>
+// Reads the current value of a ValueID into the notification record, so the
+// parse functions (and a replay) work from the record instead of the Manager.
+//-----------------------------------------------------------------------------
+void readValue(ValueID const& value_id, NotificationRecord *record) {
+    bool success = false;
+    bool bool_value = false;
+    uint8 byte_value = 0;
+    float float_value = 0;
+    int32 int_value = 0;
+
+    // The record is packed, so read into locals rather than into its members
+    record->m_valueKind = NotificationValue_None;
+
+    switch((int) value_id.GetType()) {
+        // See open-zwave/cpp/src/value_classes/ValueID.h for ValueType enum 
+        case 0:
+            // Boolean Type
+            success = Manager::Get()->GetValueAsBool(value_id, &bool_value);
+            record->m_value.m_raw = bool_value;
+            record->m_valueKind = NotificationValue_Bool;
+            break;
+        case 1:
+            // Byte Type
+            success = Manager::Get()->GetValueAsByte(value_id, &byte_value);
+            record->m_value.m_raw = byte_value;
+            record->m_valueKind = NotificationValue_Byte;
+            break;
+        case 2:
+            // Float Type
+            success = Manager::Get()->GetValueAsFloat(value_id, &float_value);
+            record->m_value.m_float = float_value;
+            record->m_valueKind = NotificationValue_Float;
+            break;
+        case 3:
+            // Int Type
+            success = Manager::Get()->GetValueAsInt(value_id, &int_value);
+            record->m_value.m_int = int_value;
+            record->m_valueKind = NotificationValue_Int;
+            break;
+        case 4:
+            // List Type -> Get the selected value
+            success = Manager::Get()->GetValueListSelection(value_id, &int_value);
+            record->m_value.m_int = int_value;
+            record->m_valueKind = NotificationValue_List;
+            break;
+        default:
+            printf("Unrecognized Type: %d\n", (int) value_id.GetType());
+            break;
     }
 
+    if(!success)
+        record->m_valueKind = NotificationValue_None;
 }
 
 //-----------------------------------------------------------------------------
-// <printConfigVariable>
-// Prints the Configuration Variable
-//-----------------------------------------------------------------------------
-void printConfigVariable(uint8 index, uint8 byte_value) {
-    static const char *parameter_names[] = {"Sensitivity", "On Time", "LED ON/OFF", 
-        "Light Threshold", "Stay Awake", "On Value"};
-    printf("\"%s\" was set to %u\n", parameter_names[index-1], byte_value);
-}
-
-//-----------------------------------------------------------------------------
-// <printSmartSwitchMeterValue>
-// Prints the Smart Switch Meter Value
-//-----------------------------------------------------------------------------
-void printSmartSwitchMeterValue(ValueID value_id) {
-    string str_value = "";
-    Manager::Get()->GetValueAsString(value_id, &str_value);
-    // printf("Successfully Got Value As String: %s\n", (success)?"Yes":"No");
-
-    // Measurement map for SmartSwitch
-    static map<uint8, string> SmartSwitchMeasurementMap;
-    SmartSwitchMeasurementMap[0] = "Energy";
-    SmartSwitchMeasurementMap[1] = "Previous_Energy_Reading";
-    SmartSwitchMeasurementMap[2] = "Energy_Interval";
-    SmartSwitchMeasurementMap[8] = "Power";
-    SmartSwitchMeasurementMap[9] = "Previous_Power_Reading";
-    SmartSwitchMeasurementMap[10] = "Power_Interval";
-    SmartSwitchMeasurementMap[32] = "Exporting";
-    SmartSwitchMeasurementMap[33] = "Reset";
-
-    string measurement = SmartSwitchMeasurementMap[value_id.GetIndex()];
-    printf("\"%s\" is set to %s\n", measurement.c_str(), str_value.c_str());
-}
-
-//-----------------------------------------------------------------------------
-// <getSensorType>
-// Get the Sensor Type Given the homeId and NodeId
+// <unpackValue>
+// Copies the value held in a notification record into the variable of the
+// matching type. Returns false if the record holds no value.
 //-----------------------------------------------------------------------------
-SensorType getSensorType(uint32 homeId, uint8 nodeId) {
-    // Get the sensor information
-    string name = Manager::Get()->GetNodeProductName(homeId, nodeId);
-    string manufacturer_name = Manager::Get()->GetNodeManufacturerName(homeId, nodeId);
-    // printf("Finished protocol info for Node %u\n", nodeId);
-    //printf("With type: %s\n", Manager::Get()->GetNodeType(nodeInfo->m_homeId, nodeInfo->m_nodeId));
-    //printf("    With Name: %s\n", name.c_str());
-    //printf("    and Manufacturer: %s\n", manufacturer_name.c_str());
-
-    
-    SensorType sensorType;
-
-    if(name == "Door/Window Sensor" && manufacturer_name == "Aeon Labs") {
-        sensorType = AL_DW_SENSOR;
-    }
-    else if(name == "HSM100 Wireless Multi-Sensor" && manufacturer_name == "Homeseer") {
-        sensorType = HSM_100_SENSOR;
-    }
-    else if(name == "Z-Stick S2" && manufacturer_name == "Aeon Labs") {
-        sensorType = Z_STICK;
-    }
-    else if(name == "Smart Energy Switch" && manufacturer_name == "Aeon Labs") {
-        sensorType = SMART_SWITCH_SENSOR;
-    }
-    else if(name != "" && manufacturer_name != "") {
-        // Print unknown nodes
-        printf("Unknown Node %u called %s, manufactured by %s\n", nodeId, name.c_str(), manufacturer_name.c_str());
+bool unpackValue(NotificationRecord const& record, bool *bool_value, uint8 *byte_value,
+                 float *float_value, int32 *int_value, int32 *list_value) {
+    switch(record.m_valueKind) {
+        case NotificationValue_Bool:
+            *bool_value = (record.m_value.m_raw != 0);
+            return true;
+        case NotificationValue_Byte:
+            *byte_value = (uint8) record.m_value.m_raw;
+            return true;
+        case NotificationValue_Float:
+            *float_value = record.m_value.m_float;
+            return true;
+        case NotificationValue_Int:
+            *int_value = record.m_value.m_int;
+            return true;
+        case NotificationValue_List:
+            *list_value = record.m_value.m_int;
+            return true;
+        default:
+            return false;
     }
-    return sensorType;
 }
+
     //-----------------------------------------------------------------------------
     // <parseHsm100Sensor>
     // Parses the HSM100 ValueChanged for luminance, temperature, motion, etc.
     //-----------------------------------------------------------------------------
-    void parseHsm100Sensor(uint8 nodeId, ValueID value_id) {
+    void parseHsm100Sensor(uint8 nodeId, ValueID value_id, NotificationRecord const& record) {
 
         // Initialize Variables
-    bool success = false;
     bool bool_value = false;
     uint8 byte_value = 0;
     float float_value = 0.0;
     int32 int_value = 0;
+    int32 list_value = 0;
 
     // Perform action based on CommandClassID
     // For HSM-100, the following Classes need to be taken care of:
@@ -369,31 +1259,8 @@ SensorType getSensorType(uint32 homeId, uint8 nodeId) {
        printf("    ID: %u\n", (uint64) value_id.GetId());
     */
 
-    // Get the Changed Value Based on the type
-    switch((int) value_id.GetType()) {
-        // See open-zwave/cpp/src/value_classes/ValueID.h for ValueType enum 
-        case 0:
-            // Boolean Type
-            success = Manager::Get()->GetValueAsBool(value_id, &bool_value);
-            break;
-        case 1:
-            // Byte Type
-            success = Manager::Get()->GetValueAsByte(value_id, &byte_value);
-            // printf("Successfully got Value? %s\n", (success)?"Yes":"No");
-            break;
-        case 2:
-            // Float Type
-            success = Manager::Get()->GetValueAsFloat(value_id, &float_value);
-            break;
-        case 3:
-            // Int Type
-            success = Manager::Get()->GetValueAsInt(value_id, &int_value);
-            break;
-        default:
-            printf("Unrecognized Type: %d\n", (int) value_id.GetType());
-            break;
-    }
-    if(!success) {
+    // Unpack the value that was read (or recorded) for this notification
+    if(!unpackValue(record, &bool_value, &byte_value, &float_value, &int_value, &list_value)) {
         printf("Unable to Get the Value\n");
         return;
     }
@@ -416,17 +1283,17 @@ SensorType getSensorType(uint32 homeId, uint8 nodeId) {
                 case 1:
                     // General
                     printf("It has been %f minutes since the last Motion Detected.\n", float_value);
-                    sendMessage("HSM100", "MotionTimeout", float_value, nodeId);
+                    sendMessage(HSM_100_SENSOR, "MotionTimeout", float_value, nodeId);
                     break;
                 case 2:
                     // Luminance
                     printf("Luminance: %f\n", float_value);
-                    sendMessage("HSM100", "Luminance", float_value, nodeId);
+                    sendMessage(HSM_100_SENSOR, "Luminance", float_value, nodeId);
                     break;
                 case 3:
                     // Temperature
                     printf("Temperature: %f\n", float_value);
-                    sendMessage("HSM100", "Temperature", float_value, nodeId);
+                    sendMessage(HSM_100_SENSOR, "Temperature", float_value, nodeId);
                     break;
 
                 default:
@@ -441,7 +1308,8 @@ SensorType getSensorType(uint32 homeId, uint8 nodeId) {
             // printf("\nGot COMMAND_CLASS_WAKE_UP!\n");
             printf("Wake-up interval: %d seconds\n", int_value);
             // Manager::Get()->RefreshNodeInfo(g_homeId, nodeId);
-            Manager::Get()->RequestNodeDynamic(g_homeId, nodeId);
+            if(!g_replaying)
+                Manager::Get()->RequestNodeDynamic(g_homeId, nodeId);
             break;
         case COMMAND_CLASS_BATTERY:
             printf("Battery: %u\n", byte_value);
@@ -461,50 +1329,17 @@ SensorType getSensorType(uint32 homeId, uint8 nodeId) {
 // <parseSmartSwitchSensor>
 // Parses the Aeon Labs Energy Switch Sensor for basic values.
 //-----------------------------------------------------------------------------
-void parseSmartSwitchSensor(uint8 nodeId, ValueID value_id) {
+void parseSmartSwitchSensor(uint8 nodeId, ValueID value_id, NotificationRecord const& record) {
 
     // Initialize Variables
-    bool success = false;
     bool bool_value = false;
     uint8 byte_value = 0;
     float float_value = 0;
-    int int_value = 0;
-    string str_value = "";
+    int32 int_value = 0;
+    int32 list_value = 0;
 
-    // printf("Value Type: %d\n", (int) value_id.GetType());
-    // Get the Changed Value Based on the type
-    switch((int) value_id.GetType()) {
-        // See open-zwave/cpp/src/value_classes/ValueID.h for ValueType enum 
-        case 0:
-            // Boolean Type
-            success = Manager::Get()->GetValueAsBool(value_id, &bool_value);
-            break;
-        case 1:
-            // Byte Type
-            success = Manager::Get()->GetValueAsByte(value_id, &byte_value);
-            // printf("Successfully got Value? %s\n", (success)?"Yes":"No");
-            break;
-        case 2:
-            // Float Type
-            success = Manager::Get()->GetValueAsFloat(value_id, &float_value);
-            break;
-        case 3:
-            // Int Type
-            success = Manager::Get()->GetValueAsInt(value_id, &int_value);
-            break;
-        case 4:
-            //  List Type -> Get as a string for easier parsing
-            // success = Manager::Get()->GetValueAsString(value_id, &str_value);
-            // break;
-        case 7:
-            // String Type
-            success = Manager::Get()->GetValueAsString(value_id, &str_value);
-            break;
-        default:
-            printf("Unrecognized Type: %d\n", (int) value_id.GetType());
-            break;
-    }
-    if(!success) {
+    // Unpack the value that was read (or recorded) for this notification
+    if(!unpackValue(record, &bool_value, &byte_value, &float_value, &int_value, &list_value)) {
         printf("Unable to Get the Value\n");
         return;
     }
@@ -529,22 +1364,22 @@ void parseSmartSwitchSensor(uint8 nodeId, ValueID value_id) {
         case COMMAND_CLASS_SENSOR_MULTILEVEL:
             // printf("Got COMMAND_CLASS_SENSOR_MULTILEVEL!\n");
             printf("Sent Power: %f\n\n", float_value);
-            sendMessage("SmartSwitch", "Power", float_value, nodeId);
+            sendMessage(SMART_SWITCH_SENSOR, "Power", float_value, nodeId);
             break;
         case COMMAND_CLASS_SWITCH_BINARY:
             // printf("Got COMMAND_CLASS_SWITCH_BINARY!\n");
             printf("Binary Switch: %s\n\n", (bool_value)?"on":"off");
-            sendMessage("SmartSwitch", "Binary_Switch", float_value, nodeId);
+            sendMessage(SMART_SWITCH_SENSOR, "Binary_Switch", float_value, nodeId);
             break;
         case COMMAND_CLASS_SWITCH_ALL:
             // printf("Got COMMAND_CLASS_SWITCH_ALL!\n");
-            printf("Switch_all: %s\n\n", str_value.c_str());
+            printf("Switch_all: %s\n\n", lookupName(SwitchAllLabels, (uint8) list_value));
             break;
         case COMMAND_CLASS_METER:
             // printf("Got COMMAND_CLASS_METER!\n");
 
             if(value_id.GetIndex() == 0) {
-                sendMessage("SmartSwitch", "Energy", float_value, nodeId);
+                sendMessage(SMART_SWITCH_SENSOR, "Energy", float_value, nodeId);
                 printf("Sent Energy: %f\n\n", float_value);
             }
             // printSmartSwitchMeterValue(value_id);
@@ -563,41 +1398,20 @@ void parseSmartSwitchSensor(uint8 nodeId, ValueID value_id) {
 // <parseAlDwSensor>
 // Parses the Aeon Labs Door/Window Sensor for basic values (open/closed)
 //-----------------------------------------------------------------------------
-void parseAlDwSensor(uint8 nodeId, ValueID value_id) {
+void parseAlDwSensor(uint8 nodeId, ValueID value_id, NotificationRecord const& record) {
 
     // Initialize Variables
-    bool success = false;
     bool bool_value = false;
     uint8 byte_value = 0;
     float float_value = 0;
-    int int_value = 0;
+    int32 int_value = 0;
+    int32 list_value = 0;
 
-    // Get the Changed Value Based on the type
-    switch((int) value_id.GetType()) {
-        // See open-zwave/cpp/src/value_classes/ValueID.h for ValueType enum 
-        case 0:
-            // Boolean Type
-            success = Manager::Get()->GetValueAsBool(value_id, &bool_value);
-            break;
-        case 1:
-            // Byte Type
-            success = Manager::Get()->GetValueAsByte(value_id, &byte_value);
-            // printf("Successfully got Value? %s\n", (success)?"Yes":"No");
-            break;
-        case 2:
-            // Float Type
-            success = Manager::Get()->GetValueAsFloat(value_id, &float_value);
-            break;
-        case 3:
-            // Int Type
-            success = Manager::Get()->GetValueAsInt(value_id, &int_value);
-            break;
-        default:
-            printf("Unrecognized Type: %d\n", (int) value_id.GetType());
-            break;
-    }
-    if(!success)
+    // Unpack the value that was read (or recorded) for this notification
+    if(!unpackValue(record, &bool_value, &byte_value, &float_value, &int_value, &list_value)) {
         printf("Unable to Get the Value\n");
+        return;
+    }
 
     // Perform action based on CommandClassID
     // For Aeon Labs Door/Window Sensor, there are 3 Class to take care of:
@@ -621,11 +1435,11 @@ void parseAlDwSensor(uint8 nodeId, ValueID value_id) {
 
             if(byte_value) {
                 printf("Door is Open!\n");
-                sendMessage("DoorSensor", "Door", 1.0, nodeId);
+                sendStateMessage(&g_doorFilter, AL_DW_SENSOR, "Door", 1.0, nodeId, record.m_timestamp / 1e9);
             }
             else {
                 printf("Door is Closed!\n");
-                sendMessage("DoorSensor", "Door", 0, nodeId);
+                sendStateMessage(&g_doorFilter, AL_DW_SENSOR, "Door", 0, nodeId, record.m_timestamp / 1e9);
             }
 
             break;
@@ -651,42 +1465,69 @@ void parseAlDwSensor(uint8 nodeId, ValueID value_id) {
     printf("\n");
 }
 
+// Value decoder bound to each SensorType; NULL for types without values
+typedef void (*ValueParser)(uint8 nodeId, ValueID value_id, NotificationRecord const& record);
+static const ValueParser g_valueParsers[NUM_SENSOR_TYPES] = {
+    NULL,                       // Z_STICK
+    parseAlDwSensor,            // AL_DW_SENSOR
+    parseHsm100Sensor,          // HSM_100_SENSOR
+    parseSmartSwitchSensor,     // SMART_SWITCH_SENSOR
+    NULL                        // UNKNOWN_SENSOR
+};
+
 
 //-----------------------------------------------------------------------------
-// <OnNotification>
-// Callback that is triggered when a value, group or node changes
+// <handleNotification>
+// Updates the node list and decodes and publishes values for one
+// notification. Live notifications and replayed ones both come through here,
+// so a replay exercises the same decode and publish path. Must be called
+// with g_criticalSection held.
 //-----------------------------------------------------------------------------
-void OnNotification
+void handleNotification
 (
-	Notification const* _notification,
-	void* _context
+	NotificationRecord* _record
 )
 {
-	// Must do this inside a critical section to avoid conflicts with the main thread
-	pthread_mutex_lock( &g_criticalSection );
+	uint32 const homeId = _record->m_homeId;
+	uint8 const nodeId = _record->m_nodeId;
 
-    // printf("_notification->GetType(): %d\n", _notification->GetType());
+    // printf("_record->m_type: %d\n", _record->m_type);
 
-	switch( _notification->GetType() )
+	switch( _record->m_type )
 	{
 		case Notification::Type_ValueAdded:
 		{
-			if( NodeInfo* nodeInfo = GetNodeInfo( _notification ) )
+			if( NodeInfo* nodeInfo = GetNodeInfo( homeId, nodeId ) )
 			{
 				// Add the new value to our list
-				nodeInfo->m_values.push_back( _notification->GetValueID() );
+				ValueID const valueId( homeId, _record->m_valueId );
+				nodeInfo->m_values.push_back( valueId );
+
+				// A value the cached node did not have means the cache no
+				// longer describes this node; wait for its live names
+				CachedNode const* cached = g_nodeCache.Get( nodeId );
+				if( nodeInfo->m_fromCache && cached && !cached->HasCommandClass( valueId.GetCommandClassId() ) )
+				{
+					printf( "Node %u: command class 0x%02x not in cache, cache is stale\n",
+							nodeId, valueId.GetCommandClassId() );
+					nodeInfo->m_fromCache = false;
+					nodeInfo->m_sensorType = UNKNOWN_SENSOR;
+					nodeInfo->m_state = NodeState_Added;
+					identifyNode( nodeInfo );
+				}
 			}
 			break;
 		}
 
 		case Notification::Type_ValueRemoved:
 		{
-			if( NodeInfo* nodeInfo = GetNodeInfo( _notification ) )
+			if( NodeInfo* nodeInfo = GetNodeInfo( homeId, nodeId ) )
 			{
 				// Remove the value from out list
+				ValueID const valueId( homeId, _record->m_valueId );
 				for( list<ValueID>::iterator it = nodeInfo->m_values.begin(); it != nodeInfo->m_values.end(); ++it )
 				{
-					if( (*it) == _notification->GetValueID() )
+					if( (*it) == valueId )
 					{
 						nodeInfo->m_values.erase( it );
 						break;
@@ -699,21 +1540,18 @@ void OnNotification
 		case Notification::Type_ValueChanged:
 		{
 			// One of the node values has changed
-			if( NodeInfo* nodeInfo = GetNodeInfo( _notification ) )
+			if( NodeInfo* nodeInfo = GetNodeInfo( homeId, nodeId ) )
 			{
                 // ValueID of value involved
-                uint8 nodeId = nodeInfo->m_nodeId;
-                ValueID value_id = _notification->GetValueID();
+                ValueID value_id( homeId, _record->m_valueId );
                 SensorType sensorType = nodeInfo->m_sensorType;
 
+                observePolledValue( *_record );
+
                 // printf("Received Value Change for Node %u\n", nodeId);
                 // Perform different actions based on which node
-                if(sensorType == HSM_100_SENSOR)
-                    parseHsm100Sensor(nodeId, value_id);
-                else if(sensorType == AL_DW_SENSOR)
-                    parseAlDwSensor(nodeId, value_id);
-                else if(sensorType == SMART_SWITCH_SENSOR)
-                    parseSmartSwitchSensor(nodeId, value_id);
+                if(ValueParser parser = g_valueParsers[sensorType])
+                    parser(nodeId, value_id, *_record);
                 else 
                     printf("Unknown Node\n");
             }
@@ -723,7 +1561,7 @@ void OnNotification
 		case Notification::Type_Group:
 		{
 			// One of the node's association groups has changed
-			if( NodeInfo* nodeInfo = GetNodeInfo( _notification ) )
+			if( NodeInfo* nodeInfo = GetNodeInfo( homeId, nodeId ) )
 			{
 				nodeInfo = nodeInfo;		// placeholder for real action
 			}
@@ -734,11 +1572,29 @@ void OnNotification
 		{
 			// Add the new node to our list
 			NodeInfo* nodeInfo = new NodeInfo();
-			nodeInfo->m_homeId = _notification->GetHomeId();
-			nodeInfo->m_nodeId = _notification->GetNodeId();
+			nodeInfo->m_homeId = homeId;
+			nodeInfo->m_nodeId = nodeId;
 			nodeInfo->m_polled = false;		
+			nodeInfo->m_state = NodeState_Added;
+			nodeInfo->m_fromCache = false;
 
-            nodeInfo->m_sensorType = getSensorType(_notification->GetHomeId(), _notification->GetNodeId());
+            if( g_replaying )
+            {
+                // No Manager to ask; trust what the recording saw
+                nodeInfo->m_sensorType = (SensorType) _record->m_sensorType;
+                g_nodes.push_back( nodeInfo );
+                break;
+            }
+
+            // The names may not be known yet; identifyNode is retried below
+            // as the node's protocol info and naming come in
+            identifyNode( nodeInfo );
+            if( nodeInfo->m_sensorType == UNKNOWN_SENSOR && identifyNodeFromCache( nodeInfo ) )
+            {
+                nodeInfo->m_state = NodeState_Identified;
+                printf( "Node %u identified as %s from cache after %.1f s\n", nodeId,
+                        g_sensorNames[nodeInfo->m_sensorType], monotonicSeconds() - g_startTime );
+            }
             
             g_nodes.push_back( nodeInfo );
 
@@ -749,8 +1605,6 @@ void OnNotification
         case Notification::Type_NodeRemoved:
         {
             // Remove the node from our list
-            uint32 const homeId = _notification->GetHomeId();
-            uint8 const nodeId = _notification->GetNodeId();
             for( list<NodeInfo*>::iterator it = g_nodes.begin(); it != g_nodes.end(); ++it )
             {
                 NodeInfo* nodeInfo = *it;
@@ -768,33 +1622,34 @@ void OnNotification
         {
             // We have received an event from the node, caused by a
             // basic_set or hail message.
-            if( NodeInfo* nodeInfo = GetNodeInfo( _notification ) )
+            if( NodeInfo* nodeInfo = GetNodeInfo( homeId, nodeId ) )
             {
                 // printf("Received Node Event for Node %u\n", nodeInfo->m_nodeId);
 
                 // Initialize values
-                ValueID value_id = _notification->GetValueID();
-                uint8 nodeId = nodeInfo->m_nodeId;
+                uint8 event = _record->m_event;
                 SensorType sensorType = nodeInfo->m_sensorType;
 
                 // Perform different actions based on which node
                 if(sensorType == AL_DW_SENSOR) {
                     // 0: Door is closed
                     // 255: Door is open
-                    if(_notification->GetEvent()) {
+                    if(event) {
                         printf("Door is Open!\n");
-                        sendMessage("DoorSensor", "Door", 1.0, nodeId);
+                        sendStateMessage(&g_doorFilter, AL_DW_SENSOR, "Door", 1.0, nodeId, _record->m_timestamp / 1e9);
                     }
                     else {
                         printf("Door is Closed!\n");
-                        sendMessage("DoorSensor", "Door", 0, nodeId);
+                        sendStateMessage(&g_doorFilter, AL_DW_SENSOR, "Door", 0, nodeId, _record->m_timestamp / 1e9);
                     }
                 }
                 else if(sensorType == HSM_100_SENSOR) {
-                    printf("Motion: %u\n", _notification->GetEvent());
-                    sendMessage("HSM100", "Motion", (_notification->GetEvent())?1.0:0.0, nodeId);
+                    printf("Motion: %u\n", event);
+                    sendStateMessage(&g_motionFilter, HSM_100_SENSOR, "Motion", (event)?1.0:0.0, nodeId,
+                                     _record->m_timestamp / 1e9);
                     // Manager::Get()->RefreshNodeInfo(g_homeId, nodeId);
-                    Manager::Get()->RequestNodeDynamic(g_homeId, nodeId);
+                    if(!g_replaying)
+                        Manager::Get()->RequestNodeDynamic(g_homeId, nodeId);
                 }
                 else {
                     printf("Received Node Event for Unknown Node %u", nodeId);
@@ -806,7 +1661,7 @@ void OnNotification
 
 		case Notification::Type_PollingDisabled:
 		{
-			if( NodeInfo* nodeInfo = GetNodeInfo( _notification ) )
+			if( NodeInfo* nodeInfo = GetNodeInfo( homeId, nodeId ) )
 			{
 				nodeInfo->m_polled = false;
 			}
@@ -815,7 +1670,7 @@ void OnNotification
 
 		case Notification::Type_PollingEnabled:
 		{
-			if( NodeInfo* nodeInfo = GetNodeInfo( _notification ) )
+			if( NodeInfo* nodeInfo = GetNodeInfo( homeId, nodeId ) )
 			{
 				nodeInfo->m_polled = true;
 			}
@@ -824,38 +1679,252 @@ void OnNotification
 
 		case Notification::Type_DriverReady:
 		{
-			g_homeId = _notification->GetHomeId();
+			g_homeId = homeId;
+
+			if( !g_replaying )
+			{
+				// Written by WriteConfig in the previous run
+				char path[32];
+				snprintf( path, sizeof(path), "zwcfg_0x%08x.xml", homeId );
+				int count = g_nodeCache.Load( path );
+				if( count >= 0 )
+					printf( "Loaded %d cached nodes from %s\n", count, path );
+			}
 			break;
 		}
 
 		case Notification::Type_DriverFailed:
 		{
 			g_initFailed = true;
-			pthread_cond_broadcast(&initCond);
+			wakeEventLoop();
 			break;
 		}
 
 		case Notification::Type_AwakeNodesQueried:
 		case Notification::Type_AllNodesQueried:
 		{
-			pthread_cond_broadcast(&initCond);
+			// Save the node information now that (more) nodes are known
+			g_writeConfigPending = true;
+			wakeEventLoop();
 			break;
 		}
 
-		case Notification::Type_DriverReset:
-		case Notification::Type_MsgComplete:
 		case Notification::Type_NodeNaming:
 		case Notification::Type_NodeProtocolInfo:
+		case Notification::Type_NodeQueriesComplete:
+		{
+			NodeInfo* nodeInfo = GetNodeInfo( homeId, nodeId );
+			if( !nodeInfo )
+				break;
+
+			if( nodeInfo->m_sensorType == UNKNOWN_SENSOR )
+			{
+				if( g_replaying )
+					nodeInfo->m_sensorType = (SensorType) _record->m_sensorType;
+				else
+					identifyNode( nodeInfo );
+			}
+			else if( nodeInfo->m_fromCache )
+			{
+				verifyCachedNode( nodeInfo );
+			}
+
+			if( nodeInfo->m_state == NodeState_Added && nodeInfo->m_sensorType != UNKNOWN_SENSOR )
+			{
+				nodeInfo->m_state = NodeState_Identified;
+				printf( "Node %u identified as %s after %.1f s\n", nodeId,
+						g_sensorNames[nodeInfo->m_sensorType], monotonicSeconds() - g_startTime );
+			}
+
+			// Once all of its values are known, hand the node to the main
+			// thread for configuration
+			if( _record->m_type == Notification::Type_NodeQueriesComplete
+				&& nodeInfo->m_state == NodeState_Identified && !g_replaying )
+			{
+				nodeInfo->m_state = NodeState_Pending;
+				wakeEventLoop();
+			}
+			break;
+		}
+
+		case Notification::Type_DriverReset:
+		case Notification::Type_MsgComplete:
         {
             break;
         }
-		case Notification::Type_NodeQueriesComplete:
 		default:
 		{
 		}
 	}
+}
+
+//-----------------------------------------------------------------------------
+// <processNotification>
+// Handles one notification record under g_criticalSection, appends it to the
+// recording (if any) and updates the latency statistics. entered is the
+// time the notification reached us, from nowMicros().
+//-----------------------------------------------------------------------------
+void processNotification
+(
+	NotificationRecord* _record,
+	uint64 entered
+)
+{
+	// Must do this inside a critical section to avoid conflicts with the main thread
+	uint64 locked = lockCriticalSection();
+	g_notificationStart = entered;
+	g_nodeNotificationCount[_record->m_nodeId]++;
+
+	handleNotification( _record );
+
+	if( g_recordLog )
+	{
+		// Save the sensor type as resolved now, so a replay needs no Manager
+		NodeInfo* nodeInfo = GetNodeInfo( _record->m_homeId, _record->m_nodeId );
+		_record->m_sensorType = nodeInfo ? nodeInfo->m_sensorType : UNKNOWN_SENSOR;
+		g_recordLog->Write( *_record );
+	}
+
+	g_callbackLatency.Record( nowMicros() - entered );
+	unlockCriticalSection( locked );
+}
+
+//-----------------------------------------------------------------------------
+// <OnNotification>
+// Callback that is triggered when a value, group or node changes
+//-----------------------------------------------------------------------------
+void OnNotification
+(
+	Notification const* _notification,
+	void* _context
+)
+{
+#ifdef DEBUG
+	unsigned long allocCountAtEntry = allocCount();
+#endif
+
+	uint64 entered = nowMicros();
+	struct timespec now;
+	clock_gettime( CLOCK_REALTIME, &now );
+
+	// Capture everything the handlers need from the notification
+	NotificationRecord record;
+	memset( &record, 0, sizeof( record ) );
+	record.m_timestamp = (uint64) now.tv_sec * 1000000000ULL + now.tv_nsec;
+	record.m_type = (uint8) _notification->GetType();
+	record.m_homeId = _notification->GetHomeId();
+	record.m_nodeId = _notification->GetNodeId();
+	record.m_valueId = _notification->GetValueID().GetId();
+	record.m_sensorType = UNKNOWN_SENSOR;
+	if( _notification->GetType() == Notification::Type_NodeEvent )
+	{
+		record.m_event = _notification->GetEvent();
+	}
+	else if( _notification->GetType() == Notification::Type_ValueChanged )
+	{
+		readValue( _notification->GetValueID(), &record );
+	}
+
+	processNotification( &record, entered );
+
+#ifdef DEBUG
+	// Value and node events are the steady-state traffic and must not allocate
+	unsigned long allocations = allocCount() - allocCountAtEntry;
+	if( allocations > 0 &&
+		( _notification->GetType() == Notification::Type_ValueChanged ||
+		  _notification->GetType() == Notification::Type_NodeEvent ) )
+	{
+		fprintf( stderr, "Warning: notification type %d made %lu heap allocations\n",
+				 _notification->GetType(), allocations );
+	}
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// <replayLog>
+// Feeds a recorded notification log through processNotification, either
+// with the recorded timing or as fast as possible. Stops early on a shutdown
+// signal. Prints the throughput and publishes the latency statistics at the
+// end, so a capture can be used as a benchmark. In the debug build it also
+// fails (returns 1) if a value or node event allocated, which "make
+// alloctest" checks with every malloc counted.
+//-----------------------------------------------------------------------------
+int replayLog( const char* _path, bool _fast, int _signalFd )
+{
+	NotificationLog log;
+	NotificationRecord record;
+	uint64 firstTimestamp = 0;
+	uint32 count = 0;
+#ifdef DEBUG
+	unsigned long steadyAllocations = 0;
+#endif
+
+	if( !log.OpenForRead( _path ) )
+	{
+		fprintf( stderr, "Could not open notification log %s\n", _path );
+		return 1;
+	}
+
+	g_statsPeriodStart = monotonicSeconds();
+	uint64 replayStart = nowMicros();
+
+	while( log.Read( &record ) )
+	{
+		int timeoutMs = 0;
+		if( count == 0 )
+		{
+			firstTimestamp = record.m_timestamp;
+		}
+		else if( !_fast && record.m_timestamp > firstTimestamp )
+		{
+			// Wait until the same offset from the start as when it was recorded
+			uint64 due = replayStart + ( record.m_timestamp - firstTimestamp ) / 1000;
+			uint64 now = nowMicros();
+			timeoutMs = ( due > now ) ? (int) ( ( due - now ) / 1000 ) : 0;
+		}
+
+		// Check for a shutdown signal while waiting (or every 1024 records
+		// when replaying as fast as possible)
+		if( timeoutMs > 0 || ( count & 1023 ) == 0 )
+		{
+			struct pollfd fds[1];
+			fds[0].fd = _signalFd;
+			fds[0].events = POLLIN;
+			if( poll( fds, 1, timeoutMs ) > 0 )
+			{
+				printf( "Replay interrupted\n" );
+				break;
+			}
+		}
+
+#ifdef DEBUG
+		unsigned long allocCountBefore = allocCount();
+#endif
+		processNotification( &record, nowMicros() );
+		count++;
+#ifdef DEBUG
+		if( record.m_type == Notification::Type_ValueChanged ||
+			record.m_type == Notification::Type_NodeEvent )
+		{
+			steadyAllocations += allocCount() - allocCountBefore;
+		}
+#endif
+	}
 
-	pthread_mutex_unlock( &g_criticalSection );
+	double elapsed = ( nowMicros() - replayStart ) / 1e6;
+	printf( "Replayed %u notifications in %.3f seconds (%.0f per second)\n",
+			count, elapsed, ( elapsed > 0 ) ? count / elapsed : 0.0 );
+
+	publishLatencyStatistics();
+#ifdef DEBUG
+	if( steadyAllocations > 0 )
+	{
+		fprintf( stderr, "Value and node events made %lu heap allocations\n",
+				 steadyAllocations );
+		return 1;
+	}
+#endif
+	return 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -871,10 +1940,99 @@ int main( int argc, char* argv[] )
 	pthread_mutex_init( &g_criticalSection, &mutexattr );
 	pthread_mutexattr_destroy( &mutexattr );
 
-	pthread_mutex_lock( &initMutex );
+    // Parse the command line:
+    // [-c config file] [-r record file | -p replay file [-f]] [serial port]
+    const char *configFile = "config.json";
+    const char *recordFile = NULL;
+    const char *replayFile = NULL;
+    bool fastReplay = false;
+    int opt;
+    while( ( opt = getopt( argc, argv, "c:r:p:f" ) ) != -1 )
+    {
+        switch( opt )
+        {
+            case 'c':
+                configFile = optarg;
+                break;
+            case 'r':
+                recordFile = optarg;
+                break;
+            case 'p':
+                replayFile = optarg;
+                break;
+            case 'f':
+                fastReplay = true;
+                break;
+            default:
+                fprintf( stderr, "Usage: %s [-c config file] [-r record file | -p replay file [-f]] [serial port | usb]\n", argv[0] );
+                return 1;
+        }
+    }
+
+    // Load the node id mapping once, before any notifications arrive
+    loadConfig( configFile );
+
+    // Block the shutdown signals before the OpenZWave threads are started so
+    // that they inherit the mask, and receive them through a signalfd in the
+    // event loop instead
+    sigset_t shutdownSignals;
+    sigemptyset( &shutdownSignals );
+    sigaddset( &shutdownSignals, SIGINT );
+    sigaddset( &shutdownSignals, SIGTERM );
+    pthread_sigmask( SIG_BLOCK, &shutdownSignals, NULL );
+    int signalFd = signalfd( -1, &shutdownSignals, SFD_CLOEXEC );
+    if( signalFd < 0 )
+    {
+        perror( "signalfd() failed" );
+        return 1;
+    }
 
-    // Bind zeromq to tcp port 5556
+    // Bind zeromq to tcp port 5556, bounding the queues to the publish pool
+#ifdef ZMQ_SNDHWM
+    int hwm = PUBLISH_HWM;
+    publisher.setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
+#else
+    uint64_t hwm = PUBLISH_HWM;             // libzmq 2.x
+    publisher.setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
+#endif
     publisher.bind("tcp://*:5556");
+    statsPublisher.bind("tcp://*:5561");
+
+    // Have the socket handle the commands bind queued for it (taking over the
+    // listener allocates) now, rather than in the first publishValue
+    int events;
+    size_t eventsSize = sizeof(events);
+    publisher.getsockopt(ZMQ_EVENTS, &events, &eventsSize);
+
+    // In replay mode the recorded notifications are fed through the same
+    // handlers without starting the OpenZWave driver at all
+    if( replayFile )
+    {
+        g_replaying = true;
+        int rc = replayLog( replayFile, fastReplay, signalFd );
+        close( signalFd );
+        return rc;
+    }
+
+    if( recordFile )
+    {
+        g_recordLog = new NotificationLog;
+        if( !g_recordLog->OpenForWrite( recordFile ) )
+        {
+            fprintf( stderr, "Unable to open record file %s\n", recordFile );
+            return 1;
+        }
+    }
+
+    // The notification thread hands startup work to the event loop through
+    // this eventfd
+    g_startTime = monotonicSeconds();
+    g_wakeFd = eventfd( 0, EFD_CLOEXEC );
+    if( g_wakeFd < 0 )
+    {
+        perror( "eventfd() failed" );
+        return 1;
+    }
 
 	// Create the OpenZWave Manager.
 	// The first argument is the path to the config files (where the manufacturer_specific.xml file is located
@@ -884,8 +2042,6 @@ int main( int argc, char* argv[] )
 	Options::Get()->AddOptionInt( "SaveLogLevel", LogLevel_Detail );
 	Options::Get()->AddOptionInt( "QueueLogLevel", LogLevel_Debug );
 	Options::Get()->AddOptionInt( "DumpTrigger", LogLevel_Error );
-	Options::Get()->AddOptionInt( "PollInterval", 500 );
-	Options::Get()->AddOptionBool( "IntervalBetweenPolls", true );
 	Options::Get()->AddOptionBool("ValidateValueChanges", true);
 
     // Turn off Console Logging
@@ -905,9 +2061,9 @@ int main( int argc, char* argv[] )
 	// Modify this line to set the correct serial port for your PC interface.
 
 	string port = "/dev/ttyUSB0";
-	if ( argc > 1 )
+	if ( optind < argc )
 	{
-		port = argv[1];
+		port = argv[optind];
 	}
 	if( strcasecmp( port.c_str(), "usb" ) == 0 )
 	{
@@ -918,78 +2074,16 @@ int main( int argc, char* argv[] )
 		Manager::Get()->AddDriver( port );
 	}
 
-	// Now we just wait for either the AwakeNodesQueried or AllNodesQueried notification,
-	// then write out the config file.
-	// In a normal app, we would be handling notifications and building a UI for the user.
-	pthread_cond_wait( &initCond, &initMutex );
+	// Nodes are identified, published and configured one by one as their
+	// notifications come in (see NodeState). From here on the main thread
+	// only does the startup work handed to it, sends the scheduled polls,
+	// publishes the statistics periodically and waits for a shutdown signal.
+	runEventLoop( signalFd );
 
-	// Since the configuration file contains command class information that is only 
-	// known after the nodes on the network are queried, wait until all of the nodes 
-	// on the network have been queried (at least the "listening" ones) before
-	// writing the configuration file.  (Maybe write again after sleeping nodes have
-	// been queried as well.)
 	if( !g_initFailed )
 	{
-
-		Manager::Get()->WriteConfig( g_homeId );
-
-        uint8 ccId = 0;
-        uint8 nodeId = 0;
-
-		// The section below demonstrates setting up polling for a variable.  In this simple
-		// example, it has been hardwired to poll COMMAND_CLASS_BASIC on the each node that 
-		// supports this setting.
-		pthread_mutex_lock( &g_criticalSection );
-		for( list<NodeInfo*>::iterator it = g_nodes.begin(); it != g_nodes.end(); ++it )
-		{
-			NodeInfo* nodeInfo = *it;
-            nodeId = nodeInfo->m_nodeId;
-            
-
-			// skip the controller (most likely node 1)
-			if( nodeId == 1) continue;
-
-			for( list<ValueID>::iterator it2 = nodeInfo->m_values.begin(); it2 != nodeInfo->m_values.end(); ++it2 )
-			{
-				ValueID v = *it2;
-                ccId = v.GetCommandClassId();
-				if(ccId == COMMAND_CLASS_BASIC)
-				{
-                    // Poll every 5 seconds
-					// Manager::Get()->EnablePoll( v, 2);		// enables polling with "intensity" of 2, though this is irrelevant with only one value polled
-				}
-                else if(getSensorType(g_homeId, nodeId) == HSM_100_SENSOR && ccId == COMMAND_CLASS_WAKE_UP) {
-                    // Set the Wake-up interval
-                    bool success = Manager::Get()->SetValue(v, 360);
-                    printf("Set Wake-up Interval Successfully: %s\n", (success)?"Yes":"No");
-                }
-			}
-		}
-		pthread_mutex_unlock( &g_criticalSection );
-
-        configureSensorParameters();
-
-		// If we want to access our NodeInfo list, that has been built from all the
-		// notification callbacks we received from the library, we have to do so
-		// from inside a Critical Section.  This is because the callbacks occur on other 
-		// threads, and we cannot risk the list being changed while we are using it.  
-		// We must hold the critical section for as short a time as possible, to avoid
-		// stalling the OpenZWave drivers.
-		// At this point, the program just waits for 3 minutes (to demonstrate polling),
-		// then exits
-		// for( int i = 0; i < 60*30; i++ )
-        while(1)
-		{
-			pthread_mutex_lock( &g_criticalSection );
-			// but NodeInfo list and similar data should be inside critical section
-            
-            //Manager::Get()->RefreshNodeInfo(g_homeId, Hsm100SensorId);
-            //Manager::Get()->RequestNodeDynamic(g_homeId, Hsm100SensorId);
-			pthread_mutex_unlock( &g_criticalSection );
-			sleep(5);
-		}
-
 		Driver::DriverData data;
+		memset( &data, 0, sizeof(data) );
 		Manager::Get()->GetDriverStatistics( g_homeId, &data );
 		printf("SOF: %d ACK Waiting: %d Read Aborts: %d Bad Checksums: %d\n", data.s_SOFCnt, data.s_ACKWaiting, data.s_readAborts, data.s_badChecksum);
 		printf("Reads: %d Writes: %d CAN: %d NAK: %d ACK: %d Out of Frame: %d\n", data.s_readCnt, data.s_writeCnt, data.s_CANCnt, data.s_NAKCnt, data.s_ACKCnt, data.s_OOFCnt);
@@ -1006,8 +2100,16 @@ int main( int argc, char* argv[] )
 		Manager::Get()->RemoveDriver( port );
 	}
 	Manager::Get()->RemoveWatcher( OnNotification, NULL );
+	if( g_recordLog )
+	{
+		g_recordLog->Close();
+		delete g_recordLog;
+		g_recordLog = NULL;
+	}
 	Manager::Destroy();
 	Options::Destroy();
 	pthread_mutex_destroy( &g_criticalSection );
+	close( g_wakeFd );
+	close( signalFd );
 	return 0;
 }
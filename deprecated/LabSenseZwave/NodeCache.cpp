@@ -0,0 +1,159 @@
+//-----------------------------------------------------------------------------
+//
+//	NodeCache.cpp
+//
+//	Reads node information from OpenZWave's zwcfg XML, see NodeCache.h
+//
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "NodeCache.h"
+
+NodeCache::NodeCache()
+{
+	Clear();
+}
+
+void NodeCache::Clear()
+{
+	memset( m_nodes, 0, sizeof(m_nodes) );
+}
+
+//-----------------------------------------------------------------------------
+// <getAttribute>
+// Copies the value of attribute _name of the tag starting at _tag (up to
+// its closing '>') into _value, decoding the predefined XML entities.
+// Returns false if the tag has no such attribute.
+//-----------------------------------------------------------------------------
+static bool getAttribute( const char* _tag, const char* _name, char* _value, size_t _size )
+{
+	const char* end = strchr( _tag, '>' );
+	size_t nameLength = strlen( _name );
+
+	for( const char* p = _tag; p && ( p = strstr( p, _name ) ) != NULL && p < end; p += nameLength )
+	{
+		// Whole attribute names only ("id" must not match "vid")
+		if( p[-1] != ' ' && p[-1] != '\t' && p[-1] != '\n' )
+		{
+			continue;
+		}
+		if( p[nameLength] != '=' || p[nameLength + 1] != '"' )
+		{
+			continue;
+		}
+
+		const char* in = p + nameLength + 2;
+		size_t out = 0;
+		while( *in && *in != '"' && out + 1 < _size )
+		{
+			static const struct { const char* m_entity; char m_char; } entities[] = {
+				{ "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '"' }, { "&apos;", '\'' }
+			};
+			char c = *in++;
+			if( c == '&' )
+			{
+				for( size_t i = 0; i < sizeof(entities) / sizeof(entities[0]); i++ )
+				{
+					size_t length = strlen( entities[i].m_entity );
+					if( strncmp( in - 1, entities[i].m_entity, length ) == 0 )
+					{
+						c = entities[i].m_char;
+						in += length - 1;
+						break;
+					}
+				}
+			}
+			_value[out++] = c;
+		}
+		_value[out] = '\0';
+		return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// <NodeCache::Load>
+// Walks the <Node> elements; within each, the <Manufacturer> and <Product>
+// names and the <CommandClass> ids.
+//-----------------------------------------------------------------------------
+int NodeCache::Load( const char* _path )
+{
+	FILE* file = fopen( _path, "rb" );
+	if( !file )
+	{
+		return -1;
+	}
+
+	fseek( file, 0, SEEK_END );
+	long size = ftell( file );
+	fseek( file, 0, SEEK_SET );
+	if( size <= 0 )
+	{
+		fclose( file );
+		return -1;
+	}
+
+	char* text = (char*) malloc( size + 1 );
+	if( !text || fread( text, 1, size, file ) != (size_t) size )
+	{
+		free( text );
+		fclose( file );
+		return -1;
+	}
+	text[size] = '\0';
+	fclose( file );
+
+	Clear();
+
+	int count = 0;
+	char value[64];
+	const char* node = text;
+	while( ( node = strstr( node, "<Node " ) ) != NULL )
+	{
+		const char* next = strstr( node + 1, "<Node " );
+		const char* nodeEnd = strstr( node, "</Node>" );
+		if( !nodeEnd || ( next && next < nodeEnd ) )
+		{
+			// Unterminated or nested: not a file OpenZWave wrote
+			break;
+		}
+
+		int id = getAttribute( node, "id", value, sizeof(value) ) ? atoi( value ) : 0;
+		if( id > 0 && id < 256 )
+		{
+			CachedNode& cached = m_nodes[id];
+			cached.m_present = true;
+			cached.m_listening = getAttribute( node, "listening", value, sizeof(value) ) && strcmp( value, "true" ) == 0;
+
+			const char* manufacturer = strstr( node, "<Manufacturer " );
+			if( manufacturer && manufacturer < nodeEnd )
+			{
+				getAttribute( manufacturer, "name", cached.m_manufacturerName, sizeof(cached.m_manufacturerName) );
+			}
+			const char* product = strstr( node, "<Product " );
+			if( product && product < nodeEnd )
+			{
+				getAttribute( product, "name", cached.m_productName, sizeof(cached.m_productName) );
+			}
+
+			for( const char* cc = node; ( cc = strstr( cc + 1, "<CommandClass " ) ) != NULL && cc < nodeEnd; )
+			{
+				if( getAttribute( cc, "id", value, sizeof(value) ) )
+				{
+					int ccId = atoi( value );
+					if( ccId > 0 && ccId < 256 )
+					{
+						cached.m_commandClasses[ccId >> 5] |= 1u << ( ccId & 31 );
+					}
+				}
+			}
+			count++;
+		}
+		node = nodeEnd;
+	}
+
+	free( text );
+	return count;
+}
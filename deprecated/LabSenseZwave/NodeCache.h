@@ -0,0 +1,60 @@
+//-----------------------------------------------------------------------------
+//
+//	NodeCache.h
+//
+//	Node information from the zwcfg_<home id>.xml file that OpenZWave
+//	writes (Manager::WriteConfig). LabSenseZwave reads it when the driver
+//	is ready, so nodes that were seen before are identified and decoded as
+//	soon as they are added instead of after their network queries. Live
+//	data still has the last word; see the NodeAdded/ValueAdded handling in
+//	Main.cpp.
+//
+//	Only what identification needs is kept: the product and manufacturer
+//	names, whether the node listens and which command classes it has. The
+//	file is machine written, so a small scanner is used rather than a full
+//	XML parser.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _NodeCache_H
+#define _NodeCache_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct CachedNode
+{
+	bool		m_present;
+	bool		m_listening;
+	char		m_productName[64];
+	char		m_manufacturerName[64];
+	uint32_t	m_commandClasses[8];	// Bit set by command class id
+
+	bool HasCommandClass( uint8_t _commandClassId ) const
+	{
+		return ( m_commandClasses[_commandClassId >> 5] >> ( _commandClassId & 31 ) ) & 1;
+	}
+};
+
+class NodeCache
+{
+public:
+	NodeCache();
+
+	// Reads the cached config. Returns the number of nodes found, or -1 if
+	// the file cannot be read.
+	int Load( const char* _path );
+
+	// The cached node, or NULL if the node is not in the file
+	CachedNode const* Get( uint8_t _nodeId ) const
+	{
+		return m_nodes[_nodeId].m_present ? &m_nodes[_nodeId] : NULL;
+	}
+
+	void Clear();
+
+private:
+	CachedNode	m_nodes[256];	// Indexed by node id
+};
+
+#endif // _NodeCache_H
@@ -0,0 +1,93 @@
+//-----------------------------------------------------------------------------
+//
+//	NotificationLog.cpp
+//
+//	Binary notification log for record and replay, see NotificationLog.h
+//
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+#include "NotificationLog.h"
+
+// stdio buffer for the log; notifications are written from the OpenZWave
+// thread, so writes should only hit the disk every few thousand records
+#define NOTIFICATION_LOG_BUFFER_SIZE (128 * 1024)
+
+NotificationLog::NotificationLog():
+	m_file( NULL ),
+	m_buffer( NULL )
+{
+}
+
+NotificationLog::~NotificationLog()
+{
+	Close();
+}
+
+bool NotificationLog::OpenForWrite( const char* _path )
+{
+	NotificationLogHeader header;
+
+	Close();
+	m_file = fopen( _path, "wb" );
+	if( !m_file )
+	{
+		return false;
+	}
+
+	m_buffer = (char*) malloc( NOTIFICATION_LOG_BUFFER_SIZE );
+	if( m_buffer )
+	{
+		setvbuf( m_file, m_buffer, _IOFBF, NOTIFICATION_LOG_BUFFER_SIZE );
+	}
+
+	memset( &header, 0, sizeof( header ) );
+	strncpy( header.m_magic, NOTIFICATION_LOG_MAGIC, sizeof( header.m_magic ) );
+	header.m_version = NOTIFICATION_LOG_VERSION;
+	header.m_recordSize = sizeof( NotificationRecord );
+	return fwrite( &header, sizeof( header ), 1, m_file ) == 1;
+}
+
+bool NotificationLog::OpenForRead( const char* _path )
+{
+	NotificationLogHeader header;
+
+	Close();
+	m_file = fopen( _path, "rb" );
+	if( !m_file )
+	{
+		return false;
+	}
+
+	if( fread( &header, sizeof( header ), 1, m_file ) != 1 ||
+		strncmp( header.m_magic, NOTIFICATION_LOG_MAGIC, sizeof( header.m_magic ) ) != 0 ||
+		header.m_version != NOTIFICATION_LOG_VERSION ||
+		header.m_recordSize != sizeof( NotificationRecord ) )
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool NotificationLog::Write( NotificationRecord const& _record )
+{
+	return m_file && fwrite( &_record, sizeof( _record ), 1, m_file ) == 1;
+}
+
+bool NotificationLog::Read( NotificationRecord* _record )
+{
+	return m_file && fread( _record, sizeof( *_record ), 1, m_file ) == 1;
+}
+
+void NotificationLog::Close()
+{
+	if( m_file )
+	{
+		fclose( m_file );
+		m_file = NULL;
+	}
+	free( m_buffer );
+	m_buffer = NULL;
+}
@@ -0,0 +1,91 @@
+//-----------------------------------------------------------------------------
+//
+//	NotificationLog.h
+//
+//	Compact binary log of OpenZWave notifications, used by LabSenseZwave to
+//	record live traffic (-r) and to replay it through the same decode and
+//	publish path without a Z-Stick (-p).
+//
+//	A log is a NotificationLogHeader followed by fixed-size
+//	NotificationRecords in host byte order. Both the guruplug (ARM) and x86
+//	development machines are little-endian, so logs move freely between them.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _NotificationLog_H
+#define _NotificationLog_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define NOTIFICATION_LOG_MAGIC   "LSZWLOG"
+#define NOTIFICATION_LOG_VERSION 1
+
+// Which member of NotificationRecord::m_value holds the value
+enum NotificationValueKind
+{
+	NotificationValue_None = 0,     // No value, or it could not be read
+	NotificationValue_Bool,
+	NotificationValue_Byte,
+	NotificationValue_Float,
+	NotificationValue_Int,
+	NotificationValue_List          // Selected value of a list
+};
+
+#pragma pack(push, 1)
+
+typedef struct
+{
+	char			m_magic[8];
+	uint32_t		m_version;
+	uint32_t		m_recordSize;
+}NotificationLogHeader;
+
+typedef struct
+{
+	uint64_t		m_timestamp;    // CLOCK_REALTIME, nanoseconds
+	uint64_t		m_valueId;      // ValueID::GetId()
+	uint32_t		m_homeId;
+	union
+	{
+		uint32_t	m_raw;
+		float		m_float;
+		int32_t		m_int;
+	}				m_value;        // Value read for ValueChanged notifications
+	uint8_t			m_type;         // Notification::NotificationType
+	uint8_t			m_nodeId;
+	uint8_t			m_event;        // Notification::GetEvent() for NodeEvent
+	uint8_t			m_valueKind;    // NotificationValueKind
+	uint8_t			m_sensorType;   // SensorType of the node when recorded
+	uint8_t			m_reserved[3];
+}NotificationRecord;
+
+#pragma pack(pop)
+
+class NotificationLog
+{
+public:
+	NotificationLog();
+	~NotificationLog();
+
+	// Create (truncate) a log for recording. Returns false on error.
+	bool OpenForWrite( const char* _path );
+
+	// Open an existing log for replay. Returns false on error or if the
+	// file is not a notification log of this version.
+	bool OpenForRead( const char* _path );
+
+	// Append one record. Records are buffered; Close() flushes them.
+	bool Write( NotificationRecord const& _record );
+
+	// Read the next record. Returns false at the end of the log.
+	bool Read( NotificationRecord* _record );
+
+	void Close();
+
+private:
+	FILE*	m_file;
+	char*	m_buffer;
+};
+
+#endif
@@ -0,0 +1,262 @@
+//-----------------------------------------------------------------------------
+//
+//	PollScheduler.cpp
+//
+//	Adaptive polling within an airtime budget, see PollScheduler.h
+//
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "PollScheduler.h"
+
+#define POLL_ACTIVITY_TIME_CONSTANT	300.0	// Seconds
+#define POLL_REBALANCE_PERIOD		1.0		// Seconds between rebalancing for the activity decay
+#define POLL_BURST					2.0		// Polls that may be sent back to back
+#define POLL_NEVER					1e18
+
+PollScheduler::PollScheduler():
+	m_count( 0 ),
+	m_budgetRate( 1.0 ),
+	m_tokens( POLL_BURST ),
+	m_tokensUpdated( 0 ),
+	m_dirty( false ),
+	m_rebalanced( 0 ),
+	m_polls( 0 )
+{
+}
+
+void PollScheduler::SetBudget( double _airtimeFraction, double _pollAirtime )
+{
+	if( _airtimeFraction > 0 && _pollAirtime > 0 )
+	{
+		m_budgetRate = _airtimeFraction / _pollAirtime;
+		m_dirty = true;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// <PollScheduler::Find>
+// Binary search of the sorted table
+//-----------------------------------------------------------------------------
+PollScheduler::Entry* PollScheduler::Find( uint64_t _valueId )
+{
+	int lo = 0;
+	int hi = m_count;
+	while( lo < hi )
+	{
+		int mid = ( lo + hi ) / 2;
+		if( m_entries[mid].m_valueId < _valueId )
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return ( lo < m_count && m_entries[lo].m_valueId == _valueId ) ? &m_entries[lo] : NULL;
+}
+
+bool PollScheduler::Add( uint64_t _valueId, double _priority, double _minInterval, double _maxInterval,
+	double _scale, double _now )
+{
+	if( m_count >= POLL_SCHEDULER_MAX_VALUES || Find( _valueId ) )
+	{
+		return false;
+	}
+
+	int pos = m_count;
+	while( pos > 0 && m_entries[pos - 1].m_valueId > _valueId )
+	{
+		m_entries[pos] = m_entries[pos - 1];
+		pos--;
+	}
+
+	Entry& entry = m_entries[pos];
+	entry.m_valueId = _valueId;
+	entry.m_priority = ( _priority > 0 ) ? _priority : 1;
+	entry.m_minInterval = _minInterval;
+	entry.m_maxInterval = ( _maxInterval >= _minInterval ) ? _maxInterval : _minInterval;
+	entry.m_scale = ( _scale > 0 ) ? _scale : 1;
+	entry.m_activity = 0;
+	entry.m_lastUpdate = _now;
+	entry.m_lastFresh = _now - entry.m_maxInterval;	// Poll soon after startup
+	entry.m_interval = entry.m_maxInterval;
+	entry.m_lastValue = 0;
+	entry.m_hasValue = false;
+
+	m_count++;
+	m_dirty = true;
+	return true;
+}
+
+void PollScheduler::Observe( uint64_t _valueId, float _value, double _now )
+{
+	Entry* entry = Find( _valueId );
+	if( !entry )
+	{
+		return;
+	}
+
+	double decay = exp( -( _now - entry->m_lastUpdate ) / POLL_ACTIVITY_TIME_CONSTANT );
+	entry->m_activity *= decay;
+	if( entry->m_hasValue )
+	{
+		entry->m_activity += fabs( (double) _value - entry->m_lastValue ) / entry->m_scale;
+	}
+	entry->m_lastValue = _value;
+	entry->m_hasValue = true;
+	entry->m_lastUpdate = _now;
+	entry->m_lastFresh = _now;
+	m_dirty = true;
+}
+
+//-----------------------------------------------------------------------------
+// <PollScheduler::Rebalance>
+// Splits the budget rate between the values by weight
+//-----------------------------------------------------------------------------
+void PollScheduler::Rebalance( double _now )
+{
+	double weights[POLL_SCHEDULER_MAX_VALUES];
+	double total = 0;
+	int i;
+
+	for( i = 0; i < m_count; i++ )
+	{
+		Entry& entry = m_entries[i];
+		double activity = entry.m_activity * exp( -( _now - entry.m_lastUpdate ) / POLL_ACTIVITY_TIME_CONSTANT );
+		weights[i] = entry.m_priority * ( 1.0 + activity );
+		total += weights[i];
+	}
+
+	for( i = 0; i < m_count; i++ )
+	{
+		Entry& entry = m_entries[i];
+		double rate = m_budgetRate * weights[i] / total;
+		double interval = 1.0 / rate;
+		if( interval < entry.m_minInterval )
+		{
+			interval = entry.m_minInterval;
+		}
+		if( interval > entry.m_maxInterval )
+		{
+			interval = entry.m_maxInterval;
+		}
+		entry.m_interval = interval;
+	}
+
+	m_dirty = false;
+	m_rebalanced = _now;
+}
+
+void PollScheduler::RefillTokens( double _now )
+{
+	if( _now > m_tokensUpdated )
+	{
+		m_tokens += ( _now - m_tokensUpdated ) * m_budgetRate;
+		if( m_tokens > POLL_BURST )
+		{
+			m_tokens = POLL_BURST;
+		}
+		m_tokensUpdated = _now;
+	}
+}
+
+int PollScheduler::Due( double _now, uint64_t* o_valueIds, int _max )
+{
+	if( m_dirty || _now - m_rebalanced >= POLL_REBALANCE_PERIOD )
+	{
+		Rebalance( _now );
+	}
+	RefillTokens( _now );
+
+	int found = 0;
+	while( found < _max && m_tokens >= 1.0 )
+	{
+		// Most overdue relative to its own interval first
+		Entry* best = NULL;
+		double bestLateness = 0;
+		for( int i = 0; i < m_count; i++ )
+		{
+			Entry& entry = m_entries[i];
+			double lateness = ( _now - entry.m_lastFresh ) / entry.m_interval;
+			if( lateness >= 1.0 && ( !best || lateness > bestLateness ) )
+			{
+				best = &entry;
+				bestLateness = lateness;
+			}
+		}
+		if( !best )
+		{
+			break;
+		}
+
+		best->m_lastFresh = _now;
+		o_valueIds[found++] = best->m_valueId;
+		m_tokens -= 1.0;
+		m_polls++;
+	}
+	return found;
+}
+
+double PollScheduler::NextDue()
+{
+	if( m_count == 0 )
+	{
+		return POLL_NEVER;
+	}
+
+	double next = POLL_NEVER;
+	for( int i = 0; i < m_count; i++ )
+	{
+		double due = m_entries[i].m_lastFresh + m_entries[i].m_interval;
+		if( due < next )
+		{
+			next = due;
+		}
+	}
+
+	// Not before there is a token to spend, and wake up for the decay
+	if( m_tokens < 1.0 )
+	{
+		double refill = m_tokensUpdated + ( 1.0 - m_tokens ) / m_budgetRate;
+		if( refill > next )
+		{
+			next = refill;
+		}
+	}
+	if( m_rebalanced + POLL_REBALANCE_PERIOD < next )
+	{
+		next = m_rebalanced + POLL_REBALANCE_PERIOD;
+	}
+	return next;
+}
+
+int PollScheduler::Format( char* _buffer, size_t _size, double _elapsed )
+{
+	double minInterval = 0;
+	double maxInterval = 0;
+	for( int i = 0; i < m_count; i++ )
+	{
+		double interval = m_entries[i].m_interval;
+		if( i == 0 || interval < minInterval )
+		{
+			minInterval = interval;
+		}
+		if( interval > maxInterval )
+		{
+			maxInterval = interval;
+		}
+	}
+
+	int length = snprintf( _buffer, _size, "values=%d polls=%u rate=%.3f budget=%.3f minInterval=%.1f maxInterval=%.1f",
+		m_count, m_polls, ( _elapsed > 0 ) ? m_polls / _elapsed : 0.0, m_budgetRate, minInterval, maxInterval );
+	m_polls = 0;
+	if( length >= (int) _size )
+	{
+		length = (int) _size - 1;
+	}
+	return length;
+}
@@ -0,0 +1,101 @@
+//-----------------------------------------------------------------------------
+//
+//	PollScheduler.h
+//
+//	Adaptive polling of Z-Wave values within an airtime budget. Instead of
+//	polling every value at the driver's fixed PollInterval, LabSenseZwave
+//	refreshes each configured value on its own interval:
+//
+//	- The budget is a fraction of the radio channel. Divided by the airtime
+//	  of one poll (request and report) it gives the polls per second that
+//	  may be spent across all values.
+//	- Each value gets a share of that rate proportional to its weight,
+//	  priority * (1 + activity). Activity is the recent change of the value
+//	  in units of its configured scale, decayed with a five minute time
+//	  constant, so a busy switch's power gets polled often while a steady
+//	  temperature falls back to its priority share.
+//	- The resulting interval is clamped to the value's [min, max] interval.
+//	  The max interval is a freshness guarantee and wins over the budget.
+//	- Any report of the value, polled or unsolicited, counts as fresh and
+//	  pushes its next poll out by one interval.
+//
+//	A token bucket holds polls to the budget rate, and when several values
+//	are due the most overdue (relative to their interval) go first.
+//
+//	Fixed capacity and no allocation after construction. Not thread-safe:
+//	LabSenseZwave uses it under g_criticalSection.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _PollScheduler_H
+#define _PollScheduler_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define POLL_SCHEDULER_MAX_VALUES	256
+
+class PollScheduler
+{
+public:
+	PollScheduler();
+
+	// Fraction of the channel (0..1] that polls may use, and the airtime of
+	// one poll in seconds
+	void SetBudget( double _airtimeFraction, double _pollAirtime );
+
+	// Adds a value (by OpenZWave value id). Intervals are in seconds, the
+	// scale is the change of the value that counts as one unit of activity.
+	// Returns false if the value is already scheduled or the table is full.
+	bool Add( uint64_t _valueId, double _priority, double _minInterval, double _maxInterval,
+		double _scale, double _now );
+
+	// A new reading of a value arrived. Ignored for unscheduled values.
+	void Observe( uint64_t _valueId, float _value, double _now );
+
+	// Fills o_valueIds with up to _max values to poll now and marks them
+	// polled. Returns how many.
+	int Due( double _now, uint64_t* o_valueIds, int _max );
+
+	// Earliest time at which Due() may return a value (a huge value when
+	// nothing is scheduled)
+	double NextDue();
+
+	int Count() const { return m_count; }
+
+	// Formats "values=.. polls=.. rate=.. budget=.. minInterval=.. maxInterval=.."
+	// for the polls since the last call (rates per second over _elapsed
+	// seconds) and resets the poll counter
+	int Format( char* _buffer, size_t _size, double _elapsed );
+
+private:
+	struct Entry
+	{
+		uint64_t	m_valueId;
+		double		m_priority;
+		double		m_minInterval;
+		double		m_maxInterval;
+		double		m_scale;
+		double		m_activity;		// Decayed sum of scaled changes
+		double		m_lastUpdate;	// Time of the last reading
+		double		m_lastFresh;	// Time of the last reading or poll
+		double		m_interval;		// Current poll interval
+		float		m_lastValue;
+		bool		m_hasValue;
+	};
+
+	Entry* Find( uint64_t _valueId );
+	void Rebalance( double _now );
+	void RefillTokens( double _now );
+
+	Entry	m_entries[POLL_SCHEDULER_MAX_VALUES];	// Sorted by value id
+	int		m_count;
+	double	m_budgetRate;		// Polls per second
+	double	m_tokens;
+	double	m_tokensUpdated;
+	bool	m_dirty;			// Weights changed since the last Rebalance
+	double	m_rebalanced;		// Time of the last Rebalance
+	uint32_t m_polls;			// Since the last Format
+};
+
+#endif // _PollScheduler_H
@@ -0,0 +1,32 @@
+//-----------------------------------------------------------------------------
+//
+//	Defs.h
+//
+//	Simulated OpenZWave stand-in (see SimulatedMesh.h). Provides the
+//	integer typedefs of OpenZWave's Defs.h that LabSenseZwave relies on.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _Defs_H
+#define _Defs_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <list>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+typedef int8_t		int8;
+typedef uint8_t		uint8;
+typedef int16_t		int16;
+typedef uint16_t	uint16;
+typedef int32_t		int32;
+typedef uint32_t	uint32;
+typedef int64_t		int64;
+typedef uint64_t	uint64;
+
+#endif // _Defs_H
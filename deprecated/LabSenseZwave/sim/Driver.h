@@ -0,0 +1,47 @@
+//-----------------------------------------------------------------------------
+//
+//	Driver.h
+//
+//	Simulated OpenZWave stand-in. Only the controller interface selector and
+//	the statistics structure of OpenZWave's Driver are provided.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _Driver_H
+#define _Driver_H
+
+#include "Defs.h"
+
+namespace OpenZWave
+{
+	class Driver
+	{
+	public:
+		enum ControllerInterface
+		{
+			ControllerInterface_Unknown = 0,
+			ControllerInterface_Serial,
+			ControllerInterface_Hid
+		};
+
+		struct DriverData
+		{
+			uint32 s_SOFCnt;		// Number of SOF bytes received
+			uint32 s_ACKWaiting;	// Number of unsolicited messages while waiting for an ACK
+			uint32 s_readAborts;	// Number of times read were aborted due to timeouts
+			uint32 s_badChecksum;	// Number of bad checksums
+			uint32 s_readCnt;		// Number of messages successfully read
+			uint32 s_writeCnt;		// Number of messages successfully sent
+			uint32 s_CANCnt;		// Number of CAN bytes received
+			uint32 s_NAKCnt;		// Number of NAK bytes received
+			uint32 s_ACKCnt;		// Number of ACK bytes received
+			uint32 s_OOFCnt;		// Number of bytes out of framing
+			uint32 s_dropped;		// Number of messages dropped & not delivered
+			uint32 s_retries;		// Number of messages retransmitted
+			uint32 s_callbacks;		// Number of unexpected callbacks
+			uint32 s_badroutes;		// Number of failed messages due to bad route response
+		};
+	};
+}
+
+#endif // _Driver_H
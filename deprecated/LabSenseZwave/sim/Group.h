@@ -0,0 +1,15 @@
+//-----------------------------------------------------------------------------
+//
+//	Group.h
+//
+//	Simulated OpenZWave stand-in. Nothing from OpenZWave's Group.h is used
+//	by LabSenseZwave; the header only exists so Main.cpp builds unchanged.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _Group_H
+#define _Group_H
+
+#include "Defs.h"
+
+#endif // _Group_H
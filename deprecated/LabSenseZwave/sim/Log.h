@@ -0,0 +1,33 @@
+//-----------------------------------------------------------------------------
+//
+//	Log.h
+//
+//	Simulated OpenZWave stand-in. Only the LogLevel values passed to the
+//	Options are needed; the simulation does not log.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _Log_H
+#define _Log_H
+
+#include "Defs.h"
+
+namespace OpenZWave
+{
+	enum LogLevel
+	{
+		LogLevel_None,
+		LogLevel_Always,
+		LogLevel_Fatal,
+		LogLevel_Error,
+		LogLevel_Warning,
+		LogLevel_Alert,
+		LogLevel_Info,
+		LogLevel_Detail,
+		LogLevel_Debug,
+		LogLevel_StreamDetail,
+		LogLevel_Internal
+	};
+}
+
+#endif // _Log_H
@@ -0,0 +1,534 @@
+//-----------------------------------------------------------------------------
+//
+//	Manager.cpp
+//
+//	Simulated OpenZWave stand-in for the Manager singleton. Calls for the
+//	simulated network's home id are forwarded to its SimulatedMesh.
+//
+//-----------------------------------------------------------------------------
+
+#include "Manager.h"
+#include "Options.h"
+#include "Notification.h"
+#include "SimulatedMesh.h"
+
+using namespace OpenZWave;
+
+Manager* Manager::s_instance = NULL;
+
+//-----------------------------------------------------------------------------
+// <Manager::Create>
+//-----------------------------------------------------------------------------
+Manager* Manager::Create
+(
+)
+{
+	if( Options::Get() && Options::Get()->AreLocked() )
+	{
+		if( s_instance == NULL )
+		{
+			s_instance = new Manager();
+		}
+		return s_instance;
+	}
+
+	// Same as OpenZWave: the options must be locked before creating the Manager
+	fprintf( stderr, "Options have not been created and locked. Exiting...\n" );
+	exit( 1 );
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::Destroy>
+//-----------------------------------------------------------------------------
+void Manager::Destroy
+(
+)
+{
+	delete s_instance;
+	s_instance = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::Manager>
+//-----------------------------------------------------------------------------
+Manager::Manager
+(
+):
+	m_mesh( NULL ),
+	m_pollInterval( 0 ),
+	m_intervalBetweenPolls( false )
+{
+	pthread_mutexattr_t mutexattr;
+	pthread_mutexattr_init( &mutexattr );
+	pthread_mutexattr_settype( &mutexattr, PTHREAD_MUTEX_RECURSIVE );
+	pthread_mutex_init( &m_notificationMutex, &mutexattr );
+	pthread_mutexattr_destroy( &mutexattr );
+
+	Options::Get()->GetOptionAsInt( "PollInterval", &m_pollInterval );
+	Options::Get()->GetOptionAsBool( "IntervalBetweenPolls", &m_intervalBetweenPolls );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::~Manager>
+//-----------------------------------------------------------------------------
+Manager::~Manager
+(
+)
+{
+	delete m_mesh;
+	pthread_mutex_destroy( &m_notificationMutex );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::AddDriver>
+// Starts the simulated network. Only one driver is supported.
+//-----------------------------------------------------------------------------
+bool Manager::AddDriver
+(
+	string const& _controllerPath,
+	Driver::ControllerInterface const& _interface
+)
+{
+	if( m_mesh )
+	{
+		return false;
+	}
+	m_controllerPath = _controllerPath;
+	m_mesh = new SimulatedMesh( this, _controllerPath );
+	m_mesh->SetPollInterval( m_pollInterval, m_intervalBetweenPolls );
+	return m_mesh->Start();
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::RemoveDriver>
+//-----------------------------------------------------------------------------
+bool Manager::RemoveDriver
+(
+	string const& _controllerPath
+)
+{
+	if( !m_mesh || _controllerPath != m_controllerPath )
+	{
+		return false;
+	}
+	delete m_mesh;
+	m_mesh = NULL;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::WriteConfig>
+// Nothing to save for a simulated network
+//-----------------------------------------------------------------------------
+void Manager::WriteConfig
+(
+	uint32 const _homeId
+)
+{
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::GetDriverStatistics>
+//-----------------------------------------------------------------------------
+void Manager::GetDriverStatistics
+(
+	uint32 const _homeId,
+	Driver::DriverData* _data
+)
+{
+	if( m_mesh && m_mesh->GetHomeId() == _homeId )
+	{
+		m_mesh->GetDriverStatistics( _data );
+	}
+	else
+	{
+		memset( _data, 0, sizeof(*_data) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::GetPollInterval>
+//-----------------------------------------------------------------------------
+int32 Manager::GetPollInterval
+(
+)
+{
+	return m_pollInterval;
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::SetPollInterval>
+//-----------------------------------------------------------------------------
+void Manager::SetPollInterval
+(
+	int32 _milliseconds,
+	bool _bIntervalBetweenPolls
+)
+{
+	m_pollInterval = _milliseconds;
+	m_intervalBetweenPolls = _bIntervalBetweenPolls;
+	if( m_mesh )
+	{
+		m_mesh->SetPollInterval( _milliseconds, _bIntervalBetweenPolls );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::EnablePoll>
+//-----------------------------------------------------------------------------
+bool Manager::EnablePoll
+(
+	ValueID const& _valueId,
+	uint8 const _intensity
+)
+{
+	return m_mesh && m_mesh->EnablePoll( _valueId, _intensity );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::DisablePoll>
+//-----------------------------------------------------------------------------
+bool Manager::DisablePoll
+(
+	ValueID const& _valueId
+)
+{
+	return m_mesh && m_mesh->DisablePoll( _valueId );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::isPolled>
+//-----------------------------------------------------------------------------
+bool Manager::isPolled
+(
+	ValueID const& _valueId
+)
+{
+	return m_mesh && m_mesh->IsPolled( _valueId );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::SetPollIntensity>
+//-----------------------------------------------------------------------------
+void Manager::SetPollIntensity
+(
+	ValueID const& _valueId,
+	uint8 const _intensity
+)
+{
+	if( m_mesh && m_mesh->IsPolled( _valueId ) )
+	{
+		m_mesh->EnablePoll( _valueId, _intensity );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::RefreshNodeInfo>
+//-----------------------------------------------------------------------------
+bool Manager::RefreshNodeInfo
+(
+	uint32 const _homeId,
+	uint8 const _nodeId
+)
+{
+	return m_mesh && m_mesh->GetHomeId() == _homeId && m_mesh->RefreshNodeInfo( _nodeId );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::RequestNodeDynamic>
+//-----------------------------------------------------------------------------
+bool Manager::RequestNodeDynamic
+(
+	uint32 const _homeId,
+	uint8 const _nodeId
+)
+{
+	return m_mesh && m_mesh->GetHomeId() == _homeId && m_mesh->RequestNodeDynamic( _nodeId );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::IsNodeListeningDevice>
+//-----------------------------------------------------------------------------
+bool Manager::IsNodeListeningDevice
+(
+	uint32 const _homeId,
+	uint8 const _nodeId
+)
+{
+	return m_mesh && m_mesh->GetHomeId() == _homeId && m_mesh->IsListening( _nodeId );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::GetNodeType>
+//-----------------------------------------------------------------------------
+string Manager::GetNodeType
+(
+	uint32 const _homeId,
+	uint8 const _nodeId
+)
+{
+	if( m_mesh && m_mesh->GetHomeId() == _homeId )
+	{
+		return m_mesh->GetNodeType( _nodeId );
+	}
+	return "";
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::GetNodeManufacturerName>
+//-----------------------------------------------------------------------------
+string Manager::GetNodeManufacturerName
+(
+	uint32 const _homeId,
+	uint8 const _nodeId
+)
+{
+	if( m_mesh && m_mesh->GetHomeId() == _homeId )
+	{
+		return m_mesh->GetManufacturerName( _nodeId );
+	}
+	return "";
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::GetNodeProductName>
+//-----------------------------------------------------------------------------
+string Manager::GetNodeProductName
+(
+	uint32 const _homeId,
+	uint8 const _nodeId
+)
+{
+	if( m_mesh && m_mesh->GetHomeId() == _homeId )
+	{
+		return m_mesh->GetProductName( _nodeId );
+	}
+	return "";
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::GetValueAsBool>
+//-----------------------------------------------------------------------------
+bool Manager::GetValueAsBool
+(
+	ValueID const& _id,
+	bool* o_value
+)
+{
+	return m_mesh && m_mesh->GetBool( _id, o_value );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::GetValueAsByte>
+//-----------------------------------------------------------------------------
+bool Manager::GetValueAsByte
+(
+	ValueID const& _id,
+	uint8* o_value
+)
+{
+	return m_mesh && m_mesh->GetByte( _id, o_value );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::GetValueAsFloat>
+//-----------------------------------------------------------------------------
+bool Manager::GetValueAsFloat
+(
+	ValueID const& _id,
+	float* o_value
+)
+{
+	return m_mesh && m_mesh->GetFloat( _id, o_value );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::GetValueAsInt>
+//-----------------------------------------------------------------------------
+bool Manager::GetValueAsInt
+(
+	ValueID const& _id,
+	int32* o_value
+)
+{
+	return _id.GetType() == ValueID::ValueType_Int && m_mesh && m_mesh->GetInt( _id, o_value );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::GetValueAsShort>
+//-----------------------------------------------------------------------------
+bool Manager::GetValueAsShort
+(
+	ValueID const& _id,
+	int16* o_value
+)
+{
+	int32 value;
+	if( _id.GetType() != ValueID::ValueType_Short || !m_mesh || !m_mesh->GetInt( _id, &value ) )
+	{
+		return false;
+	}
+	*o_value = (int16) value;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::GetValueAsString>
+//-----------------------------------------------------------------------------
+bool Manager::GetValueAsString
+(
+	ValueID const& _id,
+	string* o_value
+)
+{
+	return m_mesh && m_mesh->GetString( _id, o_value );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::GetValueListSelection>
+// The selection is returned as the item value
+//-----------------------------------------------------------------------------
+bool Manager::GetValueListSelection
+(
+	ValueID const& _id,
+	int32* o_value
+)
+{
+	return _id.GetType() == ValueID::ValueType_List && m_mesh && m_mesh->GetInt( _id, o_value );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::SetValue>
+//-----------------------------------------------------------------------------
+bool Manager::SetValue
+(
+	ValueID const& _id,
+	int32 const _value
+)
+{
+	return m_mesh && m_mesh->SetValue( _id, _value );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::RefreshValue>
+//-----------------------------------------------------------------------------
+bool Manager::RefreshValue
+(
+	ValueID const& _id
+)
+{
+	return m_mesh && m_mesh->RefreshValue( _id );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::SetConfigParam>
+//-----------------------------------------------------------------------------
+bool Manager::SetConfigParam
+(
+	uint32 const _homeId,
+	uint8 const _nodeId,
+	uint8 const _param,
+	int32 _value,
+	uint8 const _size
+)
+{
+	return m_mesh && m_mesh->GetHomeId() == _homeId && m_mesh->SetConfigParam( _nodeId, _param, _value );
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::RequestConfigParam>
+//-----------------------------------------------------------------------------
+void Manager::RequestConfigParam
+(
+	uint32 const _homeId,
+	uint8 const _nodeId,
+	uint8 const _param
+)
+{
+	if( m_mesh && m_mesh->GetHomeId() == _homeId )
+	{
+		m_mesh->RequestConfigParam( _nodeId, _param );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::AddAssociation>
+//-----------------------------------------------------------------------------
+void Manager::AddAssociation
+(
+	uint32 const _homeId,
+	uint8 const _nodeId,
+	uint8 const _groupIdx,
+	uint8 const _targetNodeId
+)
+{
+	if( m_mesh && m_mesh->GetHomeId() == _homeId )
+	{
+		m_mesh->AddAssociation( _nodeId );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::AddWatcher>
+//-----------------------------------------------------------------------------
+bool Manager::AddWatcher
+(
+	pfnOnNotification_t _watcher,
+	void* _context
+)
+{
+	pthread_mutex_lock( &m_notificationMutex );
+	for( list<Watcher>::iterator it = m_watchers.begin(); it != m_watchers.end(); ++it )
+	{
+		if( ( it->m_callback == _watcher ) && ( it->m_context == _context ) )
+		{
+			// Already in the list
+			pthread_mutex_unlock( &m_notificationMutex );
+			return false;
+		}
+	}
+	Watcher watcher = { _watcher, _context };
+	m_watchers.push_back( watcher );
+	pthread_mutex_unlock( &m_notificationMutex );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::RemoveWatcher>
+//-----------------------------------------------------------------------------
+bool Manager::RemoveWatcher
+(
+	pfnOnNotification_t _watcher,
+	void* _context
+)
+{
+	pthread_mutex_lock( &m_notificationMutex );
+	for( list<Watcher>::iterator it = m_watchers.begin(); it != m_watchers.end(); ++it )
+	{
+		if( ( it->m_callback == _watcher ) && ( it->m_context == _context ) )
+		{
+			m_watchers.erase( it );
+			pthread_mutex_unlock( &m_notificationMutex );
+			return true;
+		}
+	}
+	pthread_mutex_unlock( &m_notificationMutex );
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// <Manager::NotifyWatchers>
+//-----------------------------------------------------------------------------
+void Manager::NotifyWatchers
+(
+	Notification* _notification
+)
+{
+	pthread_mutex_lock( &m_notificationMutex );
+	for( list<Watcher>::iterator it = m_watchers.begin(); it != m_watchers.end(); ++it )
+	{
+		it->m_callback( _notification, it->m_context );
+	}
+	pthread_mutex_unlock( &m_notificationMutex );
+}
@@ -0,0 +1,101 @@
+//-----------------------------------------------------------------------------
+//
+//	Manager.h
+//
+//	Simulated OpenZWave stand-in for the part of the Manager interface used
+//	by LabSenseZwave. AddDriver() starts a SimulatedMesh instead of opening
+//	a serial port; all other calls are forwarded to it.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _Manager_H
+#define _Manager_H
+
+#include <pthread.h>
+#include "Defs.h"
+#include "Driver.h"
+#include "ValueID.h"
+
+namespace OpenZWave
+{
+	class Notification;
+	class SimulatedMesh;
+
+	class Manager
+	{
+		friend class SimulatedMesh;
+
+	public:
+		typedef void (*pfnOnNotification_t)( Notification const* _pNotification, void* _context );
+
+		static Manager* Create();
+		static Manager* Get(){ return s_instance; }
+		static void Destroy();
+
+		// Drivers
+		bool AddDriver( string const& _controllerPath, Driver::ControllerInterface const& _interface = Driver::ControllerInterface_Serial );
+		bool RemoveDriver( string const& _controllerPath );
+		void WriteConfig( uint32 const _homeId );
+		void GetDriverStatistics( uint32 const _homeId, Driver::DriverData* _data );
+
+		// Polling
+		int32 GetPollInterval();
+		void SetPollInterval( int32 _milliseconds, bool _bIntervalBetweenPolls );
+		bool EnablePoll( ValueID const& _valueId, uint8 const _intensity = 1 );
+		bool DisablePoll( ValueID const& _valueId );
+		bool isPolled( ValueID const& _valueId );
+		void SetPollIntensity( ValueID const& _valueId, uint8 const _intensity );
+
+		// Nodes
+		bool RefreshNodeInfo( uint32 const _homeId, uint8 const _nodeId );
+		bool RequestNodeDynamic( uint32 const _homeId, uint8 const _nodeId );
+		bool IsNodeListeningDevice( uint32 const _homeId, uint8 const _nodeId );
+		string GetNodeType( uint32 const _homeId, uint8 const _nodeId );
+		string GetNodeManufacturerName( uint32 const _homeId, uint8 const _nodeId );
+		string GetNodeProductName( uint32 const _homeId, uint8 const _nodeId );
+
+		// Values
+		bool GetValueAsBool( ValueID const& _id, bool* o_value );
+		bool GetValueAsByte( ValueID const& _id, uint8* o_value );
+		bool GetValueAsFloat( ValueID const& _id, float* o_value );
+		bool GetValueAsInt( ValueID const& _id, int32* o_value );
+		bool GetValueAsShort( ValueID const& _id, int16* o_value );
+		bool GetValueAsString( ValueID const& _id, string* o_value );
+		bool GetValueListSelection( ValueID const& _id, int32* o_value );
+		bool SetValue( ValueID const& _id, int32 const _value );
+		bool RefreshValue( ValueID const& _id );
+
+		// Configuration parameters and associations
+		bool SetConfigParam( uint32 const _homeId, uint8 const _nodeId, uint8 const _param, int32 _value, uint8 const _size = 2 );
+		void RequestConfigParam( uint32 const _homeId, uint8 const _nodeId, uint8 const _param );
+		void AddAssociation( uint32 const _homeId, uint8 const _nodeId, uint8 const _groupIdx, uint8 const _targetNodeId );
+
+		// Watchers
+		bool AddWatcher( pfnOnNotification_t _watcher, void* _context );
+		bool RemoveWatcher( pfnOnNotification_t _watcher, void* _context );
+
+	private:
+		Manager();
+		~Manager();
+
+		// Called from the mesh thread for every notification
+		void NotifyWatchers( Notification* _notification );
+
+		struct Watcher
+		{
+			pfnOnNotification_t	m_callback;
+			void*				m_context;
+		};
+
+		list<Watcher>		m_watchers;
+		pthread_mutex_t		m_notificationMutex;	// Serialises watcher calls and changes to m_watchers
+		SimulatedMesh*		m_mesh;					// NULL until AddDriver()
+		string				m_controllerPath;
+		int32				m_pollInterval;			// Milliseconds
+		bool				m_intervalBetweenPolls;
+
+		static Manager*		s_instance;
+	};
+}
+
+#endif // _Manager_H
@@ -0,0 +1,15 @@
+//-----------------------------------------------------------------------------
+//
+//	Node.h
+//
+//	Simulated OpenZWave stand-in. Nothing from OpenZWave's Node.h is used
+//	by LabSenseZwave; the header only exists so Main.cpp builds unchanged.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _Node_H
+#define _Node_H
+
+#include "Defs.h"
+
+#endif // _Node_H
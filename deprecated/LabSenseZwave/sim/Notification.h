@@ -0,0 +1,77 @@
+//-----------------------------------------------------------------------------
+//
+//	Notification.h
+//
+//	Simulated OpenZWave stand-in. Notifications are created by the
+//	SimulatedMesh and handed to the watchers registered with the Manager.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _Notification_H
+#define _Notification_H
+
+#include "Defs.h"
+#include "ValueID.h"
+
+namespace OpenZWave
+{
+	class Notification
+	{
+		friend class SimulatedMesh;
+
+	public:
+		enum NotificationType
+		{
+			Type_ValueAdded = 0,
+			Type_ValueRemoved,
+			Type_ValueChanged,
+			Type_ValueRefreshed,
+			Type_Group,
+			Type_NodeNew,
+			Type_NodeAdded,
+			Type_NodeRemoved,
+			Type_NodeProtocolInfo,
+			Type_NodeNaming,
+			Type_NodeEvent,
+			Type_PollingDisabled,
+			Type_PollingEnabled,
+			Type_SceneEvent,
+			Type_CreateButton,
+			Type_DeleteButton,
+			Type_ButtonOn,
+			Type_ButtonOff,
+			Type_DriverReady,
+			Type_DriverFailed,
+			Type_DriverReset,
+			Type_EssentialNodeQueriesComplete,
+			Type_NodeQueriesComplete,
+			Type_AwakeNodesQueried,
+			Type_AllNodesQueried,
+			Type_Notification,
+			Type_MsgComplete
+		};
+
+		NotificationType GetType()const{ return m_type; }
+		uint32 GetHomeId()const{ return m_valueId.GetHomeId(); }
+		uint8 GetNodeId()const{ return m_valueId.GetNodeId(); }
+		ValueID const& GetValueID()const{ return m_valueId; }
+		uint8 GetGroupIdx()const{ return m_byte; }
+		uint8 GetEvent()const{ return m_byte; }
+		uint8 GetButtonId()const{ return m_byte; }
+		uint8 GetSceneId()const{ return m_byte; }
+		uint8 GetNotification()const{ return m_byte; }
+
+	private:
+		Notification( NotificationType _type ): m_type( _type ), m_byte( 0 ) {}
+
+		void SetHomeAndNodeIds( uint32 const _homeId, uint8 const _nodeId ){ m_valueId = ValueID( _homeId, ((uint64)_nodeId)<<24 ); }
+		void SetValueId( ValueID const& _valueId ){ m_valueId = _valueId; }
+		void SetByte( uint8 const _byte ){ m_byte = _byte; }
+
+		NotificationType	m_type;
+		ValueID				m_valueId;
+		uint8				m_byte;
+	};
+}
+
+#endif // _Notification_H
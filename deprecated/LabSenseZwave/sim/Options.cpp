@@ -0,0 +1,183 @@
+//-----------------------------------------------------------------------------
+//
+//	Options.cpp
+//
+//	Simulated OpenZWave stand-in for the Options singleton.
+//
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include "Options.h"
+
+using namespace OpenZWave;
+
+Options* Options::s_instance = NULL;
+
+//-----------------------------------------------------------------------------
+// <Options::Create>
+//-----------------------------------------------------------------------------
+Options* Options::Create
+(
+	string const& _configPath,
+	string const& _userPath,
+	string const& _commandLine
+)
+{
+	if( s_instance == NULL )
+	{
+		s_instance = new Options( _configPath, _userPath, _commandLine );
+	}
+	return s_instance;
+}
+
+//-----------------------------------------------------------------------------
+// <Options::Destroy>
+//-----------------------------------------------------------------------------
+bool Options::Destroy
+(
+)
+{
+	delete s_instance;
+	s_instance = NULL;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// <Options::Options>
+// The paths are not used: the simulation has no device database or cache
+//-----------------------------------------------------------------------------
+Options::Options
+(
+	string const& _configPath,
+	string const& _userPath,
+	string const& _commandLine
+):
+	m_locked( false )
+{
+}
+
+//-----------------------------------------------------------------------------
+// <Options::Lock>
+//-----------------------------------------------------------------------------
+bool Options::Lock
+(
+)
+{
+	m_locked = true;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// <Options::AddOption>
+// Options can only be added before Lock()
+//-----------------------------------------------------------------------------
+bool Options::AddOption
+(
+	string const& _name,
+	string const& _value
+)
+{
+	if( m_locked )
+	{
+		return false;
+	}
+	m_options[_name] = _value;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// <Options::AddOptionBool>
+//-----------------------------------------------------------------------------
+bool Options::AddOptionBool
+(
+	string const& _name,
+	bool const _default
+)
+{
+	return AddOption( _name, _default ? "true" : "false" );
+}
+
+//-----------------------------------------------------------------------------
+// <Options::AddOptionInt>
+//-----------------------------------------------------------------------------
+bool Options::AddOptionInt
+(
+	string const& _name,
+	int32 const _default
+)
+{
+	char buf[16];
+	snprintf( buf, sizeof(buf), "%d", _default );
+	return AddOption( _name, buf );
+}
+
+//-----------------------------------------------------------------------------
+// <Options::AddOptionString>
+//-----------------------------------------------------------------------------
+bool Options::AddOptionString
+(
+	string const& _name,
+	string const& _default,
+	bool const _append
+)
+{
+	if( _append && m_options.count( _name ) )
+	{
+		return AddOption( _name, m_options[_name] + "," + _default );
+	}
+	return AddOption( _name, _default );
+}
+
+//-----------------------------------------------------------------------------
+// <Options::GetOptionAsBool>
+//-----------------------------------------------------------------------------
+bool Options::GetOptionAsBool
+(
+	string const& _name,
+	bool* o_value
+)
+{
+	map<string,string>::iterator it = m_options.find( _name );
+	if( it == m_options.end() )
+	{
+		return false;
+	}
+	*o_value = ( it->second == "true" );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// <Options::GetOptionAsInt>
+//-----------------------------------------------------------------------------
+bool Options::GetOptionAsInt
+(
+	string const& _name,
+	int32* o_value
+)
+{
+	map<string,string>::iterator it = m_options.find( _name );
+	if( it == m_options.end() )
+	{
+		return false;
+	}
+	*o_value = (int32) strtol( it->second.c_str(), NULL, 10 );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// <Options::GetOptionAsString>
+//-----------------------------------------------------------------------------
+bool Options::GetOptionAsString
+(
+	string const& _name,
+	string* o_value
+)
+{
+	map<string,string>::iterator it = m_options.find( _name );
+	if( it == m_options.end() )
+	{
+		return false;
+	}
+	*o_value = it->second;
+	return true;
+}
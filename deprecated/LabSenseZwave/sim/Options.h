@@ -0,0 +1,47 @@
+//-----------------------------------------------------------------------------
+//
+//	Options.h
+//
+//	Simulated OpenZWave stand-in. Stores the options LabSenseZwave sets;
+//	the simulation reads "PollInterval" and "IntervalBetweenPolls".
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _Options_H
+#define _Options_H
+
+#include "Defs.h"
+
+namespace OpenZWave
+{
+	class Options
+	{
+	public:
+		static Options* Create( string const& _configPath, string const& _userPath, string const& _commandLine );
+		static bool Destroy();
+		static Options* Get(){ return s_instance; }
+
+		bool Lock();
+		bool AreLocked()const{ return m_locked; }
+
+		bool AddOptionBool( string const& _name, bool const _default );
+		bool AddOptionInt( string const& _name, int32 const _default );
+		bool AddOptionString( string const& _name, string const& _default, bool const _append );
+
+		bool GetOptionAsBool( string const& _name, bool* o_value );
+		bool GetOptionAsInt( string const& _name, int32* o_value );
+		bool GetOptionAsString( string const& _name, string* o_value );
+
+	private:
+		Options( string const& _configPath, string const& _userPath, string const& _commandLine );
+
+		bool AddOption( string const& _name, string const& _value );
+
+		map<string,string>	m_options;		// Option values, stored as text
+		bool				m_locked;
+
+		static Options*		s_instance;
+	};
+}
+
+#endif // _Options_H
@@ -0,0 +1,1311 @@
+//-----------------------------------------------------------------------------
+//
+//	SimulatedMesh.cpp
+//
+//	Simulated Z-Wave network behind the OpenZWave stand-in. See
+//	SimulatedMesh.h for the mesh description syntax.
+//
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include "SimulatedMesh.h"
+#include "Manager.h"
+
+using namespace OpenZWave;
+
+#define SIM_HOME_ID				0x014d08e6	// Home id of the deployed network
+#define SIM_CONTROLLER_ID		1
+#define SIM_MAX_NODE_ID			232
+#define SIM_DEFAULT_AIRTIME		4000		// us per frame, ~20 byte frame + ACK at 40 kbit/s
+#define SIM_MAX_PENDING			4096		// Reports beyond this are dropped
+#define SIM_WAKEUP_WINDOW		5000000		// Sleeping nodes first wake up within 5 s
+
+// Default spontaneous report rates (per second per node)
+#define SIM_HSM100_RATE			0.05
+#define SIM_DOOR_RATE			0.02
+#define SIM_SWITCH_RATE			0.2
+
+#define COMMAND_CLASS_BASIC				0x20
+#define COMMAND_CLASS_SWITCH_BINARY		0x25
+#define COMMAND_CLASS_SWITCH_ALL		0x27
+#define COMMAND_CLASS_SENSOR_BINARY		0x30
+#define COMMAND_CLASS_SENSOR_MULTILEVEL	0x31
+#define COMMAND_CLASS_METER				0x32
+#define COMMAND_CLASS_CONFIGURATION		0x70
+#define COMMAND_CLASS_ALARM				0x71
+#define COMMAND_CLASS_BATTERY			0x80
+#define COMMAND_CLASS_WAKE_UP			0x84
+
+static uint64 monotonicMicros()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::SimulatedMesh>
+// Builds the node and value tables described by the controller path
+//-----------------------------------------------------------------------------
+SimulatedMesh::SimulatedMesh
+(
+	Manager* _manager,
+	string const& _controllerPath
+):
+	m_manager( _manager ),
+	m_homeId( SIM_HOME_ID ),
+	m_airtime( SIM_DEFAULT_AIRTIME ),
+	m_seed( (uint32) time( NULL ) ),
+	m_running( false ),
+	m_stopping( false ),
+	m_channelFree( 0 ),
+	m_channelBusy( 0 ),
+	m_pollInterval( 0 ),
+	m_intervalBetweenPolls( false ),
+	m_pollCursor( 0 ),
+	m_pollCycle( 0 ),
+	m_nextPoll( 0 ),
+	m_uninterviewed( 0 )
+{
+	memset( m_nodeTable, 0, sizeof(m_nodeTable) );
+	memset( &m_stats, 0, sizeof(m_stats) );
+
+	pthread_mutex_init( &m_mutex, NULL );
+
+	pthread_condattr_t condattr;
+	pthread_condattr_init( &condattr );
+	pthread_condattr_setclock( &condattr, CLOCK_MONOTONIC );
+	pthread_cond_init( &m_wakeup, &condattr );
+	pthread_condattr_destroy( &condattr );
+
+	m_valid = ParsePath( _controllerPath );
+	m_random.seed( m_seed );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::~SimulatedMesh>
+//-----------------------------------------------------------------------------
+SimulatedMesh::~SimulatedMesh
+(
+)
+{
+	Stop();
+	pthread_cond_destroy( &m_wakeup );
+	pthread_mutex_destroy( &m_mutex );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::ParsePath>
+// Parses "sim:<type>=<count>[@<rate>],seed=<n>,airtime=<us>". Any path not
+// starting with "sim:" gives the deployed network.
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::ParsePath
+(
+	string const& _controllerPath
+)
+{
+	AddNode( SIM_CONTROLLER_ID, NodeKind_Controller, 0 );
+
+	if( _controllerPath.compare( 0, 4, "sim:" ) != 0 )
+	{
+		AddNode( 16, NodeKind_SmartSwitch, SIM_SWITCH_RATE );
+		AddNode( 27, NodeKind_Hsm100, SIM_HSM100_RATE );
+		AddNode( 35, NodeKind_Hsm100, SIM_HSM100_RATE );
+		AddNode( 37, NodeKind_Hsm100, SIM_HSM100_RATE );
+		AddNode( 38, NodeKind_Hsm100, SIM_HSM100_RATE );
+		AddNode( 39, NodeKind_Hsm100, SIM_HSM100_RATE );
+		AddNode( 42, NodeKind_DoorWindow, SIM_DOOR_RATE );
+		AddNode( 43, NodeKind_DoorWindow, SIM_DOOR_RATE );
+		return true;
+	}
+
+	uint32 nextId = SIM_CONTROLLER_ID + 1;
+	char spec[256];
+	snprintf( spec, sizeof(spec), "%s", _controllerPath.c_str() + 4 );
+
+	char* saveptr = NULL;
+	for( char* item = strtok_r( spec, ",", &saveptr ); item; item = strtok_r( NULL, ",", &saveptr ) )
+	{
+		char* value = strchr( item, '=' );
+		if( !value )
+		{
+			fprintf( stderr, "Simulated mesh: expected <name>=<value> in \"%s\"\n", item );
+			return false;
+		}
+		*value++ = '\0';
+
+		if( strcmp( item, "seed" ) == 0 )
+		{
+			m_seed = (uint32) strtoul( value, NULL, 10 );
+			continue;
+		}
+		if( strcmp( item, "airtime" ) == 0 )
+		{
+			m_airtime = (uint32) strtoul( value, NULL, 10 );
+			continue;
+		}
+
+		NodeKind kind;
+		double rate;
+		if( strcmp( item, "hsm100" ) == 0 )
+		{
+			kind = NodeKind_Hsm100;
+			rate = SIM_HSM100_RATE;
+		}
+		else if( strcmp( item, "door" ) == 0 )
+		{
+			kind = NodeKind_DoorWindow;
+			rate = SIM_DOOR_RATE;
+		}
+		else if( strcmp( item, "switch" ) == 0 )
+		{
+			kind = NodeKind_SmartSwitch;
+			rate = SIM_SWITCH_RATE;
+		}
+		else
+		{
+			fprintf( stderr, "Simulated mesh: unknown node type \"%s\"\n", item );
+			return false;
+		}
+
+		char* end;
+		unsigned long count = strtoul( value, &end, 10 );
+		if( *end == '@' )
+		{
+			rate = strtod( end + 1, &end );
+		}
+		if( *end != '\0' || rate < 0 )
+		{
+			fprintf( stderr, "Simulated mesh: bad count or rate \"%s\" for %s\n", value, item );
+			return false;
+		}
+
+		for( unsigned long i = 0; i < count; i++ )
+		{
+			if( nextId > SIM_MAX_NODE_ID )
+			{
+				fprintf( stderr, "Simulated mesh: more than %d nodes\n", SIM_MAX_NODE_ID );
+				return false;
+			}
+			AddNode( (uint8) nextId++, kind, rate );
+		}
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::AddNode>
+// Adds a node with the command classes and values of the real device
+// (see zwcfg_0x014d08e6.xml)
+//-----------------------------------------------------------------------------
+void SimulatedMesh::AddNode
+(
+	uint8 _nodeId,
+	NodeKind _kind,
+	double _rate
+)
+{
+	m_nodes.push_back( SimNode() );
+	SimNode* node = &m_nodes.back();
+	node->m_nodeId = _nodeId;
+	node->m_kind = _kind;
+	node->m_rate = _rate;
+	node->m_interviewed = false;
+	node->m_named = false;
+	node->m_nextEvent = UINT64_MAX;
+	m_nodeTable[_nodeId] = node;
+
+	switch( _kind )
+	{
+		case NodeKind_Controller:
+		{
+			AddValue( node, ValueID::ValueGenre_Basic, COMMAND_CLASS_BASIC, 1, 0, ValueID::ValueType_Byte, 0, 0, 255, 0 );
+			break;
+		}
+		case NodeKind_Hsm100:
+		{
+			AddValue( node, ValueID::ValueGenre_Basic, COMMAND_CLASS_BASIC, 1, 0, ValueID::ValueType_Byte, 0, 0, 255, 0 );
+			AddValue( node, ValueID::ValueGenre_User, COMMAND_CLASS_SENSOR_MULTILEVEL, 1, 2, ValueID::ValueType_Decimal, 0, 0, 255, 1 );
+			AddValue( node, ValueID::ValueGenre_User, COMMAND_CLASS_SENSOR_MULTILEVEL, 2, 3, ValueID::ValueType_Decimal, 40, 0, 100, 5 );
+			AddValue( node, ValueID::ValueGenre_User, COMMAND_CLASS_SENSOR_MULTILEVEL, 3, 1, ValueID::ValueType_Decimal, 72, 50, 95, 0.5f );
+			for( uint8 param = 1; param <= 6; param++ )
+			{
+				AddValue( node, ValueID::ValueGenre_Config, COMMAND_CLASS_CONFIGURATION, 1, param, ValueID::ValueType_Byte, 0, 0, 255, 0 );
+			}
+			AddValue( node, ValueID::ValueGenre_User, COMMAND_CLASS_BATTERY, 1, 0, ValueID::ValueType_Byte, 100, 0, 100, -0.1f );
+			AddValue( node, ValueID::ValueGenre_System, COMMAND_CLASS_WAKE_UP, 1, 0, ValueID::ValueType_Int, 3600, 0, 0x7fffffff, 0 );
+			break;
+		}
+		case NodeKind_DoorWindow:
+		{
+			AddValue( node, ValueID::ValueGenre_Basic, COMMAND_CLASS_BASIC, 1, 0, ValueID::ValueType_Byte, 0, 0, 255, 0 );
+			AddValue( node, ValueID::ValueGenre_User, COMMAND_CLASS_SENSOR_BINARY, 1, 0, ValueID::ValueType_Bool, 0, 0, 1, 0 );
+			AddValue( node, ValueID::ValueGenre_User, COMMAND_CLASS_ALARM, 1, 0, ValueID::ValueType_Byte, 0, 0, 255, 0 );
+			AddValue( node, ValueID::ValueGenre_User, COMMAND_CLASS_ALARM, 1, 1, ValueID::ValueType_Byte, 0, 0, 255, 0 );
+			AddValue( node, ValueID::ValueGenre_User, COMMAND_CLASS_BATTERY, 1, 0, ValueID::ValueType_Byte, 100, 0, 100, -0.1f );
+			AddValue( node, ValueID::ValueGenre_System, COMMAND_CLASS_WAKE_UP, 1, 0, ValueID::ValueType_Int, 3600, 0, 0x7fffffff, 0 );
+			break;
+		}
+		case NodeKind_SmartSwitch:
+		{
+			AddValue( node, ValueID::ValueGenre_Basic, COMMAND_CLASS_BASIC, 1, 0, ValueID::ValueType_Byte, 255, 0, 255, 0 );
+			AddValue( node, ValueID::ValueGenre_User, COMMAND_CLASS_SWITCH_BINARY, 1, 0, ValueID::ValueType_Bool, 1, 0, 1, 0 );
+			AddValue( node, ValueID::ValueGenre_System, COMMAND_CLASS_SWITCH_ALL, 1, 0, ValueID::ValueType_List, 255, 0, 255, 0 );
+			AddValue( node, ValueID::ValueGenre_User, COMMAND_CLASS_SENSOR_MULTILEVEL, 1, 4, ValueID::ValueType_Decimal, 13, 0, 1800, 20 );
+			AddValue( node, ValueID::ValueGenre_User, COMMAND_CLASS_METER, 1, 0, ValueID::ValueType_Decimal, 12.28f, 0, 1e9f, -0.01f );
+			AddValue( node, ValueID::ValueGenre_User, COMMAND_CLASS_METER, 1, 8, ValueID::ValueType_Decimal, 13, 0, 1800, 20 );
+			AddValue( node, ValueID::ValueGenre_User, COMMAND_CLASS_METER, 1, 32, ValueID::ValueType_Bool, 0, 0, 1, 0 );
+			AddValue( node, ValueID::ValueGenre_Config, COMMAND_CLASS_CONFIGURATION, 1, 101, ValueID::ValueType_Int, 0, 0, 0x7fffffff, 0 );
+			AddValue( node, ValueID::ValueGenre_Config, COMMAND_CLASS_CONFIGURATION, 1, 102, ValueID::ValueType_Int, 0, 0, 0x7fffffff, 0 );
+			AddValue( node, ValueID::ValueGenre_Config, COMMAND_CLASS_CONFIGURATION, 1, 111, ValueID::ValueType_Int, 720, 0, 0x7fffffff, 0 );
+			break;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::AddValue>
+//-----------------------------------------------------------------------------
+void SimulatedMesh::AddValue
+(
+	SimNode* _node,
+	ValueID::ValueGenre _genre,
+	uint8 _commandClassId,
+	uint8 _instance,
+	uint8 _index,
+	ValueID::ValueType _type,
+	float _value,
+	float _min,
+	float _max,
+	float _step
+)
+{
+	SimValue value;
+	value.m_id = ValueID( m_homeId, _node->m_nodeId, _genre, _commandClassId, _instance, _index, _type );
+	value.m_value = _value;
+	value.m_min = _min;
+	value.m_max = _max;
+	value.m_step = _step;
+	value.m_pollIntensity = 0;
+	_node->m_values.push_back( value );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::GetNode>
+//-----------------------------------------------------------------------------
+SimulatedMesh::SimNode* SimulatedMesh::GetNode
+(
+	uint8 _nodeId
+)
+{
+	return m_nodeTable[_nodeId];
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::GetValue>
+//-----------------------------------------------------------------------------
+SimulatedMesh::SimValue* SimulatedMesh::GetValue
+(
+	ValueID const& _id
+)
+{
+	if( _id.GetHomeId() != m_homeId )
+	{
+		return NULL;
+	}
+	if( SimNode* node = GetNode( _id.GetNodeId() ) )
+	{
+		for( vector<SimValue>::iterator it = node->m_values.begin(); it != node->m_values.end(); ++it )
+		{
+			if( it->m_id == _id )
+			{
+				return &(*it);
+			}
+		}
+	}
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::FindValue>
+//-----------------------------------------------------------------------------
+SimulatedMesh::SimValue* SimulatedMesh::FindValue
+(
+	SimNode* _node,
+	uint8 _commandClassId,
+	uint8 _instance,
+	uint8 _index
+)
+{
+	for( vector<SimValue>::iterator it = _node->m_values.begin(); it != _node->m_values.end(); ++it )
+	{
+		if( it->m_id.GetCommandClassId() == _commandClassId && it->m_id.GetInstance() == _instance && it->m_id.GetIndex() == _index )
+		{
+			return &(*it);
+		}
+	}
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::Start>
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::Start
+(
+)
+{
+	if( m_running )
+	{
+		return false;
+	}
+	m_stopping = false;
+	if( pthread_create( &m_thread, NULL, ThreadEntry, this ) != 0 )
+	{
+		return false;
+	}
+	m_running = true;
+	return m_valid;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::Stop>
+//-----------------------------------------------------------------------------
+void SimulatedMesh::Stop
+(
+)
+{
+	if( !m_running )
+	{
+		return;
+	}
+	pthread_mutex_lock( &m_mutex );
+	m_stopping = true;
+	pthread_cond_signal( &m_wakeup );
+	pthread_mutex_unlock( &m_mutex );
+
+	pthread_join( m_thread, NULL );
+	m_running = false;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::ThreadEntry>
+//-----------------------------------------------------------------------------
+void* SimulatedMesh::ThreadEntry
+(
+	void* _context
+)
+{
+	((SimulatedMesh*) _context)->Run();
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::Run>
+// The driver thread. Interviews the nodes, then delivers queued
+// notifications, spontaneous reports and polls in time order until Stop().
+//-----------------------------------------------------------------------------
+void SimulatedMesh::Run
+(
+)
+{
+	pthread_mutex_lock( &m_mutex );
+
+	if( !m_valid )
+	{
+		QueueNotification( Notification::Type_DriverFailed, SIM_CONTROLLER_ID );
+	}
+	else
+	{
+		uint64 now = monotonicMicros();
+		QueueNotification( Notification::Type_DriverReady, SIM_CONTROLLER_ID );
+
+		// Listening nodes are interviewed straight away, sleeping ones get
+		// their values from the cache and finish when they first wake up
+		for( list<SimNode>::iterator it = m_nodes.begin(); it != m_nodes.end(); ++it )
+		{
+			SimNode* node = &(*it);
+			QueueNotification( Notification::Type_NodeAdded, node->m_nodeId );
+			QueueNotification( Notification::Type_NodeProtocolInfo, node->m_nodeId );
+			for( vector<SimValue>::iterator vit = node->m_values.begin(); vit != node->m_values.end(); ++vit )
+			{
+				QueueValue( Notification::Type_ValueAdded, *vit );
+			}
+
+			if( IsListening( node->m_nodeId ) )
+			{
+				QueueInterview( node );
+				node->m_nextEvent = now + NextInterval( node->m_rate );
+			}
+			else
+			{
+				m_uninterviewed++;
+				node->m_nextEvent = now + m_random() % SIM_WAKEUP_WINDOW;
+			}
+		}
+		QueueNotification( Notification::Type_AwakeNodesQueried, SIM_CONTROLLER_ID );
+	}
+
+	while( !m_stopping )
+	{
+		uint64 now = monotonicMicros();
+
+		// Deliver everything that is due, without the lock held so the
+		// watchers can call back into the Manager
+		if( !m_pending.empty() && m_pending.front().m_due <= now )
+		{
+			Notification notification = m_pending.front().m_notification;
+			m_pending.pop_front();
+
+			if( notification.GetType() == Notification::Type_NodeNaming )
+			{
+				GetNode( notification.GetNodeId() )->m_named = true;
+			}
+
+			pthread_mutex_unlock( &m_mutex );
+			m_manager->NotifyWatchers( &notification );
+			pthread_mutex_lock( &m_mutex );
+			continue;
+		}
+
+		uint64 wakeup = m_pending.empty() ? UINT64_MAX : m_pending.front().m_due;
+
+		// Next spontaneous report (or first wake-up of a sleeping node)
+		SimNode* next = NULL;
+		for( list<SimNode>::iterator it = m_nodes.begin(); it != m_nodes.end(); ++it )
+		{
+			if( !next || it->m_nextEvent < next->m_nextEvent )
+			{
+				next = &(*it);
+			}
+		}
+		if( next && next->m_nextEvent <= now )
+		{
+			if( !next->m_interviewed )
+			{
+				QueueInterview( next );
+				if( --m_uninterviewed == 0 )
+				{
+					QueueNotification( Notification::Type_AllNodesQueried, SIM_CONTROLLER_ID );
+				}
+			}
+			else
+			{
+				QueueReport( next );
+			}
+			next->m_nextEvent = now + NextInterval( next->m_rate );
+			continue;
+		}
+		if( next && next->m_nextEvent < wakeup )
+		{
+			wakeup = next->m_nextEvent;
+		}
+
+		if( !m_polled.empty() && m_pollInterval > 0 )
+		{
+			if( m_nextPoll <= now )
+			{
+				QueuePoll();
+				uint64 interval = (uint64) m_pollInterval * 1000;
+				if( !m_intervalBetweenPolls )
+				{
+					interval /= m_polled.size();
+				}
+				m_nextPoll = now + interval;
+				continue;
+			}
+			if( m_nextPoll < wakeup )
+			{
+				wakeup = m_nextPoll;
+			}
+		}
+
+		if( wakeup == UINT64_MAX )
+		{
+			pthread_cond_wait( &m_wakeup, &m_mutex );
+		}
+		else
+		{
+			struct timespec ts;
+			ts.tv_sec = wakeup / 1000000;
+			ts.tv_nsec = ( wakeup % 1000000 ) * 1000;
+			pthread_cond_timedwait( &m_wakeup, &m_mutex, &ts );
+		}
+	}
+
+	pthread_mutex_unlock( &m_mutex );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::UseAirtime>
+// Reserves the channel for a number of frames starting no earlier than
+// _now; returns when the last frame ends
+//-----------------------------------------------------------------------------
+uint64 SimulatedMesh::UseAirtime
+(
+	uint64 _now,
+	uint32 _frames
+)
+{
+	uint64 start = ( m_channelFree > _now ) ? m_channelFree : _now;
+	uint64 airtime = (uint64) _frames * m_airtime;
+	m_channelFree = start + airtime;
+	m_channelBusy += airtime;
+	return m_channelFree;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::NextInterval>
+// Exponentially distributed gap of a Poisson process, in microseconds
+//-----------------------------------------------------------------------------
+uint64 SimulatedMesh::NextInterval
+(
+	double _rate
+)
+{
+	if( _rate <= 0 )
+	{
+		return UINT64_MAX / 2;
+	}
+	std::exponential_distribution<double> gap( _rate );
+	return (uint64)( gap( m_random ) * 1000000.0 );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::QueueNotification>
+// Notifications without a frame of their own go out with the last frame
+//-----------------------------------------------------------------------------
+void SimulatedMesh::QueueNotification
+(
+	Notification::NotificationType _type,
+	uint8 _nodeId,
+	uint8 _byte
+)
+{
+	Pending pending = { Notification( _type ), m_channelFree };
+	pending.m_notification.SetHomeAndNodeIds( m_homeId, _nodeId );
+	pending.m_notification.SetByte( _byte );
+	m_pending.push_back( pending );
+	pthread_cond_signal( &m_wakeup );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::QueueValue>
+//-----------------------------------------------------------------------------
+void SimulatedMesh::QueueValue
+(
+	Notification::NotificationType _type,
+	SimValue const& _value
+)
+{
+	Pending pending = { Notification( _type ), m_channelFree };
+	pending.m_notification.SetValueId( _value.m_id );
+	m_pending.push_back( pending );
+	pthread_cond_signal( &m_wakeup );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::QueueInterview>
+// The end of a node interview: its names become known
+//-----------------------------------------------------------------------------
+void SimulatedMesh::QueueInterview
+(
+	SimNode* _node
+)
+{
+	UseAirtime( monotonicMicros(), 4 );
+	m_stats.s_writeCnt += 2;
+	m_stats.s_ACKCnt += 2;
+	m_stats.s_readCnt += 2;
+	m_stats.s_SOFCnt += 2;
+
+	_node->m_interviewed = true;
+	QueueNotification( Notification::Type_NodeNaming, _node->m_nodeId );
+	QueueNotification( Notification::Type_EssentialNodeQueriesComplete, _node->m_nodeId );
+	QueueNotification( Notification::Type_NodeQueriesComplete, _node->m_nodeId );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::ChangeValue>
+// Random walk of a sensor reading within its range
+//-----------------------------------------------------------------------------
+void SimulatedMesh::ChangeValue
+(
+	SimValue* _value
+)
+{
+	if( _value->m_step == 0 )
+	{
+		return;
+	}
+
+	float change;
+	if( _value->m_step < 0 )
+	{
+		std::uniform_real_distribution<float> delta( 0, -_value->m_step );
+		change = delta( m_random );
+		// Battery levels drain, meters count up
+		if( _value->m_id.GetCommandClassId() == COMMAND_CLASS_BATTERY )
+		{
+			change = -change;
+		}
+	}
+	else
+	{
+		std::uniform_real_distribution<float> delta( -_value->m_step, _value->m_step );
+		change = delta( m_random );
+	}
+
+	float value = _value->m_value + change;
+	if( value < _value->m_min ) value = _value->m_min;
+	if( value > _value->m_max ) value = _value->m_max;
+	_value->m_value = value;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::QueueReport>
+// One unsolicited report from a node, like the real devices send them
+//-----------------------------------------------------------------------------
+void SimulatedMesh::QueueReport
+(
+	SimNode* _node
+)
+{
+	if( m_pending.size() >= SIM_MAX_PENDING )
+	{
+		// The channel cannot keep up; the report is lost
+		m_stats.s_dropped++;
+		return;
+	}
+
+	uint64 now = monotonicMicros();
+	std::uniform_real_distribution<float> pick( 0, 1 );
+	float choice = pick( m_random );
+	SimValue* value = NULL;
+
+	m_stats.s_readCnt++;
+	m_stats.s_SOFCnt++;
+
+	switch( _node->m_kind )
+	{
+		case NodeKind_Hsm100:
+		{
+			if( choice < 0.5f )
+			{
+				// Motion: a basic set to the controller, on and then off
+				SimValue* basic = FindValue( _node, COMMAND_CLASS_BASIC, 1, 0 );
+				basic->m_value = ( basic->m_value != 0 ) ? 0 : 255;
+				UseAirtime( now, 1 );
+				QueueNotification( Notification::Type_NodeEvent, _node->m_nodeId, (uint8) basic->m_value );
+				return;
+			}
+			if( choice < 0.95f )
+			{
+				// General, luminance and temperature are instances 1 to 3
+				uint8 instance = (uint8)( 1 + m_random() % 3 );
+				for( vector<SimValue>::iterator it = _node->m_values.begin(); it != _node->m_values.end(); ++it )
+				{
+					if( it->m_id.GetCommandClassId() == COMMAND_CLASS_SENSOR_MULTILEVEL && it->m_id.GetInstance() == instance )
+					{
+						value = &(*it);
+						break;
+					}
+				}
+			}
+			else
+			{
+				value = FindValue( _node, COMMAND_CLASS_BATTERY, 1, 0 );
+			}
+			break;
+		}
+
+		case NodeKind_DoorWindow:
+		{
+			if( choice < 0.9f )
+			{
+				// Opened or closed: a basic set followed by a sensor binary report
+				SimValue* basic = FindValue( _node, COMMAND_CLASS_BASIC, 1, 0 );
+				basic->m_value = ( basic->m_value != 0 ) ? 0 : 255;
+				UseAirtime( now, 1 );
+				QueueNotification( Notification::Type_NodeEvent, _node->m_nodeId, (uint8) basic->m_value );
+
+				value = FindValue( _node, COMMAND_CLASS_SENSOR_BINARY, 1, 0 );
+				value->m_value = ( basic->m_value != 0 ) ? 1 : 0;
+				m_stats.s_readCnt++;
+				m_stats.s_SOFCnt++;
+				UseAirtime( now, 1 );
+				QueueValue( Notification::Type_ValueChanged, *value );
+				return;
+			}
+			value = FindValue( _node, COMMAND_CLASS_BATTERY, 1, 0 );
+			break;
+		}
+
+		case NodeKind_SmartSwitch:
+		{
+			if( choice < 0.45f )
+			{
+				value = FindValue( _node, COMMAND_CLASS_SENSOR_MULTILEVEL, 1, 4 );
+			}
+			else if( choice < 0.95f )
+			{
+				// Meter report: energy and the current power
+				SimValue* power = FindValue( _node, COMMAND_CLASS_METER, 1, 8 );
+				power->m_value = FindValue( _node, COMMAND_CLASS_SENSOR_MULTILEVEL, 1, 4 )->m_value;
+				value = FindValue( _node, COMMAND_CLASS_METER, 1, 0 );
+				ChangeValue( value );
+				UseAirtime( now, 1 );
+				QueueValue( Notification::Type_ValueChanged, *value );
+				QueueValue( Notification::Type_ValueChanged, *power );
+				return;
+			}
+			else
+			{
+				// Switched by hand
+				SimValue* basic = FindValue( _node, COMMAND_CLASS_BASIC, 1, 0 );
+				value = FindValue( _node, COMMAND_CLASS_SWITCH_BINARY, 1, 0 );
+				value->m_value = ( value->m_value != 0 ) ? 0 : 1;
+				basic->m_value = ( value->m_value != 0 ) ? 255 : 0;
+			}
+			break;
+		}
+
+		case NodeKind_Controller:
+		{
+			break;
+		}
+	}
+
+	if( value )
+	{
+		ChangeValue( value );
+		UseAirtime( now, 1 );
+		QueueValue( Notification::Type_ValueChanged, *value );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::QueuePoll>
+// Polls the next value due at the poll cursor. A value with intensity N is
+// polled on every Nth pass through the list; sleeping nodes never answer.
+//-----------------------------------------------------------------------------
+void SimulatedMesh::QueuePoll
+(
+)
+{
+	for( size_t tries = 0; tries < m_polled.size(); tries++ )
+	{
+		if( m_pollCursor >= m_polled.size() )
+		{
+			m_pollCursor = 0;
+			m_pollCycle++;
+		}
+		ValueID id = m_polled[m_pollCursor++];
+		SimValue* value = GetValue( id );
+		if( !value || !value->m_pollIntensity || ( m_pollCycle % value->m_pollIntensity ) != 0 )
+		{
+			continue;
+		}
+
+		PollValue( value );
+		return;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::PollValue>
+// Sends a get for the value; a listening node answers with a report
+//-----------------------------------------------------------------------------
+void SimulatedMesh::PollValue
+(
+	SimValue* _value
+)
+{
+	m_stats.s_writeCnt++;
+	m_stats.s_ACKCnt++;
+	if( !IsListening( _value->m_id.GetNodeId() ) )
+	{
+		m_stats.s_readAborts++;
+		UseAirtime( monotonicMicros(), 1 );
+		return;
+	}
+
+	m_stats.s_readCnt++;
+	m_stats.s_SOFCnt++;
+	ChangeValue( _value );
+	UseAirtime( monotonicMicros(), 2 );
+	QueueValue( Notification::Type_ValueChanged, *_value );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::GetDriverStatistics>
+//-----------------------------------------------------------------------------
+void SimulatedMesh::GetDriverStatistics
+(
+	Driver::DriverData* _data
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	*_data = m_stats;
+	pthread_mutex_unlock( &m_mutex );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::SetPollInterval>
+//-----------------------------------------------------------------------------
+void SimulatedMesh::SetPollInterval
+(
+	int32 _milliseconds,
+	bool _bIntervalBetweenPolls
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	m_pollInterval = _milliseconds;
+	m_intervalBetweenPolls = _bIntervalBetweenPolls;
+	pthread_cond_signal( &m_wakeup );
+	pthread_mutex_unlock( &m_mutex );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::IsListening>
+// Only the controller and the mains powered switches listen; the battery
+// powered sensors sleep between wake-ups
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::IsListening
+(
+	uint8 _nodeId
+)
+{
+	SimNode* node = GetNode( _nodeId );
+	return node && ( node->m_kind == NodeKind_Controller || node->m_kind == NodeKind_SmartSwitch );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::GetNodeType>
+//-----------------------------------------------------------------------------
+string SimulatedMesh::GetNodeType
+(
+	uint8 _nodeId
+)
+{
+	SimNode* node = GetNode( _nodeId );
+	if( !node )
+	{
+		return "";
+	}
+	switch( node->m_kind )
+	{
+		case NodeKind_Controller:	return "Static PC Controller";
+		case NodeKind_Hsm100:		return "Routing Multilevel Sensor";
+		case NodeKind_DoorWindow:	return "Routing Binary Sensor";
+		case NodeKind_SmartSwitch:	return "Binary Power Switch";
+	}
+	return "";
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::GetManufacturerName>
+//-----------------------------------------------------------------------------
+string SimulatedMesh::GetManufacturerName
+(
+	uint8 _nodeId
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	SimNode* node = GetNode( _nodeId );
+	string name;
+	if( node && node->m_named )
+	{
+		name = ( node->m_kind == NodeKind_Hsm100 ) ? "Homeseer" : "Aeon Labs";
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return name;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::GetProductName>
+//-----------------------------------------------------------------------------
+string SimulatedMesh::GetProductName
+(
+	uint8 _nodeId
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	SimNode* node = GetNode( _nodeId );
+	string name;
+	if( node && node->m_named )
+	{
+		switch( node->m_kind )
+		{
+			case NodeKind_Controller:	name = "Z-Stick S2"; break;
+			case NodeKind_Hsm100:		name = "HSM100 Wireless Multi-Sensor"; break;
+			case NodeKind_DoorWindow:	name = "Door/Window Sensor"; break;
+			case NodeKind_SmartSwitch:	name = "Smart Energy Switch"; break;
+		}
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return name;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::GetBool>
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::GetBool
+(
+	ValueID const& _id,
+	bool* o_value
+)
+{
+	if( _id.GetType() != ValueID::ValueType_Bool )
+	{
+		return false;
+	}
+	pthread_mutex_lock( &m_mutex );
+	SimValue* value = GetValue( _id );
+	if( value )
+	{
+		*o_value = ( value->m_value != 0 );
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return value != NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::GetByte>
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::GetByte
+(
+	ValueID const& _id,
+	uint8* o_value
+)
+{
+	if( _id.GetType() != ValueID::ValueType_Byte )
+	{
+		return false;
+	}
+	pthread_mutex_lock( &m_mutex );
+	SimValue* value = GetValue( _id );
+	if( value )
+	{
+		*o_value = (uint8) value->m_value;
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return value != NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::GetFloat>
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::GetFloat
+(
+	ValueID const& _id,
+	float* o_value
+)
+{
+	if( _id.GetType() != ValueID::ValueType_Decimal )
+	{
+		return false;
+	}
+	pthread_mutex_lock( &m_mutex );
+	SimValue* value = GetValue( _id );
+	if( value )
+	{
+		*o_value = value->m_value;
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return value != NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::GetInt>
+// Int, Short and List values (the list selection is its item value)
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::GetInt
+(
+	ValueID const& _id,
+	int32* o_value
+)
+{
+	if( _id.GetType() != ValueID::ValueType_Int && _id.GetType() != ValueID::ValueType_Short
+		&& _id.GetType() != ValueID::ValueType_List )
+	{
+		return false;
+	}
+	pthread_mutex_lock( &m_mutex );
+	SimValue* value = GetValue( _id );
+	if( value )
+	{
+		*o_value = (int32) value->m_value;
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return value != NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::GetString>
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::GetString
+(
+	ValueID const& _id,
+	string* o_value
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	SimValue* value = GetValue( _id );
+	if( value )
+	{
+		char buf[32];
+		if( _id.GetType() == ValueID::ValueType_Decimal )
+		{
+			snprintf( buf, sizeof(buf), "%.3f", value->m_value );
+		}
+		else if( _id.GetType() == ValueID::ValueType_Bool )
+		{
+			snprintf( buf, sizeof(buf), "%s", ( value->m_value != 0 ) ? "True" : "False" );
+		}
+		else
+		{
+			snprintf( buf, sizeof(buf), "%d", (int32) value->m_value );
+		}
+		*o_value = buf;
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return value != NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::SetValue>
+// Sets a value on the node, which confirms it with a report
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::SetValue
+(
+	ValueID const& _id,
+	int32 _value
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	SimValue* value = GetValue( _id );
+	if( value )
+	{
+		value->m_value = (float) _value;
+		m_stats.s_writeCnt++;
+		m_stats.s_ACKCnt++;
+		m_stats.s_readCnt++;
+		m_stats.s_SOFCnt++;
+		UseAirtime( monotonicMicros(), 2 );
+		QueueValue( Notification::Type_ValueChanged, *value );
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return value != NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::RefreshValue>
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::RefreshValue
+(
+	ValueID const& _id
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	SimValue* value = GetValue( _id );
+	if( value )
+	{
+		PollValue( value );
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return value != NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::SetConfigParam>
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::SetConfigParam
+(
+	uint8 _nodeId,
+	uint8 _param,
+	int32 _value
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	SimNode* node = GetNode( _nodeId );
+	if( node )
+	{
+		if( SimValue* value = FindValue( node, COMMAND_CLASS_CONFIGURATION, 1, _param ) )
+		{
+			value->m_value = (float) _value;
+		}
+		m_stats.s_writeCnt++;
+		m_stats.s_ACKCnt++;
+		UseAirtime( monotonicMicros(), 1 );
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return node != NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::RequestConfigParam>
+//-----------------------------------------------------------------------------
+void SimulatedMesh::RequestConfigParam
+(
+	uint8 _nodeId,
+	uint8 _param
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	if( SimNode* node = GetNode( _nodeId ) )
+	{
+		m_stats.s_writeCnt++;
+		m_stats.s_ACKCnt++;
+		SimValue* value = FindValue( node, COMMAND_CLASS_CONFIGURATION, 1, _param );
+		if( value )
+		{
+			m_stats.s_readCnt++;
+			m_stats.s_SOFCnt++;
+		}
+		UseAirtime( monotonicMicros(), value ? 2 : 1 );
+		if( value )
+		{
+			QueueValue( Notification::Type_ValueChanged, *value );
+		}
+	}
+	pthread_mutex_unlock( &m_mutex );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::RequestNodeDynamic>
+// Re-reads the node's user values (sensor readings, meters, battery)
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::RequestNodeDynamic
+(
+	uint8 _nodeId
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	SimNode* node = GetNode( _nodeId );
+	if( node )
+	{
+		uint64 now = monotonicMicros();
+		for( vector<SimValue>::iterator it = node->m_values.begin(); it != node->m_values.end(); ++it )
+		{
+			if( it->m_id.GetGenre() != ValueID::ValueGenre_User )
+			{
+				continue;
+			}
+			m_stats.s_writeCnt++;
+			m_stats.s_ACKCnt++;
+			m_stats.s_readCnt++;
+			m_stats.s_SOFCnt++;
+			ChangeValue( &(*it) );
+			UseAirtime( now, 2 );
+			QueueValue( Notification::Type_ValueChanged, *it );
+		}
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return node != NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::RefreshNodeInfo>
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::RefreshNodeInfo
+(
+	uint8 _nodeId
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	SimNode* node = GetNode( _nodeId );
+	if( node )
+	{
+		QueueNotification( Notification::Type_NodeProtocolInfo, _nodeId );
+		QueueInterview( node );
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return node != NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::AddAssociation>
+//-----------------------------------------------------------------------------
+void SimulatedMesh::AddAssociation
+(
+	uint8 _nodeId
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	if( GetNode( _nodeId ) )
+	{
+		m_stats.s_writeCnt++;
+		m_stats.s_ACKCnt++;
+		UseAirtime( monotonicMicros(), 1 );
+	}
+	pthread_mutex_unlock( &m_mutex );
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::EnablePoll>
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::EnablePoll
+(
+	ValueID const& _id,
+	uint8 _intensity
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	SimValue* value = GetValue( _id );
+	if( value )
+	{
+		if( !value->m_pollIntensity )
+		{
+			m_polled.push_back( _id );
+			QueueNotification( Notification::Type_PollingEnabled, _id.GetNodeId() );
+		}
+		value->m_pollIntensity = _intensity ? _intensity : 1;
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return value != NULL;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::DisablePoll>
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::DisablePoll
+(
+	ValueID const& _id
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	SimValue* value = GetValue( _id );
+	bool polled = value && value->m_pollIntensity;
+	if( polled )
+	{
+		value->m_pollIntensity = 0;
+		for( vector<ValueID>::iterator it = m_polled.begin(); it != m_polled.end(); ++it )
+		{
+			if( *it == _id )
+			{
+				m_polled.erase( it );
+				break;
+			}
+		}
+		QueueNotification( Notification::Type_PollingDisabled, _id.GetNodeId() );
+	}
+	pthread_mutex_unlock( &m_mutex );
+	return polled;
+}
+
+//-----------------------------------------------------------------------------
+// <SimulatedMesh::IsPolled>
+//-----------------------------------------------------------------------------
+bool SimulatedMesh::IsPolled
+(
+	ValueID const& _id
+)
+{
+	pthread_mutex_lock( &m_mutex );
+	SimValue* value = GetValue( _id );
+	bool polled = value && value->m_pollIntensity;
+	pthread_mutex_unlock( &m_mutex );
+	return polled;
+}
@@ -0,0 +1,180 @@
+//-----------------------------------------------------------------------------
+//
+//	SimulatedMesh.h
+//
+//	Simulated Z-Wave network behind the OpenZWave stand-in in this
+//	directory. Building LabSenseZwave with "make SIM=1" links Main.cpp
+//	against these sources instead of the OpenZWave tree, so the daemon can
+//	be built, load-tested and profiled on any Linux machine without a
+//	Z-Stick.
+//
+//	The mesh has a Z-Stick S2 controller (node 1) and HSM100 multi-sensors,
+//	Aeon Labs Door/Window sensors and Smart Energy Switches with the same
+//	command classes and values as in zwcfg_0x014d08e6.xml. A thread plays
+//	the driver: it reports the nodes and their values as OpenZWave does at
+//	startup (sleeping nodes finish their interview after
+//	AwakeNodesQueried), then each node sends random reports as a Poisson
+//	process at its configured rate. Every frame occupies the single radio
+//	channel for a fixed airtime, so a high event rate or heavy polling
+//	delays reports just as on the real network.
+//
+//	The mesh is described by the controller path given to AddDriver():
+//
+//		sim:hsm100=5@0.5,door=2@0.1,switch=1@1,seed=7,airtime=4000
+//
+//	<type>=<count>[@<events per second per node>] adds nodes (numbered from
+//	2 in order), "seed" fixes the random sequence and "airtime" sets the
+//	microseconds one frame occupies the channel. Any other path simulates
+//	the deployed network (node ids as in zwcfg_0x014d08e6.xml).
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _SimulatedMesh_H
+#define _SimulatedMesh_H
+
+#include <pthread.h>
+#include <deque>
+#include <random>
+#include "Defs.h"
+#include "Driver.h"
+#include "ValueID.h"
+#include "Notification.h"
+
+namespace OpenZWave
+{
+	class Manager;
+
+	class SimulatedMesh
+	{
+	public:
+		enum NodeKind
+		{
+			NodeKind_Controller,
+			NodeKind_Hsm100,
+			NodeKind_DoorWindow,
+			NodeKind_SmartSwitch
+		};
+
+		SimulatedMesh( Manager* _manager, string const& _controllerPath );
+		~SimulatedMesh();
+
+		// Starts and stops the driver thread
+		bool Start();
+		void Stop();
+
+		uint32 GetHomeId()const{ return m_homeId; }
+		void GetDriverStatistics( Driver::DriverData* _data );
+		void SetPollInterval( int32 _milliseconds, bool _bIntervalBetweenPolls );
+
+		// Node information. The names are empty until the node has been named.
+		bool IsListening( uint8 _nodeId );
+		string GetNodeType( uint8 _nodeId );
+		string GetManufacturerName( uint8 _nodeId );
+		string GetProductName( uint8 _nodeId );
+
+		// Value access. Get* fail for unknown ids or a different value type.
+		bool GetBool( ValueID const& _id, bool* o_value );
+		bool GetByte( ValueID const& _id, uint8* o_value );
+		bool GetFloat( ValueID const& _id, float* o_value );
+		bool GetInt( ValueID const& _id, int32* o_value );
+		bool GetString( ValueID const& _id, string* o_value );
+		bool SetValue( ValueID const& _id, int32 _value );
+		bool RefreshValue( ValueID const& _id );
+
+		// Requests sent to nodes. Each costs airtime and may queue reports.
+		bool SetConfigParam( uint8 _nodeId, uint8 _param, int32 _value );
+		void RequestConfigParam( uint8 _nodeId, uint8 _param );
+		bool RequestNodeDynamic( uint8 _nodeId );
+		bool RefreshNodeInfo( uint8 _nodeId );
+		void AddAssociation( uint8 _nodeId );
+
+		bool EnablePoll( ValueID const& _id, uint8 _intensity );
+		bool DisablePoll( ValueID const& _id );
+		bool IsPolled( ValueID const& _id );
+
+	private:
+		struct SimValue
+		{
+			ValueID		m_id;
+			float		m_value;		// Every type is held as a float
+			float		m_min;
+			float		m_max;
+			float		m_step;			// Largest random change per report (0 = constant,
+										// negative = counter increasing by up to -m_step)
+			uint8		m_pollIntensity;// 0 = not polled
+		};
+
+		struct SimNode
+		{
+			uint8				m_nodeId;
+			NodeKind			m_kind;
+			double				m_rate;			// Spontaneous reports per second
+			bool				m_interviewed;	// Sleeping nodes finish their interview at the first wake-up
+			bool				m_named;		// Names are known once NodeNaming has been sent
+			uint64				m_nextEvent;	// Microseconds (monotonic)
+			vector<SimValue>	m_values;
+		};
+
+		static void* ThreadEntry( void* _context );
+		void Run();
+
+		bool ParsePath( string const& _controllerPath );
+		void AddNode( uint8 _nodeId, NodeKind _kind, double _rate );
+		void AddValue( SimNode* _node, ValueID::ValueGenre _genre, uint8 _commandClassId, uint8 _instance,
+			uint8 _index, ValueID::ValueType _type, float _value, float _min, float _max, float _step );
+		SimNode* GetNode( uint8 _nodeId );
+		SimValue* GetValue( ValueID const& _id );
+		SimValue* FindValue( SimNode* _node, uint8 _commandClassId, uint8 _instance, uint8 _index );
+
+		// Helpers used with m_mutex held
+		void QueueNotification( Notification::NotificationType _type, uint8 _nodeId, uint8 _byte = 0 );
+		void QueueValue( Notification::NotificationType _type, SimValue const& _value );
+		void QueueInterview( SimNode* _node );
+		void QueueReport( SimNode* _node );
+		void QueuePoll();
+		void PollValue( SimValue* _value );
+		void ChangeValue( SimValue* _value );
+		uint64 NextInterval( double _rate );
+		uint64 UseAirtime( uint64 _now, uint32 _frames );
+
+		Manager*			m_manager;
+		uint32				m_homeId;
+		uint32				m_airtime;				// Microseconds per frame
+		uint32				m_seed;
+		bool				m_valid;				// False if the controller path could not be parsed
+
+		SimNode*			m_nodeTable[256];		// Indexed by node id
+		list<SimNode>		m_nodes;
+
+		pthread_t			m_thread;
+		pthread_mutex_t		m_mutex;				// Guards everything below; never held while notifying
+		pthread_cond_t		m_wakeup;				// Signalled when a notification is queued or on Stop()
+		bool				m_running;
+		bool				m_stopping;
+
+		// Notifications waiting to be delivered, each with the earliest time
+		// it may go out (the end of its frame on the channel)
+		struct Pending
+		{
+			Notification	m_notification;
+			uint64			m_due;
+		};
+		deque<Pending>		m_pending;
+
+		uint64				m_channelFree;			// End of the last frame on the channel
+		uint64				m_channelBusy;			// Total airtime used
+		int32				m_pollInterval;			// Milliseconds
+		bool				m_intervalBetweenPolls;
+		vector<ValueID>		m_polled;				// Values with polling enabled, in poll order
+		size_t				m_pollCursor;
+		uint32				m_pollCycle;			// Passes through m_polled so far
+		uint64				m_nextPoll;
+
+		uint32				m_uninterviewed;		// Sleeping nodes yet to wake up for the first time
+
+		Driver::DriverData	m_stats;
+		std::mt19937		m_random;
+	};
+}
+
+#endif // _SimulatedMesh_H
@@ -0,0 +1,15 @@
+//-----------------------------------------------------------------------------
+//
+//	Value.h
+//
+//	Simulated OpenZWave stand-in. Nothing from OpenZWave's Value.h is used
+//	by LabSenseZwave; the header only exists so Main.cpp builds unchanged.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _Value_H
+#define _Value_H
+
+#include "Defs.h"
+
+#endif // _Value_H
@@ -0,0 +1,15 @@
+//-----------------------------------------------------------------------------
+//
+//	ValueBool.h
+//
+//	Simulated OpenZWave stand-in. Nothing from OpenZWave's ValueBool.h is used
+//	by LabSenseZwave; the header only exists so Main.cpp builds unchanged.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _ValueBool_H
+#define _ValueBool_H
+
+#include "Defs.h"
+
+#endif // _ValueBool_H
@@ -0,0 +1,97 @@
+//-----------------------------------------------------------------------------
+//
+//	ValueID.h
+//
+//	Simulated OpenZWave stand-in. Same packing of the node id, genre,
+//	command class, instance, index and type into a 64 bit id as OpenZWave,
+//	so ids recorded with the real library (NotificationLog) replay unchanged.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _ValueID_H
+#define _ValueID_H
+
+#include "Defs.h"
+
+namespace OpenZWave
+{
+	class ValueID
+	{
+	public:
+		enum ValueGenre
+		{
+			ValueGenre_Basic = 0,
+			ValueGenre_User,
+			ValueGenre_Config,
+			ValueGenre_System,
+			ValueGenre_Count
+		};
+
+		enum ValueType
+		{
+			ValueType_Bool = 0,
+			ValueType_Byte,
+			ValueType_Decimal,
+			ValueType_Int,
+			ValueType_List,
+			ValueType_Schedule,
+			ValueType_Short,
+			ValueType_String,
+			ValueType_Button,
+			ValueType_Raw,
+			ValueType_Max = ValueType_Raw
+		};
+
+		ValueID(): m_id( 0 ), m_id1( 0 ), m_homeId( 0 ) {}
+
+		ValueID( uint32 const _homeId, uint64 const _id ):
+			m_homeId( _homeId )
+		{
+			m_id = (uint32)( _id & 0xffffffff );
+			m_id1 = (uint32)( _id >> 32 );
+		}
+
+		ValueID( uint32 const _homeId, uint8 const _nodeId, ValueGenre const _genre, uint8 const _commandClassId,
+			uint8 const _instance, uint8 const _valueIndex, ValueType const _type ):
+			m_homeId( _homeId )
+		{
+			m_id = (((uint32)_nodeId)<<24)
+				 | (((uint32)_genre)<<22)
+				 | (((uint32)_commandClassId)<<14)
+				 | (((uint32)_valueIndex)<<4)
+				 | ((uint32)_type);
+			m_id1 = ((uint32)_instance)<<24;
+		}
+
+		uint32 GetHomeId()const{ return m_homeId; }
+		uint8 GetNodeId()const{ return( (uint8)( (m_id & 0xff000000) >> 24 ) ); }
+		ValueGenre GetGenre()const{ return( (ValueGenre)( (m_id & 0x00c00000) >> 22 ) ); }
+		uint8 GetCommandClassId()const{ return( (uint8)( (m_id & 0x003fc000) >> 14 ) ); }
+		uint8 GetInstance()const{ return( (uint8)( (m_id1 & 0xff000000) >> 24 ) ); }
+		uint8 GetIndex()const{ return( (uint8)( (m_id & 0x00000ff0) >> 4 ) ); }
+		ValueType GetType()const{ return( (ValueType)( m_id & 0x0000000f ) ); }
+		uint64 GetId()const{ return (uint64) ( ( (uint64)m_id1 << 32 ) | m_id ); }
+
+		bool operator == ( ValueID const& _other )const{ return( ( m_homeId == _other.m_homeId ) && ( m_id == _other.m_id ) && ( m_id1 == _other.m_id1 ) ); }
+		bool operator != ( ValueID const& _other )const{ return( ( m_homeId != _other.m_homeId ) || ( m_id != _other.m_id ) || ( m_id1 != _other.m_id1 ) ); }
+		bool operator < ( ValueID const& _other )const
+		{
+			if( m_homeId == _other.m_homeId )
+			{
+				if( m_id == _other.m_id )
+				{
+					return( m_id1 < _other.m_id1 );
+				}
+				return( m_id < _other.m_id );
+			}
+			return( m_homeId < _other.m_homeId );
+		}
+
+	private:
+		uint32	m_id;
+		uint32	m_id1;
+		uint32	m_homeId;
+	};
+}
+
+#endif // _ValueID_H
@@ -0,0 +1,15 @@
+//-----------------------------------------------------------------------------
+//
+//	ValueStore.h
+//
+//	Simulated OpenZWave stand-in. Nothing from OpenZWave's ValueStore.h is used
+//	by LabSenseZwave; the header only exists so Main.cpp builds unchanged.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef _ValueStore_H
+#define _ValueStore_H
+
+#include "Defs.h"
+
+#endif // _ValueStore_H